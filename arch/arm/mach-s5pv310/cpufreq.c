@@ -34,6 +34,8 @@
 #include <linux/ktime.h>
 #include <linux/tick.h>
 #include <linux/kernel_stat.h>
+#include <linux/workqueue.h>
+#include <linux/pm_qos_params.h>
 
 #include <plat/pm.h>
 #include <plat/s5pv310.h>
@@ -44,6 +46,9 @@
 #include <mach/regs-clock.h>
 #include <mach/pm-core.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/s5pv310_dvfs.h>
+
 #define CPUFREQ_SAMPLING_RATE      40000
 
 static struct clk *arm_clk;
@@ -78,6 +83,11 @@ static struct freq_lock_info busfreq_lock = {
 	.min_level	= (BUSFREQ_LEVEL_END - 1),
 };
 
+static struct freq_lock_info busfreq_upper_lock = {
+	.level		= BUS_L0,
+	.max_level	= BUS_L0,
+};
+
 /*********************************************************************
  *                     CPUFREQ DEFINITIONS                           *
  *********************************************************************/
@@ -90,6 +100,45 @@ static struct s5pv310_cpufreq_table cpufreq_table[CPUFREQ_LEVEL_END];
 static struct cpufreq_frequency_table cpufreq_freq_table[CPUFREQ_LEVEL_END + 1];
 static struct cpufreq_freqs freqs;
 
+/*
+ * Governor fast switch. s5pv310_fast_switch() changes the level from
+ * atomic context, but only while no slow-path change is running and
+ * only to a level that the VDD_ARM voltage already set is enough for.
+ * It does not notify: the transition is reported, and a voltage left
+ * higher than the new level needs is brought down, by cpufreq_fast_work
+ * or by the next slow-path change, whichever comes first.
+ */
+#define CPUFREQ_FAST_SETTLE_MS	20
+
+static DEFINE_SPINLOCK(cpufreq_fast_lock);
+static bool cpufreq_fast_blocked;	/* a slow-path change is running */
+static unsigned int arm_volt_now;	/* uV on VDD_ARM, 0 if unknown */
+static unsigned int fast_notify_old;	/* kHz last notified, 0 if none due */
+static unsigned int fast_notify_cpu;
+
+static void cpufreq_fast_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(cpufreq_fast_work, cpufreq_fast_work_fn);
+
+/* Cost of the level changes from one level to another */
+struct dvfs_trans_stat {
+	unsigned int count;
+	unsigned int max_us;
+	u64 total_us;
+};
+
+/* under cpufreq_change_lock() or cpufreq_fast_lock */
+static struct dvfs_trans_stat
+	cpufreq_trans_stat[CPUFREQ_LEVEL_END][CPUFREQ_LEVEL_END];
+static unsigned int apll_lock_us;	/* set by s5pv310_set_apll() */
+
+static void dvfs_trans_account(struct dvfs_trans_stat *stat, unsigned int us)
+{
+	stat->count++;
+	stat->total_us += us;
+	if (us > stat->max_us)
+		stat->max_us = us;
+}
+
 /*
  * available_cpufreq_table[] is composed of cpufreq level index
  * Select one of the tables by reading chip ID and make cpufreq_table
@@ -262,6 +311,23 @@ static unsigned int freq_trans_table[][CPUFREQ_LEVEL_END] = {
 #define CPU_PMU_L0_THRESHOLD	10
 #define CPU_PMU_L1_THRESHOLD	5
 
+/*
+ * The bus governor samples the PPMU counters on its own period, so the
+ * bus follows memory load (MFC, FIMC, ...) even while the CPU frequency
+ * is stable. Raising is immediate; lowering takes down_hold samples in
+ * a row asking for a lower level and then goes one level at a time.
+ */
+#define BUSFREQ_SAMPLING_MS_DEFAULT	50
+#define BUSFREQ_SAMPLING_MS_MIN		10
+#define BUSFREQ_SAMPLING_MS_MAX		1000
+#define BUSFREQ_DOWN_HOLD_DEFAULT	3
+
+static unsigned int busfreq_sampling_ms = BUSFREQ_SAMPLING_MS_DEFAULT;
+static unsigned int busfreq_down_hold = BUSFREQ_DOWN_HOLD_DEFAULT;
+static unsigned int busfreq_down_count;
+static struct delayed_work busfreq_work;
+static struct workqueue_struct *busfreq_wq;
+
 static unsigned int up_threshold;
 static struct s5pv310_dmc_ppmu_hw dmc[2];
 static struct s5pv310_cpu_ppmu_hw cpu;
@@ -276,13 +342,38 @@ static void busfreq_target(void);
 static DEFINE_MUTEX(set_bus_freq_change);
 static DEFINE_MUTEX(set_bus_freq_lock);
 
+static unsigned int cur_busfreq_index;
+
+static struct dvfs_trans_stat
+	busfreq_trans_stat[BUSFREQ_LEVEL_END][BUSFREQ_LEVEL_END];
+
 #ifdef SYSFS_DEBUG_BUSFREQ
 static unsigned int time_in_state[BUSFREQ_LEVEL_END];
+static unsigned int trans_count[BUSFREQ_LEVEL_END];
 static unsigned long pre_jiffies;
 static unsigned long cur_jiffies;
-#endif
 
-static unsigned int cur_busfreq_index;
+/*
+ * Account the time spent at cur_busfreq_index since the last call.
+ * Called before every level change and when the stats are read, with
+ * set_bus_freq_change held.
+ */
+static void update_busfreq_stat(void)
+{
+	unsigned long level_state_jiffies;
+
+	cur_jiffies = jiffies;
+	if (pre_jiffies != 0)
+		level_state_jiffies = cur_jiffies - pre_jiffies;
+	else
+		level_state_jiffies = 0;
+
+	pre_jiffies = cur_jiffies;
+
+	if (cur_busfreq_index < BUSFREQ_LEVEL_END)
+		time_in_state[cur_busfreq_index] += level_state_jiffies;
+}
+#endif
 
 struct busfreq_table {
 	unsigned int index;
@@ -420,18 +511,92 @@ unsigned int s5pv310_getspeed(unsigned int cpu)
 	return rate;
 }
 
+/* Report a level change made by s5pv310_fast_switch(), if any */
+static void cpufreq_fast_notify(void)
+{
+	struct cpufreq_freqs f;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cpufreq_fast_lock, flags);
+	f.old = fast_notify_old;
+	f.cpu = fast_notify_cpu;
+	fast_notify_old = 0;
+	spin_unlock_irqrestore(&cpufreq_fast_lock, flags);
+
+	if (!f.old)
+		return;
+
+	f.new = s5pv310_getspeed(f.cpu);
+	f.flags = 0;
+	if (f.new == f.old)
+		return;
+
+	cpufreq_notify_transition(&f, CPUFREQ_PRECHANGE);
+	cpufreq_notify_transition(&f, CPUFREQ_POSTCHANGE);
+}
+
+/*
+ * Every change made outside s5pv310_fast_switch() goes between these:
+ * they hold set_cpu_freq_change and keep the fast path out.
+ */
+static void cpufreq_change_lock(void)
+{
+	unsigned long flags;
+
+	mutex_lock(&set_cpu_freq_change);
+	spin_lock_irqsave(&cpufreq_fast_lock, flags);
+	cpufreq_fast_blocked = true;
+	spin_unlock_irqrestore(&cpufreq_fast_lock, flags);
+
+	cpufreq_fast_notify();
+}
+
+static void cpufreq_change_unlock(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&cpufreq_fast_lock, flags);
+	cpufreq_fast_blocked = false;
+	spin_unlock_irqrestore(&cpufreq_fast_lock, flags);
+	mutex_unlock(&set_cpu_freq_change);
+}
+
+#if defined(CONFIG_REGULATOR)
+/* Under cpufreq_change_lock(), or before the driver is registered */
+static int s5pv310_set_arm_volt(unsigned int volt)
+{
+	int ret;
+
+	ret = regulator_set_voltage(arm_regulator, volt, volt);
+	arm_volt_now = ret ? 0 : volt;
+
+	return ret;
+}
+#endif
+
 void s5pv310_set_busfreq(unsigned int index)
 {
 	unsigned int tmp, val, volt;
+	unsigned int volt_us = 0, total_us;
+	ktime_t start, t;
 
 	if (cur_busfreq_index == index)
 		return;
 
+#ifdef SYSFS_DEBUG_BUSFREQ
+	update_busfreq_stat();
+	trans_count[index]++;
+#endif
+
+	start = ktime_get();
+
 #if defined(CONFIG_REGULATOR)
 	volt = s5pv310_busfreq_table[index].volt;
 
-	if (cur_busfreq_index > index)
+	if (cur_busfreq_index > index) {
 		regulator_set_voltage(int_regulator, volt, volt);
+		volt_us = ktime_us_delta(ktime_get(), start);
+	}
 #endif
 
 	/* Change Divider - DMC0 */
@@ -546,10 +711,19 @@ void s5pv310_set_busfreq(unsigned int index)
 	} while (tmp & 0x1111);
 
 #if defined(CONFIG_REGULATOR)
-	if (cur_busfreq_index < index)
+	if (cur_busfreq_index < index) {
+		t = ktime_get();
 		regulator_set_voltage(int_regulator, volt, volt);
+		volt_us += ktime_us_delta(ktime_get(), t);
+	}
 #endif
 
+	total_us = ktime_us_delta(ktime_get(), start);
+	dvfs_trans_account(&busfreq_trans_stat[cur_busfreq_index][index],
+			   total_us);
+	trace_s5pv310_busfreq_transition(cur_busfreq_index, index, volt_us,
+					 total_us - volt_us, total_us);
+
 	cur_busfreq_index = index;
 }
 
@@ -581,6 +755,7 @@ void s5pv310_set_apll(unsigned int index)
 {
 	unsigned int tmp;
 	unsigned int save_val;
+	ktime_t lock_start;
 
 	/* 1. MUX_CORE_SEL = MPLL,
 	 * Reduce the CLKDIVCPU value for using MPLL */
@@ -603,6 +778,7 @@ void s5pv310_set_apll(unsigned int index)
 	} while (tmp != 0x2);
 
 	/* 2. Set APLL Lock time */
+	lock_start = ktime_get();
 	__raw_writel(S5P_APLL_LOCKTIME, S5P_APLL_LOCK);
 
 	/* 3. Change PLL PMS values */
@@ -615,6 +791,7 @@ void s5pv310_set_apll(unsigned int index)
 	do {
 		tmp = __raw_readl(S5P_APLL_CON0);
 	} while (!(tmp & (0x1 << S5P_APLLCON0_LOCKED_SHIFT)));
+	apll_lock_us = ktime_us_delta(ktime_get(), lock_start);
 
 	/* 5. MUX_CORE_SEL = APLL */
 	clk_set_parent(moutcore, mout_apll);
@@ -692,6 +869,8 @@ void s5pv310_set_cpufreq_armvolt(unsigned int old_index, unsigned int index)
 {
 	unsigned int pre_volt = 0, post_volt = 0;
 	unsigned int freq_trans_val, volt_change = 0;
+	unsigned int volt_us = 0, total_us;
+	ktime_t start, t;
 
 	freq_trans_val = cpufreq_table[old_index].freq_trans[index];
 
@@ -715,23 +894,37 @@ void s5pv310_set_cpufreq_armvolt(unsigned int old_index, unsigned int index)
 
 	cpufreq_notify_transition(&freqs, CPUFREQ_PRECHANGE);
 
+	start = ktime_get();
+
 	/* When the new frequency is higher than current frequency
 	 * and freqency is changed btn 500MHz to 200MHz
 	 */
 #if defined(CONFIG_REGULATOR)
-	if (volt_change & VOLT_PRECHANGE)
-		regulator_set_voltage(arm_regulator, pre_volt, pre_volt);
+	if (volt_change & VOLT_PRECHANGE) {
+		s5pv310_set_arm_volt(pre_volt);
+		volt_us = ktime_us_delta(ktime_get(), start);
+	}
 #endif
+	apll_lock_us = 0;
 	s5pv310_set_frequency(old_index, index);
 
 	/* When the new frequency is lower than current frequency
 	 * and freqency is increased from 200MHz to 500MHz
 	*/
 #if defined(CONFIG_REGULATOR)
-	if (volt_change & VOLT_POSTCHANGE)
-		regulator_set_voltage(arm_regulator, post_volt, post_volt);
+	if (volt_change & VOLT_POSTCHANGE) {
+		t = ktime_get();
+		s5pv310_set_arm_volt(post_volt);
+		volt_us += ktime_us_delta(ktime_get(), t);
+	}
 #endif
+	total_us = ktime_us_delta(ktime_get(), start);
+
 	cpufreq_notify_transition(&freqs, CPUFREQ_POSTCHANGE);
+
+	dvfs_trans_account(&cpufreq_trans_stat[old_index][index], total_us);
+	trace_s5pv310_cpufreq_transition(old_index, index, volt_us,
+					 apll_lock_us, total_us);
 }
 
 static int s5pv310_target(struct cpufreq_policy *policy,
@@ -741,7 +934,7 @@ static int s5pv310_target(struct cpufreq_policy *policy,
 	int ret = 0;
 	unsigned int index, old_index;
 
-	mutex_lock(&set_cpu_freq_change);
+	cpufreq_change_lock();
 #if defined(CONFIG_REGULATOR)
 	/* Do not set voltage during disable_further_cpufreq */
 	if (disable_further_cpufreq)
@@ -783,20 +976,138 @@ set_cpufreq:
 
 	/* If the new frequency is same with previous frequency, skip */
 	if (freqs.new == freqs.old)
-		goto bus_freq;
+		goto cpufreq_out;
 
 	s5pv310_set_cpufreq_armvolt(old_index, index);
 
-bus_freq:
-	mutex_unlock(&set_cpu_freq_change);
-	busfreq_target();
+	/* bus frequency is handled by busfreq_work on its own period */
+cpufreq_out:
+	cpufreq_change_unlock();
 	return ret;
+}
 
-cpufreq_out:
-	mutex_unlock(&set_cpu_freq_change);
+/*
+ * Called from the governor, possibly in atomic context, with @index a
+ * position in cpufreq_freq_table within the policy limits. Returns
+ * -EAGAIN when the change needs more voltage, -EBUSY when a slow-path
+ * change is running; the caller then goes through s5pv310_target().
+ */
+static int s5pv310_fast_switch(struct cpufreq_policy *policy,
+			       unsigned int index)
+{
+	unsigned int i, old_index, total_us;
+#if defined(CONFIG_REGULATOR)
+	unsigned int need_volt;
+#endif
+	unsigned long flags;
+	ktime_t start;
+	int ret = 0;
+
+	if (index >= CPUFREQ_LEVEL_END ||
+	    cpufreq_freq_table[index].frequency == CPUFREQ_TABLE_END)
+		return -EINVAL;
+
+	spin_lock_irqsave(&cpufreq_fast_lock, flags);
+	if (cpufreq_fast_blocked) {
+		ret = -EBUSY;
+		goto out;
+	}
+#if defined(CONFIG_REGULATOR)
+	if (disable_further_cpufreq) {
+		ret = -EBUSY;
+		goto out;
+	}
+#endif
+
+	/* freqs is ours: only slow-path changes use it, and none is running */
+	freqs.old = s5pv310_getspeed(policy->cpu);
+	for (i = 0; cpufreq_freq_table[i].frequency != CPUFREQ_TABLE_END; i++)
+		if (cpufreq_freq_table[i].frequency == freqs.old)
+			break;
+	if (cpufreq_freq_table[i].frequency == CPUFREQ_TABLE_END) {
+		ret = -EAGAIN;
+		goto out;
+	}
+	old_index = i;
+
+	/* same limits as s5pv310_target() */
+	if (!cpufreq_lock.disable_lock && (index > cpufreq_lock.level))
+		index = cpufreq_lock.level;
+
+	if (!cpufreq_upper_lock.disable_lock &&
+				(index < cpufreq_upper_lock.level))
+		index = cpufreq_upper_lock.level;
+
+	if (cpufreq_info.max_arm_clk == CPUFREQ_1400MHZ) {
+		if ((index == 0) && (old_index > 3))
+			index = 3;
+	} else {
+		if ((index == 0) && (old_index > 2))
+			index = 2;
+	}
+
+	freqs.new = cpufreq_freq_table[index].frequency;
+	freqs.cpu = policy->cpu;
+	if (freqs.new == freqs.old)
+		goto out;
+
+#if defined(CONFIG_REGULATOR)
+	/* highest voltage s5pv310_set_cpufreq_armvolt() would use */
+	need_volt = cpufreq_table[index].arm_volt;
+	if (cpufreq_table[old_index].freq_trans[index] & VOLT_UP_ARM800)
+		need_volt = cpufreq_table[freqs.new > freqs.old ?
+					  index - 1 : index - 2].arm_volt;
+	if (need_volt > arm_volt_now) {
+		ret = -EAGAIN;
+		goto out;
+	}
+#endif
+
+	start = ktime_get();
+	apll_lock_us = 0;
+	s5pv310_set_frequency(old_index, index);
+	total_us = ktime_us_delta(ktime_get(), start);
+
+	dvfs_trans_account(&cpufreq_trans_stat[old_index][index], total_us);
+	trace_s5pv310_cpufreq_transition(old_index, index, 0, apll_lock_us,
+					 total_us);
+
+	if (!fast_notify_old) {
+		fast_notify_old = freqs.old;
+		fast_notify_cpu = policy->cpu;
+	}
+	schedule_delayed_work(&cpufreq_fast_work,
+			      msecs_to_jiffies(CPUFREQ_FAST_SETTLE_MS));
+out:
+	spin_unlock_irqrestore(&cpufreq_fast_lock, flags);
 	return ret;
 }
 
+/* Notify what the fast path did and drop VDD_ARM to what the level needs */
+static void cpufreq_fast_work_fn(struct work_struct *work)
+{
+#if defined(CONFIG_REGULATOR)
+	unsigned int i, cur_freq;
+#endif
+
+	cpufreq_change_lock();
+#if defined(CONFIG_REGULATOR)
+	if (disable_further_cpufreq)
+		goto out;
+
+	cur_freq = s5pv310_getspeed(0);
+	for (i = 0; cpufreq_freq_table[i].frequency != CPUFREQ_TABLE_END; i++) {
+		if (cpufreq_freq_table[i].frequency != cur_freq)
+			continue;
+		if (arm_volt_now > cpufreq_table[i].arm_volt)
+			s5pv310_set_arm_volt(cpufreq_table[i].arm_volt);
+		break;
+	}
+out:
+#endif
+	cpufreq_change_unlock();
+}
+
 static void busfreq_ppmu_init(void)
 {
 	unsigned int i;
@@ -873,35 +1184,6 @@ static unsigned int get_ppc_load(void)
 	return bus_load;
 }
 
-#ifdef SYSFS_DEBUG_BUSFREQ
-static void update_busfreq_stat(void)
-{
-	unsigned long level_state_jiffies;
-
-	cur_jiffies = jiffies;
-	if (pre_jiffies != 0)
-		level_state_jiffies = cur_jiffies - pre_jiffies;
-	else
-		level_state_jiffies = 0;
-
-	pre_jiffies = jiffies;
-
-	switch (cur_busfreq_index) {
-	case BUS_L0:
-		time_in_state[BUS_L0] += level_state_jiffies;
-		break;
-	case BUS_L1:
-		time_in_state[BUS_L1] += level_state_jiffies;
-		break;
-	case BUS_L2:
-		time_in_state[BUS_L2] += level_state_jiffies;
-		break;
-	default:
-		break;
-	}
-}
-#endif
-
 
 static void select_busfreq(unsigned int bus_load,
 			unsigned int cpu_bus_load,
@@ -933,6 +1215,22 @@ static void select_busfreq(unsigned int bus_load,
 	if ((*target_index > BUS_L1) && (cpu_bus_load > CPU_PMU_L1_THRESHOLD))
 		*target_index = BUS_L1;
 
+	/* Hysteresis: hold off lowering, then step down one level */
+	if (*target_index > cur_busfreq_index) {
+		if (++busfreq_down_count < busfreq_down_hold) {
+			*target_index = cur_busfreq_index;
+		} else {
+			busfreq_down_count = 0;
+			*target_index = cur_busfreq_index + 1;
+		}
+	} else {
+		busfreq_down_count = 0;
+	}
+
+	/* A lower bound wins over an upper limit */
+	if (*target_index < busfreq_upper_lock.level)
+		*target_index = busfreq_upper_lock.level;
+
 	if (*target_index > busfreq_lock.level)
 		*target_index = busfreq_lock.level;
 
@@ -949,10 +1247,6 @@ static void busfreq_target(void)
 	if (busfreq_fix)
 		goto fix_out;
 
-#ifdef SYSFS_DEBUG_BUSFREQ
-	update_busfreq_stat();
-#endif
-
 	/*
 	 * Get the CPU PPMU load value which compare for
 	 *  whether need to change
@@ -964,7 +1258,9 @@ static void busfreq_target(void)
 	 * Bus frequency is up right now
 	 */
 	if (cpu_bus_load > CPU_PMU_L0_THRESHOLD) {
-		s5pv310_set_busfreq(BUS_L0);
+		busfreq_down_count = 0;
+		s5pv310_set_busfreq(min(busfreq_upper_lock.level,
+					busfreq_lock.level));
 		goto out;
 	}
 
@@ -986,52 +1282,14 @@ fix_out:
 	mutex_unlock(&set_bus_freq_change);
 }
 
-
-int s5pv310_busfreq_lock(unsigned int nId,
-			enum busfreq_level_index req_lock_level)
+static void busfreq_work_fn(struct work_struct *work)
 {
-	if (!cpufreq_info.init_done || req_lock_level < 0)
-		return 0;
-
-	if (busfreq_lock.dev_id & (1 << nId)) {
-		printk(KERN_ERR
-		"[BUSFREQ] This device [%d] already locked busfreq\n", nId);
-		return 0;
-	}
-	mutex_lock(&set_bus_freq_lock);
-	busfreq_lock.dev_id |= (1 << nId);
-	busfreq_lock.value[nId] = req_lock_level;
-
-	/* If the requested cpufreq is higher than current min frequency */
-	if (req_lock_level < busfreq_lock.level) {
-		busfreq_lock.level = req_lock_level;
-		mutex_unlock(&set_bus_freq_lock);
-		busfreq_target();
-	} else
-		mutex_unlock(&set_bus_freq_lock);
+	busfreq_target();
 
-	return 0;
+	queue_delayed_work(busfreq_wq, &busfreq_work,
+			msecs_to_jiffies(busfreq_sampling_ms));
 }
 
-void s5pv310_busfreq_lock_free(unsigned int nId)
-{
-	unsigned int i;
-
-	mutex_lock(&set_bus_freq_lock);
-
-	busfreq_lock.dev_id &= ~(1 << nId);
-	busfreq_lock.value[nId] = busfreq_lock.min_level;
-	busfreq_lock.level = busfreq_lock.min_level;
-
-	if (busfreq_lock.dev_id) {
-		for (i = 0; i < DVFS_LOCK_ID_END; i++) {
-			if (busfreq_lock.value[i] < busfreq_lock.level)
-				busfreq_lock.level = busfreq_lock.value[i];
-		}
-	}
-
-	mutex_unlock(&set_bus_freq_lock);
-}
 
 int s5pv310_cpufreq_round_idx(unsigned int cpu_freq)
 {
@@ -1059,58 +1317,80 @@ int s5pv310_cpufreq_round_idx(unsigned int cpu_freq)
 	return cpufreq_freq_table[cpu_idx].index;
 }
 
-int s5pv310_cpufreq_lock(unsigned int nId,
-			enum cpufreq_level_index req_lock_level)
+/*
+ * Frequency locks are pm_qos requests on PM_QOS_CPU_FREQ_MIN,
+ * PM_QOS_CPU_FREQ_MAX, PM_QOS_BUS_FREQ_MIN and PM_QOS_BUS_FREQ_MAX,
+ * in kHz. The notifiers below turn the aggregate value into a level
+ * and apply it right away.
+ * The DVFS_LOCK_ID interface is kept on top of one request per ID.
+ */
+static struct pm_qos_request_list cpufreq_lock_req[DVFS_LOCK_ID_END];
+static struct pm_qos_request_list cpufreq_upper_req[DVFS_LOCK_ID_END];
+static struct pm_qos_request_list busfreq_lock_req[DVFS_LOCK_ID_END];
+
+/* Lowest cpufreq level running at @freq kHz or more */
+static unsigned int cpufreq_min_level(s32 freq)
 {
-	unsigned int i, cur_idx = 0;
-	unsigned int cur_freq, req_freq;
+	unsigned int i;
 
-	if (!cpufreq_info.init_done || req_lock_level < 0)
-		return 0;
+	for (i = cpufreq_lock.min_level; i > 0; i--)
+		if (cpufreq_freq_table[i].frequency >= freq)
+			break;
 
-	if (cpufreq_lock.dev_id & (1 << nId)) {
-		printk(KERN_ERR
-		"[CPUFREQ]This device [%d] already locked cpufreq\n", nId);
-		return 0;
-	}
+	return i;
+}
 
-	if (req_lock_level > cpufreq_lock.min_level) {
-		printk(KERN_ERR
-		"[CPUFREQ] This is wrong cpufreq_level %d (min level is %d)\n",
-			req_lock_level, cpufreq_lock.min_level);
-		req_lock_level = cpufreq_lock.min_level;
-	}
+/* Highest cpufreq level running at @freq kHz or less */
+static unsigned int cpufreq_max_level(s32 freq)
+{
+	unsigned int i;
 
-	mutex_lock(&set_cpu_freq_lock);
-	cpufreq_lock.dev_id |= (1 << nId);
-	cpufreq_lock.value[nId] = req_lock_level;
+	for (i = cpufreq_upper_lock.max_level; i < cpufreq_lock.min_level; i++)
+		if (cpufreq_freq_table[i].frequency <= freq)
+			break;
 
-	/* If the requested cpufreq is higher than current min frequency */
-	if (req_lock_level < cpufreq_lock.level)
-		cpufreq_lock.level = req_lock_level;
+	return i;
+}
 
-	mutex_unlock(&set_cpu_freq_lock);
+/* Lowest busfreq level running the memory at @freq kHz or more */
+static unsigned int busfreq_min_level(s32 freq)
+{
+	unsigned int i;
 
-	/* If the lock level is higher than upper lock
-	 * do not setting cpufreq lock frequency
-	 * because the priority of upper lock is the highest except ID_PM */
-	if ((cpufreq_lock.level < cpufreq_upper_lock.level)
-					&& (nId != DVFS_LOCK_ID_PM))
-		return 0;
+	for (i = busfreq_lock.min_level; i > 0; i--)
+		if (s5pv310_busfreq_table[i].mem_clk >= freq)
+			break;
 
-	/* Do not setting cpufreq lock frequency
-	 * because current governor doesn't support dvfs level lock
-	 * except DVFS_LOCK_ID_PM */
-	if (cpufreq_lock.disable_lock && (nId != DVFS_LOCK_ID_PM))
-		return 0;
+	return i;
+}
 
-	/* If current frequency is lower than requested freq,
-	 * it needs to update
-	 */
-	mutex_lock(&set_cpu_freq_change);
+/* Highest busfreq level running the memory at @freq kHz or less */
+static unsigned int busfreq_max_level(s32 freq)
+{
+	unsigned int i;
+
+	for (i = busfreq_upper_lock.max_level; i < busfreq_lock.min_level; i++)
+		if (s5pv310_busfreq_table[i].mem_clk <= freq)
+			break;
+
+	return i;
+}
+
+/*
+ * Switch to @level now if the current frequency is below it (@upper
+ * false) or above it (@upper true).
+ */
+static int s5pv310_cpufreq_apply_level(unsigned int level, bool upper)
+{
+	unsigned int i, cur_idx = 0;
+	unsigned int cur_freq, req_freq;
+	bool need;
+
+	cpufreq_change_lock();
 	cur_freq = s5pv310_getspeed(0);
-	req_freq = cpufreq_freq_table[req_lock_level].frequency;
-	if (cur_freq < req_freq) {
+	req_freq = cpufreq_freq_table[level].frequency;
+	need = upper ? (cur_freq > req_freq) : (cur_freq < req_freq);
+	if (need) {
 		/* Find out current level index */
 		for (i = 0; cpufreq_freq_table[i].frequency
 				!= CPUFREQ_TABLE_END; i++) {
@@ -1120,7 +1400,7 @@ int s5pv310_cpufreq_lock(unsigned int nId,
 			} else if (i == (CPUFREQ_LEVEL_END - 1)) {
 				printk(KERN_ERR "%s: Level not found\n",
 					__func__);
-				mutex_unlock(&set_cpu_freq_change);
+				cpufreq_change_unlock();
 				return -EINVAL;
 			} else {
 				continue;
@@ -1128,125 +1408,227 @@ int s5pv310_cpufreq_lock(unsigned int nId,
 		}
 		freqs.old = cur_freq;
 		freqs.new = req_freq;
-		s5pv310_set_cpufreq_armvolt(cur_idx, req_lock_level);
+		s5pv310_set_cpufreq_armvolt(cur_idx, level);
 
 	}
-	mutex_unlock(&set_cpu_freq_change);
+	cpufreq_change_unlock();
 
 	return 0;
 }
 
-void s5pv310_cpufreq_lock_free(unsigned int nId)
+static int s5pv310_cpufreq_min_notifier_call(struct notifier_block *nb,
+				unsigned long value, void *data)
 {
-	unsigned int i;
+	unsigned int level;
+	bool pm_lock;
 
 	if (!cpufreq_info.init_done)
-		return;
+		return NOTIFY_DONE;
 
 	mutex_lock(&set_cpu_freq_lock);
+	level = cpufreq_min_level(value);
+	cpufreq_lock.level = level;
+	mutex_unlock(&set_cpu_freq_lock);
 
-	cpufreq_lock.dev_id &= ~(1 << nId);
-	cpufreq_lock.value[nId] = cpufreq_lock.min_level;
-	cpufreq_lock.level = cpufreq_lock.min_level;
-	if (cpufreq_lock.dev_id) {
-		for (i = 0; i < DVFS_LOCK_ID_END; i++) {
-			if (cpufreq_lock.value[i] < cpufreq_lock.level)
-				cpufreq_lock.level = cpufreq_lock.value[i];
-		}
-	}
+	/*
+	 * The upper limit has priority over the lock, and governors
+	 * without level lock support ignore it, except for the PM lock.
+	 */
+	pm_lock = pm_qos_request_active(&cpufreq_lock_req[DVFS_LOCK_ID_PM]);
+	if (!pm_lock && ((level < cpufreq_upper_lock.level) ||
+				cpufreq_lock.disable_lock))
+		return NOTIFY_OK;
+
+	s5pv310_cpufreq_apply_level(level, false);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block s5pv310_cpufreq_min_notifier = {
+	.notifier_call = s5pv310_cpufreq_min_notifier_call,
+};
 
+static int s5pv310_cpufreq_max_notifier_call(struct notifier_block *nb,
+				unsigned long value, void *data)
+{
+	unsigned int level;
+
+	if (!cpufreq_info.init_done)
+		return NOTIFY_DONE;
+
+	mutex_lock(&set_cpu_freq_lock);
+	level = cpufreq_max_level(value);
+	cpufreq_upper_lock.level = level;
 	mutex_unlock(&set_cpu_freq_lock);
+
+	/* Current governor doesn't support dvfs upper level lock */
+	if (cpufreq_upper_lock.disable_lock)
+		return NOTIFY_OK;
+
+	s5pv310_cpufreq_apply_level(level, true);
+
+	return NOTIFY_OK;
 }
 
-int s5pv310_cpufreq_upper_limit(unsigned int nId,
+static struct notifier_block s5pv310_cpufreq_max_notifier = {
+	.notifier_call = s5pv310_cpufreq_max_notifier_call,
+};
+
+static int s5pv310_busfreq_min_notifier_call(struct notifier_block *nb,
+				unsigned long value, void *data)
+{
+	unsigned int level;
+	bool raise;
+
+	if (!cpufreq_info.init_done)
+		return NOTIFY_DONE;
+
+	mutex_lock(&set_bus_freq_lock);
+	level = busfreq_min_level(value);
+	raise = level < busfreq_lock.level;
+	busfreq_lock.level = level;
+	mutex_unlock(&set_bus_freq_lock);
+
+	/* Lowering waits for the next sample */
+	if (raise)
+		busfreq_target();
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block s5pv310_busfreq_min_notifier = {
+	.notifier_call = s5pv310_busfreq_min_notifier_call,
+};
+
+static int s5pv310_busfreq_max_notifier_call(struct notifier_block *nb,
+				unsigned long value, void *data)
+{
+	unsigned int level;
+	bool lower;
+
+	if (!cpufreq_info.init_done)
+		return NOTIFY_DONE;
+
+	mutex_lock(&set_bus_freq_lock);
+	level = busfreq_max_level(value);
+	lower = level > busfreq_upper_lock.level;
+	busfreq_upper_lock.level = level;
+	mutex_unlock(&set_bus_freq_lock);
+
+	/* Raising waits for the next sample */
+	if (lower)
+		busfreq_target();
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block s5pv310_busfreq_max_notifier = {
+	.notifier_call = s5pv310_busfreq_max_notifier_call,
+};
+
+int s5pv310_cpufreq_lock(unsigned int nId,
 			enum cpufreq_level_index req_lock_level)
 {
-	unsigned int i, cur_idx = 0;
-	unsigned int cur_freq, req_freq;
+	struct pm_qos_request_list *req = &cpufreq_lock_req[nId];
 
 	if (!cpufreq_info.init_done || req_lock_level < 0)
 		return 0;
 
-	if (cpufreq_upper_lock.dev_id & (1 << nId)) {
+	if (pm_qos_request_active(req)) {
 		printk(KERN_ERR
-		"[CPUFREQ]This device [%d] already upper locked cpufreq\n", nId);
+		"[CPUFREQ]This device [%d] already locked cpufreq\n", nId);
 		return 0;
 	}
 
-	if (req_lock_level < cpufreq_upper_lock.max_level) {
+	if (req_lock_level > cpufreq_lock.min_level) {
 		printk(KERN_ERR
-		"[CPUFREQ] This is wrong cpufreq_level %d (max level is %d)\n",
-			req_lock_level, cpufreq_upper_lock.max_level);
-		req_lock_level = cpufreq_upper_lock.max_level;
+		"[CPUFREQ] This is wrong cpufreq_level %d (min level is %d)\n",
+			req_lock_level, cpufreq_lock.min_level);
+		req_lock_level = cpufreq_lock.min_level;
 	}
 
-	mutex_lock(&set_cpu_freq_lock);
-	cpufreq_upper_lock.dev_id |= (1 << nId);
-	cpufreq_upper_lock.value[nId] = req_lock_level;
+	pm_qos_add_request(req, PM_QOS_CPU_FREQ_MIN,
+			cpufreq_freq_table[req_lock_level].frequency);
+	req->owner = __builtin_return_address(0);
 
-	/* If the requested limit level is lower than current value */
-	if (req_lock_level > cpufreq_upper_lock.level)
-		cpufreq_upper_lock.level = req_lock_level;
+	return 0;
+}
 
-	mutex_unlock(&set_cpu_freq_lock);
+void s5pv310_cpufreq_lock_free(unsigned int nId)
+{
+	if (!cpufreq_info.init_done)
+		return;
 
-	/* Do not setting cpufreq upper lock frequency
-	 * because current governor doesn't support dvfs upper level lock
-	 */
-	if (cpufreq_upper_lock.disable_lock)
+	if (pm_qos_request_active(&cpufreq_lock_req[nId]))
+		pm_qos_remove_request(&cpufreq_lock_req[nId]);
+}
+
+int s5pv310_cpufreq_upper_limit(unsigned int nId,
+			enum cpufreq_level_index req_lock_level)
+{
+	struct pm_qos_request_list *req = &cpufreq_upper_req[nId];
+
+	if (!cpufreq_info.init_done || req_lock_level < 0)
 		return 0;
 
-	/* If cur frequency is higher than limit freq, it needs to update */
-	mutex_lock(&set_cpu_freq_change);
-	cur_freq = s5pv310_getspeed(0);
-	req_freq = cpufreq_freq_table[req_lock_level].frequency;
-	if (cur_freq > req_freq) {
-		/* Find out current level index */
-		for (i = 0; cpufreq_freq_table[i].frequency
-				!= CPUFREQ_TABLE_END; i++) {
-			if (cur_freq == cpufreq_freq_table[i].frequency) {
-				cur_idx = cpufreq_freq_table[i].index;
-				break;
-			} else if (i == (CPUFREQ_LEVEL_END - 1)) {
-				printk(KERN_ERR "%s: Level not found\n",
-					__func__);
-				mutex_unlock(&set_cpu_freq_change);
-				return -EINVAL;
-			} else {
-				continue;
-			}
-		}
-		freqs.old = cur_freq;
-		freqs.new = req_freq;
-		s5pv310_set_cpufreq_armvolt(cur_idx, req_lock_level);
+	if (pm_qos_request_active(req)) {
+		printk(KERN_ERR
+		"[CPUFREQ]This device [%d] already upper locked cpufreq\n", nId);
+		return 0;
+	}
 
+	if (req_lock_level < cpufreq_upper_lock.max_level) {
+		printk(KERN_ERR
+		"[CPUFREQ] This is wrong cpufreq_level %d (max level is %d)\n",
+			req_lock_level, cpufreq_upper_lock.max_level);
+		req_lock_level = cpufreq_upper_lock.max_level;
 	}
-	mutex_unlock(&set_cpu_freq_change);
+
+	pm_qos_add_request(req, PM_QOS_CPU_FREQ_MAX,
+			cpufreq_freq_table[req_lock_level].frequency);
+	req->owner = __builtin_return_address(0);
+
 	return 0;
 }
 
 void s5pv310_cpufreq_upper_limit_free(unsigned int nId)
 {
-	unsigned int i;
-
 	if (!cpufreq_info.init_done)
 		return;
 
-	mutex_lock(&set_cpu_freq_lock);
+	if (pm_qos_request_active(&cpufreq_upper_req[nId]))
+		pm_qos_remove_request(&cpufreq_upper_req[nId]);
+}
+
+int s5pv310_busfreq_lock(unsigned int nId,
+			enum busfreq_level_index req_lock_level)
+{
+	struct pm_qos_request_list *req = &busfreq_lock_req[nId];
+
+	if (!cpufreq_info.init_done || req_lock_level < 0)
+		return 0;
 
-	cpufreq_upper_lock.dev_id &= ~(1 << nId);
-	cpufreq_upper_lock.value[nId] = cpufreq_upper_lock.max_level;
-	cpufreq_upper_lock.level = cpufreq_upper_lock.max_level;
-	if (cpufreq_upper_lock.dev_id) {
-		for (i = 0; i < DVFS_LOCK_ID_END; i++) {
-			if (cpufreq_upper_lock.value[i] > cpufreq_upper_lock.level)
-				cpufreq_upper_lock.level = cpufreq_upper_lock.value[i];
-		}
+	if (pm_qos_request_active(req)) {
+		printk(KERN_ERR
+		"[BUSFREQ] This device [%d] already locked busfreq\n", nId);
+		return 0;
 	}
 
-	mutex_unlock(&set_cpu_freq_lock);
+	if (req_lock_level > busfreq_lock.min_level)
+		req_lock_level = busfreq_lock.min_level;
+
+	pm_qos_add_request(req, PM_QOS_BUS_FREQ_MIN,
+			s5pv310_busfreq_table[req_lock_level].mem_clk);
+	req->owner = __builtin_return_address(0);
+
+	return 0;
 }
 
+void s5pv310_busfreq_lock_free(unsigned int nId)
+{
+	if (pm_qos_request_active(&busfreq_lock_req[nId]))
+		pm_qos_remove_request(&busfreq_lock_req[nId]);
+}
 
 #ifdef CONFIG_PM
 static int s5pv310_cpufreq_suspend(struct cpufreq_policy *policy,
@@ -1375,6 +1757,7 @@ static struct cpufreq_driver s5pv310_driver = {
 	.flags = CPUFREQ_STICKY,
 	.verify = s5pv310_verify_policy,
 	.target = s5pv310_target,
+	.fast_switch = s5pv310_fast_switch,
 	.get = s5pv310_getspeed,
 	.init = s5pv310_cpufreq_cpu_init,
 	.name = "s5pv310_cpufreq",
@@ -1748,7 +2131,7 @@ static void s5pv310_set_asv_voltage(void)
 	unsigned int rate, i;
 
 	/* get current ARM level */
-	mutex_lock(&set_cpu_freq_change);
+	cpufreq_change_lock();
 
 	freqs.old = s5pv310_getspeed(0);
 
@@ -1757,13 +2140,13 @@ static void s5pv310_set_asv_voltage(void)
 			arm_index = cpufreq_freq_table[i].index;
 			arm_volt = cpufreq_table[i].arm_volt;
 #if defined(CONFIG_REGULATOR)
-			regulator_set_voltage(arm_regulator, arm_volt, arm_volt);
+			s5pv310_set_arm_volt(arm_volt);
 #endif
 			break;
 		}
 	}
 
-	mutex_unlock(&set_cpu_freq_change);
+	cpufreq_change_unlock();
 
 	/* get current INT level */
 	mutex_lock(&set_bus_freq_change);
@@ -1973,9 +2356,279 @@ static void s5pv310_cpufreq_set_pmic_vol_table(void)
 }
 #endif /* CONFIG_MACH_C1 */
 
+#ifdef CONFIG_S5PV310_AVS
+/*
+ * Closed-loop AVS on top of the ASV group. The group voltage covers
+ * the slowest chip of the group; this trims each level down to what
+ * this chip needs. The HPM delay code is re-read periodically at the
+ * running level, and a higher code means faster silicon. The first
+ * read of a level, taken at its table voltage, is the reference for
+ * that level. The voltage then steps down while the code stays above
+ * reference - avs_margin_code, and back up when it falls below.
+ * The ASV table voltage is never exceeded.
+ *
+ * After each step down a fixed integer workload is checked against
+ * its result at the table voltage. A mismatch, or a code far below
+ * the reference, puts the level back at its table voltage for good.
+ *
+ * HPM sits in the ARM domain, so VDD_INT gets no reading of its own:
+ * it is trimmed by at most the ARM trim that every sampled level has
+ * proven, within its own smaller bound.
+ */
+#define AVS_STEP_UV		12500
+#define AVS_ARM_MAX_TRIM_UV	50000
+#define AVS_INT_MAX_TRIM_UV	25000
+#define AVS_MARGIN_CODE		2
+#define AVS_FAULT_CODE		4	/* code drop past the margin */
+#define AVS_SAMPLING_MS		1000
+#define AVS_HPM_SAMPLES		8
+
+struct avs_level {
+	unsigned int table_volt;	/* ASV voltage, the ceiling */
+	unsigned int trim;		/* uV below table_volt */
+	unsigned int ref_code;		/* HPM code at table_volt, 0 if unread */
+	bool fault;			/* trimming disabled */
+};
+
+static struct avs_level avs_arm[CPUFREQ_LEVEL_END];
+static struct avs_level avs_int[BUSFREQ_LEVEL_END];
+static unsigned int avs_arm_levels;
+
+static unsigned int avs_enable = 1;
+static unsigned int avs_margin_code = AVS_MARGIN_CODE;
+static unsigned int avs_arm_max_trim = AVS_ARM_MAX_TRIM_UV;
+static unsigned int avs_int_max_trim = AVS_INT_MAX_TRIM_UV;
+static unsigned int avs_faults;
+
+static void __iomem *avs_iem_base;
+static struct clk *avs_clk_iec;
+static struct clk *avs_clk_apc;
+static struct clk *avs_clk_hpm;
+static struct delayed_work avs_work;
+static struct workqueue_struct *avs_wq;
+static DEFINE_MUTEX(avs_lock);
+
+static volatile u32 avs_selftest_seed = 0x2545f491;
+static u32 avs_selftest_ref;
+
+static u32 avs_selftest(void)
+{
+	u32 x = avs_selftest_seed, acc = 0;
+	int i;
+
+	for (i = 0; i < 4096; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		acc = acc * 31 + x * (x >> 7);
+	}
+
+	return acc;
+}
+
+static unsigned int avs_read_hpm(void)
+{
+	unsigned int i, code = 0;
+
+	clk_enable(avs_clk_iec);
+	clk_enable(avs_clk_apc);
+	clk_enable(avs_clk_hpm);
+
+	for (i = 0; i < AVS_HPM_SAMPLES; i++)
+		code += __raw_readb(avs_iem_base + S5PV310_APC_DBG_DLYCODE);
+
+	clk_disable(avs_clk_hpm);
+	clk_disable(avs_clk_apc);
+	clk_disable(avs_clk_iec);
+
+	return code / AVS_HPM_SAMPLES;
+}
+
+/* under cpufreq_change_lock(); @cur is the running level */
+static void avs_apply_arm(unsigned int level, bool cur)
+{
+	unsigned int volt = avs_arm[level].table_volt - avs_arm[level].trim;
+
+	cpufreq_table[level].arm_volt = volt;
+	if (cur)
+		s5pv310_set_arm_volt(volt);
+#ifdef CONFIG_MACH_C1
+	s5pv310_cpufreq_set_pmic_vol_table();
+#endif
+}
+
+/*
+ * INT follows the smallest trim of the measured ARM levels, so it stays
+ * at the table voltage until at least one level has a reference code.
+ */
+static void avs_update_int(void)
+{
+	unsigned int i, trim = 0;
+	unsigned int volt;
+	bool measured = false;
+
+	for (i = 0; i < avs_arm_levels && avs_enable; i++) {
+		if (avs_arm[i].fault) {
+			measured = false;
+			break;
+		}
+		if (!avs_arm[i].ref_code)
+			continue;
+		trim = measured ? min(trim, avs_arm[i].trim) : avs_arm[i].trim;
+		measured = true;
+	}
+	trim = measured ? min(trim, avs_int_max_trim) : 0;
+
+	mutex_lock(&set_bus_freq_change);
+	for (i = 0; i < BUSFREQ_LEVEL_END; i++) {
+		if (avs_int[i].trim == trim)
+			continue;
+		avs_int[i].trim = trim;
+		volt = avs_int[i].table_volt - trim;
+		s5pv310_busfreq_table[i].volt = volt;
+		if (i == cur_busfreq_index)
+			regulator_set_voltage(int_regulator, volt, volt);
+	}
+	mutex_unlock(&set_bus_freq_change);
+}
+
+static void avs_fault(unsigned int level, unsigned int code)
+{
+	printk(KERN_ERR "AVS: L%u fault at -%uuV (hpm %u, ref %u), "
+		"back to %uuV\n", level, avs_arm[level].trim, code,
+		avs_arm[level].ref_code, avs_arm[level].table_volt);
+
+	avs_arm[level].trim = 0;
+	avs_arm[level].fault = true;
+	avs_faults++;
+	avs_apply_arm(level, true);
+}
+
+static void avs_work_fn(struct work_struct *work)
+{
+	struct avs_level *l;
+	unsigned int cur_freq, code, level, i;
+
+	mutex_lock(&avs_lock);
+	if (!avs_enable)
+		goto out;
+
+	cpufreq_change_lock();
+
+	cur_freq = s5pv310_getspeed(0);
+	for (i = 0; i < avs_arm_levels; i++)
+		if (cpufreq_freq_table[i].frequency == cur_freq)
+			break;
+	if (i == avs_arm_levels)
+		goto unlock;
+
+	level = i;
+	l = &avs_arm[level];
+	if (l->fault)
+		goto unlock;
+
+	code = avs_read_hpm();
+
+	if (!l->ref_code) {
+		if (!l->trim)
+			l->ref_code = code;
+		goto unlock;
+	}
+
+	if (code + avs_margin_code + AVS_FAULT_CODE < l->ref_code) {
+		avs_fault(level, code);
+	} else if (code + avs_margin_code + 1 < l->ref_code) {
+		/* lost too much margin, step back up */
+		l->trim -= min(l->trim, (unsigned int)AVS_STEP_UV);
+		avs_apply_arm(level, true);
+	} else if (code + avs_margin_code > l->ref_code &&
+		   l->trim + AVS_STEP_UV <= avs_arm_max_trim) {
+		l->trim += AVS_STEP_UV;
+		avs_apply_arm(level, true);
+		if (avs_selftest() != avs_selftest_ref)
+			avs_fault(level, code);
+	}
+
+unlock:
+	cpufreq_change_unlock();
+
+	avs_update_int();
+out:
+	mutex_unlock(&avs_lock);
+
+	queue_delayed_work(avs_wq, &avs_work,
+			msecs_to_jiffies(AVS_SAMPLING_MS));
+}
+
+/* Back to the ASV table voltages, with avs_lock held */
+static void avs_restore(void)
+{
+	unsigned int i, cur_freq;
+
+	cpufreq_change_lock();
+	cur_freq = s5pv310_getspeed(0);
+	for (i = 0; i < avs_arm_levels; i++) {
+		avs_arm[i].trim = 0;
+		avs_apply_arm(i, cpufreq_freq_table[i].frequency == cur_freq);
+	}
+	cpufreq_change_unlock();
+
+	avs_update_int();
+}
+
+static int __init s5pv310_avs_init(void)
+{
+	unsigned int i;
+
+	avs_iem_base = ioremap(S5PV310_PA_IEM, (128 * 1024));
+	if (avs_iem_base == NULL)
+		return -ENOMEM;
+
+	avs_clk_iec = clk_get(NULL, "iem-iec");
+	avs_clk_apc = clk_get(NULL, "iem-apc");
+	avs_clk_hpm = clk_get(NULL, "hpm");
+	if (IS_ERR(avs_clk_iec) || IS_ERR(avs_clk_apc) ||
+	    IS_ERR(avs_clk_hpm)) {
+		printk(KERN_ERR "AVS: IEM clock get error\n");
+		goto err_clk;
+	}
+
+	for (i = 0; cpufreq_freq_table[i].frequency != CPUFREQ_TABLE_END; i++)
+		avs_arm[i].table_volt = cpufreq_table[i].arm_volt;
+	avs_arm_levels = i;
+
+	for (i = 0; i < BUSFREQ_LEVEL_END; i++)
+		avs_int[i].table_volt = s5pv310_busfreq_table[i].volt;
+
+	/* reference result, at the table voltage */
+	avs_selftest_ref = avs_selftest();
+
+	/* freezable, so no trimming while devices are suspended */
+	avs_wq = create_freezeable_workqueue("avs");
+	if (!avs_wq)
+		goto err_clk;
+
+	INIT_DELAYED_WORK_DEFERRABLE(&avs_work, avs_work_fn);
+	queue_delayed_work(avs_wq, &avs_work,
+			msecs_to_jiffies(AVS_SAMPLING_MS));
+
+	return 0;
+
+err_clk:
+	if (!IS_ERR(avs_clk_iec))
+		clk_put(avs_clk_iec);
+	if (!IS_ERR(avs_clk_apc))
+		clk_put(avs_clk_apc);
+	if (!IS_ERR(avs_clk_hpm))
+		clk_put(avs_clk_hpm);
+	iounmap(avs_iem_base);
+	return -EINVAL;
+}
+#endif /* CONFIG_S5PV310_AVS */
+
 static int __init s5pv310_cpufreq_init(void)
 {
-	int i, ret;
+	int ret;
 
 	printk(KERN_INFO "++ %s\n", __func__);
 
@@ -1999,6 +2652,11 @@ static int __init s5pv310_cpufreq_init(void)
 	if (IS_ERR(sclk_dmc))
 		goto out;
 
+	/* freezable, so bus sampling stops across suspend */
+	busfreq_wq = create_freezeable_workqueue("busfreq");
+	if (!busfreq_wq)
+		goto out;
+
 #if defined(CONFIG_REGULATOR)
 	arm_regulator = regulator_get(NULL, "vdd_arm");
 	if (IS_ERR(arm_regulator)) {
@@ -2016,7 +2674,7 @@ static int __init s5pv310_cpufreq_init(void)
 #ifdef CONFIG_S5PV310_ASV
 #if defined(CONFIG_REGULATOR)
 	pr_info("%s: set vdd_arm (1.2V)\n", __func__);
-	ret = regulator_set_voltage(arm_regulator, 1200000, 1200000);
+	ret = s5pv310_set_arm_volt(1200000);
 	if (ret < 0)
 		pr_err("%s: fail to set vdd_arm(%d)\n", __func__, ret);
 #endif
@@ -2040,6 +2698,11 @@ static int __init s5pv310_cpufreq_init(void)
 	s5pv310_set_asv_voltage();
 #endif
 
+#ifdef CONFIG_S5PV310_AVS
+	if (s5pv310_avs_init())
+		printk(KERN_ERR "AVS: init failed, ASV voltages only\n");
+#endif
+
 	up_threshold = UP_THRESHOLD_DEFAULT;
 	cpu.cpu_hw_base = S5PV310_VA_PPMU_CPU;
 	dmc[DMC0].dmc_hw_base = S5P_VA_DMC0;
@@ -2048,15 +2711,24 @@ static int __init s5pv310_cpufreq_init(void)
 	busfreq_ppmu_init();
 	cpu_ppmu_init();
 
-	for (i = 0; i < DVFS_LOCK_ID_END; i++)
-		busfreq_lock.value[i] = busfreq_lock.min_level;
-
-	/* g_cpufreq_lock_val & g_cpufreq_lock level
-	 * initialize to minimum cpufreq level
-	*/
-	for (i = 0; i < DVFS_LOCK_ID_END; i++)
-		cpufreq_lock.value[i] = cpufreq_lock.min_level;
-	cpufreq_lock.level = cpufreq_lock.min_level;
+	/* Deferrable, so an idle system is not woken up just to sample */
+	INIT_DELAYED_WORK_DEFERRABLE(&busfreq_work, busfreq_work_fn);
+	queue_delayed_work(busfreq_wq, &busfreq_work,
+			msecs_to_jiffies(busfreq_sampling_ms));
+
+	/* Pick up any request made before the table was set up */
+	cpufreq_lock.level =
+		cpufreq_min_level(pm_qos_request(PM_QOS_CPU_FREQ_MIN));
+	cpufreq_upper_lock.level =
+		cpufreq_max_level(pm_qos_request(PM_QOS_CPU_FREQ_MAX));
+	busfreq_lock.level =
+		busfreq_min_level(pm_qos_request(PM_QOS_BUS_FREQ_MIN));
+	busfreq_upper_lock.level =
+		busfreq_max_level(pm_qos_request(PM_QOS_BUS_FREQ_MAX));
+	pm_qos_add_notifier(PM_QOS_CPU_FREQ_MIN, &s5pv310_cpufreq_min_notifier);
+	pm_qos_add_notifier(PM_QOS_CPU_FREQ_MAX, &s5pv310_cpufreq_max_notifier);
+	pm_qos_add_notifier(PM_QOS_BUS_FREQ_MIN, &s5pv310_busfreq_min_notifier);
+	pm_qos_add_notifier(PM_QOS_BUS_FREQ_MAX, &s5pv310_busfreq_max_notifier);
 
 	register_pm_notifier(&s5pv310_cpufreq_notifier);
 	register_reboot_notifier(&s5pv310_cpufreq_reboot_notifier);
@@ -2069,6 +2741,9 @@ static int __init s5pv310_cpufreq_init(void)
 	return cpufreq_register_driver(&s5pv310_driver);
 
 out:
+	if (busfreq_wq)
+		destroy_workqueue(busfreq_wq);
+
 	if (!IS_ERR(arm_clk))
 		clk_put(arm_clk);
 
@@ -2116,6 +2791,10 @@ static ssize_t store_busfreq_fix(struct device *dev,
 	if (ret != 1)
 		return -EINVAL;
 
+	/* No need to sample while the level is fixed */
+	if (busfreq_fix)
+		cancel_delayed_work_sync(&busfreq_work);
+
 	mutex_lock(&set_bus_freq_change);
 	if (busfreq_fix) {
 		for (i = 0; i < DMC_NUM; i++)
@@ -2127,6 +2806,10 @@ static ssize_t store_busfreq_fix(struct device *dev,
 	}
 	mutex_unlock(&set_bus_freq_change);
 
+	if (!busfreq_fix)
+		queue_delayed_work(busfreq_wq, &busfreq_work,
+				msecs_to_jiffies(busfreq_sampling_ms));
+
 	return count;
 }
 
@@ -2182,6 +2865,56 @@ static ssize_t show_cur_busfreq(struct device *dev,
 
 static DEVICE_ATTR(cur_busfreq, 0444, show_cur_busfreq, NULL);
 
+static ssize_t show_sampling_rate(struct device *dev,
+				struct device_attribute *attr,
+				char *buf)
+{
+	return sprintf(buf, "%u\n", busfreq_sampling_ms);
+}
+
+static ssize_t store_sampling_rate(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf,
+				size_t count)
+{
+	unsigned int val;
+
+	if (sscanf(buf, "%u", &val) != 1)
+		return -EINVAL;
+
+	busfreq_sampling_ms = clamp_t(unsigned int, val,
+			BUSFREQ_SAMPLING_MS_MIN, BUSFREQ_SAMPLING_MS_MAX);
+
+	return count;
+}
+
+static DEVICE_ATTR(sampling_rate, 0644, show_sampling_rate,
+				store_sampling_rate);
+
+static ssize_t show_down_hold(struct device *dev,
+				struct device_attribute *attr,
+				char *buf)
+{
+	return sprintf(buf, "%u\n", busfreq_down_hold);
+}
+
+static ssize_t store_down_hold(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf,
+				size_t count)
+{
+	unsigned int val;
+
+	if (sscanf(buf, "%u", &val) != 1 || !val)
+		return -EINVAL;
+
+	busfreq_down_hold = val;
+
+	return count;
+}
+
+static DEVICE_ATTR(down_hold, 0644, show_down_hold, store_down_hold);
+
 #ifdef SYSFS_DEBUG_BUSFREQ
 static ssize_t show_time_in_state(struct device *dev,
 				struct device_attribute *attr,
@@ -2190,15 +2923,112 @@ static ssize_t show_time_in_state(struct device *dev,
 	ssize_t len = 0;
 	int i;
 
+	mutex_lock(&set_bus_freq_change);
+	update_busfreq_stat();
 	for (i = 0; i < BUSFREQ_LEVEL_END; i++)
 		len += sprintf(buf + len, "%u: %u\n",
 			s5pv310_busfreq_table[i].mem_clk, time_in_state[i]);
+	mutex_unlock(&set_bus_freq_change);
 
 	return len;
 }
 
 static DEVICE_ATTR(time_in_state, 0444, show_time_in_state, NULL);
 
+static ssize_t show_trans_stat(struct device *dev,
+				struct device_attribute *attr,
+				char *buf)
+{
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < BUSFREQ_LEVEL_END; i++)
+		len += sprintf(buf + len, "%u: %u\n",
+			s5pv310_busfreq_table[i].mem_clk, trans_count[i]);
+
+	return len;
+}
+
+static DEVICE_ATTR(trans_stat, 0444, show_trans_stat, NULL);
+
+/*
+ * One row per source level: count, average and worst time in us of
+ * the changes to each destination level, as "count/avg/max".
+ */
+static ssize_t show_dvfs_trans_table(char *buf, struct dvfs_trans_stat *stat,
+				     unsigned int stride, unsigned int *freq,
+				     unsigned int levels)
+{
+	struct dvfs_trans_stat *st;
+	ssize_t len = 0;
+	unsigned int i, j;
+
+	len += sprintf(buf + len, "   From  :    To\n         :");
+	for (j = 0; j < levels; j++)
+		len += sprintf(buf + len, " %16u", freq[j]);
+	len += sprintf(buf + len, "\n");
+
+	for (i = 0; i < levels; i++) {
+		len += sprintf(buf + len, "%9u:", freq[i]);
+		for (j = 0; j < levels; j++) {
+			st = &stat[i * stride + j];
+			len += sprintf(buf + len, " %6u/%4u/%4u", st->count,
+				st->count ? (unsigned int)div_u64(st->total_us,
+							st->count) : 0,
+				st->max_us);
+		}
+		len += sprintf(buf + len, "\n");
+	}
+
+	return len;
+}
+
+static ssize_t show_bus_trans_table(struct device *dev,
+				struct device_attribute *attr,
+				char *buf)
+{
+	unsigned int freq[BUSFREQ_LEVEL_END];
+	ssize_t len;
+	int i;
+
+	for (i = 0; i < BUSFREQ_LEVEL_END; i++)
+		freq[i] = s5pv310_busfreq_table[i].mem_clk;
+
+	mutex_lock(&set_bus_freq_change);
+	len = show_dvfs_trans_table(buf, &busfreq_trans_stat[0][0],
+				    BUSFREQ_LEVEL_END, freq, BUSFREQ_LEVEL_END);
+	mutex_unlock(&set_bus_freq_change);
+
+	return len;
+}
+
+static DEVICE_ATTR(bus_trans_table, 0444, show_bus_trans_table, NULL);
+
+static ssize_t show_cpu_trans_table(struct device *dev,
+				struct device_attribute *attr,
+				char *buf)
+{
+	unsigned int freq[CPUFREQ_LEVEL_END];
+	ssize_t len;
+	int i;
+
+	/* only the levels this chip uses */
+	for (i = 0; i < CPUFREQ_LEVEL_END; i++) {
+		if (cpufreq_freq_table[i].frequency == CPUFREQ_TABLE_END)
+			break;
+		freq[i] = cpufreq_freq_table[i].frequency;
+	}
+
+	cpufreq_change_lock();
+	len = show_dvfs_trans_table(buf, &cpufreq_trans_stat[0][0],
+				    CPUFREQ_LEVEL_END, freq, i);
+	cpufreq_change_unlock();
+
+	return len;
+}
+
+static DEVICE_ATTR(cpu_trans_table, 0444, show_cpu_trans_table, NULL);
+
 static ssize_t show_up_threshold(struct device *dev,
 				struct device_attribute *attr,
 				char *buf)
@@ -2225,6 +3055,106 @@ static ssize_t store_up_threshold(struct device *dev,
 static DEVICE_ATTR(up_threshold, 0644, show_up_threshold, store_up_threshold);
 #endif
 
+#ifdef CONFIG_S5PV310_AVS
+static ssize_t show_avs_table(struct device *dev,
+				struct device_attribute *attr,
+				char *buf)
+{
+	ssize_t len = 0;
+	unsigned int i;
+
+	mutex_lock(&avs_lock);
+	len += sprintf(buf + len, "faults: %u\n", avs_faults);
+	len += sprintf(buf + len, "   freq   table  trim ref fault\n");
+	for (i = 0; i < avs_arm_levels; i++)
+		len += sprintf(buf + len, "%7u %7u %5u %3u %u\n",
+			cpufreq_freq_table[i].frequency, avs_arm[i].table_volt,
+			avs_arm[i].trim, avs_arm[i].ref_code, avs_arm[i].fault);
+	for (i = 0; i < BUSFREQ_LEVEL_END; i++)
+		len += sprintf(buf + len, "int%u    %7u %5u\n", i,
+			avs_int[i].table_volt, avs_int[i].trim);
+	mutex_unlock(&avs_lock);
+
+	return len;
+}
+
+static DEVICE_ATTR(avs_table, 0444, show_avs_table, NULL);
+
+static ssize_t show_avs_enable(struct device *dev,
+				struct device_attribute *attr,
+				char *buf)
+{
+	return sprintf(buf, "%u\n", avs_enable);
+}
+
+static ssize_t store_avs_enable(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf,
+				size_t count)
+{
+	unsigned int val;
+
+	if (sscanf(buf, "%u", &val) != 1)
+		return -EINVAL;
+
+	mutex_lock(&avs_lock);
+	avs_enable = !!val;
+	if (!avs_enable)
+		avs_restore();
+	mutex_unlock(&avs_lock);
+
+	return count;
+}
+
+static DEVICE_ATTR(avs_enable, 0644, show_avs_enable, store_avs_enable);
+
+#define avs_tunable(_name, _max)					\
+static ssize_t show_##_name(struct device *dev,				\
+				struct device_attribute *attr,		\
+				char *buf)				\
+{									\
+	return sprintf(buf, "%u\n", _name);				\
+}									\
+									\
+static ssize_t store_##_name(struct device *dev,			\
+				struct device_attribute *attr,		\
+				const char *buf,			\
+				size_t count)				\
+{									\
+	unsigned int val;						\
+									\
+	if (sscanf(buf, "%u", &val) != 1 || val > (_max))		\
+		return -EINVAL;						\
+									\
+	mutex_lock(&avs_lock);						\
+	_name = val;							\
+	avs_restore();							\
+	mutex_unlock(&avs_lock);					\
+									\
+	return count;							\
+}									\
+									\
+static DEVICE_ATTR(_name, 0644, show_##_name, store_##_name)
+
+/* a new margin or bound restarts the search from the table voltages */
+avs_tunable(avs_margin_code, 16);
+avs_tunable(avs_arm_max_trim, 100000);
+avs_tunable(avs_int_max_trim, 50000);
+
+static struct attribute *avs_attrs[] = {
+	&dev_attr_avs_table.attr,
+	&dev_attr_avs_enable.attr,
+	&dev_attr_avs_margin_code.attr,
+	&dev_attr_avs_arm_max_trim.attr,
+	&dev_attr_avs_int_max_trim.attr,
+	NULL,
+};
+
+static struct attribute_group avs_attr_group = {
+	.attrs = avs_attrs,
+};
+#endif /* CONFIG_S5PV310_AVS */
+
 static int sysfs_busfreq_create(struct device *dev)
 {
 	int ret;
@@ -2241,6 +3171,14 @@ static int sysfs_busfreq_create(struct device *dev)
 	if (ret)
 		goto cur_busfreq_err;
 
+	ret = device_create_file(dev, &dev_attr_sampling_rate);
+	if (ret)
+		goto sampling_rate_err;
+
+	ret = device_create_file(dev, &dev_attr_down_hold);
+	if (ret)
+		goto down_hold_err;
+
 #ifdef SYSFS_DEBUG_BUSFREQ
 	ret = device_create_file(dev, &dev_attr_up_threshold);
 	if (ret)
@@ -2250,15 +3188,37 @@ static int sysfs_busfreq_create(struct device *dev)
 	if (ret)
 		goto time_in_state_err;
 
+	ret = device_create_file(dev, &dev_attr_trans_stat);
+	if (ret)
+		goto trans_stat_err;
+
+	ret = device_create_file(dev, &dev_attr_bus_trans_table);
+	if (ret)
+		goto bus_trans_table_err;
+
+	ret = device_create_file(dev, &dev_attr_cpu_trans_table);
+	if (ret)
+		goto cpu_trans_table_err;
+
 	return ret;
 
+cpu_trans_table_err:
+	device_remove_file(dev, &dev_attr_bus_trans_table);
+bus_trans_table_err:
+	device_remove_file(dev, &dev_attr_trans_stat);
+trans_stat_err:
+	device_remove_file(dev, &dev_attr_time_in_state);
 time_in_state_err:
 	device_remove_file(dev, &dev_attr_up_threshold);
 up_threshold_err:
-	device_remove_file(dev, &dev_attr_cur_busfreq);
+	device_remove_file(dev, &dev_attr_down_hold);
 #else
 	return ret;
 #endif
+down_hold_err:
+	device_remove_file(dev, &dev_attr_sampling_rate);
+sampling_rate_err:
+	device_remove_file(dev, &dev_attr_cur_busfreq);
 cur_busfreq_err:
 	device_remove_file(dev, &dev_attr_fix_busfreq_level);
 busfreq_level_err:
@@ -2288,6 +3248,12 @@ static int __init s5pv310_busfreq_device_init(void)
 		goto sysfs_err;
 	}
 
+#ifdef CONFIG_S5PV310_AVS
+	if (sysfs_create_group(&s5pv310_busfreq_device.dev.kobj,
+			       &avs_attr_group))
+		printk(KERN_ERR "failed at(%d)\n", __LINE__);
+#endif
+
 	printk(KERN_INFO "s5pv310_busfreq_device_init: %d\n", ret);
 
 	return ret;
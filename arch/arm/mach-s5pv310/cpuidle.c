@@ -16,6 +16,12 @@
 #include <linux/gpio.h>
 #include <linux/delay.h>
 #include <linux/dma-mapping.h>
+#include <linux/cpu.h>
+#include <linux/sysdev.h>
+#include <linux/hrtimer.h>
+#include <linux/tick.h>
+#include <linux/ktime.h>
+#include <linux/percpu.h>
 
 #include <asm/proc-fns.h>
 #include <asm/cacheflush.h>
@@ -34,12 +40,17 @@
 #include <plat/devs.h>
 
 #include <mach/ext-gic.h>
+#include <mach/cpuidle.h>
 
 /* enable AFTR/LPA feature */
 static enum { ENABLE_IDLE = 0, ENABLE_AFTR = 1, ENABLE_LPA = 2 } enable_mask =
 	ENABLE_IDLE | ENABLE_AFTR | ENABLE_LPA;
 module_param_named(enable_mask, enable_mask, uint, 0644);
 
+/* demote AFTR/LPA to IDLE when the idle is predicted to be short */
+static unsigned int predict = 1;
+module_param_named(predict, predict, uint, 0644);
+
 static unsigned long *regs_save;
 static dma_addr_t phy_regs_save;
 
@@ -67,18 +78,12 @@ static int check_usbotg_op(void);
 #ifdef CONFIG_USB_EHCI_HCD
 static int check_usb_host_op(void);
 #endif
-#ifdef CONFIG_RFKILL
-static int check_bt_op(void);
-#endif
 #ifdef CONFIG_SND_S5P_RP
 static int check_audio_rp_op(void);
 #endif
 #ifdef CONFIG_MTD_ONENAND
 static int check_onenand_op(void);
 #endif
-#ifdef CONFIG_MACH_C1
-static int check_gps_uart_op(void);
-#endif /* CONFIG_MACH_C1 */
 #ifdef CONFIG_SAMSUNG_LTE
 static int check_idpram_op(void);
 #endif
@@ -103,18 +108,12 @@ struct check_device_op chk_device_op[] = {
 	{.name = "clockgating",	.check_operation = check_clock_gating},
 	{.name = "mmc",		.check_operation = loop_sdmmc_check},
 	{.name = "usb device",	.check_operation = check_usbotg_op},
-#ifdef CONFIG_RFKILL
-	{.name = "bluetooth",	.check_operation = check_bt_op},
-#endif
 #ifdef CONFIG_SND_S5P_RP
 	{.name = "audio rp",	.check_operation = check_audio_rp_op},
 #endif
 #ifdef CONFIG_MTD_ONENAND
 	{.name = "onenand",	.check_operation = check_onenand_op},
 #endif
-#ifdef CONFIG_MACH_C1
-	{.name = "gps uart",	.check_operation = check_gps_uart_op},
-#endif /* CONFIG_MACH_C1 */
 #ifdef CONFIG_SAMSUNG_LTE
 	{.name = "idpram",	.check_operation = check_idpram_op},
 #endif
@@ -125,6 +124,131 @@ struct check_device_op chk_device_op[] = {
 	{.name = "",		.check_operation = NULL},
 };
 
+/*
+ * Devices whose drivers know when they are busy hold a blocker instead
+ * of being polled above, so the check at idle entry is a single read.
+ */
+static LIST_HEAD(idle_blocker_list);
+static DEFINE_SPINLOCK(idle_blocker_lock);
+static unsigned int idle_blocked;	/* blockers with a nonzero count */
+
+void s5pv310_idle_block(struct s5pv310_idle_blocker *blocker)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&idle_blocker_lock, flags);
+	if (list_empty(&blocker->list))
+		list_add_tail(&blocker->list, &idle_blocker_list);
+	if (blocker->count++ == 0) {
+		blocker->nr_blocked++;
+		idle_blocked++;
+	}
+	spin_unlock_irqrestore(&idle_blocker_lock, flags);
+}
+EXPORT_SYMBOL(s5pv310_idle_block);
+
+void s5pv310_idle_unblock(struct s5pv310_idle_blocker *blocker)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&idle_blocker_lock, flags);
+	if (WARN_ON(!blocker->count))
+		goto out;
+	if (--blocker->count == 0)
+		idle_blocked--;
+out:
+	spin_unlock_irqrestore(&idle_blocker_lock, flags);
+}
+EXPORT_SYMBOL(s5pv310_idle_unblock);
+
+/* Modes actually entered; LOW_POWER falls back to AFTR */
+enum idle_mode {
+	IDLE_MODE_IDLE,
+	IDLE_MODE_AFTR,
+	IDLE_MODE_LPA,
+	IDLE_MODE_END,
+};
+
+static const char *idle_mode_name[IDLE_MODE_END] = {
+	"idle", "aftr", "lpa",
+};
+
+/* log2 buckets in us: 0, 1, 2-3, 4-7, ... 16384 and up */
+#define LAT_HIST_BUCKETS	16
+
+struct idle_mode_stats {
+	unsigned int count;
+	unsigned int demoted;		/* predicted too short */
+	unsigned int entry[LAT_HIST_BUCKETS];
+	unsigned int exit[LAT_HIST_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct idle_mode_stats, idle_stats[IDLE_MODE_END]);
+
+/* Recent idle lengths of cpu0, the only cpu with deep states */
+#define IDLE_HISTORY		8
+static unsigned int idle_history[IDLE_HISTORY];
+static unsigned int idle_history_idx;
+
+static inline unsigned int lat_hist_bucket(s64 us)
+{
+	if (us <= 0)
+		return 0;
+	return min_t(unsigned int, fls((unsigned int)min_t(s64, us, INT_MAX)),
+		     LAT_HIST_BUCKETS - 1);
+}
+
+/*
+ * @before: idle entry, @lowpwr: just before the core stops,
+ * @wakeup: back from the low power mode, @after: idle exit.
+ */
+static void s5pv310_idle_account(enum idle_mode mode, ktime_t before,
+				 ktime_t lowpwr, ktime_t wakeup, ktime_t after)
+{
+	struct idle_mode_stats *st = &__get_cpu_var(idle_stats)[mode];
+
+	st->count++;
+	st->entry[lat_hist_bucket(ktime_us_delta(lowpwr, before))]++;
+	st->exit[lat_hist_bucket(ktime_us_delta(after, wakeup))]++;
+
+	if (smp_processor_id() == 0) {
+		idle_history[idle_history_idx] =
+			(unsigned int)ktime_us_delta(after, before);
+		idle_history_idx = (idle_history_idx + 1) % IDLE_HISTORY;
+	}
+}
+
+/*
+ * Predict the idle length from the next timer event, and from the
+ * recent idles when those have been shorter: an interrupt driven
+ * wakeup pattern is not visible in the timer. AFTR and LPA save and
+ * restore much more than IDLE, so they are only worth their target
+ * residency.
+ */
+static s64 s5pv310_idle_predict(void)
+{
+	unsigned int i, avg = 0;
+	s64 predicted;
+
+	if (!predict)
+		return LLONG_MAX;
+
+	predicted = ktime_to_us(tick_nohz_get_sleep_length());
+
+	for (i = 0; i < IDLE_HISTORY; i++)
+		avg += idle_history[i] / IDLE_HISTORY;
+
+	if (avg < predicted)
+		predicted = avg;
+
+	return predicted;
+}
+
+static bool s5pv310_idle_too_short(struct cpuidle_state *state)
+{
+	return s5pv310_idle_predict() < state->target_residency;
+}
+
 enum hc_type {
 	HC_SDHC,
 	HC_MSHC,
@@ -504,15 +628,15 @@ static void s5pv310_set_wakeupmask(void)
 static int s5pv310_enter_core0_aftr(struct cpuidle_device *dev,
 				    struct cpuidle_state *state)
 {
-	struct timeval before, after;
-	int idle_time;
+	ktime_t before, lowpwr, wakeup, after;
 	unsigned long tmp;
+	int ret;
 
 
 	s3c_sleep_save_phys = phy_regs_save;
 
 	local_irq_disable();
-	do_gettimeofday(&before);
+	before = ktime_get();
 
 	s5pv310_set_wakeupmask();
 
@@ -525,7 +649,10 @@ static int s5pv310_enter_core0_aftr(struct cpuidle_device *dev,
 	s3c_pm_do_restore(s5pv310_aftr, ARRAY_SIZE(s5pv310_aftr));
 
 	__raw_writel(S5P_CHECK_DIDLE, S5P_INFORM1);
-	if (s3c_cpu_save(regs_save) == 0) {
+	lowpwr = ktime_get();
+	ret = s3c_cpu_save(regs_save);
+	wakeup = ktime_get();
+	if (ret == 0) {
 		/*
 		 * Clear Central Sequence Register in exiting early wakeup
 		 */
@@ -551,13 +678,12 @@ early_wakeup:
 	/* Clear wakeup state register */
 	__raw_writel(0x0, S5P_WAKEUP_STAT);
 
-	do_gettimeofday(&after);
+	after = ktime_get();
+	s5pv310_idle_account(IDLE_MODE_AFTR, before, lowpwr, wakeup, after);
 
 	local_irq_enable();
-	idle_time = (after.tv_sec - before.tv_sec) * USEC_PER_SEC +
-		    (after.tv_usec - before.tv_usec);
 
-	return idle_time;
+	return (int)ktime_us_delta(after, before);
 }
 
 extern void bt_uart_rts_ctrl(int flag);
@@ -565,9 +691,9 @@ extern void bt_uart_rts_ctrl(int flag);
 static int s5pv310_enter_core0_lpa(struct cpuidle_device *dev,
 				   struct cpuidle_state *state)
 {
-	struct timeval before, after;
-	int idle_time;
+	ktime_t before, lowpwr, wakeup, after;
 	unsigned long tmp;
+	int ret;
 
 	pr_info("++%s\n", __func__);
 
@@ -590,7 +716,7 @@ static int s5pv310_enter_core0_lpa(struct cpuidle_device *dev,
 #ifdef CONFIG_SAMSUNG_LTE
 	gpio_set_value(GPIO_PDA_ACTIVE, 0);
 #endif
-	do_gettimeofday(&before);
+	before = ktime_get();
 
 	/*
 	 * Unmasking all wakeup source.
@@ -611,7 +737,10 @@ static int s5pv310_enter_core0_lpa(struct cpuidle_device *dev,
 
 	__raw_writel(0xfcba0d10, S5P_VA_SYSRAM + 0x20);
 
-	if (s3c_cpu_save(regs_save) == 0) {
+	lowpwr = ktime_get();
+	ret = s3c_cpu_save(regs_save);
+	wakeup = ktime_get();
+	if (ret == 0) {
 
 		tmp = __raw_readl(S5P_CENTRAL_SEQ_CONFIGURATION);
 		tmp |= (S5P_CENTRAL_LOWPWR_CFG);
@@ -649,15 +778,14 @@ early_wakeup:
 
 	__raw_writel(0x0, S5P_WAKEUP_MASK);
 
-	do_gettimeofday(&after);
+	after = ktime_get();
+	s5pv310_idle_account(IDLE_MODE_LPA, before, lowpwr, wakeup, after);
 
 #ifdef CONFIG_SAMSUNG_LTE
 	gpio_set_value(GPIO_PDA_ACTIVE, 1);
 #endif
 
 	local_irq_enable();
-	idle_time = (after.tv_sec - before.tv_sec) * USEC_PER_SEC +
-		    (after.tv_usec - before.tv_usec);
 
 #ifdef CONFIG_RFKILL
 	/* BT-UART RTS Control (RTS Low) */
@@ -665,20 +793,19 @@ early_wakeup:
 #endif
 
 	pr_info("--%s\n", __func__);
-	return idle_time;
+	return (int)ktime_us_delta(after, before);
 }
 
 static int s5pv310_enter_idle(struct cpuidle_device *dev,
 			      struct cpuidle_state *state)
 {
-	struct timeval before, after;
-	int idle_time;
+	ktime_t before, lowpwr, wakeup, after;
 	int cpu;
 	unsigned long flags;
 	unsigned int tmp, nr_cores;
 
 	local_irq_disable();
-	do_gettimeofday(&before);
+	before = ktime_get();
 
 	cpu = get_cpu();
 
@@ -702,7 +829,9 @@ static int s5pv310_enter_idle(struct cpuidle_device *dev,
 	}
 	spin_unlock_irqrestore(&idle_lock, flags);
 
+	lowpwr = ktime_get();
 	cpu_do_idle();
+	wakeup = ktime_get();
 
 	spin_lock_irqsave(&idle_lock, flags);
 
@@ -716,14 +845,14 @@ static int s5pv310_enter_idle(struct cpuidle_device *dev,
 	cpu_core &= ~(1 << cpu);
 	spin_unlock_irqrestore(&idle_lock, flags);
 
+	after = ktime_get();
+	s5pv310_idle_account(IDLE_MODE_IDLE, before, lowpwr, wakeup, after);
+
 	put_cpu();
 
-	do_gettimeofday(&after);
 	local_irq_enable();
-	idle_time = (after.tv_sec - before.tv_sec) * USEC_PER_SEC +
-		    (after.tv_usec - before.tv_usec);
 
-	return idle_time;
+	return (int)ktime_us_delta(after, before);
 }
 
 static int check_power_domain(void)
@@ -804,18 +933,6 @@ static int check_onenand_op(void)
 }
 #endif
 
-#ifdef CONFIG_MACH_C1
-static int check_gps_uart_op(void)
-{
-	extern int gps_is_running;
-
-	if (gps_is_running)
-		return IS_OP;
-
-	return NO_OP;
-}
-#endif /* CONFIG_MACH_C1 */
-
 #ifdef CONFIG_SAMSUNG_LTE
 static int check_idpram_op(void)
 {
@@ -929,18 +1046,6 @@ static int check_audio_rp_op(void)
 }
 #endif
 
-#ifdef CONFIG_RFKILL
-static int check_bt_op(void)
-{
-	extern int bt_is_running;
-
-	if (bt_is_running)
-		return IS_OP;
-
-	return NO_OP;
-}
-#endif
-
 static void check_uart_op(void)
 {
 	unsigned int check_val = 0;
@@ -966,6 +1071,9 @@ static int s5pv310_check_operation(void)
 {
 	int i;
 
+	if (idle_blocked)
+		return IS_OP;
+
 	for (i = 0; i < chk_dev_num; i++) {
 		if (chk_device_op[i].check_operation == NULL)
 			break;
@@ -993,13 +1101,24 @@ static int s5pv310_enter_lowpower(struct cpuidle_device *dev,
 			& S5P_CORE_LOCAL_PWR_EN) == S5P_CORE_LOCAL_PWR_EN) {
 		BUG_ON(!dev->safe_state);
 		new_state = dev->safe_state;
+	} else {
+		s64 predicted = s5pv310_idle_predict();
+
+		/* too short for LPA may still be worth AFTR */
+		if (predicted < state->target_residency) {
+			__get_cpu_var(idle_stats)[IDLE_MODE_LPA].demoted++;
+			if (predicted < dev->states[1].target_residency)
+				new_state = dev->safe_state;
+			else
+				new_state = &dev->states[1];
+		}
 	}
 	dev->last_state = new_state;
 
 	if (new_state == &dev->states[0])
 		return s5pv310_enter_idle(dev, new_state);
 
-	if (s5pv310_check_operation())
+	if (new_state == &dev->states[1] || s5pv310_check_operation())
 		return (enable_mask & ENABLE_AFTR)
 			? s5pv310_enter_core0_aftr(dev, new_state)
 			: s5pv310_enter_idle(dev, new_state);
@@ -1019,6 +1138,9 @@ static int s5pv310_enter_aftr(struct cpuidle_device *dev,
 			& S5P_CORE_LOCAL_PWR_EN) == S5P_CORE_LOCAL_PWR_EN) {
 		BUG_ON(!dev->safe_state);
 		new_state = dev->safe_state;
+	} else if (s5pv310_idle_too_short(state)) {
+		__get_cpu_var(idle_stats)[IDLE_MODE_AFTR].demoted++;
+		new_state = dev->safe_state;
 	}
 	dev->last_state = new_state;
 
@@ -1030,6 +1152,75 @@ static int s5pv310_enter_aftr(struct cpuidle_device *dev,
 		: s5pv310_enter_idle(dev, new_state);
 }
 
+static ssize_t show_idle_latency(enum idle_mode mode, char *buf)
+{
+	struct idle_mode_stats *st;
+	ssize_t len = 0;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		st = &per_cpu(idle_stats, cpu)[mode];
+		len += sprintf(buf + len, "cpu%d %s count %u demoted %u\n",
+			       cpu, idle_mode_name[mode], st->count,
+			       st->demoted);
+		len += sprintf(buf + len, "entry");
+		for (i = 0; i < LAT_HIST_BUCKETS; i++)
+			len += sprintf(buf + len, " %u", st->entry[i]);
+		len += sprintf(buf + len, "\nexit ");
+		for (i = 0; i < LAT_HIST_BUCKETS; i++)
+			len += sprintf(buf + len, " %u", st->exit[i]);
+		len += sprintf(buf + len, "\n");
+	}
+
+	return len;
+}
+
+#define show_one_mode(_name, _mode)					\
+static ssize_t show_##_name(struct sysdev_class *class,		\
+			    struct sysdev_class_attribute *attr,	\
+			    char *buf)					\
+{									\
+	return show_idle_latency(_mode, buf);				\
+}									\
+static SYSDEV_CLASS_ATTR(_name, 0444, show_##_name, NULL)
+
+show_one_mode(idle_latency, IDLE_MODE_IDLE);
+show_one_mode(aftr_latency, IDLE_MODE_AFTR);
+show_one_mode(lpa_latency, IDLE_MODE_LPA);
+
+static ssize_t show_blockers(struct sysdev_class *class,
+			     struct sysdev_class_attribute *attr, char *buf)
+{
+	struct s5pv310_idle_blocker *blocker;
+	unsigned long flags;
+	ssize_t len = 0;
+
+	spin_lock_irqsave(&idle_blocker_lock, flags);
+	list_for_each_entry(blocker, &idle_blocker_list, list) {
+		if (len >= PAGE_SIZE - 64)
+			break;
+		len += sprintf(buf + len, "%-16s %u %lu\n", blocker->name,
+			       blocker->count, blocker->nr_blocked);
+	}
+	spin_unlock_irqrestore(&idle_blocker_lock, flags);
+
+	return len;
+}
+static SYSDEV_CLASS_ATTR(blockers, 0444, show_blockers, NULL);
+
+static struct attribute *s5pv310_idle_attrs[] = {
+	&attr_idle_latency.attr,
+	&attr_aftr_latency.attr,
+	&attr_lpa_latency.attr,
+	&attr_blockers.attr,
+	NULL,
+};
+
+static struct attribute_group s5pv310_idle_attr_group = {
+	.attrs = s5pv310_idle_attrs,
+	.name = "s5pv310_idle",
+};
+
 static int s5pv310_init_cpuidle(void)
 {
 	int i, max_cpuidle_state, cpu_id, ret;
@@ -1119,6 +1310,11 @@ static int s5pv310_init_cpuidle(void)
 	}
 #endif
 
+	if (sysfs_create_group(&cpu_sysdev_class.kset.kobj,
+			       &s5pv310_idle_attr_group))
+		printk(KERN_ERR "%s: failed to create sysfs group\n",
+				__func__);
+
 	return 0;
 
 err_alloc:
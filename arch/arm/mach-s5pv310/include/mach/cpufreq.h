@@ -50,6 +50,11 @@ enum cpufreq_lock_ID{
 #define CPUFREQ_500MHZ   500000
 #define CPUFREQ_200MHZ   200000
 
+/* Memory clock per BUS level, for PM_QOS_BUS_FREQ_MIN requests */
+#define BUSFREQ_400MHZ	400000
+#define BUSFREQ_267MHZ	267000
+#define BUSFREQ_160MHZ	160000
+
 /*
  * struct s5pv310_cpufreq table - has information as follows.
  *
@@ -94,9 +99,7 @@ struct s5pv310_cpufreq_info {
 
 /* Structure for keeping frequency locking information */
 struct freq_lock_info {
-	unsigned int dev_id;
 	unsigned int level;
-	unsigned int value[DVFS_LOCK_ID_END];
 	unsigned int min_level;
 	unsigned int max_level;
 	bool disable_lock;
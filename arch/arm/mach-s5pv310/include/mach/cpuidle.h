@@ -0,0 +1,49 @@
+/* linux/arch/arm/mach-s5pv310/include/mach/cpuidle.h
+ *
+ * Copyright (c) 2010 Samsung Electronics Co., Ltd.
+ *		http://www.samsung.com
+ *
+ * S5PV310 - CPU idle deep-idle blockers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+*/
+
+#ifndef __ASM_ARCH_CPUIDLE_H
+#define __ASM_ARCH_CPUIDLE_H __FILE__
+
+#include <linux/list.h>
+
+/*
+ * A driver that must not lose its clocks or pads to LPA holds its
+ * blocker while it is busy. Blocks nest; LPA is allowed again when
+ * every blocker is back at zero. Both calls may be used from
+ * interrupt context.
+ */
+struct s5pv310_idle_blocker {
+	const char		*name;
+	unsigned int		count;
+	unsigned long		nr_blocked;	/* times taken from zero */
+	struct list_head	list;
+};
+
+#define DEFINE_S5PV310_IDLE_BLOCKER(_var, _name)			\
+	struct s5pv310_idle_blocker _var = {				\
+		.name	= _name,					\
+		.list	= LIST_HEAD_INIT(_var.list),			\
+	}
+
+#ifdef CONFIG_CPU_IDLE
+extern void s5pv310_idle_block(struct s5pv310_idle_blocker *blocker);
+extern void s5pv310_idle_unblock(struct s5pv310_idle_blocker *blocker);
+#else
+static inline void s5pv310_idle_block(struct s5pv310_idle_blocker *blocker)
+{
+}
+static inline void s5pv310_idle_unblock(struct s5pv310_idle_blocker *blocker)
+{
+}
+#endif
+
+#endif /* __ASM_ARCH_CPUIDLE_H */
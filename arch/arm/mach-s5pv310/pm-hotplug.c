@@ -26,6 +26,7 @@
 #include <linux/sched.h>
 #include <linux/suspend.h>
 #include <linux/reboot.h>
+#include <linux/clk.h>
 
 #include <plat/map-base.h>
 #include <plat/gpio-cfg.h>
@@ -37,10 +38,26 @@
 #include <linux/gpio.h>
 #include <linux/cpufreq.h>
 
-#define CHECK_DELAY	(.5*HZ)
+#define CREATE_TRACE_POINTS
+#include <trace/events/pm_hotplug.h>
+
+#define CHECK_DELAY	(HZ / 10)
 #define TRANS_LOAD_L	20
 #define TRANS_LOAD_H	(TRANS_LOAD_L*3)
 
+/* Average run-queue depth, in hundredths of a task */
+#define TRANS_RQ_L	150
+#define TRANS_RQ_H	200
+
+/*
+ * Decisions are made on the average of the last up_hold (down_hold)
+ * samples out of a short history, so a burst brings cpu1 up quickly
+ * while it only goes down after a longer quiet period.
+ */
+#define HISTORY_SIZE	10
+#define UP_HOLD		2
+#define DOWN_HOLD	10
+
 #define HOTPLUG_UNLOCKED 0
 #define HOTPLUG_LOCKED 1
 #define LOWLEVEL_FREQ	200 * 1000
@@ -53,6 +70,9 @@
 
 static struct workqueue_struct *hotplug_wq;
 
+/* for the frequency while cpufreq has none to give */
+static struct clk *hotplug_arm_clk;
+
 static struct delayed_work hotplug_work;
 
 static unsigned int hotpluging_rate = CHECK_DELAY;
@@ -63,6 +83,36 @@ static unsigned int trans_load_l = TRANS_LOAD_L;
 module_param_named(loadl, trans_load_l, uint, 0644);
 static unsigned int trans_load_h = TRANS_LOAD_H;
 module_param_named(loadh, trans_load_h, uint, 0644);
+static unsigned int trans_rq_l = TRANS_RQ_L;
+module_param_named(rql, trans_rq_l, uint, 0644);
+static unsigned int trans_rq_h = TRANS_RQ_H;
+module_param_named(rqh, trans_rq_h, uint, 0644);
+static unsigned int up_hold = UP_HOLD;
+module_param_named(up_hold, up_hold, uint, 0644);
+static unsigned int down_hold = DOWN_HOLD;
+module_param_named(down_hold, down_hold, uint, 0644);
+static unsigned int up_on_max = 1;
+module_param_named(up_on_max, up_on_max, uint, 0644);
+
+enum hotplug_action {
+	HOTPLUG_NONE,
+	HOTPLUG_UP,
+	HOTPLUG_DOWN,
+	HOTPLUG_BOOST,
+};
+
+struct hotplug_sample {
+	unsigned int load;	/* average load of online cpus, in % */
+	unsigned int nr_run;	/* runnable tasks, in hundredths */
+};
+
+static struct hotplug_sample hotplug_history[HISTORY_SIZE];
+static unsigned int history_idx;	/* next slot to write */
+static unsigned int history_cnt;
+
+/* set from the cpufreq transition notifier */
+static unsigned int hotplug_boost;
+static unsigned int boost_freq;
 
 struct cpu_time_info {
 	cputime64_t prev_cpu_idle;
@@ -76,13 +126,42 @@ static DEFINE_PER_CPU(struct cpu_time_info, hotplug_cpu_time);
    timer(softirq) context but in process context */
 static DEFINE_MUTEX(hotplug_lock);
 
+/* Average of the last @n samples, false until there are that many */
+static bool hotplug_history_avg(unsigned int n, unsigned int *load,
+				unsigned int *nr_run)
+{
+	unsigned int i, idx = history_idx;
+	unsigned int sum_load = 0, sum_nr_run = 0;
+
+	n = clamp_t(unsigned int, n, 1, HISTORY_SIZE);
+	if (history_cnt < n)
+		return false;
+
+	for (i = 0; i < n; i++) {
+		idx = (idx + HISTORY_SIZE - 1) % HISTORY_SIZE;
+		sum_load += hotplug_history[idx].load;
+		sum_nr_run += hotplug_history[idx].nr_run;
+	}
+
+	*load = sum_load / n;
+	*nr_run = sum_nr_run / n;
+
+	return true;
+}
+
 static void hotplug_timer(struct work_struct *work)
 {
-	unsigned int i, avg_load = 0, load = 0;
-	unsigned int cur_freq;
+	unsigned int i, avg_load = 0, load = 0, nr_run;
+	unsigned int win_load, win_nr_run;
+	unsigned int cur_freq, boost;
+	bool freq_low;
+	enum hotplug_action action = HOTPLUG_NONE;
 
 	mutex_lock(&hotplug_lock);
 
+	boost = hotplug_boost;
+	hotplug_boost = 0;
+
 	if (user_lock == 1)
 		goto no_hotplug;
 
@@ -113,21 +192,58 @@ static void hotplug_timer(struct work_struct *work)
 
 	avg_load = load / num_online_cpus();
 
-	cur_freq = clk_get_rate(clk_get(NULL, "armclk"))/ 1000;
+	/* This worker is runnable itself, do not count it */
+	nr_run = (nr_running() - 1) * 100;
+
+	hotplug_history[history_idx].load = avg_load;
+	hotplug_history[history_idx].nr_run = nr_run;
+	history_idx = (history_idx + 1) % HISTORY_SIZE;
+	if (history_cnt < HISTORY_SIZE)
+		history_cnt++;
+
+	cur_freq = cpufreq_quick_get(0);
+	if (!cur_freq && hotplug_arm_clk)
+		cur_freq = clk_get_rate(hotplug_arm_clk) / 1000;
+	/* an unknown frequency does not count as low */
+	freq_low = cur_freq && (cur_freq <= LOWLEVEL_FREQ);
+
+	if (cpu_online(1) == 0) {
+		if (boost)
+			action = HOTPLUG_BOOST;
+		else if (!freq_low &&
+			 hotplug_history_avg(up_hold, &win_load, &win_nr_run) &&
+			 ((win_load > trans_load_h) ||
+			  (win_nr_run >= trans_rq_h)))
+			action = HOTPLUG_UP;
+	} else {
+		if (freq_low ||
+		    (hotplug_history_avg(down_hold, &win_load, &win_nr_run) &&
+		     (win_load < trans_load_l) && (win_nr_run < trans_rq_l)))
+			action = HOTPLUG_DOWN;
+	}
 
-	if (((avg_load < trans_load_l) || (cur_freq <= LOWLEVEL_FREQ)) &&
-	    (cpu_online(1) == 1)) {
-		DBG_PRINT("cpu1 turning off!\n");
-		cpu_down(1);
-		DBG_PRINT("cpu1 off end!\n");
-		hotpluging_rate = CHECK_DELAY;
-	} else if (((avg_load > trans_load_h) && (cur_freq > LOWLEVEL_FREQ)) &&
-		   (cpu_online(1) == 0)) {
+	trace_pm_hotplug_decision(avg_load, nr_run, cur_freq, action);
+
+	switch (action) {
+	case HOTPLUG_UP:
+	case HOTPLUG_BOOST:
 		DBG_PRINT("cpu1 turning on!\n");
 		cpu_up(1);
 		DBG_PRINT("cpu1 on end!\n");
-		hotpluging_rate = CHECK_DELAY * 4;
+		break;
+	case HOTPLUG_DOWN:
+		DBG_PRINT("cpu1 turning off!\n");
+		cpu_down(1);
+		DBG_PRINT("cpu1 off end!\n");
+		break;
+	default:
+		break;
 	}
+
+	/* Per-cpu load is not comparable across a change of online cpus */
+	if (action != HOTPLUG_NONE)
+		history_cnt = 0;
+
  no_hotplug:
 
 	queue_delayed_work_on(0, hotplug_wq, &hotplug_work, hotpluging_rate);
@@ -135,6 +251,49 @@ static void hotplug_timer(struct work_struct *work)
 	mutex_unlock(&hotplug_lock);
 }
 
+/*
+ * The governor jumping to the policy maximum, on a load burst or an
+ * input boost, brings cpu1 up without waiting for the load history.
+ */
+static int hotplug_cpufreq_transition(struct notifier_block *nb,
+				      unsigned long val, void *data)
+{
+	struct cpufreq_freqs *freqs = data;
+
+	if (val != CPUFREQ_POSTCHANGE || freqs->cpu != 0)
+		return NOTIFY_DONE;
+
+	if (!up_on_max || !boost_freq || cpu_online(1))
+		return NOTIFY_DONE;
+
+	if ((freqs->new > freqs->old) && (freqs->new >= boost_freq)) {
+		hotplug_boost = 1;
+		if (cancel_delayed_work(&hotplug_work))
+			queue_delayed_work_on(0, hotplug_wq, &hotplug_work, 0);
+	}
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block hotplug_cpufreq_transition_notifier = {
+	.notifier_call = hotplug_cpufreq_transition,
+};
+
+static int hotplug_cpufreq_policy(struct notifier_block *nb,
+				  unsigned long val, void *data)
+{
+	struct cpufreq_policy *policy = data;
+
+	if (val == CPUFREQ_NOTIFY && policy->cpu == 0)
+		boost_freq = policy->max;
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block hotplug_cpufreq_policy_notifier = {
+	.notifier_call = hotplug_cpufreq_policy,
+};
+
 static int s5pv310_pm_hotplug_notifier_event(struct notifier_block *this,
 					     unsigned long event, void *ptr)
 {
@@ -189,12 +348,20 @@ static int __init s5pv310_pm_hotplug_init(void)
 		return -EFAULT;
 	}
 
+	hotplug_arm_clk = clk_get(NULL, "armclk");
+	if (IS_ERR(hotplug_arm_clk))
+		hotplug_arm_clk = NULL;
+
 	INIT_DELAYED_WORK_DEFERRABLE(&hotplug_work, hotplug_timer);
 
 	queue_delayed_work_on(0, hotplug_wq, &hotplug_work, 60 * HZ);
 
 	register_pm_notifier(&s5pv310_pm_hotplug_notifier);
 	register_reboot_notifier(&hotplug_reboot_notifier);
+	cpufreq_register_notifier(&hotplug_cpufreq_transition_notifier,
+				  CPUFREQ_TRANSITION_NOTIFIER);
+	cpufreq_register_notifier(&hotplug_cpufreq_policy_notifier,
+				  CPUFREQ_POLICY_NOTIFIER);
 
 	return 0;
 }
@@ -32,6 +32,7 @@
 #include <linux/init.h>
 #include <mach/gpio.h>
 #include <mach/hardware.h>
+#include <mach/cpuidle.h>
 #include <plat/gpio-cfg.h>
 #include <plat/irqs.h>
 
@@ -62,6 +63,23 @@ static struct rfkill *bt_sleep_rfk;
 volatile int bt_is_running = 0;
 EXPORT_SYMBOL(bt_is_running);
 
+/* The BT UART must keep its clock and pads while the chip is awake */
+static DEFINE_S5PV310_IDLE_BLOCKER(bt_idle_blocker, "bluetooth");
+static DEFINE_SPINLOCK(bt_running_lock);
+
+static void bt_set_running(int running)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&bt_running_lock, flags);
+	if (running && !bt_is_running)
+		s5pv310_idle_block(&bt_idle_blocker);
+	else if (!running && bt_is_running)
+		s5pv310_idle_unblock(&bt_idle_blocker);
+	bt_is_running = running;
+	spin_unlock_irqrestore(&bt_running_lock, flags);
+}
+
 extern int s3c_gpio_slp_cfgpin(unsigned int pin, unsigned int config);
 extern int s3c_gpio_slp_setpull_updown(unsigned int pin, unsigned int config);
 
@@ -194,7 +212,7 @@ static int bluetooth_set_power(void *data, enum rfkill_user_states state)
 	case RFKILL_USER_STATE_SOFT_BLOCKED:
 		pr_debug("[BT] Device Powering OFF\n");
 
-		bt_is_running = 0;
+		bt_set_running(0);
 
 		ret = disable_irq_wake(irq);
 		if (ret < 0)
@@ -238,7 +256,7 @@ irqreturn_t bt_host_wake_irq_handler(int irq, void *dev_id)
 {
 	pr_debug("[BT] bt_host_wake_irq_handler start\n");
 
-	bt_is_running = 1;
+	bt_set_running(1);
 
 	wake_lock_timeout(&rfkill_wake_lock, 5*HZ);
 
@@ -266,7 +284,7 @@ static int bluetooth_set_sleep(void *data, enum rfkill_user_states state)
 	switch (state) {
 
 		case RFKILL_USER_STATE_UNBLOCKED:
-			bt_is_running = 0;
+			bt_set_running(0);
 /* CSR8811 Project(Alan.Ko) 2011.07.02 */
 #if 0
 			gpio_set_value(GPIO_BT_WAKE, 0);
@@ -277,7 +295,7 @@ static int bluetooth_set_sleep(void *data, enum rfkill_user_states state)
 			break;
 
 		case RFKILL_USER_STATE_SOFT_BLOCKED:
-			bt_is_running = 1;
+			bt_set_running(1);
 /* CSR8811 Project(Alan.Ko) 2011.07.02 */
 #if 0
 			gpio_set_value(GPIO_BT_WAKE, 1);
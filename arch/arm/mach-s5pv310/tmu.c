@@ -25,6 +25,10 @@
 #include <linux/irq.h>
 #include <linux/gpio.h>
 #include <linux/slab.h>
+#include <linux/cpufreq.h>
+#include <linux/pm_qos_params.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/irq.h>
 
@@ -114,6 +118,67 @@ struct temperature_set {
 	unsigned int start_mem_throttle;
 };
 
+/*
+ * Power allocator mode: instead of the two fixed upper limits, a PID
+ * loop on (target - temperature) sets a continuous CPU frequency
+ * ceiling through a PM_QOS_CPU_FREQ_MAX request, and optionally bus
+ * and GPU ceilings in proportion. The state machine below still does
+ * the uevents, tripping and memory throttling. Gains are in kHz per
+ * celsius, per sample for the integral and derivative terms.
+ */
+struct tmu_pid {
+	u32 enable;
+	u32 target;		/* control temperature */
+	u32 sustainable_freq;	/* kHz expected to hold at target */
+	u32 k_po;		/* proportional, above target */
+	u32 k_pu;		/* proportional, below target */
+	u32 k_i;
+	u32 k_d;
+	u32 integral_cutoff;	/* integrate only below target + cutoff */
+	u32 cap_bus;
+	u32 cap_gpu;
+	u32 sampling_ms;
+
+	bool active;
+	int integral;
+	int prev_err;
+	unsigned int ceiling;
+	struct pm_qos_request_list cpu_req;
+	struct pm_qos_request_list bus_req;
+};
+
+#define PID_SAMPLING_MS		250
+#define PID_SUSTAINABLE_FREQ	800000
+#define PID_K_PO		100000
+#define PID_K_PU		50000
+#define PID_K_I			10000
+#define PID_K_D			100000
+#define PID_INTEGRAL_CUTOFF	2
+
+/* Mali DVFS clock range, MHz */
+#define TMU_GPU_CLK_MIN		160
+#define TMU_GPU_CLK_MAX		300
+
+#ifdef CONFIG_VIDEO_MALI400MP_DVFS
+extern void mali_dvfs_set_max_clock(unsigned int clock);
+#endif
+
+/* One sample of the debugfs "trace" log */
+struct tmu_trace_entry {
+	unsigned long time_ms;
+	unsigned int temp;
+	unsigned int freq;
+	unsigned int ceiling;	/* 0 if no ceiling applied */
+	int p;
+	int i;
+	int d;
+};
+
+#define TMU_TRACE_LEN		256
+static struct tmu_trace_entry tmu_trace[TMU_TRACE_LEN];
+static unsigned int tmu_trace_head;
+static unsigned int tmu_trace_count;
+
 static DEFINE_MUTEX(tmu_lock);
 
 struct s5p_tmu_info {
@@ -136,6 +201,8 @@ struct s5p_tmu_info {
 	unsigned int last_temperature;
 	unsigned int cpufreq_level_1st;
 	unsigned int cpufreq_level_2nd;
+	struct tmu_pid pid;
+	struct dentry *debugfs_dir;
 };
 struct s5p_tmu_info *tmu_info;
 
@@ -330,12 +397,160 @@ static int notify_change_of_tmu_state(struct s5p_tmu_info *info)
 	return kobject_uevent_env(&info->dev->kobj, KOBJ_CHANGE, envp);
 }
 
+/* Fixed upper limits; the PID loop owns the ceiling when enabled */
+static void tmu_upper_limit(struct s5p_tmu_info *info, unsigned int level)
+{
+	if (!info->pid.enable)
+		s5pv310_cpufreq_upper_limit(DVFS_LOCK_ID_TMU, level);
+}
+
+static void tmu_upper_limit_free(struct s5p_tmu_info *info)
+{
+	s5pv310_cpufreq_upper_limit_free(DVFS_LOCK_ID_TMU);
+}
+
+/* The fixed level for 1st (@second == 0) or 2nd throttling */
+static unsigned int tmu_fixed_level(struct s5p_tmu_info *info, int second)
+{
+#ifdef CONFIG_TMU_DEBUG
+	if (tmu_limit_on)
+		return second ? upper_limit_2nd : upper_limit_1st;
+#endif
+	return second ? info->cpufreq_level_2nd : info->cpufreq_level_1st;
+}
+
+static void tmu_pid_init(struct s5p_tmu_info *info)
+{
+	struct tmu_pid *pid = &info->pid;
+
+	pid->enable = 1;
+	pid->target = info->ts.stop_2nd_throttle;
+	pid->sustainable_freq = PID_SUSTAINABLE_FREQ;
+	pid->k_po = PID_K_PO;
+	pid->k_pu = PID_K_PU;
+	pid->k_i = PID_K_I;
+	pid->k_d = PID_K_D;
+	pid->integral_cutoff = PID_INTEGRAL_CUTOFF;
+	pid->sampling_ms = PID_SAMPLING_MS;
+
+	pm_qos_add_request(&pid->cpu_req, PM_QOS_CPU_FREQ_MAX,
+			   PM_QOS_DEFAULT_VALUE);
+	pm_qos_add_request(&pid->bus_req, PM_QOS_BUS_FREQ_MAX,
+			   PM_QOS_DEFAULT_VALUE);
+}
+
+static void tmu_pid_release(struct s5p_tmu_info *info)
+{
+	struct tmu_pid *pid = &info->pid;
+
+	if (!pid->active)
+		return;
+
+	pm_qos_update_request(&pid->cpu_req, PM_QOS_DEFAULT_VALUE);
+	pm_qos_update_request(&pid->bus_req, PM_QOS_DEFAULT_VALUE);
+#ifdef CONFIG_VIDEO_MALI400MP_DVFS
+	mali_dvfs_set_max_clock(TMU_GPU_CLK_MAX);
+#endif
+	pid->active = false;
+	pid->integral = 0;
+	pid->prev_err = 0;
+	pid->ceiling = 0;
+	pr_info("tmu: release frequency ceiling\n");
+}
+
+/*
+ * One step of the control loop. The ceiling is
+ *	sustainable_freq + P + I + D
+ * clamped to the cpufreq range. P reacts to the distance from the
+ * target, harder above it; D to the slope, so a fast rise is cut
+ * before the target is reached; I settles the ceiling at what the
+ * current load and ambient can actually sustain.
+ */
+static void tmu_pid_control(struct s5p_tmu_info *info, unsigned int cur_temp,
+			    struct tmu_trace_entry *e)
+{
+	struct tmu_pid *pid = &info->pid;
+	struct cpufreq_policy *policy;
+	unsigned int min_freq, max_freq, range;
+	int err, p, i, d, ceiling, i_max;
+
+	policy = cpufreq_cpu_get(0);
+	if (!policy)
+		return;
+	min_freq = policy->cpuinfo.min_freq;
+	max_freq = policy->cpuinfo.max_freq;
+	cpufreq_cpu_put(policy);
+	range = max_freq - min_freq;
+	if (range < 1000)
+		return;
+
+	err = (int)pid->target - (int)cur_temp;
+	if (!pid->active)
+		pid->prev_err = err;
+
+	p = err * (int)(err < 0 ? pid->k_po : pid->k_pu);
+
+	if (err < (int)pid->integral_cutoff && pid->k_i) {
+		/* no windup beyond what can move the whole range */
+		i_max = range / pid->k_i;
+		pid->integral = clamp(pid->integral + err, -i_max, i_max);
+	}
+	i = pid->integral * (int)pid->k_i;
+
+	d = (err - pid->prev_err) * (int)pid->k_d;
+	pid->prev_err = err;
+
+	ceiling = (int)pid->sustainable_freq + p + i + d;
+
+	/* past the warning level the old 2nd limit is the floor */
+	if (info->ctz->data.tmu_flag >= TMU_STATUS_WARNING)
+		ceiling = min_freq;
+	ceiling = clamp(ceiling, (int)min_freq, (int)max_freq);
+
+	pm_qos_update_request(&pid->cpu_req, ceiling >= (int)max_freq ?
+			      PM_QOS_DEFAULT_VALUE : ceiling);
+
+	/* bus and GPU follow the CPU ceiling across their own range */
+	if (pid->cap_bus && ceiling < (int)max_freq)
+		pm_qos_update_request(&pid->bus_req, BUSFREQ_160MHZ +
+			(BUSFREQ_400MHZ - BUSFREQ_160MHZ) *
+			((ceiling - min_freq) / 1000) / (range / 1000));
+	else
+		pm_qos_update_request(&pid->bus_req, PM_QOS_DEFAULT_VALUE);
+
+#ifdef CONFIG_VIDEO_MALI400MP_DVFS
+	if (pid->cap_gpu)
+		mali_dvfs_set_max_clock(TMU_GPU_CLK_MIN +
+			(TMU_GPU_CLK_MAX - TMU_GPU_CLK_MIN) *
+			((ceiling - min_freq) / 1000) / (range / 1000));
+	else
+		mali_dvfs_set_max_clock(TMU_GPU_CLK_MAX);
+#endif
+
+	pid->active = true;
+	pid->ceiling = ceiling;
+
+	e->ceiling = ceiling;
+	e->p = p;
+	e->i = i;
+	e->d = d;
+}
+
+static void tmu_trace_add(struct tmu_trace_entry *e)
+{
+	tmu_trace[tmu_trace_head] = *e;
+	tmu_trace_head = (tmu_trace_head + 1) % TMU_TRACE_LEN;
+	if (tmu_trace_count < TMU_TRACE_LEN)
+		tmu_trace_count++;
+}
+
 static void tmu_poll_timer(struct work_struct *work)
 {
 	unsigned int cur_temp;
 	static int auto_refresh_changed;
 	static int check_handle;
 	int trend = 0;
+	struct tmu_trace_entry e;
 	struct s5p_tmu_info *info =
 		container_of(work, struct s5p_tmu_info, polling_work.work);
 
@@ -353,6 +568,11 @@ static void tmu_poll_timer(struct work_struct *work)
 	pr_info("cur_temp = %d, tmu_state = %d, temp_diff = %d\n",
 			cur_temp, info->ctz->data.tmu_flag, trend);
 
+	memset(&e, 0, sizeof(e));
+	e.time_ms = jiffies_to_msecs(jiffies);
+	e.temp = cur_temp;
+	e.freq = cpufreq_quick_get(0);
+
 	switch (info->ctz->data.tmu_flag) {
 	case TMU_STATUS_NORMAL:
 		/* 1. change state: 1st-throttling */
@@ -363,9 +583,11 @@ static void tmu_poll_timer(struct work_struct *work)
 		} else if ((cur_temp <= info->ts.stop_1st_throttle)
 			&& (trend < 0)) {
 			if (check_handle & THROTTLE_FLAG) {
-				s5pv310_cpufreq_upper_limit_free(DVFS_LOCK_ID_TMU);
+				tmu_upper_limit_free(info);
 				check_handle &= ~(THROTTLE_FLAG);
 			}
+			tmu_pid_release(info);
+			tmu_trace_add(&e);
 			pr_info("check_handle = %d\n", check_handle);
 			notify_change_of_tmu_state(info);
 			pr_info("normal: free cpufreq_limit & interrupt enable.\n");
@@ -388,21 +610,11 @@ static void tmu_poll_timer(struct work_struct *work)
 		} else if ((cur_temp >= info->ts.start_1st_throttle) &&
 			(trend > 0) && !(check_handle & THROTTLE_FLAG)) {
 			if (check_handle & WARNING_FLAG) {
-				s5pv310_cpufreq_upper_limit_free(DVFS_LOCK_ID_TMU);
+				tmu_upper_limit_free(info);
 				check_handle &= ~(WARNING_FLAG);
 			}
 			pr_info("before check_handle = %d\n", check_handle);
-#ifdef CONFIG_TMU_DEBUG
-			if (tmu_limit_on)
-				s5pv310_cpufreq_upper_limit(DVFS_LOCK_ID_TMU,
-					upper_limit_1st);
-			else
-				s5pv310_cpufreq_upper_limit(DVFS_LOCK_ID_TMU,
-					info->cpufreq_level_1st);
-#else
-			s5pv310_cpufreq_upper_limit(DVFS_LOCK_ID_TMU,
-					info->cpufreq_level_1st);
-#endif
+			tmu_upper_limit(info, tmu_fixed_level(info, 0));
 			check_handle |= THROTTLE_FLAG;
 			pr_info("after check_handle = %d\n", check_handle);
 			notify_change_of_tmu_state(info);
@@ -424,21 +636,11 @@ static void tmu_poll_timer(struct work_struct *work)
 		} else if ((cur_temp >= info->ts.start_2nd_throttle)
 			&& (trend > 0) && !(check_handle & WARNING_FLAG)) {
 			if (check_handle & THROTTLE_FLAG) {
-				s5pv310_cpufreq_upper_limit_free(DVFS_LOCK_ID_TMU);
+				tmu_upper_limit_free(info);
 				check_handle &= ~(THROTTLE_FLAG);
 			}
 			pr_info("before check_handle = %d\n", check_handle);
-#ifdef CONFIG_TMU_DEBUG
-			if (tmu_limit_on)
-				s5pv310_cpufreq_upper_limit(DVFS_LOCK_ID_TMU,
-					upper_limit_2nd);
-			else
-				s5pv310_cpufreq_upper_limit(DVFS_LOCK_ID_TMU,
-					info->cpufreq_level_2nd);
-#else
-			s5pv310_cpufreq_upper_limit(DVFS_LOCK_ID_TMU,
-					info->cpufreq_level_2nd);
-#endif
+			tmu_upper_limit(info, tmu_fixed_level(info, 1));
 			check_handle |= WARNING_FLAG;
 			pr_info("after check_handle = %d\n", check_handle);
 			notify_change_of_tmu_state(info);
@@ -529,16 +731,98 @@ static void tmu_poll_timer(struct work_struct *work)
 		}
 	}
 
+	/*
+	 * THROTTLE_FLAG and WARNING_FLAG keep following the state machine
+	 * while the PID loop owns the ceiling, so switching between the two
+	 * only has to move the limit from one to the other.
+	 */
+	if (info->pid.enable) {
+		if (!info->pid.active &&
+		    (check_handle & (THROTTLE_FLAG | WARNING_FLAG)))
+			tmu_upper_limit_free(info);
+		tmu_pid_control(info, cur_temp, &e);
+	} else if (info->pid.active) {
+		tmu_pid_release(info);
+		if (check_handle & WARNING_FLAG)
+			tmu_upper_limit(info, tmu_fixed_level(info, 1));
+		else if (check_handle & THROTTLE_FLAG)
+			tmu_upper_limit(info, tmu_fixed_level(info, 0));
+	}
+	tmu_trace_add(&e);
+
 	info->last_temperature = cur_temp;
 	/* rescheduling next work */
 	queue_delayed_work_on(0, tmu_monitor_wq, &info->polling_work,
-			info->sampling_rate);
+			info->pid.enable ? msecs_to_jiffies(info->pid.sampling_ms)
+			: info->sampling_rate);
 
 	mutex_unlock(&tmu_lock);
 
 	return;
 }
 
+static int tmu_trace_show(struct seq_file *s, void *unused)
+{
+	struct tmu_trace_entry *e;
+	unsigned int i;
+
+	mutex_lock(&tmu_lock);
+	seq_printf(s, "%10s %4s %8s %8s %9s %9s %9s\n", "time_ms", "temp",
+		   "freq", "ceiling", "p", "i", "d");
+	for (i = 0; i < tmu_trace_count; i++) {
+		e = &tmu_trace[(tmu_trace_head + TMU_TRACE_LEN
+				- tmu_trace_count + i) % TMU_TRACE_LEN];
+		seq_printf(s, "%10lu %4u %8u %8u %9d %9d %9d\n", e->time_ms,
+			   e->temp, e->freq, e->ceiling, e->p, e->i, e->d);
+	}
+	mutex_unlock(&tmu_lock);
+
+	return 0;
+}
+
+static int tmu_trace_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, tmu_trace_show, inode->i_private);
+}
+
+static const struct file_operations tmu_trace_fops = {
+	.open = tmu_trace_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/*
+ * debugfs "tmu": the trace log of the polled samples, and the power
+ * allocator tunables.
+ */
+static void tmu_debugfs_init(struct s5p_tmu_info *info)
+{
+	struct tmu_pid *pid = &info->pid;
+	struct dentry *d;
+
+	d = debugfs_create_dir("tmu", NULL);
+	if (IS_ERR_OR_NULL(d))
+		return;
+	info->debugfs_dir = d;
+
+	debugfs_create_file("trace", S_IRUGO, d, NULL, &tmu_trace_fops);
+	debugfs_create_u32("pid_enable", S_IRUGO | S_IWUSR, d, &pid->enable);
+	debugfs_create_u32("target", S_IRUGO | S_IWUSR, d, &pid->target);
+	debugfs_create_u32("sustainable_freq", S_IRUGO | S_IWUSR, d,
+			   &pid->sustainable_freq);
+	debugfs_create_u32("k_po", S_IRUGO | S_IWUSR, d, &pid->k_po);
+	debugfs_create_u32("k_pu", S_IRUGO | S_IWUSR, d, &pid->k_pu);
+	debugfs_create_u32("k_i", S_IRUGO | S_IWUSR, d, &pid->k_i);
+	debugfs_create_u32("k_d", S_IRUGO | S_IWUSR, d, &pid->k_d);
+	debugfs_create_u32("integral_cutoff", S_IRUGO | S_IWUSR, d,
+			   &pid->integral_cutoff);
+	debugfs_create_u32("cap_bus", S_IRUGO | S_IWUSR, d, &pid->cap_bus);
+	debugfs_create_u32("cap_gpu", S_IRUGO | S_IWUSR, d, &pid->cap_gpu);
+	debugfs_create_u32("sampling_ms", S_IRUGO | S_IWUSR, d,
+			   &pid->sampling_ms);
+}
+
 static int tmu_initialize(struct platform_device *pdev)
 {
 	struct s5p_tmu *tz = platform_get_drvdata(pdev);
@@ -733,6 +1017,9 @@ static int __devinit s5p_tmu_probe(struct platform_device *pdev)
 
 	INIT_DELAYED_WORK_DEFERRABLE(&tmu_info->polling_work, tmu_poll_timer);
 
+	tmu_pid_init(tmu_info);
+	tmu_debugfs_init(tmu_info);
+
 	tmu_info->irq = platform_get_irq(pdev, 0);
 	if (tmu_info->irq < 0) {
 		dev_err(&pdev->dev, "no irq for thermal\n");
@@ -760,6 +1047,9 @@ err_init:
 		free_irq(tmu_info->irq, tz);
 
 err_irq:
+	debugfs_remove_recursive(tmu_info->debugfs_dir);
+	pm_qos_remove_request(&tmu_info->pid.cpu_req);
+	pm_qos_remove_request(&tmu_info->pid.bus_req);
 	iounmap(tz->tmu_base);
 
 err_nomap:
@@ -785,6 +1075,10 @@ static int __devinit s5p_tmu_remove(struct platform_device *pdev)
 	if (tmu_info->irq >= 0)
 		free_irq(tmu_info->irq, tz);
 
+	debugfs_remove_recursive(tmu_info->debugfs_dir);
+	pm_qos_remove_request(&tmu_info->pid.cpu_req);
+	pm_qos_remove_request(&tmu_info->pid.bus_req);
+
 	iounmap(tz->tmu_base);
 
 	release_resource(tmu_info->ioarea);
@@ -0,0 +1,80 @@
+/* linux/arch/arm/plat-s5p/include/plat/s5p-bufsync.h
+ *
+ * Copyright (c) 2010 Samsung Electronics Co., Ltd.
+ *		http://www.samsung.com
+ *
+ * CPU cache maintenance for buffers shared by the multimedia engines
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+*/
+
+#ifndef __PLAT_S5P_BUFSYNC_H
+#define __PLAT_S5P_BUFSYNC_H __FILE__
+
+#include <linux/types.h>
+#include <linux/rbtree.h>
+#include <linux/dma-mapping.h>
+
+enum s5p_bufsync_engine {
+	S5P_BUFSYNC_CPU = 0,
+	S5P_BUFSYNC_MFC,
+	S5P_BUFSYNC_FIMC,
+	S5P_BUFSYNC_G2D,
+	S5P_BUFSYNC_NR,
+};
+
+/*
+ * A physically contiguous buffer whose last writer is tracked. A device
+ * becomes the owner only through s5p_bufsync_device_wrote(); until the
+ * buffer is handed back with s5p_bufsync_for_cpu(), the CPU holds no
+ * dirty lines for it, so handing it to another device for reading
+ * needs nothing.
+ * The allocator of the buffer registers it; other drivers find it
+ * by address. A zeroed struct is not registered.
+ */
+struct s5p_bufsync {
+	struct rb_node		node;
+	unsigned long		start;
+	size_t			size;
+	enum s5p_bufsync_engine	owner;
+};
+
+void s5p_bufsync_register(struct s5p_bufsync *buf, unsigned long start,
+			  size_t size);
+void s5p_bufsync_unregister(struct s5p_bufsync *buf);
+
+/*
+ * @engine is about to access @lines rows of @width bytes, @stride
+ * apart, from the kernel or current user address @vaddr. DMA_TO_DEVICE
+ * cleans, the other directions flush. A DMA_TO_DEVICE hand-off of a
+ * tracked buffer that a device owns needs nothing. The owner is left
+ * unchanged: a device that writes reports it with
+ * s5p_bufsync_device_wrote() once it is done.
+ */
+void s5p_bufsync_for_device_2d(enum s5p_bufsync_engine engine,
+			       const void *vaddr, size_t width,
+			       size_t stride, unsigned int lines,
+			       enum dma_data_direction dir);
+
+/* The CPU is about to read what @engine wrote: invalidate and take it */
+void s5p_bufsync_for_cpu(enum s5p_bufsync_engine engine,
+			 const void *vaddr, size_t size);
+
+/* @engine wrote the buffer at physical @start without a CPU mapping */
+void s5p_bufsync_device_wrote(enum s5p_bufsync_engine engine,
+			      unsigned long start, size_t size);
+
+/* The same, for a kernel or current user address */
+void s5p_bufsync_device_wrote_virt(enum s5p_bufsync_engine engine,
+				   const void *vaddr, size_t size);
+
+static inline void s5p_bufsync_for_device(enum s5p_bufsync_engine engine,
+					  const void *vaddr, size_t size,
+					  enum dma_data_direction dir)
+{
+	s5p_bufsync_for_device_2d(engine, vaddr, size, size, 1, dir);
+}
+
+#endif /* __PLAT_S5P_BUFSYNC_H */
@@ -0,0 +1,408 @@
+/* linux/arch/arm/plat-s5p/s5p-bufsync.c
+ *
+ * Copyright (c) 2010 Samsung Electronics Co., Ltd.
+ *		http://www.samsung.com
+ *
+ * CPU cache maintenance for buffers shared by the multimedia engines
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+*/
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/spinlock.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include <asm/cacheflush.h>
+#include <asm/sizes.h>
+
+#include <plat/s5p-bufsync.h>
+
+enum bufsync_op {
+	BUFSYNC_CLEAN,
+	BUFSYNC_INV,
+	BUFSYNC_FLUSH,
+};
+
+struct bufsync_stat {
+	u64		bytes[3];	/* per bufsync_op */
+	u64		skipped;	/* bytes left alone, device owned */
+	unsigned long	l1_all;
+	unsigned long	l2_all;
+};
+
+static DEFINE_SPINLOCK(bufsync_lock);
+static struct rb_root bufsync_root = RB_ROOT;
+static struct bufsync_stat bufsync_stat[S5P_BUFSYNC_NR];
+
+/*
+ * Above these sizes the whole cache is cleaned and invalidated rather
+ * than walked by line: 64KB is about where walking the 32KB L1 costs
+ * more, 1MB the size of the L2.
+ */
+static u32 bufsync_l1_all = SZ_64K;
+static u32 bufsync_l2_all = SZ_1M;
+/* rows closer than this are maintained as one range */
+static u32 bufsync_row_gap = SZ_1K;
+
+static const char *bufsync_name[S5P_BUFSYNC_NR] = {
+	[S5P_BUFSYNC_CPU]	= "cpu",
+	[S5P_BUFSYNC_MFC]	= "mfc",
+	[S5P_BUFSYNC_FIMC]	= "fimc",
+	[S5P_BUFSYNC_G2D]	= "g2d",
+};
+
+/* Physical address of a kernel or current user address, 0 if unmapped */
+static unsigned long bufsync_virt_to_phys(unsigned long addr)
+{
+	struct mm_struct *mm = current->mm;
+	struct page *page;
+	pgd_t *pgd;
+	pmd_t *pmd;
+	pte_t *pte;
+	unsigned long phys = 0;
+
+	if (virt_addr_valid(addr))
+		return __pa(addr);
+
+	if (is_vmalloc_addr((void *)addr)) {
+		page = vmalloc_to_page((void *)addr);
+		return page ? page_to_phys(page) + offset_in_page(addr) : 0;
+	}
+
+	if (addr >= TASK_SIZE || !mm)
+		return 0;
+
+	pgd = pgd_offset(mm, addr);
+	if (pgd_none(*pgd) || pgd_bad(*pgd))
+		return 0;
+
+	pmd = pmd_offset(pud_offset(pgd, addr), addr);
+	if (pmd_none(*pmd) || pmd_bad(*pmd))
+		return 0;
+
+	pte = pte_offset_map(pmd, addr);
+	if (pte_present(*pte))
+		phys = (pte_pfn(*pte) << PAGE_SHIFT) + offset_in_page(addr);
+	pte_unmap(pte);
+
+	return phys;
+}
+
+/* Tracked buffer holding [start, start + size), with bufsync_lock held */
+static struct s5p_bufsync *bufsync_find(unsigned long start, size_t size)
+{
+	struct rb_node *n = bufsync_root.rb_node;
+	struct s5p_bufsync *buf, *floor = NULL;
+
+	while (n) {
+		buf = rb_entry(n, struct s5p_bufsync, node);
+		if (start < buf->start) {
+			n = n->rb_left;
+		} else {
+			floor = buf;
+			n = n->rb_right;
+		}
+	}
+
+	if (floor && (start + size) <= (floor->start + floor->size))
+		return floor;
+
+	return NULL;
+}
+
+/* Tracked buffer behind a virtual range, if the range is contiguous */
+static struct s5p_bufsync *bufsync_find_virt(const void *vaddr, size_t size)
+{
+	unsigned long start, end;
+
+	start = bufsync_virt_to_phys((unsigned long)vaddr);
+	end = bufsync_virt_to_phys((unsigned long)vaddr + size - 1);
+	if (!start || end != start + size - 1)
+		return NULL;
+
+	return bufsync_find(start, size);
+}
+
+void s5p_bufsync_register(struct s5p_bufsync *buf, unsigned long start,
+			  size_t size)
+{
+	struct rb_node **p = &bufsync_root.rb_node, *parent = NULL;
+	struct s5p_bufsync *tmp;
+	unsigned long flags;
+
+	buf->start = start;
+	buf->size = size;
+	buf->owner = S5P_BUFSYNC_CPU;
+
+	spin_lock_irqsave(&bufsync_lock, flags);
+	while (*p) {
+		parent = *p;
+		tmp = rb_entry(parent, struct s5p_bufsync, node);
+		if (start < tmp->start)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&buf->node, parent, p);
+	rb_insert_color(&buf->node, &bufsync_root);
+	spin_unlock_irqrestore(&bufsync_lock, flags);
+}
+EXPORT_SYMBOL(s5p_bufsync_register);
+
+void s5p_bufsync_unregister(struct s5p_bufsync *buf)
+{
+	unsigned long flags;
+
+	if (!buf->size)
+		return;
+
+	spin_lock_irqsave(&bufsync_lock, flags);
+	rb_erase(&buf->node, &bufsync_root);
+	buf->size = 0;
+	spin_unlock_irqrestore(&bufsync_lock, flags);
+}
+EXPORT_SYMBOL(s5p_bufsync_unregister);
+
+static void bufsync_l1_range(unsigned long vaddr, size_t size,
+			     enum bufsync_op op)
+{
+	const void *start = (const void *)vaddr;
+
+	switch (op) {
+	case BUFSYNC_CLEAN:
+		dmac_map_area(start, size, DMA_TO_DEVICE);
+		break;
+	case BUFSYNC_INV:
+		dmac_unmap_area(start, size, DMA_FROM_DEVICE);
+		break;
+	default:
+		dmac_flush_range(start, start + size);
+		break;
+	}
+}
+
+/* The L2 works on physical addresses: go page by page */
+static void bufsync_l2_range(unsigned long vaddr, size_t size,
+			     enum bufsync_op op)
+{
+	unsigned long end = vaddr + size;
+	unsigned long next, phys;
+
+	while (vaddr < end) {
+		next = min((vaddr & PAGE_MASK) + PAGE_SIZE, end);
+		phys = bufsync_virt_to_phys(vaddr);
+		if (phys) {
+			switch (op) {
+			case BUFSYNC_CLEAN:
+				outer_clean_range(phys, phys + (next - vaddr));
+				break;
+			case BUFSYNC_INV:
+				outer_inv_range(phys, phys + (next - vaddr));
+				break;
+			default:
+				outer_flush_range(phys, phys + (next - vaddr));
+				break;
+			}
+		}
+		vaddr = next;
+	}
+}
+
+static void bufsync_rows(unsigned long vaddr, size_t width, size_t stride,
+			 unsigned int lines, enum bufsync_op op, int l2)
+{
+	while (lines--) {
+		if (l2)
+			bufsync_l2_range(vaddr, width, op);
+		else
+			bufsync_l1_range(vaddr, width, op);
+		vaddr += stride;
+	}
+}
+
+static void bufsync_do(enum s5p_bufsync_engine engine, const void *vaddr,
+		       size_t width, size_t stride, unsigned int lines,
+		       enum bufsync_op op)
+{
+	unsigned long addr = (unsigned long)vaddr;
+	size_t bytes = width * lines;
+	int l1_all, l2_all;
+	unsigned long flags;
+
+	if (lines > 1 && (stride - width) < bufsync_row_gap) {
+		width += stride * (lines - 1);
+		stride = width;
+		lines = 1;
+	}
+
+	l1_all = bytes >= bufsync_l1_all;
+	l2_all = bytes >= bufsync_l2_all;
+
+	/* invalidate outer first, so that the L1 does not refill stale */
+	if (op == BUFSYNC_INV) {
+		if (l2_all)
+			outer_flush_all();
+		else
+			bufsync_rows(addr, width, stride, lines, op, 1);
+	}
+
+	if (l1_all)
+		flush_all_cpu_caches();
+	else
+		bufsync_rows(addr, width, stride, lines, op, 0);
+
+	if (op != BUFSYNC_INV) {
+		if (l2_all)
+			outer_flush_all();
+		else
+			bufsync_rows(addr, width, stride, lines, op, 1);
+	}
+
+	spin_lock_irqsave(&bufsync_lock, flags);
+	bufsync_stat[engine].bytes[op] += bytes;
+	bufsync_stat[engine].l1_all += l1_all;
+	bufsync_stat[engine].l2_all += l2_all;
+	spin_unlock_irqrestore(&bufsync_lock, flags);
+}
+
+void s5p_bufsync_for_device_2d(enum s5p_bufsync_engine engine,
+			       const void *vaddr, size_t width,
+			       size_t stride, unsigned int lines,
+			       enum dma_data_direction dir)
+{
+	struct s5p_bufsync *buf;
+	unsigned long flags;
+	size_t span;
+
+	if (!width || !lines)
+		return;
+
+	span = stride * (lines - 1) + width;
+
+	spin_lock_irqsave(&bufsync_lock, flags);
+	buf = bufsync_find_virt(vaddr, span);
+	if (buf && buf->owner != S5P_BUFSYNC_CPU && dir == DMA_TO_DEVICE) {
+		/* a device wrote it and the CPU has not been handed it since */
+		bufsync_stat[engine].skipped += width * lines;
+		spin_unlock_irqrestore(&bufsync_lock, flags);
+		return;
+	}
+	spin_unlock_irqrestore(&bufsync_lock, flags);
+
+	bufsync_do(engine, vaddr, width, stride, lines,
+		   dir == DMA_TO_DEVICE ? BUFSYNC_CLEAN : BUFSYNC_FLUSH);
+}
+EXPORT_SYMBOL(s5p_bufsync_for_device_2d);
+
+void s5p_bufsync_for_cpu(enum s5p_bufsync_engine engine,
+			 const void *vaddr, size_t size)
+{
+	struct s5p_bufsync *buf;
+	unsigned long flags;
+
+	if (!size)
+		return;
+
+	spin_lock_irqsave(&bufsync_lock, flags);
+	buf = bufsync_find_virt(vaddr, size);
+	if (buf)
+		buf->owner = S5P_BUFSYNC_CPU;
+	spin_unlock_irqrestore(&bufsync_lock, flags);
+
+	bufsync_do(engine, vaddr, size, size, 1, BUFSYNC_INV);
+}
+EXPORT_SYMBOL(s5p_bufsync_for_cpu);
+
+void s5p_bufsync_device_wrote(enum s5p_bufsync_engine engine,
+			      unsigned long start, size_t size)
+{
+	struct s5p_bufsync *buf;
+	unsigned long flags;
+
+	spin_lock_irqsave(&bufsync_lock, flags);
+	buf = bufsync_find(start, size);
+	if (buf)
+		buf->owner = engine;
+	spin_unlock_irqrestore(&bufsync_lock, flags);
+}
+EXPORT_SYMBOL(s5p_bufsync_device_wrote);
+
+void s5p_bufsync_device_wrote_virt(enum s5p_bufsync_engine engine,
+				   const void *vaddr, size_t size)
+{
+	struct s5p_bufsync *buf;
+	unsigned long flags;
+
+	if (!size)
+		return;
+
+	spin_lock_irqsave(&bufsync_lock, flags);
+	buf = bufsync_find_virt(vaddr, size);
+	if (buf)
+		buf->owner = engine;
+	spin_unlock_irqrestore(&bufsync_lock, flags);
+}
+EXPORT_SYMBOL(s5p_bufsync_device_wrote_virt);
+
+static int bufsync_stat_show(struct seq_file *s, void *unused)
+{
+	struct bufsync_stat stat[S5P_BUFSYNC_NR];
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&bufsync_lock, flags);
+	memcpy(stat, bufsync_stat, sizeof(stat));
+	spin_unlock_irqrestore(&bufsync_lock, flags);
+
+	seq_printf(s, "%-6s %12s %12s %12s %12s %8s %8s\n", "engine",
+		   "clean", "inv", "flush", "skipped", "l1_all", "l2_all");
+
+	for (i = 0; i < S5P_BUFSYNC_NR; i++)
+		seq_printf(s, "%-6s %12llu %12llu %12llu %12llu %8lu %8lu\n",
+			   bufsync_name[i], stat[i].bytes[BUFSYNC_CLEAN],
+			   stat[i].bytes[BUFSYNC_INV],
+			   stat[i].bytes[BUFSYNC_FLUSH], stat[i].skipped,
+			   stat[i].l1_all, stat[i].l2_all);
+
+	return 0;
+}
+
+static int bufsync_stat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bufsync_stat_show, NULL);
+}
+
+static const struct file_operations bufsync_stat_fops = {
+	.open		= bufsync_stat_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init s5p_bufsync_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("s5p-bufsync", NULL);
+	if (IS_ERR_OR_NULL(dir))
+		return 0;
+
+	debugfs_create_file("stats", S_IRUGO, dir, NULL, &bufsync_stat_fops);
+	debugfs_create_u32("l1_all_bytes", S_IRUGO | S_IWUSR, dir,
+			   &bufsync_l1_all);
+	debugfs_create_u32("l2_all_bytes", S_IRUGO | S_IWUSR, dir,
+			   &bufsync_l2_all);
+	debugfs_create_u32("row_gap_bytes", S_IRUGO | S_IWUSR, dir,
+			   &bufsync_row_gap);
+
+	return 0;
+}
+late_initcall(s5p_bufsync_init);
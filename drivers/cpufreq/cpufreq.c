@@ -1533,6 +1533,26 @@ int __cpufreq_driver_target(struct cpufreq_policy *policy,
 }
 EXPORT_SYMBOL_GPL(__cpufreq_driver_target);
 
+/**
+ * cpufreq_driver_fast_switch - change frequency without sleeping
+ * @policy: the policy the governor runs on
+ * @index: position in the policy's frequency table, within its limits
+ *
+ * For governors that decide in timer context. The driver makes the
+ * change only if it can do it without sleeping, and reports it to the
+ * transition notifiers later on. Returns 0 when done; on error the
+ * caller has to use __cpufreq_driver_target() instead.
+ */
+int cpufreq_driver_fast_switch(struct cpufreq_policy *policy,
+			       unsigned int index)
+{
+	if (!cpufreq_driver->fast_switch)
+		return -ENOSYS;
+
+	return cpufreq_driver->fast_switch(policy, index);
+}
+EXPORT_SYMBOL_GPL(cpufreq_driver_fast_switch);
+
 int cpufreq_driver_target(struct cpufreq_policy *policy,
 			  unsigned int target_freq,
 			  unsigned int relation)
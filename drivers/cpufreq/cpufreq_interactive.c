@@ -25,6 +25,8 @@
 #include <linux/timer.h>
 #include <linux/workqueue.h>
 #include <linux/kthread.h>
+#include <linux/input.h>
+#include <linux/slab.h>
 
 #include <asm/cputime.h>
 
@@ -67,6 +69,26 @@ static unsigned long go_maxspeed_load;
 #define DEFAULT_MIN_SAMPLE_TIME 80000;
 static unsigned long min_sample_time;
 
+/*
+ * On touch or key input, go straight to input_boost_freq (0 for the
+ * policy maximum) and do not go below it for input_boost_duration us.
+ */
+#define DEFAULT_INPUT_BOOST_DURATION 500000
+static unsigned long input_boost = 1;
+static unsigned long input_boost_freq;
+static unsigned long input_boost_duration;
+static u64 input_boost_until;
+
+/*
+ * Make changes from the timer through the driver's fast path when it
+ * can, instead of waking up_task or queueing the down work.
+ */
+static unsigned long fast_switch = 1;
+
+/* Also bring offline CPUs up on input */
+static unsigned long input_boost_cpus;
+static struct work_struct input_boost_cpus_work;
+
 #define DEBUG 0
 #define BUFSZ 128
 
@@ -167,6 +189,15 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 	.owner = THIS_MODULE,
 };
 
+static unsigned int input_boost_target(struct cpufreq_policy *policy)
+{
+	if (!input_boost_freq || input_boost_freq > policy->max)
+		return policy->max;
+	if (input_boost_freq < policy->min)
+		return policy->min;
+	return input_boost_freq;
+}
+
 static void cpufreq_interactive_timer(unsigned long data)
 {
 	unsigned int delta_idle;
@@ -255,6 +286,13 @@ static void cpufreq_interactive_timer(unsigned long data)
 	else
 		new_freq = pcpu->policy->max * cpu_load / 100;
 
+	if (pcpu->timer_run_time < input_boost_until) {
+		unsigned int boost_freq = input_boost_target(pcpu->policy);
+
+		if (new_freq < boost_freq)
+			new_freq = boost_freq;
+	}
+
 	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
 					   new_freq, CPUFREQ_RELATION_H,
 					   &index)) {
@@ -282,6 +320,15 @@ static void cpufreq_interactive_timer(unsigned long data)
 		}
 	}
 
+	if (fast_switch &&
+	    !cpufreq_driver_fast_switch(pcpu->policy, index)) {
+		dbgpr("timer %d: load=%d cur=%d tgt=%d fast\n", (int) data, cpu_load, pcpu->target_freq, new_freq);
+		pcpu->target_freq = new_freq;
+		pcpu->freq_change_time_in_idle =
+			get_cpu_idle_time_us(data, &pcpu->freq_change_time);
+		goto rearm_if_notmax;
+	}
+
 	dbgpr("timer %d: load=%d cur=%d tgt=%d queue\n", (int) data, cpu_load, pcpu->target_freq, new_freq);
 
 	if (new_freq < pcpu->target_freq) {
@@ -527,6 +574,125 @@ static void cpufreq_interactive_freq_down(struct work_struct *work)
 	}
 }
 
+static void cpufreq_interactive_input_boost(void)
+{
+	unsigned int cpu, index;
+	unsigned long flags;
+	int wake = 0;
+	struct cpufreq_interactive_cpuinfo *pcpu;
+
+	input_boost_until = ktime_to_us(ktime_get()) + input_boost_duration;
+
+	spin_lock_irqsave(&up_cpumask_lock, flags);
+	for_each_online_cpu(cpu) {
+		pcpu = &per_cpu(cpuinfo, cpu);
+
+		if (!pcpu->governor_enabled)
+			continue;
+
+		if (cpufreq_frequency_table_target(pcpu->policy,
+					pcpu->freq_table,
+					input_boost_target(pcpu->policy),
+					CPUFREQ_RELATION_H, &index))
+			continue;
+
+		if (pcpu->target_freq < pcpu->freq_table[index].frequency) {
+			pcpu->target_freq = pcpu->freq_table[index].frequency;
+			cpumask_set_cpu(cpu, &up_cpumask);
+			wake = 1;
+		}
+	}
+	spin_unlock_irqrestore(&up_cpumask_lock, flags);
+
+	if (wake)
+		wake_up_process(up_task);
+
+	if (input_boost_cpus && num_online_cpus() < num_present_cpus())
+		schedule_work(&input_boost_cpus_work);
+}
+
+static void cpufreq_interactive_input_boost_cpus(struct work_struct *work)
+{
+	unsigned int cpu;
+
+	for_each_present_cpu(cpu) {
+		if (!cpu_online(cpu))
+			cpu_up(cpu);
+	}
+}
+
+static void cpufreq_interactive_input_event(struct input_handle *handle,
+					    unsigned int type,
+					    unsigned int code, int value)
+{
+	/* One boost per input frame */
+	if (input_boost && type == EV_SYN && code == SYN_REPORT)
+		cpufreq_interactive_input_boost();
+}
+
+static int cpufreq_interactive_input_connect(struct input_handler *handler,
+					     struct input_dev *dev,
+					     const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_interactive";
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_free;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_unregister;
+
+	return 0;
+
+err_unregister:
+	input_unregister_handle(handle);
+err_free:
+	kfree(handle);
+	return error;
+}
+
+static void cpufreq_interactive_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+static const struct input_device_id cpufreq_interactive_ids[] = {
+	{	/* touchscreens */
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+			    BIT_MASK(ABS_MT_POSITION_X) |
+			    BIT_MASK(ABS_MT_POSITION_Y) },
+	},
+	{	/* keys and single touch */
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT,
+		.evbit = { BIT_MASK(EV_KEY) },
+	},
+	{ },
+};
+
+static struct input_handler cpufreq_interactive_input_handler = {
+	.event		= cpufreq_interactive_input_event,
+	.connect	= cpufreq_interactive_input_connect,
+	.disconnect	= cpufreq_interactive_input_disconnect,
+	.name		= "cpufreq_interactive",
+	.id_table	= cpufreq_interactive_ids,
+};
+
 static ssize_t show_go_maxspeed_load(struct kobject *kobj,
 				     struct attribute *attr, char *buf)
 {
@@ -557,9 +723,39 @@ static ssize_t store_min_sample_time(struct kobject *kobj,
 static struct global_attr min_sample_time_attr = __ATTR(min_sample_time, 0644,
 		show_min_sample_time, store_min_sample_time);
 
+#define show_store_one(name)						\
+static ssize_t show_##name(struct kobject *kobj,			\
+			   struct attribute *attr, char *buf)		\
+{									\
+	return sprintf(buf, "%lu\n", name);				\
+}									\
+									\
+static ssize_t store_##name(struct kobject *kobj,			\
+			struct attribute *attr, const char *buf,	\
+			size_t count)					\
+{									\
+	int ret = strict_strtoul(buf, 0, &name);			\
+									\
+	return ret ? ret : count;					\
+}									\
+									\
+static struct global_attr name##_attr = __ATTR(name, 0644,		\
+		show_##name, store_##name)
+
+show_store_one(input_boost);
+show_store_one(input_boost_freq);
+show_store_one(input_boost_duration);
+show_store_one(input_boost_cpus);
+show_store_one(fast_switch);
+
 static struct attribute *interactive_attributes[] = {
 	&go_maxspeed_load_attr.attr,
 	&min_sample_time_attr.attr,
+	&input_boost_attr.attr,
+	&input_boost_freq_attr.attr,
+	&input_boost_duration_attr.attr,
+	&input_boost_cpus_attr.attr,
+	&fast_switch_attr.attr,
 	NULL,
 };
 
@@ -600,6 +796,14 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 		if (rc)
 			return rc;
 
+		rc = input_register_handler(&cpufreq_interactive_input_handler);
+		if (rc) {
+			sysfs_remove_group(cpufreq_global_kobject,
+					&interactive_attr_group);
+			atomic_dec(&active_count);
+			return rc;
+		}
+
 		pm_idle_old = pm_idle;
 		pm_idle = cpufreq_interactive_idle;
 		break;
@@ -620,6 +824,9 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 		if (atomic_dec_return(&active_count) > 0)
 			return 0;
 
+		input_unregister_handler(&cpufreq_interactive_input_handler);
+		cancel_work_sync(&input_boost_cpus_work);
+
 		sysfs_remove_group(cpufreq_global_kobject,
 				&interactive_attr_group);
 
@@ -646,6 +853,7 @@ static int __init cpufreq_interactive_init(void)
 
 	go_maxspeed_load = DEFAULT_GO_MAXSPEED_LOAD;
 	min_sample_time = DEFAULT_MIN_SAMPLE_TIME;
+	input_boost_duration = DEFAULT_INPUT_BOOST_DURATION;
 
 	/* Initalize per-cpu timers */
 	for_each_possible_cpu(i) {
@@ -672,6 +880,8 @@ static int __init cpufreq_interactive_init(void)
 
 	INIT_WORK(&freq_scale_down_work,
 		  cpufreq_interactive_freq_down);
+	INIT_WORK(&input_boost_cpus_work,
+		  cpufreq_interactive_input_boost_cpus);
 
 	spin_lock_init(&up_cpumask_lock);
 	spin_lock_init(&down_cpumask_lock);
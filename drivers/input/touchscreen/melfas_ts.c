@@ -118,7 +118,12 @@
 #define DEBUG_PRINT				0
 #define DEBUG_MODE
 
+/* the interactive governor boosts on input by itself */
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_INTERACTIVE
+#define TOUCH_BOOSTER			0
+#else
 #define TOUCH_BOOSTER			1
+#endif
 #define TOUCH_BOOSTER_TIME		3000
 
 //#define TEST_FW_UPDATE
@@ -94,8 +94,12 @@
 
 #define MAX_USING_FINGER_NUM 10
 
-/* touch booster */
+/* touch booster, the interactive governor boosts on input by itself */
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_INTERACTIVE
+#define TOUCH_BOOSTER			0
+#else
 #define TOUCH_BOOSTER			1
+#endif
 #define TOUCH_BOOSTER_TIME		3000
 #if TOUCH_BOOSTER
 #include <mach/cpufreq.h>
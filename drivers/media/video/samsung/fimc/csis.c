@@ -23,6 +23,8 @@
 #include <linux/io.h>
 #include <linux/memory.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/time.h>
 #include <plat/clock.h>
 #include <plat/regs-csis.h>
 #include <plat/csis.h>
@@ -53,6 +55,7 @@ static int s3c_csis_set_info(struct platform_device *pdev)
 
 	sprintf(s3c_csis[pdev->id]->name, "%s%d", S3C_CSIS_NAME, pdev->id);
 	s3c_csis[pdev->id]->nr_lanes = S3C_CSIS_NR_LANES;
+	spin_lock_init(&s3c_csis[pdev->id]->frame_lock);
 
 	return 0;
 }
@@ -287,14 +290,49 @@ void s3c_csis_stop(int csis_id)
 }
 }
 
+/*
+ * Time the latest frame started on @csis_id, if it has not been handed
+ * out through @seq yet. Only sensors sending non-image data before the
+ * frame raise the interrupt this is taken from.
+ */
+int s3c_csis_get_frame_time(int csis_id, u32 *seq, struct timeval *tv)
+{
+	struct s3c_csis_info *info;
+	unsigned long flags;
+	int ret = -ENODATA;
+
+	if (csis_id < 0 || csis_id >= S3C_CSIS_CH_NUM || !s3c_csis[csis_id])
+		return -ENODEV;
+
+	info = s3c_csis[csis_id];
+	spin_lock_irqsave(&info->frame_lock, flags);
+	if (info->frame_seq != *seq) {
+		*seq = info->frame_seq;
+		*tv = info->frame_time;
+		ret = 0;
+	}
+	spin_unlock_irqrestore(&info->frame_lock, flags);
+
+	return ret;
+}
+
 static irqreturn_t s3c_csis_irq(int irq, void *dev_id)
 {
 	u32 cfg;
 
 	struct platform_device *pdev = (struct platform_device *) dev_id;
+	struct s3c_csis_info *info = s3c_csis[pdev->id];
 	/* just clearing the pends */
-	cfg = readl(s3c_csis[pdev->id]->regs + S3C_CSIS_INTSRC);
-	writel(cfg, s3c_csis[pdev->id]->regs + S3C_CSIS_INTSRC);
+	cfg = readl(info->regs + S3C_CSIS_INTSRC);
+	writel(cfg, info->regs + S3C_CSIS_INTSRC);
+
+	/* non-image data ahead of a frame: the frame starts now */
+	if (cfg & (S3C_CSIS_INTSRC_EVEN_BEFORE | S3C_CSIS_INTSRC_ODD_BEFORE)) {
+		spin_lock(&info->frame_lock);
+		do_gettimeofday(&info->frame_time);
+		info->frame_seq++;
+		spin_unlock(&info->frame_lock);
+	}
 
 #ifdef CONFIG_VIDEO_FIMC_MIPI_IRQ_DEBUG
 	if (unlikely(cfg & S3C_CSIS_INTSRC_ERR)) {
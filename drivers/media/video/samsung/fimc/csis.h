@@ -42,6 +42,11 @@ struct s3c_csis_info {
 	void __iomem	*regs;
 	int		irq;
 	int		nr_lanes;
+
+	/* start of the latest frame, from the non-image data interrupts */
+	spinlock_t	frame_lock;
+	u32		frame_seq;
+	struct timeval	frame_time;
 };
 
 #endif /* __CSIS_H */
@@ -17,6 +17,8 @@
 #ifdef __KERNEL__
 #include <linux/wait.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
 #include <linux/i2c.h>
 #include <linux/fb.h>
 #include <linux/videodev2.h>
@@ -27,6 +29,7 @@
 #include <media/videobuf-core.h>
 #include <plat/media.h>
 #include <plat/fimc.h>
+#include <plat/s5p-bufsync.h>
 #endif
 
 #ifdef CONFIG_VIDEO_FIMC_UMP_VCM_CMA
@@ -199,6 +202,14 @@ enum cam_mclk_status {
 	CAM_MCLK_ON,
 };
 
+#ifdef CONFIG_VIDEO_FIMC_M2M_POOL
+enum fimc_pool_state {
+	FIMC_POOL_FREE,		/* not lent, powered by its own users */
+	FIMC_POOL_IDLE,		/* lent and powered, no job */
+	FIMC_POOL_BUSY,		/* running a job of pool_owner */
+};
+#endif
+
 /*
  * STRUCTURES
 */
@@ -241,6 +252,13 @@ struct fimc_buf_set {
 	u32			flags;
 	atomic_t		mapped_cnt;
 	struct list_head	list;
+	struct s5p_bufsync	sync[4];
+	/* capture: start of the frame held, and the USERPTR it came from */
+	struct timeval		timestamp;
+	unsigned long		userptr;
+#ifdef CONFIG_VIDEO_FIMC_UMP_VCM_CMA
+	ump_dd_handle		ump_handle;
+#endif
 };
 
 #define CONFIG_VIDEO_HD_SUPPORT
@@ -256,8 +274,10 @@ struct fimc_capinfo {
 	/* using c210 */
 	struct list_head	outgoing_q;
 	int			nr_bufs;
+	enum v4l2_memory	memory;
 	int			irq;
 	int			lastirq;
+	u32			csis_seq;
 
 	u32			cnt;
 
@@ -323,6 +343,9 @@ struct fimc_ctx {
 	u32			flip;
 	u32			rotate;
 	enum fimc_status	status;
+#ifdef CONFIG_VIDEO_FIMC_M2M_POOL
+	atomic_t		pool_jobs;	/* running on other controllers */
+#endif
 };
 
 struct fimc_outinfo {
@@ -464,6 +487,23 @@ struct fimc_control {
 #ifdef CONFIG_CPU_FREQ
 	int				busfreq_flag;		/* context bus frequency flag*/
 #endif
+#ifdef CONFIG_VIDEO_FIMC_M2M_POOL
+	/* m2m job borrowed from another controller */
+	enum fimc_pool_state		pool_state;
+	struct fimc_control		*pool_owner;
+	struct fimc_ctx			*pool_ctx;	/* programmed context */
+	int				pool_idx;
+	struct delayed_work		pool_work;	/* power down when idle */
+
+	/* m2m utilization */
+	ktime_t				m2m_start;
+	ktime_t				m2m_since;
+	u64				m2m_busy_ns;
+	u64				m2m_window_ns;
+	u32				m2m_jobs;
+	u32				m2m_borrowed;
+	u32				m2m_lent;
+#endif
 };
 
 /* global */
@@ -549,8 +589,11 @@ extern int s3cfb_close_fifo(int id, int (*do_priv)(void *), void *param);
 /* general */
 extern void s3c_csis_start(int csis_id, int lanes, int settle, int align, int width, int height, int pixel_format);
 extern void s3c_csis_stop(int csis_id);
+extern int s3c_csis_get_frame_time(int csis_id, u32 *seq, struct timeval *tv);
 extern int fimc_dma_alloc(struct fimc_control *ctrl, struct fimc_buf_set *bs, int i, int align);
 extern void fimc_dma_free(struct fimc_control *ctrl, struct fimc_buf_set *bs, int i);
+extern void fimc_dma_device_wrote(struct fimc_buf_set *bs);
+extern void fimc_userptr_put(struct fimc_buf_set *bs);
 extern u32 fimc_mapping_rot_flip(u32 rot, u32 flip);
 extern int fimc_get_scaler_factor(u32 src, u32 tar, u32 *ratio, u32 *shift);
 extern void fimc_get_nv12t_size(int img_hres, int img_vres,
@@ -623,9 +666,41 @@ extern int fimc_pop_outq(struct fimc_control *ctrl, struct fimc_ctx *ctx, int *i
 extern int fimc_init_out_queue(struct fimc_control *ctrl, struct fimc_ctx *ctx);
 extern void fimc_outdev_init_idxs(struct fimc_control *ctrl);
 
+extern int fimc_peek_inq(struct fimc_control *ctrl, int *ctx_num);
+extern int fimc_pop_inq_ctx(struct fimc_control *ctrl, int ctx_num, int *idx);
+
 extern void fimc_dump_context(struct fimc_control *ctrl, struct fimc_ctx *ctx);
 extern void fimc_print_signal(struct fimc_control *ctrl);
 
+/* m2m pool */
+#ifdef CONFIG_VIDEO_FIMC_M2M_POOL
+extern void fimc_m2m_init(struct fimc_control *ctrl);
+extern void fimc_m2m_kick(struct fimc_control *owner);
+extern int fimc_m2m_irq(struct fimc_control *ctrl);
+extern void fimc_m2m_reclaim(struct fimc_control *ctrl);
+extern void fimc_m2m_drain(struct fimc_control *owner, struct fimc_ctx *ctx);
+extern void fimc_m2m_forget(struct fimc_control *owner);
+extern void fimc_m2m_job_start(struct fimc_control *ctrl);
+extern void fimc_m2m_job_done(struct fimc_control *ctrl);
+extern int fimc_m2m_show_stat(struct fimc_control *ctrl, char *buf);
+
+static inline int fimc_m2m_lent(struct fimc_control *ctrl)
+{
+	return ctrl->pool_state != FIMC_POOL_FREE;
+}
+#else
+static inline void fimc_m2m_init(struct fimc_control *ctrl) {}
+static inline void fimc_m2m_kick(struct fimc_control *owner) {}
+static inline int fimc_m2m_irq(struct fimc_control *ctrl) { return 0; }
+static inline void fimc_m2m_reclaim(struct fimc_control *ctrl) {}
+static inline void fimc_m2m_drain(struct fimc_control *owner,
+				  struct fimc_ctx *ctx) {}
+static inline void fimc_m2m_forget(struct fimc_control *owner) {}
+static inline void fimc_m2m_job_start(struct fimc_control *ctrl) {}
+static inline void fimc_m2m_job_done(struct fimc_control *ctrl) {}
+static inline int fimc_m2m_lent(struct fimc_control *ctrl) { return 0; }
+#endif
+
 /* overlay device */
 extern int fimc_try_fmt_overlay(struct file *filp, void *fh, struct v4l2_format *f);
 extern int fimc_g_fmt_vid_overlay(struct file *filp, void *fh, struct v4l2_format *f);
@@ -197,6 +197,10 @@ static const struct v4l2_queryctrl fimc_controls[] = {
 void s3c_csis_start(int csis_id, int lanes, int settle, \
 	int align, int width, int height, int pixel_format) {}
 void s3c_csis_stop(int csis_id) {}
+int s3c_csis_get_frame_time(int csis_id, u32 *seq, struct timeval *tv)
+{
+	return -ENODEV;
+}
 #endif
 
 static int fimc_init_camera(struct fimc_control *ctrl)
@@ -1101,6 +1105,17 @@ static int fimc_alloc_buffers(struct fimc_control *ctrl,
 	else
 		plane_length[3] = 0;
 
+	/* USERPTR: only the sizes, checked against the planes on qbuf */
+	if (cap->memory == V4L2_MEMORY_USERPTR) {
+		for (i = 0; i < cap->nr_bufs; i++) {
+			for (j = 0; j < plane; j++)
+				cap->bufs[i].length[j] = plane_length[j];
+			cap->bufs[i].state = VIDEOBUF_IDLE;
+		}
+
+		return 0;
+	}
+
 #ifdef CONFIG_VIDEO_FIMC_UMP_VCM_CMA
 	/* set each buffer pointer in nr_bufs */
 	if (!align)
@@ -1151,7 +1166,7 @@ err_alloc:
 static void fimc_free_buffers(struct fimc_control *ctrl)
 {
 	struct fimc_capinfo *cap;
-	int i;
+	int i, j;
 
 	if (ctrl && ctrl->cap)
 		cap = ctrl->cap;
@@ -1159,6 +1174,10 @@ static void fimc_free_buffers(struct fimc_control *ctrl)
 		return;
 
 	for (i = 0; i < FIMC_PHYBUFS; i++) {
+		if (cap->memory == V4L2_MEMORY_USERPTR)
+			fimc_userptr_put(&cap->bufs[i]);
+		for (j = 0; j < 4; j++)
+			s5p_bufsync_unregister(&cap->bufs[i].sync[j]);
 		memset(&cap->bufs[i], 0, sizeof(cap->bufs[i]));
 		cap->bufs[i].state = VIDEOBUF_NEEDS_INIT;
 	}
@@ -1183,6 +1202,12 @@ int fimc_reqbufs_capture(void *fh, struct v4l2_requestbuffers *b)
 		return -ENODEV;
 	}
 
+	if (b->memory != V4L2_MEMORY_MMAP &&
+	    (b->memory != V4L2_MEMORY_USERPTR || pdata->hw_ver < 0x51)) {
+		fimc_err("%s: invalid memory type\n", __func__);
+		return -EINVAL;
+	}
+
 	mutex_lock(&ctrl->v4l2_lock);
 
 	if (cap->fmt.priv == V4L2_PIX_FMT_MODE_CAPTURE && b->count == 1)
@@ -1195,6 +1220,12 @@ int fimc_reqbufs_capture(void *fh, struct v4l2_requestbuffers *b)
 		/* aborting or finishing any DMA in progress */
 		if (ctrl->status == FIMC_STREAMON)
 			fimc_streamoff_capture(fh);
+		if (cap->memory == V4L2_MEMORY_USERPTR) {
+			fimc_free_buffers(ctrl);
+			cap->nr_bufs = 0;
+			mutex_unlock(&ctrl->v4l2_lock);
+			return 0;
+		}
 		for (i = 0; i < FIMC_CAPBUFS; i++) {
 			fimc_dma_free(ctrl, &ctrl->cap->bufs[i], 0);
 			fimc_dma_free(ctrl, &ctrl->cap->bufs[i], 1);
@@ -1205,7 +1236,8 @@ int fimc_reqbufs_capture(void *fh, struct v4l2_requestbuffers *b)
 		return 0;
 	}
 	/* free previous buffers */
-	if ((cap->nr_bufs >= 0) && (cap->nr_bufs < FIMC_CAPBUFS)) {
+	if ((cap->memory != V4L2_MEMORY_USERPTR) &&
+	    (cap->nr_bufs >= 0) && (cap->nr_bufs < FIMC_CAPBUFS)) {
 		fimc_info1("%s : remained previous buffer count is %d\n", __func__,
 				cap->nr_bufs);
 		for (i = 0; i < cap->nr_bufs; i++) {
@@ -1216,6 +1248,7 @@ int fimc_reqbufs_capture(void *fh, struct v4l2_requestbuffers *b)
 	}
 	fimc_free_buffers(ctrl);
 
+	cap->memory = b->memory;
 	cap->nr_bufs = b->count;
 	if (pdata->hw_ver >= 0x51) {
 #if (defined(CONFIG_S5PV310_DEV_PD) && defined(CONFIG_PM_RUNTIME))
@@ -1226,7 +1259,9 @@ int fimc_reqbufs_capture(void *fh, struct v4l2_requestbuffers *b)
 #endif
 		fimc_hw_reset_output_buf_sequence(ctrl);
 		for (i = 0; i < cap->nr_bufs; i++) {
-			fimc_hwset_output_buf_sequence(ctrl, i, 1);
+			/* USERPTR buffers have no planes before qbuf */
+			if (cap->memory != V4L2_MEMORY_USERPTR)
+				fimc_hwset_output_buf_sequence(ctrl, i, 1);
 			cap->bufs[i].id = i;
 			cap->bufs[i].state = VIDEOBUF_NEEDS_INIT;
 
@@ -1359,11 +1394,16 @@ int fimc_querybuf_capture(void *fh, struct v4l2_buffer *b)
 		b->length = cap->bufs[b->index].length[0];
 		break;
 	}
-	b->m.offset = b->index * PAGE_SIZE;
-	/* memory field should filled V4L2_MEMORY_MMAP */
-	b->memory = V4L2_MEMORY_MMAP;
+	if (cap->memory == V4L2_MEMORY_USERPTR) {
+		b->m.userptr = cap->bufs[b->index].userptr;
+		b->memory = V4L2_MEMORY_USERPTR;
+	} else {
+		b->m.offset = b->index * PAGE_SIZE;
+		/* memory field should filled V4L2_MEMORY_MMAP */
+		b->memory = V4L2_MEMORY_MMAP;
 
-	ctrl->cap->bufs[b->index].state = VIDEOBUF_IDLE;
+		ctrl->cap->bufs[b->index].state = VIDEOBUF_IDLE;
+	}
 
 	fimc_dbg("%s: %d bytes with offset: %d\n",
 		__func__, b->length, b->m.offset);
@@ -2061,14 +2101,108 @@ int fimc_streamoff_capture(void *fh)
 	return 0;
 }
 
+/*
+ * Capture into a buffer another driver allocated. As on the output
+ * path, b->m.userptr points at a struct fimc_buf. base[FIMC_ADDR_Y]
+ * is the UMP secure id of the buffer and the other bases are offsets
+ * into it. The UMP reference taken here keeps the buffer alive until
+ * the frame is dequeued. Raw physical addresses are not accepted:
+ * they carry neither ownership nor lifetime.
+ */
+static int fimc_qbuf_userptr(struct fimc_control *ctrl, struct v4l2_buffer *b)
+{
+#ifdef CONFIG_VIDEO_FIMC_UMP_VCM_CMA
+	struct fimc_buf_set *bs = &ctrl->cap->bufs[b->index];
+	struct fimc_buf buf;
+	dma_addr_t addr[3];
+	unsigned long start, size;
+	ump_dd_handle handle;
+	ump_dd_physical_block block;
+	struct vcm_res *res;
+	int i;
+
+	if (copy_from_user(&buf, (void __user *)b->m.userptr, sizeof(buf)))
+		return -EFAULT;
+
+	for (i = 0; i < 3; i++) {
+		if (bs->length[i] && buf.length[i] < bs->length[i]) {
+			fimc_err("%s: plane %d is %zu bytes, needs %zu\n", __func__,
+					i, buf.length[i], bs->length[i]);
+			return -EINVAL;
+		}
+		addr[i] = buf.base[i];
+	}
+
+	handle = ump_dd_handle_create_from_secure_id(buf.base[FIMC_ADDR_Y]);
+	if (handle == UMP_DD_HANDLE_INVALID) {
+		fimc_err("%s: no UMP buffer %u\n", __func__,
+				buf.base[FIMC_ADDR_Y]);
+		return -EINVAL;
+	}
+
+	if (ctrl->sysmmu_flag == FIMC_SYSMMU_ON) {
+		res = (struct vcm_res *)ump_dd_meminfo_get(buf.base[FIMC_ADDR_Y],
+						(void *)ctrl->vcm_id);
+		if (!res)
+			goto err_range;
+		start = res->start;
+		size = res->bound_size;
+	} else {
+		/* without the System MMU the planes need contiguous memory */
+		if (ump_dd_phys_block_count_get(handle) != 1 ||
+		    ump_dd_phys_blocks_get(handle, &block, 1) != UMP_DD_SUCCESS)
+			goto err_range;
+		start = block.addr;
+		size = block.size;
+	}
+
+	addr[FIMC_ADDR_Y] = 0;
+	for (i = 0; i < 3; i++) {
+		if (!bs->length[i])
+			continue;
+		if (addr[i] > size || bs->length[i] > size - addr[i])
+			goto err_range;
+		addr[i] += start;
+		if (!IS_ALIGNED(addr[i], 8))
+			goto err_range;
+	}
+
+	fimc_userptr_put(bs);
+	for (i = 0; i < 3; i++) {
+		if (!bs->length[i])
+			continue;
+		if (ctrl->sysmmu_flag == FIMC_SYSMMU_ON)
+			bs->vaddr_base[i] = addr[i];
+		else
+			bs->base[i] = addr[i];
+	}
+	bs->ump_handle = handle;
+	bs->userptr = b->m.userptr;
+
+	if (ctrl->status == FIMC_STREAMON || ctrl->status == FIMC_BUFFER_STOP)
+		fimc_hwset_output_address(ctrl, bs, b->index);
+
+	return 0;
+
+err_range:
+	fimc_err("%s: planes do not fit the buffer\n", __func__);
+	ump_dd_reference_release(handle);
+	return -EINVAL;
+#else
+	fimc_err("%s: USERPTR capture needs UMP\n", __func__);
+	return -EINVAL;
+#endif
+}
+
 int fimc_qbuf_capture(void *fh, struct v4l2_buffer *b)
 {
 	struct fimc_control *ctrl = fh;
 	struct s3c_platform_fimc *pdata = to_fimc_plat(ctrl->dev);
 	struct fimc_capinfo *cap = ctrl->cap;
+	int ret;
 
-	if (b->memory != V4L2_MEMORY_MMAP) {
-		fimc_err("%s: invalid memory type\n", __func__);
+	if (b->memory != cap->memory || b->index >= cap->nr_bufs) {
+		fimc_err("%s: invalid memory type or index\n", __func__);
 		return -EINVAL;
 	}
 
@@ -2079,6 +2213,13 @@ int fimc_qbuf_capture(void *fh, struct v4l2_buffer *b)
 			mutex_unlock(&ctrl->v4l2_buf_lock);
 			return -EINVAL;
 		} else {
+			if (b->memory == V4L2_MEMORY_USERPTR) {
+				ret = fimc_qbuf_userptr(ctrl, b);
+				if (ret) {
+					mutex_unlock(&ctrl->v4l2_buf_lock);
+					return ret;
+				}
+			}
 			fimc_info2("%s[%d] : b->index : %d\n", __func__, ctrl->id, b->index);
 			fimc_hwset_output_buf_sequence(ctrl, b->index, FIMC_FRAMECNT_SEQ_ENABLE);
 			cap->bufs[b->index].state = VIDEOBUF_QUEUED;
@@ -2113,23 +2254,27 @@ int fimc_dqbuf_capture(void *fh, struct v4l2_buffer *b)
 
 	struct s3c_platform_fimc *pdata = to_fimc_plat(ctrl->dev);
 
-	if (b->memory != V4L2_MEMORY_MMAP) {
+	if (b->memory != cap->memory) {
 		fimc_err("%s: invalid memory type\n", __func__);
 		return -EINVAL;
 	}
 
 
 	if (pdata->hw_ver >= 0x51) {
+		/* no qbuf on the buffer before its USERPTR planes are dropped */
+		mutex_lock(&ctrl->v4l2_buf_lock);
 		spin_lock_irqsave(&ctrl->outq_lock, spin_flags);
 
 		if (list_empty(&cap->outgoing_q)) {
 			fimc_info2("%s: outgoing_q is empty\n", __func__);
 			spin_unlock_irqrestore(&ctrl->outq_lock, spin_flags);
+			mutex_unlock(&ctrl->v4l2_buf_lock);
 			return -EAGAIN;
 		} else {
 			buf = list_first_entry(&cap->outgoing_q, struct fimc_buf_set, list);
 			fimc_info2("%s[%d]: buf->id : %d\n", __func__, ctrl->id, buf->id);
 			b->index = buf->id;
+			b->timestamp = buf->timestamp;
 			buf->state = VIDEOBUF_IDLE;
 
 			list_del(&buf->list);
@@ -2137,6 +2282,13 @@ int fimc_dqbuf_capture(void *fh, struct v4l2_buffer *b)
 
 		spin_unlock_irqrestore(&ctrl->outq_lock, spin_flags);
 
+		/* the planes go back to their owner */
+		if (cap->memory == V4L2_MEMORY_USERPTR) {
+			b->m.userptr = buf->userptr;
+			fimc_userptr_put(buf);
+		}
+		mutex_unlock(&ctrl->v4l2_buf_lock);
+
 	} else {
 		pp = ((fimc_hwget_frame_count(ctrl) + 2) % 4);
 		if (cap->fmt.field == V4L2_FIELD_INTERLACED_TB)
@@ -116,6 +116,8 @@ int fimc_dma_alloc(struct fimc_control *ctrl, struct fimc_buf_set *bs,
 		}
 	}
 
+	s5p_bufsync_register(&bs->sync[i], bs->base[i], bs->length[i]);
+
 	mutex_unlock(&ctrl->lock);
 
 	return 0;
@@ -139,6 +141,7 @@ void fimc_dma_free(struct fimc_control *ctrl, struct fimc_buf_set *bs, int i)
 		if (ctrl->mem.curr - total >= ctrl->mem.base)
 			ctrl->mem.curr -= total;
 
+		s5p_bufsync_unregister(&bs->sync[i]);
 		bs->base[i] = 0;
 		bs->vaddr_base[i] = 0;
 		bs->length[i] = 0;
@@ -148,6 +151,36 @@ void fimc_dma_free(struct fimc_control *ctrl, struct fimc_buf_set *bs, int i)
 	mutex_unlock(&ctrl->lock);
 }
 
+/* Drop the planes a USERPTR buffer was queued with */
+void fimc_userptr_put(struct fimc_buf_set *bs)
+{
+	int i;
+
+#ifdef CONFIG_VIDEO_FIMC_UMP_VCM_CMA
+	if (bs->ump_handle) {
+		ump_dd_reference_release(bs->ump_handle);
+		bs->ump_handle = NULL;
+	}
+#endif
+	for (i = 0; i < 4; i++) {
+		bs->base[i] = 0;
+		bs->vaddr_base[i] = 0;
+	}
+	bs->userptr = 0;
+}
+
+/* FIMC has written every plane of @bs behind the CPU caches */
+void fimc_dma_device_wrote(struct fimc_buf_set *bs)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (bs->base[i] && bs->length[i])
+			s5p_bufsync_device_wrote(S5P_BUFSYNC_FIMC,
+						 bs->base[i], bs->length[i]);
+	}
+}
+
 static inline u32 fimc_irq_out_single_buf(struct fimc_control *ctrl,
 					  struct fimc_ctx *ctx)
 {
@@ -207,6 +240,8 @@ static inline u32 fimc_irq_out_multi_buf(struct fimc_control *ctrl,
 	int cfg;
 	u32 wakeup = 1;
 
+	fimc_m2m_job_done(ctrl);
+
 	if (ctx->status == FIMC_READY_OFF) {
 		if (ctrl->out->idxs.active.ctx == ctx->ctx_num) {
 			ctrl->out->idxs.active.ctx = -1;
@@ -300,6 +335,7 @@ static inline u32 fimc_irq_out_multi_buf(struct fimc_control *ctrl,
 		ret = fimc_outdev_start_camif(ctrl);
 		if (ret < 0)
 			fimc_err("Fail: fimc_start_camif\n");
+		fimc_m2m_job_start(ctrl);
 
 		ctrl->out->idxs.active.ctx = ctx_num;
 		ctrl->out->idxs.active.idx = next;
@@ -341,6 +377,9 @@ static inline u32 fimc_irq_out_dma(struct fimc_control *ctrl,
 	if (ret < 0)
 		fimc_err("Failed: fimc_push_outq\n");
 
+	if (ctrl->sysmmu_flag != FIMC_SYSMMU_ON)
+		fimc_dma_device_wrote(&ctx->dst[idx]);
+
 	if (ctx->overlay.mode == FIMC_OVLY_DMA_AUTO) {
 		if (ctrl->sysmmu_flag == FIMC_SYSMMU_ON) {
 			ret = s3cfb_direct_ioctl(ctrl->id, S3CFB_SET_WIN_ADDR,
@@ -522,6 +561,25 @@ static int fimc_add_outgoing_queue(struct fimc_control *ctrl, int i)
 	return 0;
 }
 
+/*
+ * Stamp a finished frame with the time it started on the MIPI link, as
+ * taken in the CSIS interrupt. Cameras on the ITU port, or sensors that
+ * send no non-image data, get the time of the FIMC interrupt instead.
+ */
+static void fimc_cap_timestamp(struct fimc_control *ctrl,
+			       struct fimc_buf_set *bs)
+{
+	struct s3c_platform_camera *cam = ctrl->cam;
+	int csis_id = -1;
+
+	if (cam && cam->type == CAM_TYPE_MIPI)
+		csis_id = (cam->id == CAMERA_CSI_C) ? CSI_CH_0 : CSI_CH_1;
+
+	if (csis_id < 0 || s3c_csis_get_frame_time(csis_id,
+					&ctrl->cap->csis_seq, &bs->timestamp))
+		do_gettimeofday(&bs->timestamp);
+}
+
 static inline void fimc_irq_cap(struct fimc_control *ctrl)
 {
 	struct fimc_capinfo *cap = ctrl->cap;
@@ -558,6 +616,8 @@ static inline void fimc_irq_cap(struct fimc_control *ctrl)
 				return;
 		}
 		buf_index = pp - 1;
+		fimc_cap_timestamp(ctrl, &cap->bufs[buf_index]);
+		fimc_dma_device_wrote(&cap->bufs[buf_index]);
 		fimc_add_outgoing_queue(ctrl, buf_index);
 		fimc_hwset_output_buf_sequence(ctrl, buf_index,
 				FIMC_FRAMECNT_SEQ_DISABLE);
@@ -597,6 +657,9 @@ static irqreturn_t fimc_irq(int irq, void *dev_id)
 	struct fimc_control *ctrl = (struct fimc_control *) dev_id;
 	struct s3c_platform_fimc *pdata;
 
+	if (fimc_m2m_irq(ctrl))
+		return IRQ_HANDLED;
+
 	if (ctrl->cap)
 		fimc_irq_cap(ctrl);
 	else if (ctrl->out)
@@ -853,6 +916,7 @@ struct fimc_control *fimc_register_controller(struct platform_device *pdev)
 #if (!defined(CONFIG_S5PV310_DEV_PD) || !defined(CONFIG_PM_RUNTIME))
 	fimc_hwset_reset(ctrl);
 #endif
+	fimc_m2m_init(ctrl);
 
 	return ctrl;
 }
@@ -1010,6 +1074,12 @@ static inline int fimc_mmap_cap(struct file *filp, struct vm_area_struct *vma)
 	u32 size = vma->vm_end - vma->vm_start;
 	u32 pfn, idx = vma->vm_pgoff;
 
+	/* USERPTR planes belong to another driver */
+	if (ctrl->cap->memory == V4L2_MEMORY_USERPTR) {
+		fimc_err("%s: no mmap for USERPTR buffers\n", __func__);
+		return -EINVAL;
+	}
+
 	vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
 	vma->vm_flags |= VM_RESERVED;
 
@@ -1287,6 +1357,9 @@ static int fimc_open(struct file *filp)
 	}
 
 	if (in_use == 1) {
+		/* Take the controller back if it was lent to another one */
+		fimc_m2m_reclaim(ctrl);
+
 #if (!defined(CONFIG_S5PV310_DEV_PD) || !defined(CONFIG_PM_RUNTIME))
 		if (pdata->clk_on)
 			pdata->clk_on(to_platform_device(ctrl->dev),
@@ -1597,6 +1670,7 @@ static int fimc_release(struct file *filp)
 
 			ctrl->mem.curr = ctrl->mem.base;
 
+			fimc_m2m_forget(ctrl);
 			kfree(ctrl->out);
 			ctrl->out = NULL;
 
@@ -1617,12 +1691,17 @@ static int fimc_release(struct file *filp)
 		if (pdata->hw_ver >= 0x51)
 			INIT_LIST_HEAD(&cap->outgoing_q);
 		for (i = 0; i < FIMC_CAPBUFS; i++) {
+			if (cap->memory == V4L2_MEMORY_USERPTR) {
+				fimc_userptr_put(&cap->bufs[i]);
+				continue;
+			}
 			fimc_dma_free(ctrl, &ctrl->cap->bufs[i], 0);
 			fimc_dma_free(ctrl, &ctrl->cap->bufs[i], 1);
 			fimc_dma_free(ctrl, &ctrl->cap->bufs[i], 2);
 		}
 #ifdef CONFIG_VIDEO_FIMC_UMP_VCM_CMA
-		for (i = 0; i < ctrl->cap->nr_bufs; i++) {
+		for (i = 0; cap->memory != V4L2_MEMORY_USERPTR &&
+				i < ctrl->cap->nr_bufs; i++) {
 			fimc_info1("%s : ctrl->ump_wrapped_buffer[%d] : 0x%x\n",
 			__func__, i, (unsigned int)ctrl->ump_wrapped_buffer[i]);
 
@@ -1957,6 +2036,18 @@ static DEVICE_ATTR(range_mode, 0644, \
 			fimc_show_range_mode,
 			fimc_store_range_mode);
 
+#ifdef CONFIG_VIDEO_FIMC_M2M_POOL
+static int fimc_show_m2m_stat(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct platform_device *pdev = to_platform_device(dev);
+
+	return fimc_m2m_show_stat(get_fimc_ctrl(pdev->id), buf);
+}
+
+static DEVICE_ATTR(m2m_stat, 0444, fimc_show_m2m_stat, NULL);
+#endif
+
 static int __devinit fimc_probe(struct platform_device *pdev)
 {
 	struct s3c_platform_fimc *pdata;
@@ -2042,6 +2133,13 @@ static int __devinit fimc_probe(struct platform_device *pdev)
 		fimc_err("failed to add sysfs entries for range mode\n");
 		goto err_global;
 	}
+#ifdef CONFIG_VIDEO_FIMC_M2M_POOL
+	ret = device_create_file(&(pdev->dev), &dev_attr_m2m_stat);
+	if (ret < 0) {
+		fimc_err("failed to add sysfs entries for m2m stat\n");
+		goto err_global;
+	}
+#endif
 	printk(KERN_INFO "FIMC%d registered successfully\n", ctrl->id);
 #if (defined(CONFIG_S5PV310_DEV_PD) && defined(CONFIG_PM_RUNTIME))
 	ctrl->power_status = FIMC_POWER_OFF;
@@ -2079,6 +2177,9 @@ static int fimc_remove(struct platform_device *pdev)
 	fimc_unregister_controller(pdev);
 
 	device_remove_file(&(pdev->dev), &dev_attr_log_level);
+#ifdef CONFIG_VIDEO_FIMC_M2M_POOL
+	device_remove_file(&(pdev->dev), &dev_attr_m2m_stat);
+#endif
 
 	kfree(fimc_dev);
 	fimc_dev = NULL;
@@ -2644,6 +2745,9 @@ static int fimc_runtime_suspend(struct device *dev)
 	} else if (ctrl->cap) {
 		fimc_info1("%s: fimc capture\n", __func__);
 		fimc_runtime_suspend_cap(ctrl);
+	} else if (fimc_m2m_lent(ctrl)) {
+		fimc_info1("%s: fimc m2m pool\n", __func__);
+		fimc_runtime_suspend_out(ctrl);
 	} else
 		fimc_err("%s : invalid fimc control\n", __func__);
 
@@ -2763,6 +2867,8 @@ static int fimc_runtime_resume(struct device *dev)
 	} else if (ctrl->cap) {
 		fimc_info1("%s: fimc cap\n", __func__);
 		fimc_runtime_resume_cap(ctrl);
+	} else if (fimc_m2m_lent(ctrl)) {
+		fimc_info1("%s: fimc m2m pool\n", __func__);
 	} else {
 		fimc_err("%s: runtime resume error\n", __func__);
 	}
@@ -0,0 +1,458 @@
+/* linux/drivers/media/video/samsung/fimc/fimc_m2m.c
+ *
+ * Copyright (c) 2010 Samsung Electronics Co., Ltd.
+ *		http://www.samsung.com/
+ *
+ * Memory-to-memory job sharing between FIMC controllers
+ *
+ * An output context is bound to the controller it was opened on, so its
+ * buffers queue behind each other while the other controllers may sit
+ * unused. A controller nobody has opened is lent to a busy one: it takes
+ * the oldest queued buffer of a NONE_MULTI_BUF context, converts it and
+ * hands the result back to the owner's outgoing queue, then keeps taking
+ * buffers from the same owner until its queue runs dry.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+*/
+
+#include <linux/kernel.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/platform_device.h>
+#include <linux/pm_runtime.h>
+#include <linux/videodev2.h>
+#include <linux/videodev2_samsung.h>
+#include <media/videobuf-core.h>
+#include <asm/div64.h>
+
+#include "fimc.h"
+
+/* Keep a lent controller powered this long for the next burst */
+#define FIMC_M2M_IDLE_DELAY	(HZ / 10)
+
+/* pool_* fields of every controller and the m2m counters */
+static DEFINE_SPINLOCK(fimc_m2m_lock);
+
+static int fimc_m2m_usable(struct fimc_control *owner,
+			   struct fimc_control *ctrl)
+{
+	if (ctrl == owner || !ctrl->dev)
+		return 0;
+
+	/* Buffers are passed by physical address */
+	if (owner->sysmmu_flag == FIMC_SYSMMU_ON ||
+	    ctrl->sysmmu_flag == FIMC_SYSMMU_ON)
+		return 0;
+
+	return 1;
+}
+
+static int fimc_m2m_ctx_running(struct fimc_ctx *ctx)
+{
+	return ctx->status == FIMC_READY_ON || ctx->status == FIMC_STREAMON ||
+		ctx->status == FIMC_STREAMON_IDLE;
+}
+
+/* Called with ctrl->lock held and pool_state FREE */
+static void fimc_m2m_power_on(struct fimc_control *ctrl)
+{
+#if (!defined(CONFIG_S5PV310_DEV_PD) || !defined(CONFIG_PM_RUNTIME))
+	struct s3c_platform_fimc *pdata = to_fimc_plat(ctrl->dev);
+#endif
+	unsigned long flags;
+
+	/* Runtime PM callbacks tell a lent controller by its state */
+	spin_lock_irqsave(&fimc_m2m_lock, flags);
+	ctrl->pool_state = FIMC_POOL_IDLE;
+	ctrl->pool_ctx = NULL;
+	spin_unlock_irqrestore(&fimc_m2m_lock, flags);
+
+#if (defined(CONFIG_S5PV310_DEV_PD) && defined(CONFIG_PM_RUNTIME))
+	pm_runtime_get_sync(ctrl->dev);
+#else
+	if (pdata->clk_on)
+		pdata->clk_on(to_platform_device(ctrl->dev), &ctrl->clk);
+#endif
+	fimc_hwset_reset(ctrl);
+	fimc_hwset_output_buf_sequence_all(ctrl, FRAME_SEQ);
+	ctrl->status = FIMC_STREAMON_IDLE;
+}
+
+/* Called with ctrl->lock held */
+static void fimc_m2m_release(struct fimc_control *ctrl)
+{
+#if (!defined(CONFIG_S5PV310_DEV_PD) || !defined(CONFIG_PM_RUNTIME))
+	struct s3c_platform_fimc *pdata = to_fimc_plat(ctrl->dev);
+#endif
+	unsigned long flags;
+
+	spin_lock_irqsave(&fimc_m2m_lock, flags);
+	if (ctrl->pool_state != FIMC_POOL_IDLE) {
+		spin_unlock_irqrestore(&fimc_m2m_lock, flags);
+		return;
+	}
+	spin_unlock_irqrestore(&fimc_m2m_lock, flags);
+
+	/*
+	 * Only a BUSY controller gets new work from interrupt context and
+	 * lending takes ctrl->lock, so the state holds while powering off.
+	 */
+	fimc_hwset_disable_irq(ctrl);
+#if (defined(CONFIG_S5PV310_DEV_PD) && defined(CONFIG_PM_RUNTIME))
+	pm_runtime_put_sync(ctrl->dev);
+#else
+	if (pdata->clk_off)
+		pdata->clk_off(to_platform_device(ctrl->dev), &ctrl->clk);
+#endif
+	ctrl->status = FIMC_STREAMOFF;
+
+	spin_lock_irqsave(&fimc_m2m_lock, flags);
+	ctrl->pool_state = FIMC_POOL_FREE;
+	ctrl->pool_owner = NULL;
+	ctrl->pool_ctx = NULL;
+	spin_unlock_irqrestore(&fimc_m2m_lock, flags);
+}
+
+static void fimc_m2m_release_work(struct work_struct *work)
+{
+	struct fimc_control *ctrl = container_of(to_delayed_work(work),
+					struct fimc_control, pool_work);
+
+	mutex_lock(&ctrl->lock);
+	if (atomic_read(&ctrl->in_use) == 0)
+		fimc_m2m_release(ctrl);
+	mutex_unlock(&ctrl->lock);
+}
+
+/* Called with fimc_m2m_lock held */
+static void fimc_m2m_run(struct fimc_control *ctrl, struct fimc_control *owner,
+			 struct fimc_ctx *ctx, int idx)
+{
+	struct fimc_buf_set buf_set;
+	int i, cfg;
+
+	fimc_outdev_set_src_addr(ctrl, ctx->src[idx].base);
+
+	memset(&buf_set, 0x00, sizeof(buf_set));
+	buf_set.base[FIMC_ADDR_Y] = ctx->dst[idx].base[FIMC_ADDR_Y];
+	switch (ctx->fbuf.fmt.pixelformat) {
+	case V4L2_PIX_FMT_YUV420:
+		buf_set.base[FIMC_ADDR_CR] = ctx->dst[idx].base[FIMC_ADDR_CR];
+		/* fall through */
+	case V4L2_PIX_FMT_NV12:		/* fall through */
+	case V4L2_PIX_FMT_NV21:		/* fall through */
+	case V4L2_PIX_FMT_NV12T:
+		buf_set.base[FIMC_ADDR_CB] = ctx->dst[idx].base[FIMC_ADDR_CB];
+		break;
+	default:
+		break;
+	}
+
+	cfg = fimc_hwget_output_buf_sequence(ctrl);
+	for (i = 0; i < FIMC_PHYBUFS; i++) {
+		if (check_bit(cfg, i))
+			fimc_hwset_output_address(ctrl, &buf_set, i);
+	}
+
+	fimc_outdev_start_camif(ctrl);
+
+	ctrl->pool_state = FIMC_POOL_BUSY;
+	ctrl->pool_owner = owner;
+	ctrl->pool_idx = idx;
+	ctrl->status = FIMC_STREAMON;
+	ctrl->m2m_start = ktime_get();
+	owner->m2m_lent++;
+	atomic_inc(&ctx->pool_jobs);
+}
+
+/*
+ * Start the oldest buffer queued on @owner if its context can run here.
+ * Called with fimc_m2m_lock held and pool_state IDLE.
+ */
+static int fimc_m2m_next(struct fimc_control *ctrl, struct fimc_control *owner)
+{
+	struct fimc_ctx *ctx;
+	int ctx_num, idx;
+
+	if (atomic_read(&ctrl->in_use) || !owner->out)
+		return -EBUSY;
+
+	if (fimc_peek_inq(owner, &ctx_num) < 0)
+		return -ENOENT;
+
+	ctx = &owner->out->ctx[ctx_num];
+	if (ctx->overlay.mode != FIMC_OVLY_NONE_MULTI_BUF ||
+	    !fimc_m2m_ctx_running(ctx))
+		return -EINVAL;
+
+	/* Limits differ between controllers: the setup fails if too big */
+	if (ctrl->pool_ctx != ctx) {
+		ctrl->status = FIMC_STREAMON_IDLE;
+		if (fimc_outdev_set_ctx_param(ctrl, ctx) < 0) {
+			ctrl->pool_ctx = NULL;
+			return -EINVAL;
+		}
+		ctrl->pool_ctx = ctx;
+	}
+
+	if (fimc_pop_inq_ctx(owner, ctx_num, &idx) < 0)
+		return -EAGAIN;
+
+	fimc_m2m_run(ctrl, owner, ctx, idx);
+
+	return 0;
+}
+
+void fimc_m2m_kick(struct fimc_control *owner)
+{
+	struct fimc_control *ctrl;
+	unsigned long flags;
+	int ctx_num, i, ret;
+
+	for (i = 0; i < FIMC_DEVICES; i++) {
+		ctrl = get_fimc_ctrl(i);
+		if (!fimc_m2m_usable(owner, ctrl))
+			continue;
+
+		if (fimc_peek_inq(owner, &ctx_num) < 0)
+			break;
+
+		/* Never wait behind an open() of the other controller */
+		if (!mutex_trylock(&ctrl->lock))
+			continue;
+
+		if (atomic_read(&ctrl->in_use)) {
+			mutex_unlock(&ctrl->lock);
+			continue;
+		}
+
+		if (ctrl->pool_state == FIMC_POOL_FREE)
+			fimc_m2m_power_on(ctrl);
+
+		ret = -EBUSY;
+		spin_lock_irqsave(&fimc_m2m_lock, flags);
+		if (ctrl->pool_state == FIMC_POOL_IDLE)
+			ret = fimc_m2m_next(ctrl, owner);
+		spin_unlock_irqrestore(&fimc_m2m_lock, flags);
+
+		if (ret < 0 && ctrl->pool_state == FIMC_POOL_IDLE)
+			schedule_delayed_work(&ctrl->pool_work,
+					      FIMC_M2M_IDLE_DELAY);
+		else if (ret == 0)
+			cancel_delayed_work(&ctrl->pool_work);
+
+		mutex_unlock(&ctrl->lock);
+	}
+}
+
+/* Called with fimc_m2m_lock held */
+static void fimc_m2m_account(struct fimc_control *ctrl)
+{
+	s64 delta;
+
+	if (!ctrl->m2m_start.tv64)
+		return;
+
+	delta = ktime_to_ns(ktime_sub(ktime_get(), ctrl->m2m_start));
+	ctrl->m2m_busy_ns += delta;
+	ctrl->m2m_window_ns += delta;
+	ctrl->m2m_jobs++;
+	ctrl->m2m_start.tv64 = 0;
+}
+
+int fimc_m2m_irq(struct fimc_control *ctrl)
+{
+	struct fimc_control *owner;
+	struct fimc_ctx *ctx;
+	int idx;
+
+	spin_lock(&fimc_m2m_lock);
+	if (ctrl->pool_state != FIMC_POOL_BUSY) {
+		spin_unlock(&fimc_m2m_lock);
+		return 0;
+	}
+
+	fimc_hwset_clear_irq(ctrl);
+
+	owner = ctrl->pool_owner;
+	ctx = ctrl->pool_ctx;
+	idx = ctrl->pool_idx;
+
+	fimc_m2m_account(ctrl);
+	ctrl->m2m_borrowed++;
+	ctrl->pool_state = FIMC_POOL_IDLE;
+	ctrl->status = FIMC_STREAMON_IDLE;
+
+	if (fimc_m2m_ctx_running(ctx)) {
+		if (fimc_push_outq(owner, ctx, idx) < 0)
+			fimc_err("Failed: fimc_push_outq\n");
+		fimc_dma_device_wrote(&ctx->dst[idx]);
+	} else if (ctx->status == FIMC_READY_OFF &&
+		   owner->out->idxs.active.ctx != ctx->ctx_num) {
+		/* The owner has nothing left to finish for this context */
+		ctx->status = FIMC_STREAMOFF;
+	}
+	atomic_dec(&ctx->pool_jobs);
+
+#if (defined(CONFIG_S5PV310_DEV_PD) && defined(CONFIG_PM_RUNTIME))
+	/* The owner took a runtime PM reference for this buffer at qbuf */
+	atomic_inc(&owner->irq_cnt);
+	queue_work(owner->fimc_irq_wq, &owner->work_struct);
+#endif
+
+	if (fimc_m2m_next(ctrl, owner) < 0)
+		schedule_delayed_work(&ctrl->pool_work, FIMC_M2M_IDLE_DELAY);
+
+	spin_unlock(&fimc_m2m_lock);
+
+	wake_up(&owner->wq);
+	wake_up(&ctrl->wq);
+
+	return 1;
+}
+
+void fimc_m2m_reclaim(struct fimc_control *ctrl)
+{
+	struct fimc_ctx *ctx;
+	unsigned long flags;
+	int ret;
+
+	if (ctrl->pool_state == FIMC_POOL_FREE)
+		return;
+
+	/* new jobs stop here: in_use is no longer zero */
+	ret = wait_event_timeout(ctrl->wq,
+			ctrl->pool_state != FIMC_POOL_BUSY,
+			FIMC_ONESHOT_TIMEOUT);
+	if (ret == 0) {
+		fimc_err("%s: lent job did not finish\n", __func__);
+
+		spin_lock_irqsave(&fimc_m2m_lock, flags);
+		if (ctrl->pool_state == FIMC_POOL_BUSY) {
+			ctx = ctrl->pool_ctx;
+			atomic_dec(&ctx->pool_jobs);
+			ctrl->m2m_start.tv64 = 0;
+			ctrl->pool_state = FIMC_POOL_IDLE;
+		}
+		spin_unlock_irqrestore(&fimc_m2m_lock, flags);
+	}
+
+	cancel_delayed_work(&ctrl->pool_work);
+	fimc_m2m_release(ctrl);
+}
+
+void fimc_m2m_drain(struct fimc_control *owner, struct fimc_ctx *ctx)
+{
+	struct fimc_control *ctrl;
+	unsigned long flags;
+	int i, ret;
+
+	/*
+	 * ctx->status has been moved off the running states: once the
+	 * lock has been taken, no other controller starts a buffer of it.
+	 */
+	spin_lock_irqsave(&fimc_m2m_lock, flags);
+	spin_unlock_irqrestore(&fimc_m2m_lock, flags);
+
+	ret = wait_event_timeout(owner->wq, !atomic_read(&ctx->pool_jobs),
+				 FIMC_ONESHOT_TIMEOUT);
+	if (ret == 0)
+		fimc_err("%s: ctx%d has %d lent jobs\n", __func__,
+			 ctx->ctx_num, atomic_read(&ctx->pool_jobs));
+
+	/* The context may be reconfigured before it runs again */
+	spin_lock_irqsave(&fimc_m2m_lock, flags);
+	for (i = 0; i < FIMC_DEVICES; i++) {
+		ctrl = get_fimc_ctrl(i);
+		if (ctrl->pool_ctx == ctx && ctrl->pool_state != FIMC_POOL_BUSY)
+			ctrl->pool_ctx = NULL;
+	}
+	spin_unlock_irqrestore(&fimc_m2m_lock, flags);
+}
+
+/* @owner is about to free its output contexts */
+void fimc_m2m_forget(struct fimc_control *owner)
+{
+	struct fimc_control *ctrl;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&fimc_m2m_lock, flags);
+	for (i = 0; i < FIMC_DEVICES; i++) {
+		ctrl = get_fimc_ctrl(i);
+		if (ctrl->pool_owner != owner ||
+		    ctrl->pool_state == FIMC_POOL_BUSY)
+			continue;
+
+		ctrl->pool_owner = NULL;
+		ctrl->pool_ctx = NULL;
+	}
+	spin_unlock_irqrestore(&fimc_m2m_lock, flags);
+}
+
+void fimc_m2m_job_start(struct fimc_control *ctrl)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&fimc_m2m_lock, flags);
+	ctrl->m2m_start = ktime_get();
+	spin_unlock_irqrestore(&fimc_m2m_lock, flags);
+}
+
+void fimc_m2m_job_done(struct fimc_control *ctrl)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&fimc_m2m_lock, flags);
+	fimc_m2m_account(ctrl);
+	spin_unlock_irqrestore(&fimc_m2m_lock, flags);
+}
+
+/*
+ * Utilization is the busy time since the previous read, so polling the
+ * file gives the load over the polling period.
+ */
+int fimc_m2m_show_stat(struct fimc_control *ctrl, char *buf)
+{
+	unsigned long flags;
+	ktime_t now;
+	u64 window, busy, total;
+	u32 jobs, borrowed, lent;
+
+	spin_lock_irqsave(&fimc_m2m_lock, flags);
+	now = ktime_get();
+	window = ktime_to_ns(ktime_sub(now, ctrl->m2m_since));
+	busy = ctrl->m2m_window_ns;
+	total = ctrl->m2m_busy_ns;
+	jobs = ctrl->m2m_jobs;
+	borrowed = ctrl->m2m_borrowed;
+	lent = ctrl->m2m_lent;
+	ctrl->m2m_since = now;
+	ctrl->m2m_window_ns = 0;
+	spin_unlock_irqrestore(&fimc_m2m_lock, flags);
+
+	/* in units of 1024ns so that the divisor fits 32 bits */
+	window >>= 10;
+	busy = (busy * 100) >> 10;
+	if (window)
+		do_div(busy, (u32)window);
+	else
+		busy = 0;
+	do_div(total, NSEC_PER_USEC);
+
+	return sprintf(buf, "jobs %u\nborrowed %u\nlent %u\n"
+			"busy_us %llu\nutil %llu%%\n",
+			jobs, borrowed, lent, (unsigned long long)total,
+			(unsigned long long)busy);
+}
+
+void fimc_m2m_init(struct fimc_control *ctrl)
+{
+	ctrl->pool_state = FIMC_POOL_FREE;
+	ctrl->pool_owner = NULL;
+	ctrl->pool_ctx = NULL;
+	ctrl->m2m_since = ktime_get();
+	INIT_DELAYED_WORK(&ctrl->pool_work, fimc_m2m_release_work);
+}
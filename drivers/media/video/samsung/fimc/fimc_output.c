@@ -211,6 +211,7 @@ int fimc_outdev_stop_streaming(struct fimc_control *ctrl, struct fimc_ctx *ctx)
 			fimc_err("fail %s: %d\n", __func__, ctx->ctx_num);
 		}
 
+		fimc_m2m_drain(ctrl, ctx);
 		break;
 	default:
 		break;
@@ -2199,6 +2200,7 @@ int fimc_streamoff_output(void *fh)
 	ctx = &ctrl->out->ctx[ctx_id];
 	/* Move it to here to ignore fimc_irq_out_dma operation. */
 	ctx->status = FIMC_STREAMOFF;
+	fimc_m2m_drain(ctrl, ctx);
 
 	if (ctx->overlay.mode == FIMC_OVLY_DMA_AUTO ||
 			ctx->overlay.mode == FIMC_OVLY_DMA_MANUAL) {
@@ -2465,6 +2467,7 @@ static int fimc_qbuf_output_multi_buf(struct fimc_control *ctrl,
 		fimc_err("Fail: fimc_start_camif\n");
 		return -EINVAL;
 	}
+	fimc_m2m_job_start(ctrl);
 
 	ctrl->out->idxs.active.idx = idx;
 	ctrl->out->idxs.active.ctx = ctx->ctx_num;
@@ -2804,6 +2807,10 @@ int fimc_qbuf_output(void *fh, struct v4l2_buffer *b)
 		}
 	}
 
+	/* Hand what this controller can't start now to idle ones. */
+	if (ctrl->out->ctx[ctx_id].overlay.mode == FIMC_OVLY_NONE_MULTI_BUF)
+		fimc_m2m_kick(ctrl);
+
 	return ret;
 }
 
@@ -3098,7 +3105,8 @@ int fimc_push_inq(struct fimc_control *ctrl, struct fimc_ctx *ctx, int idx)
 	return 0;
 }
 
-int fimc_pop_inq(struct fimc_control *ctrl, int *ctx_num, int *idx)
+static int __fimc_pop_inq(struct fimc_control *ctrl, int want,
+			  int *ctx_num, int *idx)
 {
 	struct fimc_ctx *ctx;
 	unsigned long spin_flags;
@@ -3110,6 +3118,11 @@ int fimc_pop_inq(struct fimc_control *ctrl, int *ctx_num, int *idx)
 	/* find valid index from common incoming queue */
 	for (i = (FIMC_INQUEUES-1); i >= 0; i--) {
 		if (ctrl->out->inq[i].ctx != -1) {
+			if (want >= 0 && ctrl->out->inq[i].ctx != want) {
+				spin_unlock_irqrestore(&ctrl->out->lock_in,
+							spin_flags);
+				return -EAGAIN;
+			}
 			*ctx_num = ctrl->out->inq[i].ctx;
 			*idx = ctrl->out->inq[i].idx;
 			ctrl->out->inq[i].ctx = -1;
@@ -3150,6 +3163,39 @@ int fimc_pop_inq(struct fimc_control *ctrl, int *ctx_num, int *idx)
 	return ret;
 }
 
+int fimc_pop_inq(struct fimc_control *ctrl, int *ctx_num, int *idx)
+{
+	return __fimc_pop_inq(ctrl, -1, ctx_num, idx);
+}
+
+/* Detach the oldest buffer only if it belongs to @ctx_num */
+int fimc_pop_inq_ctx(struct fimc_control *ctrl, int ctx_num, int *idx)
+{
+	int num;
+
+	return __fimc_pop_inq(ctrl, ctx_num, &num, idx);
+}
+
+/* Context of the oldest buffer in the common incoming queue */
+int fimc_peek_inq(struct fimc_control *ctrl, int *ctx_num)
+{
+	unsigned long spin_flags;
+	int i;
+
+	spin_lock_irqsave(&ctrl->out->lock_in, spin_flags);
+
+	for (i = (FIMC_INQUEUES-1); i >= 0; i--) {
+		if (ctrl->out->inq[i].ctx != -1) {
+			*ctx_num = ctrl->out->inq[i].ctx;
+			break;
+		}
+	}
+
+	spin_unlock_irqrestore(&ctrl->out->lock_in, spin_flags);
+
+	return (i < 0) ? -EINVAL : 0;
+}
+
 int fimc_push_outq(struct fimc_control *ctrl, struct fimc_ctx *ctx, int idx)
 {
 	unsigned long spin_flags;
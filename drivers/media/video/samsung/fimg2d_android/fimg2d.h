@@ -18,6 +18,11 @@
 #include <linux/wait.h>
 #include <linux/mutex.h>
 #include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/list.h>
+#include <linux/timer.h>
+#include <linux/workqueue.h>
+#include <linux/poll.h>
 
 #define G2D_SFR_SIZE    0x1000
 
@@ -36,9 +41,17 @@
 #define G2D_DMA_CACHE_FLUSH	        _IOWR(G2D_IOCTL_MAGIC,5, struct g2d_dma_info)
 #define G2D_SYNC                    	_IO(G2D_IOCTL_MAGIC,6)
 #define G2D_RESET                    	_IO(G2D_IOCTL_MAGIC, 7)
+#define G2D_QUEUE_BLIT			_IOWR(G2D_IOCTL_MAGIC, 8, struct g2d_queue_req)
+#define G2D_QUEUE_WAIT			_IOW(G2D_IOCTL_MAGIC, 9, unsigned int)
+#define G2D_QUEUE_STATUS		_IOR(G2D_IOCTL_MAGIC, 10, struct g2d_queue_status)
 
 #define G2D_TIMEOUT             (1000)
 
+/* command queue limits, per file descriptor */
+#define G2D_QUEUE_MAX_BATCH	(32)
+#define G2D_QUEUE_MAX_PENDING	(128)
+#define G2D_QUEUE_MAX_PIN	(32 << 20)	/* bytes per surface */
+
 #define G2D_MAX_WIDTH   	(2048)
 #define G2D_MAX_HEIGHT  	(2048)
 
@@ -248,6 +261,25 @@ typedef struct {
         g2d_flag flag;
 } g2d_params;
 
+/*
+ * G2D_QUEUE_BLIT: enqueue 'count' blits read from 'params'.
+ * On return 'seq' holds the fence of the batch. The batch has
+ * completed once the done_seq reported by G2D_QUEUE_STATUS (or
+ * POLLIN on the file) has reached it.
+ */
+struct g2d_queue_req {
+	g2d_params	*params;
+	unsigned int	count;
+	unsigned int	seq;
+};
+
+struct g2d_queue_status {
+	unsigned int	submit_seq;	/* fence of the last queued batch */
+	unsigned int	done_seq;	/* fence of the last completed batch */
+	unsigned int	pending;	/* blits not yet completed */
+	unsigned int	faults;		/* blits dropped by fault or timeout */
+};
+
 /* for reserved memory */
 struct g2d_reserved_mem {
 	/* buffer base */
@@ -270,6 +302,37 @@ struct g2d_platdata {
 	unsigned long clkrate;
 };
 
+/* per file descriptor state of the command queue */
+struct g2d_context {
+	struct mm_struct	*mm;		/* submitter mm, pinned while open */
+	unsigned int		submit_seq;
+	unsigned int		done_seq;
+	unsigned int		pending;
+	unsigned int		faults;
+	unsigned int		reported_seq;	/* done_seq last returned to user */
+	int			engine_held;	/* G2D_BLIT left g2d_dev->lock held */
+	g2d_params		held_params;	/* and the blit it waits for */
+	wait_queue_head_t	waitq;
+};
+
+/* user pages of a queued blit surface, pinned until it completes */
+struct g2d_pin {
+	unsigned long		first;		/* page aligned user address */
+	unsigned int		nr;
+	struct page		**pages;
+};
+
+struct g2d_job {
+	struct list_head	node;
+	struct g2d_context	*ctx;
+	g2d_params		params;
+	u32			pgd;		/* physical base of page table */
+	struct g2d_pin		src_pin;
+	struct g2d_pin		dst_pin;
+	unsigned int		seq;
+	int			last;		/* last blit of its batch */
+};
+
 struct g2d_timer {
 	int			cnt;
 	struct timeval		start_marker;
@@ -288,8 +351,6 @@ struct g2d_global {
 	struct mutex		lock;
 	struct device		* dev;
 	atomic_t 		ready_to_run;
-	int 			src_attribute;
-	int 			dst_attribute;
 
 	struct g2d_reserved_mem	reserved_mem;		/* for reserved memory */
 	atomic_t		is_mmu_faulted;
@@ -298,6 +359,18 @@ struct g2d_global {
 	struct early_suspend	early_suspend;
 #endif	
 	int			irq_handled;
+
+	/* command queue */
+	spinlock_t		queue_lock;
+	struct list_head	queue;
+	struct g2d_job		*cur_job;
+	int			queue_active;	/* queue holds clock and in_use */
+	int			queue_owner;	/* engine held by G2D_BLIT */
+	wait_queue_head_t	queue_idle;
+	struct timer_list	queue_timer;
+	unsigned long		queue_deadline;
+	struct list_head	queue_done;	/* retired, pages to unpin */
+	struct work_struct	queue_done_work;
 };
 
 
@@ -366,9 +439,8 @@ void g2d_set_int_finish(struct g2d_global *g2d_dev);
 
 /* fimg2d_cache */
 void g2d_clip_for_src(g2d_rect *src_rect, g2d_rect *dst_rect, g2d_clip *clip, g2d_clip *src_clip);
-void g2d_mem_inner_cache(g2d_params *params);
-void g2d_mem_outer_cache(struct g2d_global *g2d_dev, g2d_params *params, int *need_dst_clean);
-void g2d_mem_cache_oneshot(void *src_addr,  void *dst_addr, unsigned long src_size, unsigned long dst_size);
+void g2d_mem_cache_sync(g2d_params *params);
+void g2d_mem_dst_wrote(g2d_params *params);
 u32 g2d_mem_cache_op(unsigned int cmd, void * addr, unsigned int size);
 void g2d_mem_outer_cache_flush(void *start_addr, unsigned long size);                                      
 void g2d_mem_outer_cache_clean(const void *start_addr, unsigned long size);
@@ -388,8 +460,23 @@ void g2d_sysmmu_off(struct g2d_global *g2d_dev);
 void g2d_sysmmu_set_pgd(u32 pgd);
 void g2d_fail_debug(g2d_params *params);
 int g2d_init_regs(struct g2d_global *g2d_dev, g2d_params *params);
+int g2d_prepare_blit(struct g2d_global *g2d_dev, g2d_params *params, unsigned long *pgd, int *need_dst_clean);
 int g2d_do_blit(struct g2d_global *g2d_dev, g2d_params *params);
 int g2d_wait_for_finish(struct g2d_global *g2d_dev, g2d_params *params);
 int g2d_init_mem(struct device *dev, unsigned int *base, unsigned int *size);
 
+/* fimg2d_queue */
+void g2d_queue_init(struct g2d_global *g2d_dev);
+struct g2d_context *g2d_queue_ctx_create(void);
+void g2d_queue_ctx_destroy(struct g2d_global *g2d_dev, struct g2d_context *ctx);
+int g2d_queue_submit(struct g2d_global *g2d_dev, struct g2d_context *ctx, struct g2d_queue_req *req, int nonblock);
+int g2d_queue_wait(struct g2d_global *g2d_dev, struct g2d_context *ctx, unsigned int seq);
+void g2d_queue_status(struct g2d_global *g2d_dev, struct g2d_context *ctx, struct g2d_queue_status *status);
+unsigned int g2d_queue_poll(struct g2d_global *g2d_dev, struct g2d_context *ctx, struct file *file, poll_table *wait);
+int g2d_queue_irq(struct g2d_global *g2d_dev);
+int g2d_queue_fault(struct g2d_global *g2d_dev);
+void g2d_queue_kick(struct g2d_global *g2d_dev);
+void g2d_queue_claim_engine(struct g2d_global *g2d_dev);
+void g2d_queue_release_engine(struct g2d_global *g2d_dev);
+
 #endif /*__SEC_FIMG2D_H_*/
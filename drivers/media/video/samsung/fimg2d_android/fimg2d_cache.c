@@ -17,12 +17,9 @@
 #include <linux/sched.h>
 #include <linux/poll.h>
 
-#include "fimg2d.h"
-
-#define L1_ALL_THRESHOLD_SIZE SZ_64K
-#define L2_ALL_THRESHOLD_SIZE SZ_1M
+#include <plat/s5p-bufsync.h>
 
-#define L2_CACHE_SKIP_MARK 256*4
+#include "fimg2d.h"
 
 void g2d_pagetable_clean(const void *start_addr, unsigned long size, unsigned long pgd)
 {
@@ -133,151 +130,44 @@ void g2d_clip_for_src(g2d_rect *src_rect, g2d_rect *dst_rect, g2d_clip *clip, g2
 	}
 }
 
-void g2d_mem_inner_cache(g2d_params * params)
+/*
+ * Clean the source and flush the destination rows before a blit.
+ * The shared layer walks the rows or flushes the whole cache,
+ * whichever is cheaper, and skips buffers last written by another
+ * engine.
+ */
+void g2d_mem_cache_sync(g2d_params *params)
 {
-	void *src_addr, *dst_addr;
-	unsigned long src_size, dst_size;
 	g2d_clip clip_src;
 	g2d_clip_for_src(&params->src_rect, &params->dst_rect, &params->clip, &clip_src);
 
-	src_addr = (void *)GET_START_ADDR_C(params->src_rect, clip_src); 
-	dst_addr = (void *)GET_START_ADDR_C(params->dst_rect, params->clip);
-	src_size = (unsigned long)GET_RECT_SIZE_C(params->src_rect, clip_src); 
-	dst_size = (unsigned long)GET_RECT_SIZE_C(params->dst_rect, params->clip);
-
-	if((src_size + dst_size) < L1_ALL_THRESHOLD_SIZE) {
-		dmac_map_area(src_addr, src_size, DMA_TO_DEVICE);
-		dmac_flush_range(dst_addr, dst_addr + dst_size);
-	} else {
-		on_each_cpu(__cpuc_flush_kern_all, NULL, 1);
-	}
+	s5p_bufsync_for_device_2d(S5P_BUFSYNC_G2D,
+		(void *)(GET_REAL_START_ADDR_C(params->src_rect, clip_src)),
+		(clip_src.r - clip_src.l) * params->src_rect.bytes_per_pixel,
+		GET_STRIDE(params->src_rect), clip_src.b - clip_src.t,
+		DMA_TO_DEVICE);
+
+	s5p_bufsync_for_device_2d(S5P_BUFSYNC_G2D,
+		(void *)(GET_REAL_START_ADDR_C(params->dst_rect, params->clip)),
+		(params->clip.r - params->clip.l) * params->dst_rect.bytes_per_pixel,
+		GET_STRIDE(params->dst_rect), params->clip.b - params->clip.t,
+		DMA_BIDIRECTIONAL);
 }
 
-void g2d_mem_outer_cache(struct g2d_global *g2d_dev, g2d_params * params, int *need_dst_clean)
-{
- 	unsigned long start_paddr, end_paddr;
-	unsigned long cur_addr, end_addr;
-	unsigned long width_bytes;
-	unsigned long stride;
-	unsigned long src_size, dst_size;
-
-#if 0
-	if (((GET_RECT_SIZE(params->src_rect) + GET_RECT_SIZE(params->dst_rect)) > L2_ALL_THRESHOLD_SIZE)
-		&& ((*need_dst_clean == true) || ( GET_RECT_SIZE(params->src_rect) > 384*640*4))) {
-		outer_flush_all();
-		*need_dst_clean = true;
-		return;
-	}	
-#endif
-
-	g2d_clip clip_src;
-	g2d_clip_for_src(&params->src_rect, &params->dst_rect, &params->clip, &clip_src);
-
-	src_size = GET_RECT_SIZE_C(params->src_rect, clip_src);
-	dst_size = GET_RECT_SIZE_C(params->dst_rect, params->clip);
-
-	if ((src_size + dst_size) >= L2_ALL_THRESHOLD_SIZE) {
-		outer_flush_all();
-		*need_dst_clean = true;
-		return;
-	}
-
-	if((GET_SPARE_BYTES(params->src_rect) < L2_CACHE_SKIP_MARK) 
-		|| ((params->src_rect.w * params->src_rect.bytes_per_pixel) >= PAGE_SIZE)) {
-		g2d_mem_outer_cache_clean((void *)GET_START_ADDR_C(params->src_rect, clip_src), 
-			(unsigned int)GET_RECT_SIZE_C(params->src_rect, clip_src));
-	} else {
-		stride = GET_STRIDE(params->src_rect);
-		width_bytes = params->src_rect.w * params->src_rect.bytes_per_pixel;
-		cur_addr = (unsigned long)GET_REAL_START_ADDR_C(params->src_rect, clip_src);
-		end_addr = (unsigned long)GET_REAL_END_ADDR_C(params->src_rect, clip_src);
-
-		while (cur_addr <= end_addr) {
-			start_paddr = virt2phys((unsigned long)cur_addr);
-			end_paddr = virt2phys((unsigned long)cur_addr + width_bytes);
-			
-			if (((end_paddr - start_paddr) > 0) && ((end_paddr -start_paddr) < PAGE_SIZE)) {
-				outer_clean_range(start_paddr, end_paddr);
-			} else {
-				outer_clean_range(start_paddr, ((start_paddr + PAGE_SIZE) & PAGE_MASK) - 1);
-				outer_clean_range(end_paddr & PAGE_MASK, end_paddr);			
-			}
-			cur_addr += stride;
-		}
-	}
-
-	if (*need_dst_clean) {
-		if ((GET_SPARE_BYTES(params->dst_rect) < L2_CACHE_SKIP_MARK)
-			|| ((params->dst_rect.w * params->src_rect.bytes_per_pixel) >= PAGE_SIZE)) {		
-			g2d_mem_outer_cache_flush((void *)GET_START_ADDR_C(params->dst_rect, params->clip), 
-				(unsigned int)GET_RECT_SIZE_C(params->dst_rect, params->clip));
-		} else {
-			stride = GET_STRIDE(params->dst_rect);
-			width_bytes = (params->clip.r - params->clip.l) * params->dst_rect.bytes_per_pixel;
-			
-			cur_addr = (unsigned long)GET_REAL_START_ADDR_C(params->dst_rect, params->clip);
-			end_addr = (unsigned long)GET_REAL_END_ADDR_C(params->dst_rect, params->clip);
-
-			while (cur_addr <= end_addr) {
-				start_paddr = virt2phys((unsigned long)cur_addr);
-				end_paddr = virt2phys((unsigned long)cur_addr + width_bytes);
-				
-				if (((end_paddr - start_paddr) > 0) && ((end_paddr -start_paddr) < PAGE_SIZE)) {
-					outer_flush_range(start_paddr, end_paddr);
-				} else {
-					outer_flush_range(start_paddr, ((start_paddr + PAGE_SIZE) & PAGE_MASK) - 1);
-					outer_flush_range(end_paddr & PAGE_MASK, end_paddr);
-				}
-				cur_addr += stride;
-			}	
-		}
-	}
-}
-
-void g2d_mem_cache_oneshot(void *src_addr,  void *dst_addr, unsigned long src_size, unsigned long dst_size)
+/*
+ * The blit is done: a registered destination is now G2D's, so another
+ * engine reading it needs no clean. Only blits the driver maintained
+ * the caches for, from the context of the submitting process.
+ */
+void g2d_mem_dst_wrote(g2d_params *params)
 {
- 	unsigned long paddr;
-        	void *cur_addr, *end_addr;
-	unsigned long full_size;
-
-	full_size = src_size + dst_size;
-
-	if(full_size < L1_ALL_THRESHOLD_SIZE)
-		dmac_map_area(src_addr, src_size, DMA_TO_DEVICE);
-	else
-		on_each_cpu(__cpuc_flush_kern_all, NULL, 1);
-
-	if(full_size > L2_ALL_THRESHOLD_SIZE) {
-		outer_flush_all();
+	if (params->flag.memory_type != G2D_MEMORY_USER
+		|| !(params->flag.render_mode & G2D_CACHE_OP))
 		return;
-	}
-
-	cur_addr = (void *)((unsigned long)src_addr & PAGE_MASK);
-	src_size = PAGE_ALIGN(src_size);
-	end_addr = cur_addr + src_size + PAGE_SIZE;
-
-	while (cur_addr < end_addr) {
-		paddr = virt2phys((unsigned long)cur_addr);
-		if (paddr) {            
-			outer_clean_range(paddr, paddr + PAGE_SIZE);
-		}
-		cur_addr += PAGE_SIZE;
-	}   
 
-	if(full_size < L1_ALL_THRESHOLD_SIZE)
-		dmac_flush_range(dst_addr, dst_addr + dst_size);
-
-	cur_addr = (void *)((unsigned long)dst_addr & PAGE_MASK);
-	dst_size = PAGE_ALIGN(dst_size);
-	end_addr = cur_addr + dst_size + PAGE_SIZE;
-
-	while (cur_addr < end_addr) {
-		paddr = virt2phys((unsigned long)cur_addr);
-		if (paddr) {            
-			outer_flush_range(paddr, paddr + PAGE_SIZE);
-		}
-		cur_addr += PAGE_SIZE;
-	}
+	s5p_bufsync_device_wrote_virt(S5P_BUFSYNC_G2D,
+		(void *)GET_START_ADDR_C(params->dst_rect, params->clip),
+		GET_RECT_SIZE_C(params->dst_rect, params->clip));
 }
 
 u32 g2d_mem_cache_op(unsigned int cmd, void *addr, unsigned int size)
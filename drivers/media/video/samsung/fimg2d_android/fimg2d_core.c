@@ -148,11 +148,14 @@ int g2d_init_regs(struct g2d_global *g2d_dev, g2d_params *params)
 	return 0;
 }
 
-int g2d_do_blit(struct g2d_global *g2d_dev, g2d_params *params)
+/*
+ * Translate addresses, check page tables and do the cache maintenance
+ * for a blit. This must run in the context of the submitting process.
+ * On success *pgd holds the page table the engine has to use.
+ */
+int g2d_prepare_blit(struct g2d_global *g2d_dev, g2d_params *params,
+			unsigned long *pgd, int *need_dst_clean)
 {
-	unsigned long 	pgd;
-	int need_dst_clean = true;
-
 	if ((params->src_rect.addr == NULL) 
 		|| (params->dst_rect.addr == NULL)) {
 		FIMG2D_ERROR("error : addr Null\n");
@@ -162,52 +165,60 @@ int g2d_do_blit(struct g2d_global *g2d_dev, g2d_params *params)
 	if (params->flag.memory_type == G2D_MEMORY_KERNEL) {
 		params->src_rect.addr = (unsigned char *)phys_to_virt((unsigned long)params->src_rect.addr);
 		params->dst_rect.addr = (unsigned char *)phys_to_virt((unsigned long)params->dst_rect.addr);
-		pgd = (unsigned long)init_mm.pgd;
+		*pgd = (unsigned long)init_mm.pgd;
 	} else {
-		pgd = (unsigned long)current->mm->pgd;
+		*pgd = (unsigned long)current->mm->pgd;
 	}
 
 	if (params->flag.memory_type == G2D_MEMORY_USER)
 	{
 		g2d_clip clip_src;
+		int src_attribute, dst_attribute;
+
 		g2d_clip_for_src(&params->src_rect, &params->dst_rect, &params->clip, &clip_src);
 
-		g2d_dev->src_attribute =
+		src_attribute =
 			g2d_check_pagetable((unsigned char *)GET_START_ADDR(params->src_rect),
 				(unsigned int)GET_RECT_SIZE(params->src_rect) + 8,
-					(u32)virt_to_phys((void *)pgd));
-		if (g2d_dev->src_attribute == G2D_PT_NOTVALID) {
+					(u32)virt_to_phys((void *)*pgd));
+		if (src_attribute == G2D_PT_NOTVALID) {
 			FIMG2D_DEBUG("Src is not in valid pagetable\n");
 			return false;
 		}
 
-		g2d_dev->dst_attribute = 
+		dst_attribute =
 			g2d_check_pagetable((unsigned char *)GET_START_ADDR_C(params->dst_rect, params->clip),
 				(unsigned int)GET_RECT_SIZE_C(params->dst_rect, params->clip),
-					(u32)virt_to_phys((void *)pgd));
-		if (g2d_dev->dst_attribute == G2D_PT_NOTVALID) {
+					(u32)virt_to_phys((void *)*pgd));
+		if (dst_attribute == G2D_PT_NOTVALID) {
 			FIMG2D_DEBUG("Dst is not in valid pagetable\n");
 			return false;
 		}
 
 		g2d_pagetable_clean((unsigned char *)GET_START_ADDR(params->src_rect),
 				(u32)GET_RECT_SIZE(params->src_rect) + 8,
-				(u32)virt_to_phys((void *)pgd));
+				(u32)virt_to_phys((void *)*pgd));
 		g2d_pagetable_clean((unsigned char *)GET_START_ADDR_C(params->dst_rect, params->clip),
 				(u32)GET_RECT_SIZE_C(params->dst_rect, params->clip),
-				(u32)virt_to_phys((void *)pgd));
+				(u32)virt_to_phys((void *)*pgd));
 
 		if (params->flag.render_mode & G2D_CACHE_OP) {
-			/*g2d_mem_cache_oneshot((void *)GET_START_ADDR(params->src_rect), 
-				(void *)GET_START_ADDR(params->dst_rect),
-				(unsigned int)GET_REAL_SIZE(params->src_rect), 
-				(unsigned int)GET_REAL_SIZE(params->dst_rect));*/
 		//	need_dst_clean = g2d_check_need_dst_cache_clean(params);
-			g2d_mem_inner_cache(params);
-			g2d_mem_outer_cache(g2d_dev, params, &need_dst_clean);
+			g2d_mem_cache_sync(params);
 		}
 	}
 
+	return true;
+}
+
+int g2d_do_blit(struct g2d_global *g2d_dev, g2d_params *params)
+{
+	unsigned long 	pgd;
+	int need_dst_clean = true;
+
+	if (!g2d_prepare_blit(g2d_dev, params, &pgd, &need_dst_clean))
+		return false;
+
 	g2d_sysmmu_set_pgd((u32)virt_to_phys((void *)pgd));
 
 	if(g2d_init_regs(g2d_dev, params) < 0) {
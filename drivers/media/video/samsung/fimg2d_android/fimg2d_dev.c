@@ -59,10 +59,13 @@ int g2d_sysmmu_fault(unsigned int faulted_addr, unsigned int pt_base)
 {
 	g2d_reset(g2d_dev);
 
-	atomic_set(&g2d_dev->is_mmu_faulted, 1);
-
 	g2d_dev->faulted_addr = faulted_addr;
 
+	if (g2d_queue_fault(g2d_dev))
+		return 0;
+
+	atomic_set(&g2d_dev->is_mmu_faulted, 1);
+
 	wake_up_interruptible(&g2d_dev->waitq);
 
 	return 0;
@@ -73,6 +76,9 @@ irqreturn_t g2d_irq(int irq, void *dev_id)
 {
 	g2d_set_int_finish(g2d_dev);
 
+	if (g2d_queue_irq(g2d_dev))
+		return IRQ_HANDLED;
+
 	g2d_dev->irq_handled = 1;
 
 	wake_up_interruptible(&g2d_dev->waitq);
@@ -85,6 +91,10 @@ irqreturn_t g2d_irq(int irq, void *dev_id)
 
 static int g2d_open(struct inode *inode, struct file *file)
 {
+	file->private_data = g2d_queue_ctx_create();
+	if (!file->private_data)
+		return -ENOMEM;
+
 	atomic_inc(&g2d_dev->num_of_object);
 
 	FIMG2D_DEBUG("Context Opened %d\n", atomic_read(&g2d_dev->num_of_object));
@@ -95,6 +105,21 @@ static int g2d_open(struct inode *inode, struct file *file)
 
 static int g2d_release(struct inode *inode, struct file *file)
 {
+	struct g2d_context *ctx = file->private_data;
+
+	/* closed between a G2D_HYBRID_MODE blit and its poll */
+	if (ctx->engine_held) {
+		wait_event_timeout(g2d_dev->waitq,
+			atomic_read(&g2d_dev->in_use) == 0,
+			msecs_to_jiffies(G2D_TIMEOUT));
+		g2d_clk_disable(g2d_dev);
+		ctx->engine_held = 0;
+		g2d_queue_release_engine(g2d_dev);
+		mutex_unlock(&g2d_dev->lock);
+	}
+
+	g2d_queue_ctx_destroy(g2d_dev, ctx);
+
 	atomic_dec(&g2d_dev->num_of_object);
 
 	FIMG2D_DEBUG("Context Closed %d\n", atomic_read(&g2d_dev->num_of_object));
@@ -110,10 +135,14 @@ static int g2d_mmap(struct file* filp, struct vm_area_struct *vma)
 
 static long g2d_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
+	struct g2d_context *ctx = file->private_data;
 	g2d_params params;
 	int ret = -1;
 
 	struct g2d_dma_info dma_info;
+	struct g2d_queue_req queue_req;
+	struct g2d_queue_status queue_status;
+	unsigned int seq;
 
 	switch(cmd) {
 	case G2D_GET_MEMORY :
@@ -156,22 +185,67 @@ static long g2d_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		return 0;
 
 	case G2D_SYNC :
-		g2d_check_fifo_state_wait(g2d_dev);
-		ret = 0;
-		goto g2d_ioctl_done;
-
 	case G2D_RESET :
-		g2d_reset(g2d_dev);
-		FIMG2D_ERROR("G2D TimeOut Error\n");
+		/* ends a G2D_HYBRID_MODE blit, or takes the engine for itself */
+		if (!ctx->engine_held) {
+			mutex_lock(&g2d_dev->lock);
+			g2d_queue_claim_engine(g2d_dev);
+			g2d_clk_enable(g2d_dev);
+		}
+
+		if (cmd == G2D_SYNC) {
+			g2d_check_fifo_state_wait(g2d_dev);
+			if (ctx->engine_held)
+				g2d_mem_dst_wrote(&ctx->held_params);
+		} else {
+			g2d_reset(g2d_dev);
+			FIMG2D_ERROR("G2D TimeOut Error\n");
+		}
 		ret = 0;
 		goto g2d_ioctl_done;
 
+	case G2D_QUEUE_BLIT:
+		if (copy_from_user(&queue_req, (struct g2d_queue_req *)arg, sizeof(queue_req))) {
+			FIMG2D_ERROR("error : copy_from_user\n");
+			return -EFAULT;
+		}
+
+		ret = g2d_queue_submit(g2d_dev, ctx, &queue_req,
+				file->f_flags & O_NONBLOCK);
+		if (ret)
+			return ret;
+
+		if (copy_to_user((struct g2d_queue_req *)arg, &queue_req, sizeof(queue_req))) {
+			FIMG2D_ERROR("error : copy_to_user\n");
+			return -EFAULT;
+		}
+		return 0;
+
+	case G2D_QUEUE_WAIT:
+		if (copy_from_user(&seq, (unsigned int *)arg, sizeof(seq))) {
+			FIMG2D_ERROR("error : copy_from_user\n");
+			return -EFAULT;
+		}
+
+		return g2d_queue_wait(g2d_dev, ctx, seq);
+
+	case G2D_QUEUE_STATUS:
+		g2d_queue_status(g2d_dev, ctx, &queue_status);
+
+		if (copy_to_user((struct g2d_queue_status *)arg, &queue_status, sizeof(queue_status))) {
+			FIMG2D_ERROR("error : copy_to_user\n");
+			return -EFAULT;
+		}
+		return 0;
+
 	case G2D_BLIT:
 		if  (atomic_read(&g2d_dev->ready_to_run) == 0)
 			goto g2d_ioctl_done2;
 
 		mutex_lock(&g2d_dev->lock);
 
+		g2d_queue_claim_engine(g2d_dev);
+
 		g2d_clk_enable(g2d_dev);
 
 		if (copy_from_user(&params, (struct g2d_params *)arg, sizeof(g2d_params))) {
@@ -193,8 +267,12 @@ static long g2d_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			if(!(file->f_flags & O_NONBLOCK)) {
 				if (!g2d_wait_for_finish(g2d_dev, &params))
 					goto g2d_ioctl_done;
+				g2d_mem_dst_wrote(&params);
 			}
 		} else {
+			/* g2d_poll, G2D_SYNC or G2D_RESET lets go of the engine */
+			ctx->engine_held = 1;
+			ctx->held_params = params;
 			ret = 0;
 			goto g2d_ioctl_done2;
 		}
@@ -212,10 +290,13 @@ g2d_ioctl_done :
 
 	g2d_clk_disable(g2d_dev);
 
-	mutex_unlock(&g2d_dev->lock);
-
 	atomic_set(&g2d_dev->in_use, 0);
 
+	ctx->engine_held = 0;
+	g2d_queue_release_engine(g2d_dev);
+
+	mutex_unlock(&g2d_dev->lock);
+
 g2d_ioctl_done2 :
 
 	return ret;
@@ -223,12 +304,20 @@ g2d_ioctl_done2 :
 
 static unsigned int g2d_poll(struct file *file, poll_table *wait)
 {
+	struct g2d_context *ctx = file->private_data;
 	unsigned int mask = 0;
 
+	/* only a G2D_HYBRID_MODE blit of this file waits on the engine */
+	if (!ctx->engine_held)
+		return g2d_queue_poll(g2d_dev, ctx, file, wait);
+
 	if (atomic_read(&g2d_dev->in_use) == 0) {
 		mask = POLLOUT | POLLWRNORM;
 		g2d_clk_disable(g2d_dev);
 
+		g2d_mem_dst_wrote(&ctx->held_params);
+		ctx->engine_held = 0;
+		g2d_queue_release_engine(g2d_dev);
 		mutex_unlock(&g2d_dev->lock);
 
 	} else {
@@ -238,6 +327,9 @@ static unsigned int g2d_poll(struct file *file, poll_table *wait)
 			mask = POLLOUT | POLLWRNORM;
 			g2d_clk_disable(g2d_dev);
 
+			g2d_mem_dst_wrote(&ctx->held_params);
+			ctx->engine_held = 0;
+			g2d_queue_release_engine(g2d_dev);
 			mutex_unlock(&g2d_dev->lock);
 		}
 	}
@@ -361,6 +453,9 @@ static int g2d_probe(struct platform_device *pdev)
 	/* blocking I/O */
 	init_waitqueue_head(&g2d_dev->waitq);
 
+	/* command queue */
+	g2d_queue_init(g2d_dev);
+
 	/* atomic init */
 	atomic_set(&g2d_dev->in_use, 0);
 	atomic_set(&g2d_dev->num_of_object, 0);
@@ -432,6 +527,9 @@ static int g2d_remove(struct platform_device *dev)
 
 	free_irq(g2d_dev->irq_num, NULL);
 
+	del_timer_sync(&g2d_dev->queue_timer);
+	flush_work(&g2d_dev->queue_done_work);
+
 	if (g2d_dev->mem != NULL) {
 		FIMG2D_INFO("releasing resource\n");
 		iounmap(g2d_dev->base);
@@ -503,6 +601,7 @@ void g2d_late_resume(struct early_suspend *h)
 
 	atomic_set(&g2d_dev->ready_to_run, 1);
 
+	g2d_queue_kick(g2d_dev);
 }
 #endif
 
@@ -540,6 +639,8 @@ static int g2d_resume(struct platform_device *pdev)
 
 	atomic_set(&g2d_dev->ready_to_run, 1);
 
+	g2d_queue_kick(g2d_dev);
+
 	return 0;
 }
 #endif
@@ -0,0 +1,623 @@
+/* drivers/media/video/samsung/fimg2d_android/fimg2d_queue.c
+ *
+ * Copyright  2010 Samsung Electronics Co, Ltd. All Rights Reserved.
+ *		      http://www.samsungsemi.com/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements the fimg2d command queue. Blits are prepared in
+ * the context of the submitting process and then fed to the engine
+ * back-to-back from the interrupt handler. Every batch of blits gets a
+ * sequence number which is signalled through poll() on completion.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/jiffies.h>
+#include <linux/poll.h>
+#include <linux/highmem.h>
+#include <linux/dma-mapping.h>
+#include <asm/uaccess.h>
+#include <asm/cacheflush.h>
+
+#include <plat/s5p-bufsync.h>
+
+#include "fimg2d.h"
+
+static inline int g2d_seq_passed(unsigned int seq, unsigned int done)
+{
+	return (int)(done - seq) >= 0;
+}
+
+/*
+ * Pin the user pages under [start, start + size), so that they stay
+ * in place while the engine works on them after the ioctl returned.
+ */
+static int g2d_queue_pin(struct g2d_pin *pin, unsigned long start,
+				unsigned long size, int write)
+{
+	int got;
+
+	if (size > G2D_QUEUE_MAX_PIN || start + size < start)
+		return -EINVAL;
+
+	pin->first = start & PAGE_MASK;
+	pin->nr = (PAGE_ALIGN(start + size) - pin->first) >> PAGE_SHIFT;
+	pin->pages = kmalloc(pin->nr * sizeof(struct page *), GFP_KERNEL);
+	if (!pin->pages)
+		return -ENOMEM;
+
+	down_read(&current->mm->mmap_sem);
+	got = get_user_pages(current, current->mm, pin->first, pin->nr,
+				write, 0, pin->pages, NULL);
+	up_read(&current->mm->mmap_sem);
+
+	if (got == pin->nr)
+		return 0;
+
+	while (got > 0)
+		put_page(pin->pages[--got]);
+	kfree(pin->pages);
+	pin->pages = NULL;
+
+	return -EFAULT;
+}
+
+static void g2d_queue_unpin(struct g2d_pin *pin, int dirty)
+{
+	unsigned int i;
+
+	if (!pin->pages)
+		return;
+
+	for (i = 0; i < pin->nr; i++) {
+		if (dirty)
+			set_page_dirty_lock(pin->pages[i]);
+		put_page(pin->pages[i]);
+	}
+	kfree(pin->pages);
+	pin->pages = NULL;
+}
+
+/* may sleep: set_page_dirty_lock() takes the page lock */
+static void g2d_queue_free_job(struct g2d_job *job)
+{
+	g2d_queue_unpin(&job->src_pin, false);
+	g2d_queue_unpin(&job->dst_pin, true);
+	kfree(job);
+}
+
+static void g2d_queue_done_work(struct work_struct *work)
+{
+	struct g2d_global *g2d_dev =
+		container_of(work, struct g2d_global, queue_done_work);
+	LIST_HEAD(done);
+	struct g2d_job *job, *n;
+	unsigned long flags;
+
+	spin_lock_irqsave(&g2d_dev->queue_lock, flags);
+	list_splice_init(&g2d_dev->queue_done, &done);
+	spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+
+	list_for_each_entry_safe(job, n, &done, node) {
+		list_del(&job->node);
+		g2d_queue_free_job(job);
+	}
+}
+
+/* invalidate the pinned pages under [addr, addr + size), L2 then L1 */
+static void g2d_queue_pin_inv(struct g2d_pin *pin, unsigned long addr,
+				unsigned long size)
+{
+	unsigned long idx, off, len, phys;
+	void *kaddr;
+
+	while (size) {
+		idx = (addr - pin->first) >> PAGE_SHIFT;
+		if (addr < pin->first || idx >= pin->nr)
+			return;
+
+		off = addr & ~PAGE_MASK;
+		len = min(size, PAGE_SIZE - off);
+		phys = page_to_phys(pin->pages[idx]) + off;
+
+		outer_inv_range(phys, phys + len);
+		kaddr = kmap_atomic(pin->pages[idx], KM_IRQ0);
+		dmac_unmap_area(kaddr + off, len, DMA_FROM_DEVICE);
+		kunmap_atomic(kaddr, KM_IRQ0);
+
+		addr += len;
+		size -= len;
+	}
+}
+
+/*
+ * The CPU may have pulled destination lines back into the caches while
+ * the engine was writing: drop them before the fence is signalled.
+ * Called with queue_lock held, so interrupts are off.
+ */
+static void g2d_queue_inv_dst(struct g2d_job *job)
+{
+	g2d_params *params = &job->params;
+	unsigned long addr, width, stride;
+	unsigned int lines;
+
+	addr = (unsigned long)GET_REAL_START_ADDR_C(params->dst_rect, params->clip);
+	width = (params->clip.r - params->clip.l) * params->dst_rect.bytes_per_pixel;
+	stride = GET_STRIDE(params->dst_rect);
+
+	for (lines = params->clip.b - params->clip.t; lines; lines--) {
+		g2d_queue_pin_inv(&job->dst_pin, addr, width);
+		addr += stride;
+	}
+}
+
+/*
+ * A physically contiguous destination may be a registered buffer:
+ * tell the shared cache layer that G2D wrote it.
+ */
+static void g2d_queue_dst_wrote(struct g2d_job *job)
+{
+	struct g2d_pin *pin = &job->dst_pin;
+	unsigned long start, pfn;
+	unsigned int i;
+
+	pfn = page_to_pfn(pin->pages[0]);
+	for (i = 1; i < pin->nr; i++)
+		if (page_to_pfn(pin->pages[i]) != pfn + i)
+			return;
+
+	start = (unsigned long)GET_START_ADDR_C(job->params.dst_rect,
+						job->params.clip);
+	s5p_bufsync_device_wrote(S5P_BUFSYNC_G2D,
+		(pfn << PAGE_SHIFT) + (start - pin->first),
+		GET_RECT_SIZE_C(job->params.dst_rect, job->params.clip));
+}
+
+/* called with queue_lock held */
+static void g2d_queue_retire(struct g2d_global *g2d_dev, struct g2d_job *job,
+				int failed)
+{
+	struct g2d_context *ctx = job->ctx;
+
+	if (failed) {
+		ctx->faults++;
+		g2d_fail_debug(&job->params);
+	}
+
+	if (job->dst_pin.pages
+		&& (job->params.flag.render_mode & G2D_CACHE_OP)) {
+		g2d_queue_inv_dst(job);
+		g2d_queue_dst_wrote(job);
+	}
+
+	ctx->pending--;
+	if (job->last)
+		ctx->done_seq = job->seq;
+
+	wake_up(&ctx->waitq);
+
+	/* unpin from process context */
+	list_add_tail(&job->node, &g2d_dev->queue_done);
+	schedule_work(&g2d_dev->queue_done_work);
+}
+
+/* called with queue_lock held */
+static int g2d_queue_start_job(struct g2d_global *g2d_dev, struct g2d_job *job)
+{
+	g2d_sysmmu_set_pgd(job->pgd);
+
+	if (g2d_init_regs(g2d_dev, &job->params) < 0)
+		return -1;
+
+	g2d_dev->cur_job = job;
+	g2d_dev->queue_deadline = jiffies + msecs_to_jiffies(G2D_TIMEOUT);
+	mod_timer(&g2d_dev->queue_timer, g2d_dev->queue_deadline);
+
+	g2d_start_bitblt(g2d_dev, &job->params);
+
+	return 0;
+}
+
+/* called with queue_lock held: feed the engine while it is ours */
+static void g2d_queue_run(struct g2d_global *g2d_dev)
+{
+	struct g2d_job *job;
+
+	while (!g2d_dev->cur_job && !g2d_dev->queue_owner
+		&& !list_empty(&g2d_dev->queue)
+		&& atomic_read(&g2d_dev->ready_to_run)) {
+		job = list_first_entry(&g2d_dev->queue, struct g2d_job, node);
+		list_del(&job->node);
+
+		if (!g2d_dev->queue_active) {
+			atomic_set(&g2d_dev->in_use, 1);
+			g2d_clk_enable(g2d_dev);
+			g2d_dev->queue_active = 1;
+		}
+
+		if (g2d_queue_start_job(g2d_dev, job) < 0)
+			g2d_queue_retire(g2d_dev, job, 1);
+	}
+
+	if (g2d_dev->cur_job)
+		return;
+
+	if (g2d_dev->queue_active) {
+		g2d_dev->queue_active = 0;
+		atomic_set(&g2d_dev->in_use, 0);
+		g2d_clk_disable(g2d_dev);
+	}
+
+	wake_up(&g2d_dev->queue_idle);
+}
+
+/* called with queue_lock held */
+static void __g2d_queue_complete(struct g2d_global *g2d_dev, int failed)
+{
+	struct g2d_job *job = g2d_dev->cur_job;
+
+	del_timer(&g2d_dev->queue_timer);
+	g2d_dev->cur_job = NULL;
+
+	g2d_queue_retire(g2d_dev, job, failed);
+	g2d_queue_run(g2d_dev);
+}
+
+static int g2d_queue_complete(struct g2d_global *g2d_dev, int failed)
+{
+	unsigned long flags;
+	int ret = false;
+
+	spin_lock_irqsave(&g2d_dev->queue_lock, flags);
+	if (g2d_dev->cur_job) {
+		__g2d_queue_complete(g2d_dev, failed);
+		ret = true;
+	}
+	spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+
+	return ret;
+}
+
+static void g2d_queue_timeout(unsigned long data)
+{
+	struct g2d_global *g2d_dev = (struct g2d_global *)data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&g2d_dev->queue_lock, flags);
+
+	/* finished, or replaced by a newer job in the meantime */
+	if (!g2d_dev->cur_job
+		|| time_before(jiffies, g2d_dev->queue_deadline)) {
+		spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+		return;
+	}
+
+	FIMG2D_ERROR("error : waiting for interrupt is timeout\n");
+	g2d_reset(g2d_dev);
+	__g2d_queue_complete(g2d_dev, true);
+
+	spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+}
+
+/* returns true when the interrupt belonged to a queued blit */
+int g2d_queue_irq(struct g2d_global *g2d_dev)
+{
+	return g2d_queue_complete(g2d_dev, false);
+}
+
+/* returns true when the fault belonged to a queued blit */
+int g2d_queue_fault(struct g2d_global *g2d_dev)
+{
+	if (!g2d_dev->cur_job)
+		return false;
+
+	FIMG2D_ERROR("error : sysmmu_faulted\n");
+	FIMG2D_ERROR("faulted addr: 0x%x\n", g2d_dev->faulted_addr);
+
+	return g2d_queue_complete(g2d_dev, true);
+}
+
+void g2d_queue_kick(struct g2d_global *g2d_dev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&g2d_dev->queue_lock, flags);
+	g2d_queue_run(g2d_dev);
+	spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+}
+
+static int g2d_queue_engine_idle(struct g2d_global *g2d_dev)
+{
+	unsigned long flags;
+	int idle;
+
+	spin_lock_irqsave(&g2d_dev->queue_lock, flags);
+	idle = !g2d_dev->cur_job && !g2d_dev->queue_active;
+	spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+
+	return idle;
+}
+
+/*
+ * G2D_BLIT programs the engine directly. Stop feeding queued blits,
+ * let the running one finish and hand the engine over. Callers are
+ * serialized by g2d_dev->lock.
+ */
+void g2d_queue_claim_engine(struct g2d_global *g2d_dev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&g2d_dev->queue_lock, flags);
+	g2d_dev->queue_owner = 1;
+	spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+
+	wait_event(g2d_dev->queue_idle, g2d_queue_engine_idle(g2d_dev));
+}
+
+void g2d_queue_release_engine(struct g2d_global *g2d_dev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&g2d_dev->queue_lock, flags);
+	if (g2d_dev->queue_owner) {
+		g2d_dev->queue_owner = 0;
+		g2d_queue_run(g2d_dev);
+	}
+	spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+}
+
+static int g2d_queue_has_room(struct g2d_global *g2d_dev,
+				struct g2d_context *ctx, unsigned int count)
+{
+	unsigned long flags;
+	int room;
+
+	spin_lock_irqsave(&g2d_dev->queue_lock, flags);
+	room = (ctx->pending + count) <= G2D_QUEUE_MAX_PENDING;
+	spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+
+	return room;
+}
+
+int g2d_queue_submit(struct g2d_global *g2d_dev, struct g2d_context *ctx,
+			struct g2d_queue_req *req, int nonblock)
+{
+	LIST_HEAD(jobs);
+	struct g2d_job *job, *n;
+	unsigned long pgd;
+	unsigned long flags;
+	unsigned int i;
+	int need_dst_clean;
+	int ret;
+
+	if (req->count == 0 || req->count > G2D_QUEUE_MAX_BATCH)
+		return -EINVAL;
+
+	if (ctx->mm && ctx->mm != current->mm)
+		return -EINVAL;
+
+	if (!g2d_queue_has_room(g2d_dev, ctx, req->count)) {
+		if (nonblock)
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(ctx->waitq,
+			g2d_queue_has_room(g2d_dev, ctx, req->count));
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < req->count; i++) {
+		job = kzalloc(sizeof(*job), GFP_KERNEL);
+		if (!job) {
+			ret = -ENOMEM;
+			goto err_free;
+		}
+		list_add_tail(&job->node, &jobs);
+
+		if (copy_from_user(&job->params, &req->params[i],
+					sizeof(g2d_params))) {
+			FIMG2D_ERROR("error : copy_from_user\n");
+			ret = -EFAULT;
+			goto err_free;
+		}
+
+		/* queued blits always complete by interrupt */
+		job->params.flag.render_mode &= ~(G2D_POLLING | G2D_HYBRID_MODE);
+
+		if (g2d_check_params(&job->params) < 0) {
+			ret = -EINVAL;
+			goto err_free;
+		}
+
+		if (job->params.flag.memory_type == G2D_MEMORY_USER) {
+			ret = g2d_queue_pin(&job->src_pin,
+				(unsigned long)GET_START_ADDR(job->params.src_rect),
+				GET_RECT_SIZE(job->params.src_rect) + 8, false);
+			if (ret)
+				goto err_free;
+
+			ret = g2d_queue_pin(&job->dst_pin,
+				(unsigned long)GET_START_ADDR_C(job->params.dst_rect,
+							job->params.clip),
+				GET_RECT_SIZE_C(job->params.dst_rect,
+						job->params.clip), true);
+			if (ret)
+				goto err_free;
+		}
+
+		need_dst_clean = true;
+		if (!g2d_prepare_blit(g2d_dev, &job->params, &pgd,
+					&need_dst_clean)) {
+			ret = -EINVAL;
+			goto err_free;
+		}
+
+		job->pgd = (u32)virt_to_phys((void *)pgd);
+		job->ctx = ctx;
+	}
+
+	/* keep the page tables the engine walks alive as well */
+	if (!ctx->mm && current->mm) {
+		atomic_inc(&current->mm->mm_users);
+		ctx->mm = current->mm;
+	}
+
+	spin_lock_irqsave(&g2d_dev->queue_lock, flags);
+
+	req->seq = ++ctx->submit_seq;
+	list_for_each_entry(job, &jobs, node)
+		job->seq = req->seq;
+	list_entry(jobs.prev, struct g2d_job, node)->last = 1;
+
+	ctx->pending += req->count;
+	list_splice_tail(&jobs, &g2d_dev->queue);
+
+	g2d_queue_run(g2d_dev);
+
+	spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+
+	return 0;
+
+err_free:
+	list_for_each_entry_safe(job, n, &jobs, node) {
+		list_del(&job->node);
+		g2d_queue_free_job(job);
+	}
+
+	return ret;
+}
+
+static int g2d_queue_seq_done(struct g2d_global *g2d_dev,
+				struct g2d_context *ctx, unsigned int seq)
+{
+	unsigned long flags;
+	int done;
+
+	spin_lock_irqsave(&g2d_dev->queue_lock, flags);
+	done = g2d_seq_passed(seq, ctx->done_seq);
+	spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+
+	return done;
+}
+
+int g2d_queue_wait(struct g2d_global *g2d_dev, struct g2d_context *ctx,
+			unsigned int seq)
+{
+	if (!g2d_seq_passed(seq, ctx->submit_seq))
+		return -EINVAL;
+
+	return wait_event_interruptible(ctx->waitq,
+		g2d_queue_seq_done(g2d_dev, ctx, seq));
+}
+
+void g2d_queue_status(struct g2d_global *g2d_dev, struct g2d_context *ctx,
+			struct g2d_queue_status *status)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&g2d_dev->queue_lock, flags);
+	status->submit_seq = ctx->submit_seq;
+	status->done_seq = ctx->done_seq;
+	status->pending = ctx->pending;
+	status->faults = ctx->faults;
+	ctx->reported_seq = ctx->done_seq;
+	spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+}
+
+/*
+ * POLLIN: batches completed since the last G2D_QUEUE_STATUS.
+ * POLLOUT: there is room for another batch.
+ */
+unsigned int g2d_queue_poll(struct g2d_global *g2d_dev, struct g2d_context *ctx,
+				struct file *file, poll_table *wait)
+{
+	unsigned int mask = 0;
+	unsigned long flags;
+
+	poll_wait(file, &ctx->waitq, wait);
+
+	spin_lock_irqsave(&g2d_dev->queue_lock, flags);
+	if (ctx->done_seq != ctx->reported_seq)
+		mask |= POLLIN | POLLRDNORM;
+	if (ctx->pending < G2D_QUEUE_MAX_PENDING)
+		mask |= POLLOUT | POLLWRNORM;
+	spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+
+	return mask;
+}
+
+struct g2d_context *g2d_queue_ctx_create(void)
+{
+	struct g2d_context *ctx;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return NULL;
+
+	init_waitqueue_head(&ctx->waitq);
+
+	return ctx;
+}
+
+static int g2d_queue_ctx_idle(struct g2d_global *g2d_dev,
+				struct g2d_context *ctx)
+{
+	unsigned long flags;
+	int idle;
+
+	spin_lock_irqsave(&g2d_dev->queue_lock, flags);
+	idle = (ctx->pending == 0);
+	spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+
+	return idle;
+}
+
+void g2d_queue_ctx_destroy(struct g2d_global *g2d_dev, struct g2d_context *ctx)
+{
+	LIST_HEAD(dropped);
+	struct g2d_job *job, *n;
+	unsigned long flags;
+
+	/* drop what has not reached the engine yet */
+	spin_lock_irqsave(&g2d_dev->queue_lock, flags);
+	list_for_each_entry_safe(job, n, &g2d_dev->queue, node) {
+		if (job->ctx != ctx)
+			continue;
+		list_move_tail(&job->node, &dropped);
+		ctx->pending--;
+	}
+	spin_unlock_irqrestore(&g2d_dev->queue_lock, flags);
+
+	list_for_each_entry_safe(job, n, &dropped, node) {
+		list_del(&job->node);
+		g2d_queue_free_job(job);
+	}
+
+	/* and wait for the running one, the queue timer bounds this */
+	wait_event(ctx->waitq, g2d_queue_ctx_idle(g2d_dev, ctx));
+
+	if (ctx->mm)
+		mmput(ctx->mm);
+
+	kfree(ctx);
+}
+
+void g2d_queue_init(struct g2d_global *g2d_dev)
+{
+	spin_lock_init(&g2d_dev->queue_lock);
+	INIT_LIST_HEAD(&g2d_dev->queue);
+	INIT_LIST_HEAD(&g2d_dev->queue_done);
+	INIT_WORK(&g2d_dev->queue_done_work, g2d_queue_done_work);
+	init_waitqueue_head(&g2d_dev->queue_idle);
+	setup_timer(&g2d_dev->queue_timer, g2d_queue_timeout,
+			(unsigned long)g2d_dev);
+
+	g2d_dev->cur_job = NULL;
+	g2d_dev->queue_active = 0;
+	g2d_dev->queue_owner = 0;
+}
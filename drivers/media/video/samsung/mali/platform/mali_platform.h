@@ -109,5 +109,6 @@ void deinit_mali_dvfs_staus(void);
 mali_bool mali_dvfs_handler(u32 utilization);
 int mali_dvfs_is_running(void);
 void mali_dvfs_late_resume(void);
+void mali_dvfs_set_max_clock(unsigned int clock);
 #endif
 void mali_default_step_set(int step, mali_bool boostup);
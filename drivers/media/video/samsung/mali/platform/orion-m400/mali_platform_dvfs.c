@@ -129,6 +129,9 @@ static unsigned int asv_3d_volt_8_table[ASV_8_LEVEL][MALI_DVFS_STEPS] = {
 
 static u32 mali_dvfs_utilization = 400;
 
+/* highest step allowed, lowered by the thermal driver */
+static unsigned int mali_dvfs_max_step = MALI_DVFS_STEPS - 1;
+
 static void mali_dvfs_work_handler(struct work_struct *w);
 
 static struct workqueue_struct *mali_dvfs_wq = 0;
@@ -457,12 +460,15 @@ static mali_bool mali_dvfs_staus(u32 utilization)
     /*decide next step*/
 	curStatus = get_mali_dvfs_staus();
 	nextStatus = decideNextStatus(utilization);
+	if (nextStatus > mali_dvfs_max_step)
+		nextStatus = mali_dvfs_max_step;
 	//MALI_PRINT(("Mali utilization = %d \n", utilization));
 
 	MALI_DEBUG_PRINT(1, ("= curStatus %d, nextStatus %d, maliDvfsStatus.currentStep %d \n", curStatus, nextStatus, maliDvfsStatus.currentStep));
 
 	/*if next status is same with current status, don't change anything*/
-	if((curStatus!=nextStatus && stay_count==0))
+	if((curStatus!=nextStatus && stay_count==0) ||
+		maliDvfsStatus.currentStep > mali_dvfs_max_step)
 	{
 		/*check if boost up or not*/
 		if(nextStatus > maliDvfsStatus.currentStep) boostup = 1;
@@ -491,6 +497,23 @@ int mali_dvfs_is_running(void)
 	return bMaliDvfsRun;
 }
 
+/*
+ * Limit the GPU to the steps clocked at @clock MHz or less; step 0 is
+ * always allowed. The running step follows at the next utilization
+ * report.
+ */
+void mali_dvfs_set_max_clock(unsigned int clock)
+{
+	unsigned int step;
+
+	for (step = MALI_DVFS_STEPS - 1; step > 0; step--)
+		if (mali_dvfs[step].clock <= clock)
+			break;
+
+	mali_dvfs_max_step = step;
+}
+EXPORT_SYMBOL(mali_dvfs_set_max_clock);
+
 
 
 void mali_dvfs_late_resume(void)
@@ -12,9 +12,12 @@
  */
 
 #include <linux/slab.h>
-#include <linux/spinlock.h>
+#include <linux/mutex.h>
 #include <linux/mm.h>
 #include <linux/err.h>
+#include <linux/rbtree.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "mfc.h"
 #include "mfc_mem.h"
@@ -33,393 +36,567 @@
 #define PRINT_BUF
 #undef DEBUG_ALLOC_FREE
 
-static struct list_head mfc_alloc_head[MFC_MAX_MEM_PORT_NUM];
-/* The free node list sorted by real address */
-static struct list_head mfc_free_head[MFC_MAX_MEM_PORT_NUM];
-
-/* FIXME: test locking, add locking mechanisim */
 /*
-static spinlock_t lock;
-*/
+ * Free extents of a port are kept in two trees: by address, to find
+ * the neighbours to merge with when an extent is freed, and by size
+ * then address, for the best fit. Allocated buffers are kept in one
+ * tree by address and one by user key (offset, cookie or secure id)
+ * and owner, and on a list per owner.
+ */
+struct mfc_port_buf {
+	struct rb_root	free_by_addr;
+	struct rb_root	free_by_size;
+	unsigned int	nr_free;
+	unsigned long	free_size;
+	unsigned int	nr_alloc;
+};
 
-void mfc_print_buf(void)
-{
-#ifdef PRINT_BUF
-	struct list_head *pos;
-	struct mfc_alloc_buffer *alloc = NULL;
-	struct mfc_free_buffer *free = NULL;
-	int port, i;
+static struct mfc_port_buf mfc_port_buf[MFC_MAX_MEM_PORT_NUM];
+static struct rb_root mfc_alloc_by_addr = RB_ROOT;
+static struct rb_root mfc_alloc_by_key = RB_ROOT;
+static struct list_head mfc_owner_head[MFC_MAX_INSTANCE_NUM];
 
-	for (port = 0; port < mfc_mem_count(); port++) {
-		mfc_dbg("---- port %d buffer list ----", port);
+static DEFINE_MUTEX(mfc_buf_lock);
 
-		i = 0;
-		list_for_each(pos, &mfc_alloc_head[port]) {
-			alloc = list_entry(pos, struct mfc_alloc_buffer, list);
-			mfc_dbg("[A #%04d] addr: 0x%08x, size: %d",
-				i, (unsigned int)alloc->addr, alloc->size);
-			mfc_dbg("\t  real: 0x%08lx", alloc->real);
-			mfc_dbg("\t  type: 0x%08x, owner: %d",
-				alloc->type, alloc->owner);
-#if defined(CONFIG_VIDEO_MFC_VCM_UMP)
-			mfc_dbg("\t* vcm sysmmu");
-			if (alloc->vcm_s) {
-				mfc_dbg("\t  start: 0x%08x, res_size  : 0x%08x\n",
-					(unsigned int)alloc->vcm_s->res.start,
-					(unsigned int)alloc->vcm_s->res.res_size);
-				mfc_dbg("\t  bound_size: 0x%08x\n",
-					(unsigned int)alloc->vcm_s->res.bound_size);
-			}
-
-			mfc_dbg("\t* vcm kernel");
-			if (alloc->vcm_k) {
-				mfc_dbg("\t  start: 0x%08x, res_size  : 0x%08x\n",
-					(unsigned int)alloc->vcm_k->start,
-					(unsigned int)alloc->vcm_k->res_size);
-				mfc_dbg("\t  bound_size: 0x%08x\n",
-					(unsigned int)alloc->vcm_k->bound_size);
-			}
-
-			mfc_dbg("\t* ump");
-			if (alloc->ump_handle) {
-				mfc_dbg("\t  secure id: 0x%08x",
-					mfc_ump_get_id(alloc->ump_handle));
-			}
-#elif defined(CONFIG_S5P_VMEM)
-			mfc_dbg("\t  vmem cookie: 0x%08x addr: 0x%08lx, size: %d",
-				alloc->vmem_cookie, alloc->vmem_addr,
-				alloc->vmem_size);
+static struct dentry *mfc_buf_debugfs;
+
+/*
+ * Extent taken from a free extent at @addr for @size bytes at @align.
+ * With VCM or VMEM, the buffer is mapped by pages from the start of
+ * the free extent. Otherwise only the aligned part is taken and the
+ * leading gap goes back to the free extents.
+ */
+static unsigned int mfc_buf_extent(unsigned long addr, int size, int align)
+{
+#if (defined(CONFIG_VIDEO_MFC_VCM_UMP) || defined(CONFIG_S5P_VMEM))
+	return ALIGN(ALIGN(addr, align) - addr + size, PAGE_SIZE);
 #else
-			mfc_dbg("\t  offset: 0x%08x", alloc->ofs);
+	return ALIGN(addr, align) - addr + size;
 #endif
-			i++;
-		}
+}
 
-		i = 0;
-		list_for_each(pos, &mfc_free_head[port]) {
-			free = list_entry(pos, struct mfc_free_buffer, list);
-			mfc_dbg("[F #%04d] addr: 0x%08lx, size: %d",
-				i, free->real, free->size);
-			i++;
-		}
+static void mfc_free_insert(struct mfc_port_buf *pb,
+			    struct mfc_free_buffer *free)
+{
+	struct rb_node **p, *parent;
+	struct mfc_free_buffer *tmp;
+
+	p = &pb->free_by_addr.rb_node;
+	parent = NULL;
+	while (*p) {
+		parent = *p;
+		tmp = rb_entry(parent, struct mfc_free_buffer, addr_node);
+		if (free->real < tmp->real)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
 	}
-#endif
+	rb_link_node(&free->addr_node, parent, p);
+	rb_insert_color(&free->addr_node, &pb->free_by_addr);
+
+	p = &pb->free_by_size.rb_node;
+	parent = NULL;
+	while (*p) {
+		parent = *p;
+		tmp = rb_entry(parent, struct mfc_free_buffer, size_node);
+		if (free->size < tmp->size ||
+		    (free->size == tmp->size && free->real < tmp->real))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&free->size_node, parent, p);
+	rb_insert_color(&free->size_node, &pb->free_by_size);
+
+	pb->nr_free++;
+	pb->free_size += free->size;
+}
+
+static void mfc_free_erase(struct mfc_port_buf *pb,
+			   struct mfc_free_buffer *free)
+{
+	rb_erase(&free->addr_node, &pb->free_by_addr);
+	rb_erase(&free->size_node, &pb->free_by_size);
+
+	pb->nr_free--;
+	pb->free_size -= free->size;
 }
 
-static int mfc_put_free_buf(unsigned int addr, int size, int port)
+/* Return an extent, merged with the free extents next to it */
+static int mfc_put_free_buf(unsigned long addr, unsigned int size, int port)
 {
-	struct list_head *pos, *nxt;
+	struct mfc_port_buf *pb = &mfc_port_buf[port];
+	struct rb_node *n = pb->free_by_addr.rb_node;
+	struct mfc_free_buffer *prev = NULL, *next = NULL;
 	struct mfc_free_buffer *free;
-	struct mfc_free_buffer *next = NULL;
-	struct mfc_free_buffer *prev;
-	/* 0x00: not merged, 0x01: prev merged, 0x02: next merged */
-	int merged = 0x00;
-
-	mfc_dbg("addr: 0x%08x, size: %d, port: %d\n", addr, size, port);
-
-	list_for_each_safe(pos, nxt, &mfc_free_head[port]) {
-		next = list_entry(pos, struct mfc_free_buffer, list);
-
-		/*
-		 * When the allocated address must be align without VMEM,
-		 * the free buffer can be overlap
-		 * previous free buffer temporaily
-		 * Target buffer will be shrink after this operation
-		 */
-		if (addr <= next->real) {
-			prev = list_entry(pos->prev, struct mfc_free_buffer, list);
-
-			mfc_dbg("prev->addr: 0x%08lx, size: %d", prev->real, prev->size);
-			/* merge previous free buffer */
-			if (prev && ((prev->real + prev->size) == addr)) {
-				addr  = prev->real;
-				size += prev->size;
-
-				prev->size = size;
-
-				merged |= 0x01;
-				mfc_dbg("auto merge free buffer[p]: addr: 0x%08lx, size: %d",
-					prev->real, prev->size);
-			}
-
-			mfc_dbg("next->addr: 0x%08lx, size: %d", next->real, next->size);
-			/* merge next free buffer */
-			if ((addr + size) == next->real) {
-				next->real  = addr;
-				next->size += size;
-
-				if (merged)
-					prev->size = next->size;
-
-				merged |= 0x02;
-				mfc_dbg("auto merge free buffer[n]: addr: 0x%08lx, size: %d",
-					next->real, next->size);
-			}
 
-			break;
+	mfc_dbg("addr: 0x%08lx, size: %d, port: %d\n", addr, size, port);
+
+	while (n) {
+		free = rb_entry(n, struct mfc_free_buffer, addr_node);
+		if (addr < free->real) {
+			next = free;
+			n = n->rb_left;
+		} else {
+			prev = free;
+			n = n->rb_right;
 		}
 	}
 
-	if (!merged) {
-		free = (struct mfc_free_buffer *)
-			kzalloc(sizeof(struct mfc_free_buffer), GFP_KERNEL);
-
-		if (unlikely(free == NULL))
-			return -ENOMEM;
+	if (prev && (prev->real + prev->size) != addr)
+		prev = NULL;
+	if (next && (addr + size) != next->real)
+		next = NULL;
 
-		free->real = addr;
-		free->size = size;
+	if (prev) {
+		mfc_free_erase(pb, prev);
+		addr = prev->real;
+		size += prev->size;
+		free = prev;
+	}
 
-		list_add_tail(&free->list, pos);
+	if (next) {
+		mfc_free_erase(pb, next);
+		size += next->size;
+		if (prev)
+			kfree(next);
+		else
+			free = next;
 	}
 
-	/* bi-directional merged */
-	else if ((merged & 0x03) == 0x03) {
-		list_del(&next->list);
-		kfree(next);
+	if (!prev && !next) {
+		free = kzalloc(sizeof(struct mfc_free_buffer), GFP_KERNEL);
+		if (unlikely(free == NULL))
+			return -ENOMEM;
 	}
 
+	free->real = addr;
+	free->size = size;
+	mfc_free_insert(pb, free);
+
 	return 0;
 }
 
-static unsigned int mfc_get_free_buf(int size, int align, int port)
+/* Best fit; returns the start of the free extent used, 0 if none fits */
+static unsigned long mfc_get_free_buf(int size, int align, int port)
 {
-	struct list_head *pos, *nxt;
-	struct mfc_free_buffer *free;
-	struct mfc_free_buffer *match = NULL;
-	int align_size = 0;
-	unsigned int addr = 0;
-
-	mfc_dbg("size: %d, align: %d, port: %d\n",
-			size, align, port);
+	struct mfc_port_buf *pb = &mfc_port_buf[port];
+	struct rb_node *n = pb->free_by_size.rb_node;
+	struct rb_node *first = NULL;
+	struct mfc_free_buffer *free, *gap;
+	unsigned long addr;
+	unsigned int extent = 0;
+
+	mfc_dbg("size: %d, align: %d, port: %d\n", size, align, port);
+
+	/* smallest extent of at least @size ... */
+	while (n) {
+		free = rb_entry(n, struct mfc_free_buffer, size_node);
+		if (free->size >= size) {
+			first = n;
+			n = n->rb_left;
+		} else {
+			n = n->rb_right;
+		}
+	}
 
-	if (list_empty(&mfc_free_head[port])) {
-		mfc_err("no free node in mfc buffer\n");
+	/* ... that still fits once aligned */
+	for (n = first; n; n = rb_next(n)) {
+		free = rb_entry(n, struct mfc_free_buffer, size_node);
+		extent = mfc_buf_extent(free->real, size, align);
+		if (free->size >= extent)
+			break;
+	}
 
+	if (!n) {
+		mfc_err("no suitable free node in mfc buffer\n");
 		return 0;
 	}
 
-	/* find best fit area */
-	list_for_each_safe(pos, nxt, &mfc_free_head[port]) {
-		free = list_entry(pos, struct mfc_free_buffer, list);
+	addr = free->real;
+	mfc_free_erase(pb, free);
 
-#if (defined(CONFIG_VIDEO_MFC_VCM_UMP) || defined(CONFIG_S5P_VMEM))
-		/*
-		 * Align the start address.
-		 * We assume the start address of free buffer aligned with 4KB
-		 */
-		align_size = ALIGN(align_size + size, PAGE_SIZE) - size;
-
-		if (align > PAGE_SIZE) {
-			align_size  = ALIGN(free->real, align) - free->real;
-			align_size += ALIGN(align_size + size, PAGE_SIZE) - size;
-		} else {
-			align_size = ALIGN(align_size + size, PAGE_SIZE) - size;
+#if !(defined(CONFIG_VIDEO_MFC_VCM_UMP) || defined(CONFIG_S5P_VMEM))
+	if (ALIGN(addr, align) != addr) {
+		gap = kzalloc(sizeof(struct mfc_free_buffer), GFP_KERNEL);
+		if (unlikely(gap == NULL)) {
+			mfc_free_insert(pb, free);
+			return 0;
 		}
+
+		gap->real = addr;
+		gap->size = ALIGN(addr, align) - addr;
+		mfc_free_insert(pb, gap);
+	}
+#endif
+
+	if (free->size > extent) {
+		free->real += extent;
+		free->size -= extent;
+		mfc_free_insert(pb, free);
+	} else {
+		kfree(free);
+	}
+
+	return addr;
+}
+
+/* The extent to give back when @alloc is freed */
+static void mfc_alloc_extent(struct mfc_alloc_buffer *alloc,
+			     unsigned long *addr, unsigned int *size)
+{
+#if defined(CONFIG_VIDEO_MFC_VCM_UMP)
+	*addr = alloc->vcm_addr;
+	*size = alloc->vcm_size;
+#elif defined(CONFIG_S5P_VMEM)
+	*addr = alloc->vmem_addr;
+	*size = alloc->vmem_size;
 #else
-		align_size = ALIGN(free->real, align) - free->real;
+	*addr = alloc->real;
+	*size = alloc->size;
 #endif
-		if (free->size >= (size + align_size)) {
-			if (match != NULL) {
-				if (free->size < match->size)
-					match = free;
-			} else {
-				match = free;
-			}
+}
+
+/* Key the user refers to @alloc by; 0 if the user cannot see it */
+static int mfc_alloc_key(struct mfc_alloc_buffer *alloc, unsigned int *key)
+{
+#if defined(CONFIG_VIDEO_MFC_VCM_UMP)
+	if (!alloc->ump_handle)
+		return 0;
+	*key = mfc_ump_get_id(alloc->ump_handle);
+#elif defined(CONFIG_S5P_VMEM)
+	*key = alloc->vmem_cookie;
+#else
+	*key = alloc->ofs;
+#endif
+	return 1;
+}
+
+static int mfc_key_cmp(unsigned int key, int owner,
+		       struct mfc_alloc_buffer *alloc)
+{
+	if (key != alloc->key)
+		return key < alloc->key ? -1 : 1;
+	if (owner != alloc->owner)
+		return owner < alloc->owner ? -1 : 1;
+	return 0;
+}
+
+static void mfc_alloc_insert(struct mfc_alloc_buffer *alloc)
+{
+	struct rb_node **p, *parent;
+	struct mfc_alloc_buffer *tmp;
+
+	p = &mfc_alloc_by_addr.rb_node;
+	parent = NULL;
+	while (*p) {
+		parent = *p;
+		tmp = rb_entry(parent, struct mfc_alloc_buffer, addr_node);
+		if (alloc->real < tmp->real)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&alloc->addr_node, parent, p);
+	rb_insert_color(&alloc->addr_node, &mfc_alloc_by_addr);
+
+	alloc->keyed = mfc_alloc_key(alloc, &alloc->key);
+	if (alloc->keyed) {
+		p = &mfc_alloc_by_key.rb_node;
+		parent = NULL;
+		while (*p) {
+			parent = *p;
+			tmp = rb_entry(parent, struct mfc_alloc_buffer,
+				       key_node);
+			if (mfc_key_cmp(alloc->key, alloc->owner, tmp) < 0)
+				p = &parent->rb_left;
+			else
+				p = &parent->rb_right;
 		}
+		rb_link_node(&alloc->key_node, parent, p);
+		rb_insert_color(&alloc->key_node, &mfc_alloc_by_key);
 	}
 
-	if (match != NULL) {
-		addr = match->real;
-        align_size = ALIGN(addr, align) - addr;
+	list_add_tail(&alloc->owner_list, &mfc_owner_head[alloc->owner]);
+	mfc_port_buf[alloc->port].nr_alloc++;
 
-#if !(defined(CONFIG_VIDEO_MFC_VCM_UMP) || defined(CONFIG_S5P_VMEM))
-		if (align_size > 0) {
-			/*
-			 * When the allocated address must be align without VMEM,
-			 * the free buffer can be overlap
-			 * previous free buffer temporaily
-			 */
-			if (mfc_put_free_buf(match->real, align_size, port) < 0)
-				return 0;
-		}
+#if !defined(SYSMMU_MFC_ON)
+	if (alloc->type == MBT_DPB)
+		s5p_bufsync_register(&alloc->sync, alloc->real, alloc->size);
 #endif
-		/* change allocated buffer address & size */
-		match->real += (size + align_size);
-		match->size -= (size + align_size);
+}
 
-		if (match->size == 0) {
-			list_del(&match->list);
-			kfree(match);
-		}
-	} else {
-		mfc_err("no suitable free node in mfc buffer\n");
+static struct mfc_alloc_buffer *mfc_alloc_find_addr(unsigned long real)
+{
+	struct rb_node *n = mfc_alloc_by_addr.rb_node;
+	struct mfc_alloc_buffer *alloc;
 
-		return 0;
+	while (n) {
+		alloc = rb_entry(n, struct mfc_alloc_buffer, addr_node);
+		if (real < alloc->real)
+			n = n->rb_left;
+		else if (real > alloc->real)
+			n = n->rb_right;
+		else
+			return alloc;
 	}
 
-	return addr;
+	return NULL;
 }
 
-int mfc_init_buf(void)
+/* Buffer containing @real */
+static struct mfc_alloc_buffer *mfc_alloc_find_range(unsigned long real)
 {
-	int port;
-	int ret = 0;
-
-	for (port = 0; port < mfc_mem_count(); port++) {
-		INIT_LIST_HEAD(&mfc_alloc_head[port]);
-		INIT_LIST_HEAD(&mfc_free_head[port]);
+	struct rb_node *n = mfc_alloc_by_addr.rb_node;
+	struct mfc_alloc_buffer *alloc, *floor = NULL;
 
-		ret = mfc_put_free_buf(mfc_mem_data_base(port),
-			mfc_mem_data_size(port), port);
+	while (n) {
+		alloc = rb_entry(n, struct mfc_alloc_buffer, addr_node);
+		if (real < alloc->real) {
+			n = n->rb_left;
+		} else {
+			floor = alloc;
+			n = n->rb_right;
+		}
 	}
 
-	/*
-	spin_lock_init(&lock);
-	*/
+	if (floor && real < (floor->real + floor->size))
+		return floor;
 
-	mfc_print_buf();
-
-	return ret;
+	return NULL;
 }
 
-void mfc_final_buf(void)
+static struct mfc_alloc_buffer *mfc_alloc_find_key(unsigned int key,
+						   int owner)
 {
-	struct list_head *pos, *nxt;
+	struct rb_node *n = mfc_alloc_by_key.rb_node;
 	struct mfc_alloc_buffer *alloc;
-	struct mfc_free_buffer *free;
-	int port;
-	/*
-	unsigned long flags;
-	*/
+	int cmp;
+
+	while (n) {
+		alloc = rb_entry(n, struct mfc_alloc_buffer, key_node);
+		cmp = mfc_key_cmp(key, owner, alloc);
+		if (cmp < 0)
+			n = n->rb_left;
+		else if (cmp > 0)
+			n = n->rb_right;
+		else
+			return alloc;
+	}
 
-	/*
-	spin_lock_irqsave(&lock, flags);
-	*/
+	return NULL;
+}
 
-	for (port = 0; port < mfc_mem_count(); port++) {
-		list_for_each_safe(pos, nxt, &mfc_alloc_head[port]) {
-			alloc = list_entry(pos, struct mfc_alloc_buffer, list);
-#if defined(CONFIG_VIDEO_MFC_VCM_UMP)
-			if (alloc->ump_handle)
-				mfc_ump_unmap(alloc->ump_handle);
+/* Unmap @alloc and give its extent back, with mfc_buf_lock held */
+static void mfc_release_alloc(struct mfc_alloc_buffer *alloc)
+{
+	unsigned long addr;
+	unsigned int size;
 
-			if (alloc->vcm_k)
-				mfc_vcm_unmap(alloc->vcm_k);
+	rb_erase(&alloc->addr_node, &mfc_alloc_by_addr);
+	if (alloc->keyed)
+		rb_erase(&alloc->key_node, &mfc_alloc_by_key);
+	list_del(&alloc->owner_list);
+	mfc_port_buf[alloc->port].nr_alloc--;
+	s5p_bufsync_unregister(&alloc->sync);
 
-			if (alloc->vcm_s)
-				mfc_vcm_unbind(alloc->vcm_s,
-						alloc->type & MBT_OTHER);
+#if defined(CONFIG_VIDEO_MFC_VCM_UMP)
+	if (alloc->ump_handle)
+		mfc_ump_unmap(alloc->ump_handle);
 
-			if (mfc_put_free_buf(alloc->vcm_addr,
-				alloc->vcm_size, port) < 0) {
+	if (alloc->vcm_k)
+		mfc_vcm_unmap(alloc->vcm_k);
 
-				mfc_err("failed to add free buffer\n");
-			} else {
-				list_del(&alloc->list);
-				kfree(alloc);
-			}
+	if (alloc->vcm_s)
+		mfc_vcm_unbind(alloc->vcm_s, alloc->type & MBT_OTHER);
 #elif defined(CONFIG_S5P_VMEM)
-			if (alloc->vmem_cookie)
-				s5p_vfree(alloc->vmem_cookie);
+	if (alloc->vmem_cookie)
+		s5p_vfree(alloc->vmem_cookie);
+#endif
 
-			if (mfc_put_free_buf(alloc->vmem_addr,
-				alloc->vmem_size, port) < 0) {
+	mfc_alloc_extent(alloc, &addr, &size);
+	if (mfc_put_free_buf(addr, size, alloc->port) < 0)
+		mfc_err("failed to add free buffer\n");
 
-				mfc_err("failed to add free buffer\n");
-			} else {
-				list_del(&alloc->list);
-				kfree(alloc);
-			}
+	kfree(alloc);
+}
+
+void mfc_print_buf(void)
+{
+#ifdef PRINT_BUF
+	struct rb_node *n;
+	struct mfc_alloc_buffer *alloc = NULL;
+	struct mfc_free_buffer *free = NULL;
+	int port, i;
+
+	i = 0;
+	for (n = rb_first(&mfc_alloc_by_addr); n; n = rb_next(n)) {
+		alloc = rb_entry(n, struct mfc_alloc_buffer, addr_node);
+		mfc_dbg("[A #%04d] addr: 0x%08x, size: %d",
+			i, (unsigned int)alloc->addr, alloc->size);
+		mfc_dbg("\t  real: 0x%08lx, port: %d", alloc->real, alloc->port);
+		mfc_dbg("\t  type: 0x%08x, owner: %d",
+			alloc->type, alloc->owner);
+#if defined(CONFIG_VIDEO_MFC_VCM_UMP)
+		mfc_dbg("\t* vcm sysmmu");
+		if (alloc->vcm_s) {
+			mfc_dbg("\t  start: 0x%08x, res_size  : 0x%08x\n",
+				(unsigned int)alloc->vcm_s->res.start,
+				(unsigned int)alloc->vcm_s->res.res_size);
+			mfc_dbg("\t  bound_size: 0x%08x\n",
+				(unsigned int)alloc->vcm_s->res.bound_size);
+		}
+
+		mfc_dbg("\t* vcm kernel");
+		if (alloc->vcm_k) {
+			mfc_dbg("\t  start: 0x%08x, res_size  : 0x%08x\n",
+				(unsigned int)alloc->vcm_k->start,
+				(unsigned int)alloc->vcm_k->res_size);
+			mfc_dbg("\t  bound_size: 0x%08x\n",
+				(unsigned int)alloc->vcm_k->bound_size);
+		}
+
+		mfc_dbg("\t* ump");
+		if (alloc->ump_handle) {
+			mfc_dbg("\t  secure id: 0x%08x",
+				mfc_ump_get_id(alloc->ump_handle));
+		}
+#elif defined(CONFIG_S5P_VMEM)
+		mfc_dbg("\t  vmem cookie: 0x%08x addr: 0x%08lx, size: %d",
+			alloc->vmem_cookie, alloc->vmem_addr,
+			alloc->vmem_size);
 #else
-			if (mfc_put_free_buf(alloc->real,
-				alloc->size, port) < 0) {
-
-				mfc_err("failed to add free buffer\n");
-			} else {
-				list_del(&alloc->list);
-				kfree(alloc);
-			}
+		mfc_dbg("\t  offset: 0x%08x", alloc->ofs);
 #endif
-		}
+		i++;
 	}
 
-	/*
-	spin_unlock_irqrestore(&lock, flags);
-	*/
+	for (port = 0; port < mfc_mem_count(); port++) {
+		mfc_dbg("---- port %d free extents ----", port);
 
-	mfc_print_buf();
+		i = 0;
+		n = rb_first(&mfc_port_buf[port].free_by_addr);
+		for (; n; n = rb_next(n)) {
+			free = rb_entry(n, struct mfc_free_buffer, addr_node);
+			mfc_dbg("[F #%04d] addr: 0x%08lx, size: %d",
+				i, free->real, free->size);
+			i++;
+		}
+	}
+#endif
+}
 
-	/*
-	spin_lock_irqsave(&lock, flags);
-	*/
+static int mfc_buf_debugfs_show(struct seq_file *s, void *unused)
+{
+	struct mfc_port_buf *pb;
+	struct mfc_free_buffer *free;
+	struct rb_node *n;
+	unsigned int largest;
+	int port;
 
+	mutex_lock(&mfc_buf_lock);
 	for (port = 0; port < mfc_mem_count(); port++) {
-		list_for_each_safe(pos, nxt, &mfc_free_head[port]) {
-			free = list_entry(pos, struct mfc_free_buffer, list);
-			list_del(&free->list);
-			kfree(free);
+		pb = &mfc_port_buf[port];
+
+		n = rb_last(&pb->free_by_size);
+		largest = n ? rb_entry(n, struct mfc_free_buffer,
+				       size_node)->size : 0;
+
+		seq_printf(s, "port %d: size %u, %u buffers, free %lu "
+			   "in %u extents, largest %u, fragmentation %lu%%\n",
+			   port, mfc_mem_data_size(port), pb->nr_alloc,
+			   pb->free_size, pb->nr_free, largest,
+			   pb->free_size ?
+			   100 - (largest * 100UL / pb->free_size) : 0);
+
+		for (n = rb_first(&pb->free_by_addr); n; n = rb_next(n)) {
+			free = rb_entry(n, struct mfc_free_buffer, addr_node);
+			seq_printf(s, "  0x%08lx %u\n", free->real, free->size);
 		}
 	}
+	mutex_unlock(&mfc_buf_lock);
 
-	/*
-	spin_unlock_irqrestore(&lock, flags);
-	*/
+	return 0;
+}
+
+static int mfc_buf_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mfc_buf_debugfs_show, NULL);
+}
+
+static const struct file_operations mfc_buf_debugfs_fops = {
+	.open		= mfc_buf_debugfs_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+int mfc_init_buf(void)
+{
+	int port, i;
+	int ret = 0;
+
+	for (i = 0; i < MFC_MAX_INSTANCE_NUM; i++)
+		INIT_LIST_HEAD(&mfc_owner_head[i]);
+
+	mutex_lock(&mfc_buf_lock);
+	for (port = 0; port < mfc_mem_count(); port++) {
+		mfc_port_buf[port].free_by_addr = RB_ROOT;
+		mfc_port_buf[port].free_by_size = RB_ROOT;
+
+		ret = mfc_put_free_buf(mfc_mem_data_base(port),
+			mfc_mem_data_size(port), port);
+	}
 
 	mfc_print_buf();
+	mutex_unlock(&mfc_buf_lock);
+
+	mfc_buf_debugfs = debugfs_create_file("mfc_buf", S_IRUGO, NULL, NULL,
+					      &mfc_buf_debugfs_fops);
+
+	return ret;
 }
 
-void mfc_merge_buf(void)
+void mfc_final_buf(void)
 {
-	struct list_head *pos, *nxt;
-	struct mfc_free_buffer *n1;
-	struct mfc_free_buffer *n2;
+	struct rb_node *n;
+	struct mfc_free_buffer *free;
 	int port;
 
+	debugfs_remove(mfc_buf_debugfs);
+
+	mutex_lock(&mfc_buf_lock);
+
+	while ((n = rb_first(&mfc_alloc_by_addr)))
+		mfc_release_alloc(rb_entry(n, struct mfc_alloc_buffer,
+					   addr_node));
+
+	mfc_print_buf();
+
 	for (port = 0; port < mfc_mem_count(); port++) {
-		list_for_each_safe(pos, nxt, &mfc_free_head[port]) {
-			n1 = list_entry(pos, struct mfc_free_buffer, list);
-			n2 = list_entry(nxt, struct mfc_free_buffer, list);
-
-			mfc_dbg("merge pre: n1: 0x%08lx, n2: 0x%08lx",
-				n1->real, n2->real);
-
-			if (!list_is_last(pos, &mfc_free_head[port])) {
-				if ((n1->real + n1->size) == n2->real) {
-					n2->real  = n1->real;
-					n2->size += n1->size;
-					list_del(&n1->list);
-					kfree(n1);
-				}
-			}
-
-			mfc_dbg("merge aft: n1: 0x%08lx, n2: 0x%08lx, last: %d",
-				n1->real, n2->real,
-				list_is_last(pos, &mfc_free_head[port]));
+		while ((n = rb_first(&mfc_port_buf[port].free_by_addr))) {
+			free = rb_entry(n, struct mfc_free_buffer, addr_node);
+			mfc_free_erase(&mfc_port_buf[port], free);
+			kfree(free);
 		}
 	}
 
-#ifdef DEBUG_ALLOC_FREE
-	mfc_print_buf();
-#endif
+	mutex_unlock(&mfc_buf_lock);
 }
 
 /* FIXME: port auto select, return values */
 struct mfc_alloc_buffer *_mfc_alloc_buf(
 	struct mfc_inst_ctx *ctx, int size, int align, int flag)
 {
-	unsigned int addr;
+	unsigned long addr;
 	struct mfc_alloc_buffer *alloc;
 	int port = flag & 0xFFFF;
+#if (defined(CONFIG_VIDEO_MFC_VCM_UMP) || defined(CONFIG_S5P_VMEM))
+	unsigned int extent;
+#endif
 #if defined(CONFIG_VIDEO_MFC_VCM_UMP)
-	int align_size = 0;
 	struct ump_vcm ump_vcm;
-#elif defined(CONFIG_S5P_VMEM)
-	int align_size = 0;
 #endif
-	/*
-	unsigned long flags;
-	*/
 
 	if (size <= 0)
 		return NULL;
@@ -434,44 +611,30 @@ struct mfc_alloc_buffer *_mfc_alloc_buf(
 	if (port > (mfc_mem_count() - 1))
 		port = mfc_mem_count() - 1;
 
-	/*
-	spin_lock_irqsave(&lock, flags);
-	*/
+	mutex_lock(&mfc_buf_lock);
 
 	addr = mfc_get_free_buf(size, align, port);
 
-	mfc_dbg("mfc_get_free_buf: 0x%08x\n", addr);
+	mfc_dbg("mfc_get_free_buf: 0x%08lx\n", addr);
 
 	if (!addr) {
 		mfc_dbg("cannot get suitable free buffer\n");
-		/* FIXME: is it need?
-		mfc_put_free_buf(addr, size, port);
-		*/
 		kfree(alloc);
-		/*
-		spin_unlock_irqrestore(&lock, flags);
-		*/
+		mutex_unlock(&mfc_buf_lock);
 
 		return NULL;
 	}
 
 #if defined(CONFIG_VIDEO_MFC_VCM_UMP)
-	if (align > PAGE_SIZE) {
-		align_size = ALIGN(addr, align) - addr;
-		align_size += ALIGN(align_size + size, PAGE_SIZE) - size;
-	} else {
-		align_size = ALIGN(align_size + size, PAGE_SIZE) - size;
-	}
+	extent = mfc_buf_extent(addr, size, align);
 
-	alloc->vcm_s = mfc_vcm_bind(addr, size + align_size);
+	alloc->vcm_s = mfc_vcm_bind(addr, extent);
 	if (IS_ERR(alloc->vcm_s)) {
-		mfc_put_free_buf(addr, size, port);
+		mfc_put_free_buf(addr, extent, port);
 		kfree(alloc);
+		mutex_unlock(&mfc_buf_lock);
 
 		return NULL;
-		/*
-		return PTR_ERR(alloc->vcm_s);
-		*/
 	}
 
 	if (flag & MBT_KERNEL) {
@@ -479,13 +642,11 @@ struct mfc_alloc_buffer *_mfc_alloc_buf(
 		if (IS_ERR(alloc->vcm_k)) {
 			mfc_vcm_unbind(alloc->vcm_s,
 					alloc->type & MBT_OTHER);
-			mfc_put_free_buf(addr, size, port);
+			mfc_put_free_buf(addr, extent, port);
 			kfree(alloc);
+			mutex_unlock(&mfc_buf_lock);
 
 			return NULL;
-			/*
-			return PTR_ERR(alloc->vcm_k);
-			*/
 		}
 	}
 
@@ -499,39 +660,32 @@ struct mfc_alloc_buffer *_mfc_alloc_buf(
 			mfc_vcm_unmap(alloc->vcm_k);
 			mfc_vcm_unbind(alloc->vcm_s,
 					alloc->type & MBT_OTHER);
-			mfc_put_free_buf(addr, size, port);
+			mfc_put_free_buf(addr, extent, port);
 			kfree(alloc);
+			mutex_unlock(&mfc_buf_lock);
 
-		return NULL;
-			/*
-			return PTR_ERR(alloc->vcm_k);
-			*/
+			return NULL;
 		}
 	}
 
 	alloc->vcm_addr = addr;
-	alloc->vcm_size = size + align_size;
+	alloc->vcm_size = extent;
 #elif defined(CONFIG_S5P_VMEM)
-	if (align > PAGE_SIZE) {
-		align_size = ALIGN(addr, align) - addr;
-		align_size += ALIGN(align_size + size, PAGE_SIZE) - size;
-	} else {
-		align_size = ALIGN(align_size + size, PAGE_SIZE) - size;
-	}
+	extent = mfc_buf_extent(addr, size, align);
 
-	alloc->vmem_cookie = s5p_vmem_vmemmap(size + align_size,
-			addr, addr + (size + align_size));
+	alloc->vmem_cookie = s5p_vmem_vmemmap(extent, addr, addr + extent);
 
 	if (!alloc->vmem_cookie) {
 		mfc_dbg("cannot map free buffer to memory\n");
-		mfc_put_free_buf(addr, size, port);
+		mfc_put_free_buf(addr, extent, port);
 		kfree(alloc);
+		mutex_unlock(&mfc_buf_lock);
 
 		return NULL;
 	}
 
 	alloc->vmem_addr = addr;
-	alloc->vmem_size = size + align_size;
+	alloc->vmem_size = extent;
 #endif
 	alloc->real = ALIGN(addr, align);
 	alloc->size = size;
@@ -547,24 +701,18 @@ struct mfc_alloc_buffer *_mfc_alloc_buf(
 #else
 	alloc->addr = (unsigned char *)(mfc_mem_addr(port) +
 		mfc_mem_base_ofs(alloc->real));
-	/*
-	alloc->user = (unsigned char *)(ctx->userbase +
-		mfc_mem_data_ofs(alloc->real, 1));
-	*/
 	alloc->ofs = mfc_mem_data_ofs(alloc->real, 1);
 #endif
 	alloc->type = flag & 0xFFFF0000;
 	alloc->owner = ctx->id;
+	alloc->port = port;
 
-	list_add(&alloc->list, &mfc_alloc_head[port]);
-
-	/*
-	spin_unlock_irqrestore(&lock, flags);
-	*/
+	mfc_alloc_insert(alloc);
 
 #ifdef DEBUG_ALLOC_FREE
 	mfc_print_buf();
 #endif
+	mutex_unlock(&mfc_buf_lock);
 
 	return alloc;
 }
@@ -574,7 +722,8 @@ unsigned int mfc_vcm_bind_from_others(struct mfc_inst_ctx *ctx,
 				struct mfc_buf_alloc_arg *args, int flag)
 {
 	int ret;
-	unsigned int addr, size;
+	unsigned long addr;
+	unsigned int size;
 	unsigned int secure_id = args->secure_id;
 	int port = flag & 0xFFFF;
 
@@ -607,17 +756,19 @@ unsigned int mfc_vcm_bind_from_others(struct mfc_inst_ctx *ctx,
 		goto err_ret;
 	}
 
+	mutex_lock(&mfc_buf_lock);
+
 	addr = mfc_get_free_buf(size, ALIGN_2KB, port);
 	if (!addr) {
 		mfc_dbg("cannot get suitable free buffer\n");
 		goto err_ret_alloc;
 	}
-	mfc_dbg("mfc_get_free_buf: 0x%08x\n", addr);
+	mfc_dbg("mfc_get_free_buf: 0x%08lx\n", addr);
 
 	s_res = kzalloc(sizeof(struct vcm_mmu_res), GFP_KERNEL);
 	if (!s_res) {
 		mfc_dbg("%s: Failed to get vcm_mmu_res\n", __func__);
-		goto err_ret_alloc;
+		goto err_ret_free;
 	}
 
 	s_res->res.start = addr;
@@ -634,25 +785,85 @@ unsigned int mfc_vcm_bind_from_others(struct mfc_inst_ctx *ctx,
 	alloc->vcm_s = s_res;
 	alloc->vcm_addr = addr;
 	alloc->ump_handle = ump_mem;
-	alloc->vcm_size = size;
+	alloc->vcm_size = mfc_buf_extent(addr, size, ALIGN_2KB);
 	alloc->real = addr;
 	alloc->size = size;
 	alloc->type = flag & 0xFFFF0000;
 	alloc->owner = ctx->id;
+	alloc->port = port;
 
-	list_add(&alloc->list, &mfc_alloc_head[port]);
+	mfc_alloc_insert(alloc);
 
 	mfc_print_buf();
+	mutex_unlock(&mfc_buf_lock);
 
 	return 0;
 
 err_ret_s_res:
 	kfree(s_res);
+err_ret_free:
+	mfc_put_free_buf(addr, mfc_buf_extent(addr, size, ALIGN_2KB), port);
 err_ret_alloc:
+	mutex_unlock(&mfc_buf_lock);
 	kfree(alloc);
 err_ret:
 	return -1;
 }
+
+int mfc_import_buf(struct mfc_inst_ctx *ctx, struct mfc_buf_import_arg *args)
+{
+	struct mfc_buf_alloc_arg buf_arg;
+	struct mfc_alloc_buffer *alloc;
+	unsigned long real = 0;
+	int flag, port;
+
+	switch (args->usage) {
+	case MFC_IMPORT_STRM:
+		flag = MBT_CPB | PORT_A;
+		break;
+	case MFC_IMPORT_LUMA:
+		flag = (args->type == ENCODER) ? PORT_B : (MBT_DPB | PORT_B);
+		break;
+	case MFC_IMPORT_CHROMA:
+		flag = (args->type == ENCODER) ? PORT_B : (MBT_DPB | PORT_A);
+		break;
+	default:
+		return MFC_INVALID_PARAM_FAIL;
+	}
+
+	port = flag & 0xFFFF;
+	if (port > (mfc_mem_count() - 1))
+		port = mfc_mem_count() - 1;
+
+	/* the usage of an imported buffer is fixed by its first import */
+	mutex_lock(&mfc_buf_lock);
+	alloc = mfc_alloc_find_key(args->secure_id, ctx->id);
+	if (alloc) {
+		if ((alloc->type & MBT_OTHER) &&
+		    (alloc->type != ((MBT_OTHER | flag) & 0xFFFF0000) ||
+		     alloc->port != port)) {
+			mutex_unlock(&mfc_buf_lock);
+			return MFC_INVALID_PARAM_FAIL;
+		}
+		real = alloc->real;
+	}
+	mutex_unlock(&mfc_buf_lock);
+
+	if (!real) {
+		memset(&buf_arg, 0, sizeof(struct mfc_buf_alloc_arg));
+		buf_arg.secure_id = args->secure_id;
+
+		if ((int)mfc_vcm_bind_from_others(ctx, &buf_arg,
+						  MBT_OTHER | flag) < 0)
+			return MFC_MEM_ALLOC_FAIL;
+
+		real = mfc_get_buf_real(ctx->id, args->secure_id);
+	}
+
+	args->addr = real;
+
+	return MFC_OK;
+}
 #endif
 
 int
@@ -679,202 +890,116 @@ mfc_alloc_buf(struct mfc_inst_ctx *ctx, struct mfc_buf_alloc_arg *args, int flag
 	return MFC_OK;
 }
 
-int _mfc_free_buf(unsigned long real)
+/*
+ * A DPB from the frames imported for the instance when one fits, so
+ * the codec decodes straight into the consumer's buffer, otherwise
+ * one from the reserved memory. Imported frames have no kernel
+ * mapping: addr is NULL.
+ */
+struct mfc_alloc_buffer *mfc_alloc_dpb_buf(
+	struct mfc_inst_ctx *ctx, int size, int align, int port)
 {
-	struct list_head *pos, *nxt;
 	struct mfc_alloc_buffer *alloc;
-	int port;
-	int found = 0;
-	/*
-	unsigned long flags;
-	*/
-
-	mfc_dbg("addr: 0x%08lx\n", real);
-
-	/*
-	spin_lock_irqsave(&lock, flags);
-	*/
-
-	for (port = 0; port < mfc_mem_count(); port++) {
-		list_for_each_safe(pos, nxt, &mfc_alloc_head[port]) {
-			alloc = list_entry(pos, struct mfc_alloc_buffer, list);
 
-			if (alloc->real == real) {
-				found = 1;
-#if defined(CONFIG_VIDEO_MFC_VCM_UMP)
-				if (alloc->ump_handle)
-					mfc_ump_unmap(alloc->ump_handle);
+	if (port > (mfc_mem_count() - 1))
+		port = mfc_mem_count() - 1;
 
-				if (alloc->vcm_k)
-					mfc_vcm_unmap(alloc->vcm_k);
+	mutex_lock(&mfc_buf_lock);
+	list_for_each_entry(alloc, &mfc_owner_head[ctx->id], owner_list) {
+		if (alloc->type == (MBT_DPB | MBT_OTHER) && !alloc->in_use &&
+		    alloc->port == port && alloc->size >= size &&
+		    IS_ALIGNED(alloc->real, align)) {
+			alloc->in_use = 1;
+			mutex_unlock(&mfc_buf_lock);
 
-				if (alloc->vcm_s)
-					mfc_vcm_unbind(alloc->vcm_s,
-							alloc->type & MBT_OTHER);
+			return alloc;
+		}
+	}
+	mutex_unlock(&mfc_buf_lock);
 
-				if (mfc_put_free_buf(alloc->vcm_addr,
-					alloc->vcm_size, port) < 0) {
+	return _mfc_alloc_buf(ctx, size, align, MBT_DPB | port);
+}
 
-					mfc_err("failed to add free buffer\n");
-				} else {
-					list_del(&alloc->list);
-					kfree(alloc);
-				}
-#elif defined(CONFIG_S5P_VMEM)
-				if (alloc->vmem_cookie)
-					s5p_vfree(alloc->vmem_cookie);
+int _mfc_free_buf(unsigned long real)
+{
+	struct mfc_alloc_buffer *alloc;
 
-				if (mfc_put_free_buf(alloc->vmem_addr,
-					alloc->vmem_size, port) < 0) {
+	mfc_dbg("addr: 0x%08lx\n", real);
 
-					mfc_err("failed to add free buffer\n");
-				} else {
-					list_del(&alloc->list);
-					kfree(alloc);
-				}
-#else
-				if (mfc_put_free_buf(alloc->real,
-					alloc->size, port) < 0) {
-
-					mfc_err("failed to add free buffer\n");
-				} else {
-					list_del(&alloc->list);
-					kfree(alloc);
-				}
-#endif
-				break;
-			}
-		}
+	mutex_lock(&mfc_buf_lock);
 
-		if (found)
-			break;
-	}
-
-	/*
-	spin_unlock_irqrestore(&lock, flags);
-	*/
+	alloc = mfc_alloc_find_addr(real);
+	if (alloc)
+		mfc_release_alloc(alloc);
 
 #ifdef DEBUG_ALLOC_FREE
 	mfc_print_buf();
 #endif
+	mutex_unlock(&mfc_buf_lock);
 
-	if (found)
-		return 0;
-
-	return -1;
+	return alloc ? 0 : -1;
 }
 
 int mfc_free_buf(struct mfc_inst_ctx *ctx, unsigned int key)
 {
-	unsigned long real;
+	struct mfc_alloc_buffer *alloc;
 
-	real = mfc_get_buf_real(ctx->id, key);
-	if (unlikely(real == 0))
+	mutex_lock(&mfc_buf_lock);
+	alloc = mfc_alloc_find_key(key, ctx->id);
+	if (unlikely(alloc == NULL)) {
+		mutex_unlock(&mfc_buf_lock);
 		return MFC_MEM_INVALID_ADDR_FAIL;
+	}
 
-	if (_mfc_free_buf(real) < 0)
-		return MFC_MEM_INVALID_ADDR_FAIL;
+	/* an imported DPB the codec still decodes into or refers to */
+	if (alloc->in_use) {
+		mutex_unlock(&mfc_buf_lock);
+		return MFC_MEM_BUSY_FAIL;
+	}
+
+	mfc_release_alloc(alloc);
+	mutex_unlock(&mfc_buf_lock);
 
 	return MFC_OK;
 }
 
 void mfc_free_buf_dpb(int owner)
 {
-	int port;
-	struct list_head *pos, *nxt;
-	struct mfc_alloc_buffer *alloc;
-
-	for (port = 0; port < mfc_mem_count(); port++) {
-		list_for_each_safe(pos, nxt, &mfc_alloc_head[port]) {
-			alloc = list_entry(pos, struct mfc_alloc_buffer, list);
-
-			if ((alloc->owner == owner) && (alloc->type == MBT_DPB)) {
-				_mfc_free_buf(alloc->real);
-					}
-				}
+	struct mfc_alloc_buffer *alloc, *tmp;
+
+	mutex_lock(&mfc_buf_lock);
+	list_for_each_entry_safe(alloc, tmp, &mfc_owner_head[owner],
+				 owner_list) {
+		if (alloc->type == MBT_DPB)
+			mfc_release_alloc(alloc);
+		else if (alloc->type == (MBT_DPB | MBT_OTHER))
+			alloc->in_use = 0;	/* stays imported */
 	}
+	mutex_unlock(&mfc_buf_lock);
 }
 
 /* FIXME: add MFC Buffer Type */
 void mfc_free_buf_inst(int owner)
 {
-	struct list_head *pos, *nxt;
-	int port;
-	struct mfc_alloc_buffer *alloc;
-	/*
-	unsigned long flags;
-	*/
+	struct mfc_alloc_buffer *alloc, *tmp;
 
 	mfc_dbg("owner: %d\n", owner);
 
-	/*
-	spin_lock_irqsave(&lock, flags);
-	*/
-
-	for (port = 0; port < mfc_mem_count(); port++) {
-		list_for_each_safe(pos, nxt, &mfc_alloc_head[port]) {
-			alloc = list_entry(pos, struct mfc_alloc_buffer, list);
-
-			if (alloc->owner == owner) {
-#if defined(CONFIG_VIDEO_MFC_VCM_UMP)
-				if (alloc->ump_handle)
-					mfc_ump_unmap(alloc->ump_handle);
-
-				if (alloc->vcm_k)
-					mfc_vcm_unmap(alloc->vcm_k);
-
-				if (alloc->vcm_s)
-					mfc_vcm_unbind(alloc->vcm_s,
-							alloc->type & MBT_OTHER);
-
-				if (mfc_put_free_buf(alloc->vcm_addr,
-					alloc->vcm_size, port) < 0) {
-
-					mfc_err("failed to add free buffer\n");
-				} else {
-					list_del(&alloc->list);
-					kfree(alloc);
-				}
-#elif defined(CONFIG_S5P_VMEM)
-				if (alloc->vmem_cookie)
-					s5p_vfree(alloc->vmem_cookie);
-
-				if (mfc_put_free_buf(alloc->vmem_addr,
-					alloc->vmem_size, port) < 0) {
-
-					mfc_err("failed to add free buffer\n");
-				} else {
-					list_del(&alloc->list);
-					kfree(alloc);
-				}
-#else
-				if (mfc_put_free_buf(alloc->real,
-					alloc->size, port) < 0) {
-
-					mfc_err("failed to add free buffer\n");
-				} else {
-					list_del(&alloc->list);
-					kfree(alloc);
-				}
-#endif
-			}
-		}
-	}
-
-	/*
-	spin_unlock_irqrestore(&lock, flags);
-	*/
+	mutex_lock(&mfc_buf_lock);
+	list_for_each_entry_safe(alloc, tmp, &mfc_owner_head[owner],
+				 owner_list)
+		mfc_release_alloc(alloc);
 
 #ifdef DEBUG_ALLOC_FREE
 	mfc_print_buf();
 #endif
+	mutex_unlock(&mfc_buf_lock);
 }
 
 unsigned long mfc_get_buf_real(int owner, unsigned int key)
 {
-	struct list_head *pos, *nxt;
-	int port;
 	struct mfc_alloc_buffer *alloc;
+	unsigned long real = 0;
 
 #if defined(CONFIG_VIDEO_MFC_VCM_UMP)
 		mfc_dbg("owner: %d, secure id: 0x%08x\n", owner, key);
@@ -884,97 +1009,97 @@ unsigned long mfc_get_buf_real(int owner, unsigned int key)
 		mfc_dbg("owner: %d, offset: 0x%08x\n", owner, key);
 #endif
 
-	for (port = 0; port < mfc_mem_count(); port++) {
-		list_for_each_safe(pos, nxt, &mfc_alloc_head[port]) {
-			alloc = list_entry(pos, struct mfc_alloc_buffer, list);
+	mutex_lock(&mfc_buf_lock);
+	alloc = mfc_alloc_find_key(key, owner);
+	if (alloc)
+		real = alloc->real;
+	mutex_unlock(&mfc_buf_lock);
 
-			if (alloc->owner == owner) {
-#if defined(CONFIG_VIDEO_MFC_VCM_UMP)
-				if (alloc->ump_handle) {
-					if (mfc_ump_get_id(alloc->ump_handle) == key)
-						return alloc->real;
-				}
-#elif defined(CONFIG_S5P_VMEM)
-				if (alloc->vmem_cookie == key)
-					return alloc->real;
-#else
-				if (alloc->ofs == key)
-					return alloc->real;
-#endif
-			}
-		}
-	}
-
-	return 0;
+	return real;
 }
 
-#if 0
-unsigned char *mfc_get_buf_addr(int owner, unsigned char *user)
+static int mfc_buf_sync(unsigned long real, unsigned int size, int to_device)
 {
-	struct list_head *pos, *nxt;
-	int port;
 	struct mfc_alloc_buffer *alloc;
+	unsigned char *addr = NULL;
+	unsigned int avail = 0;
+	int imported = 0;
+
+	mutex_lock(&mfc_buf_lock);
+	alloc = mfc_alloc_find_range(real);
+	if (alloc) {
+		imported = alloc->type & MBT_OTHER;
+		if (alloc->addr) {
+			addr = alloc->addr + (real - alloc->real);
+			avail = alloc->size - (real - alloc->real);
+		}
+	}
+	mutex_unlock(&mfc_buf_lock);
 
-	mfc_dbg("owner: %d, user: 0x%08x\n", owner, (unsigned int)user);
-
-	for (port = 0; port < mfc_mem_count(); port++) {
-		list_for_each_safe(pos, nxt, &mfc_alloc_head[port]) {
-			alloc = list_entry(pos, struct mfc_alloc_buffer, list);
+	if (imported)
+		return 0;
 
-			if ((alloc->owner == owner)
-				&& (alloc->user == user)){
+	if (!addr)
+		return -1;
 
-				return alloc->addr;
-			}
-		}
-	}
+	if (to_device)
+		mfc_mem_cache_clean(addr, min(size, avail));
+	else
+		mfc_mem_cache_inv(addr, min(size, avail));
 
-	return NULL;
+	return 0;
 }
 
-unsigned char *_mfc_get_buf_addr(int owner, unsigned char *user)
+/*
+ * Clean @size bytes from @real, clamped to its buffer, before the
+ * codec reads what the CPU wrote there. Buffers imported from another
+ * device are not written through the CPU cache and are left alone.
+ * Returns -1 if @real is not in a buffer with a kernel mapping.
+ */
+int mfc_buf_clean(unsigned long real, unsigned int size)
 {
-	struct list_head *pos, *nxt;
-	int port;
-	struct mfc_alloc_buffer *alloc;
-
-	mfc_dbg("owner: %d, user: 0x%08x\n", owner, (unsigned int)user);
-
-	for (port = 0; port < mfc_mem_count(); port++) {
-		list_for_each_safe(pos, nxt, &mfc_alloc_head[port]) {
-			alloc = list_entry(pos, struct mfc_alloc_buffer, list);
+	return mfc_buf_sync(real, size, 1);
+}
 
-			if ((alloc->owner == owner)
-				&& ((alloc->user <= user) || ((alloc->user + alloc->size) > user))){
+/* Invalidate before the CPU reads what the codec wrote, as above */
+int mfc_buf_inv(unsigned long real, unsigned int size)
+{
+	return mfc_buf_sync(real, size, 0);
+}
 
-				return alloc->addr;
-			}
-		}
-	}
+/*
+ * The codec wrote the buffer at @real. Without the System MMU, DPBs
+ * are physically contiguous and registered with the shared cache
+ * layer, which then knows FIMC or G2D need not clean them again.
+ */
+void mfc_buf_device_wrote(unsigned long real)
+{
+#if !defined(SYSMMU_MFC_ON)
+	struct mfc_alloc_buffer *alloc;
 
-	return NULL;
-}
+	mutex_lock(&mfc_buf_lock);
+	alloc = mfc_alloc_find_range(real);
+	if (alloc)
+		s5p_bufsync_device_wrote(S5P_BUFSYNC_MFC, alloc->real,
+					 alloc->size);
+	mutex_unlock(&mfc_buf_lock);
 #endif
+}
 
 #ifdef CONFIG_VIDEO_MFC_VCM_UMP
 void *mfc_get_buf_ump_handle(unsigned long real)
 {
-	struct list_head *pos, *nxt;
-	int port;
 	struct mfc_alloc_buffer *alloc;
+	void *handle = NULL;
 
 	mfc_dbg("real: 0x%08lx\n", real);
 
-	for (port = 0; port < mfc_mem_count(); port++) {
-		list_for_each_safe(pos, nxt, &mfc_alloc_head[port]) {
-			alloc = list_entry(pos, struct mfc_alloc_buffer, list);
-
-			if (alloc->real == real)
-				return alloc->ump_handle;
-		}
-	}
+	mutex_lock(&mfc_buf_lock);
+	alloc = mfc_alloc_find_addr(real);
+	if (alloc)
+		handle = alloc->ump_handle;
+	mutex_unlock(&mfc_buf_lock);
 
-	return NULL;
+	return handle;
 }
 #endif
-
@@ -15,6 +15,9 @@
 #define __MFC_BUF_H_ __FILE__
 
 #include <linux/list.h>
+#include <linux/rbtree.h>
+
+#include <plat/s5p-bufsync.h>
 
 #include "mfc.h"
 #include "mfc_inst.h"
@@ -128,7 +131,14 @@
 #endif
 
 struct mfc_alloc_buffer {
-	struct list_head list;
+	struct rb_node addr_node;	/* by real			*/
+	struct rb_node key_node;	/* by key, then owner		*/
+	struct list_head owner_list;
+	unsigned int key;	/* offset, cookie or secure id	*/
+	int keyed;		/* key_node is in use		*/
+	int in_use;		/* imported DPB given to the codec */
+	struct s5p_bufsync sync;
+	int port;
 	unsigned long real;	/* phys. or virt. addr for MFC	*/
 	unsigned int size;	/* allocation size		*/
 	unsigned char *addr;	/* kernel virtual address space */
@@ -155,7 +165,8 @@ struct mfc_alloc_buffer {
 };
 
 struct mfc_free_buffer {
-	struct list_head list;
+	struct rb_node addr_node;
+	struct rb_node size_node;
 	unsigned long real;	/* phys. or virt. addr for MFC	*/
 	unsigned int size;
 };
@@ -164,16 +175,20 @@ void mfc_print_buf(void);
 
 int mfc_init_buf(void);
 void mfc_final_buf(void);
-void mfc_merge_buf(void);
 struct mfc_alloc_buffer *_mfc_alloc_buf(
 	struct mfc_inst_ctx *ctx, int size, int align, int flag);
 int mfc_alloc_buf(
 	struct mfc_inst_ctx *ctx, struct mfc_buf_alloc_arg* args, int flag);
+struct mfc_alloc_buffer *mfc_alloc_dpb_buf(
+	struct mfc_inst_ctx *ctx, int size, int align, int port);
 int _mfc_free_buf(unsigned long real);
 int mfc_free_buf(struct mfc_inst_ctx *ctx, unsigned int key);
 void mfc_free_buf_dpb(int owner);
 void mfc_free_buf_inst(int owner);
 unsigned long mfc_get_buf_real(int owner, unsigned int key);
+int mfc_buf_clean(unsigned long real, unsigned int size);
+int mfc_buf_inv(unsigned long real, unsigned int size);
+void mfc_buf_device_wrote(unsigned long real);
 /*
 unsigned char *mfc_get_buf_addr(int owner, unsigned char *user);
 unsigned char *_mfc_get_buf_addr(int owner, unsigned char *user);
@@ -181,6 +196,7 @@ unsigned char *_mfc_get_buf_addr(int owner, unsigned char *user);
 #ifdef CONFIG_VIDEO_MFC_VCM_UMP
 unsigned int mfc_vcm_bind_from_others(struct mfc_inst_ctx *ctx,
 				struct mfc_buf_alloc_arg *args, int flag);
+int mfc_import_buf(struct mfc_inst_ctx *ctx, struct mfc_buf_import_arg *args);
 void *mfc_get_buf_ump_handle(unsigned long real);
 #endif
 #endif /* __MFC_BUF_H_ */
@@ -687,7 +687,7 @@ static int set_dpbs(struct mfc_inst_ctx *ctx)
 		/*
 		 * allocate chroma buffer
 		 */
-		alloc = _mfc_alloc_buf(ctx, dec_ctx->chromasize, ALIGN_2KB, MBT_DPB | PORT_A);
+		alloc = mfc_alloc_dpb_buf(ctx, dec_ctx->chromasize, ALIGN_2KB, PORT_A);
 		if (alloc == NULL) {
 			mfc_err("failed alloc chroma buffer\n");
 
@@ -696,7 +696,7 @@ static int set_dpbs(struct mfc_inst_ctx *ctx)
 
 		/* clear first DPB chroma buffer, referrence buffer for
 		   vectors starting with p-frame */
-		if (i == 0) {
+		if (i == 0 && alloc->addr) {
 			memset((void *)alloc->addr, 0x80, alloc->size);
 			mfc_mem_cache_clean((void *)alloc->addr, alloc->size);
 		}
@@ -709,7 +709,7 @@ static int set_dpbs(struct mfc_inst_ctx *ctx)
 		/*
 		 * allocate luma buffer
 		 */
-		alloc = _mfc_alloc_buf(ctx, dec_ctx->lumasize, ALIGN_2KB, MBT_DPB | PORT_B);
+		alloc = mfc_alloc_dpb_buf(ctx, dec_ctx->lumasize, ALIGN_2KB, PORT_B);
 		if (alloc == NULL) {
 			mfc_err("failed alloc luma buffer\n");
 
@@ -718,7 +718,7 @@ static int set_dpbs(struct mfc_inst_ctx *ctx)
 
 		/* clear first DPB luma buffer, referrence buffer for
 		   vectors starting with p-frame */
-		if (i == 0) {
+		if (i == 0 && alloc->addr) {
 			memset((void *)alloc->addr, 0x0, alloc->size);
 			mfc_mem_cache_clean((void *)alloc->addr, alloc->size);
 		}
@@ -763,7 +763,7 @@ static int h264_set_dpbs(struct mfc_inst_ctx *ctx)
 		/*
 		 * allocate chroma buffer
 		 */
-		alloc = _mfc_alloc_buf(ctx, dec_ctx->chromasize, ALIGN_2KB, MBT_DPB | PORT_A);
+		alloc = mfc_alloc_dpb_buf(ctx, dec_ctx->chromasize, ALIGN_2KB, PORT_A);
 		if (alloc == NULL) {
 			mfc_err("failed alloc chroma buffer\n");
 
@@ -772,7 +772,7 @@ static int h264_set_dpbs(struct mfc_inst_ctx *ctx)
 
 		/* clear first DPB chroma buffer, referrence buffer for
 		   vectors starting with p-frame */
-		if (i == 0) {
+		if (i == 0 && alloc->addr) {
 			memset((void *)alloc->addr, 0x80, alloc->size);
 			mfc_mem_cache_clean((void *)alloc->addr, alloc->size);
 		}
@@ -785,7 +785,7 @@ static int h264_set_dpbs(struct mfc_inst_ctx *ctx)
 		/*
 		 * allocate luma buffer
 		 */
-		alloc = _mfc_alloc_buf(ctx, dec_ctx->lumasize, ALIGN_2KB, MBT_DPB | PORT_B);
+		alloc = mfc_alloc_dpb_buf(ctx, dec_ctx->lumasize, ALIGN_2KB, PORT_B);
 		if (alloc == NULL) {
 			mfc_err("failed alloc luma buffer\n");
 
@@ -794,7 +794,7 @@ static int h264_set_dpbs(struct mfc_inst_ctx *ctx)
 
 		/* clear first DPB luma buffer, referrence buffer for
 		   vectors starting with p-frame */
-		if (i == 0) {
+		if (i == 0 && alloc->addr) {
 			memset((void *)alloc->addr, 0x0, alloc->size);
 			mfc_mem_cache_clean((void *)alloc->addr, alloc->size);
 		}
@@ -1562,17 +1562,17 @@ static int mfc_set_decoder(struct mfc_inst_ctx *ctx, SSBSIP_MFC_CODEC_TYPE codec
 
 static void mfc_set_stream_info(
 	struct mfc_inst_ctx *ctx,
-	unsigned int addr,
+	unsigned long real,
 	unsigned int size,
 	unsigned int ofs)
 {
-
-	if (ctx->buf_cache_type == CACHE) {
+	/* a stream outside the codec buffers still needs everything flushed */
+	if (ctx->buf_cache_type == CACHE && mfc_buf_clean(real, ofs + size) < 0) {
 		flush_all_cpu_caches();
 		outer_flush_all();
 	}
 
-	write_reg(addr, MFC_SI_CH1_ES_ADR);
+	write_reg(mfc_mem_base_ofs(real) >> 11, MFC_SI_CH1_ES_ADR);
 	write_reg(size, MFC_SI_CH1_ES_SIZE);
 
 	/* FIXME: IOCTL_MFC_GET_IN_BUF size */
@@ -1679,7 +1679,7 @@ int mfc_init_decoding(struct mfc_inst_ctx *ctx, union mfc_args *args)
 	}
 
 	/* FIXME: postion */
-	mfc_set_stream_info(ctx, mfc_mem_base_ofs(dec_ctx->streamaddr) >> 11,
+	mfc_set_stream_info(ctx, dec_ctx->streamaddr,
 		dec_ctx->streamsize, 0);
 
 	ret = mfc_cmd_seq_start(ctx);
@@ -1715,17 +1715,12 @@ int mfc_init_decoding(struct mfc_inst_ctx *ctx, union mfc_args *args)
 #if 0
 #if defined(CONFIG_CPU_FREQ) && defined(CONFIG_S5PV310_BUSFREQ)
 	/* Fix MFC & Bus Frequency for High resolution for better performance */
-	if (ctx->width >= 1920 || ctx->height >= 1080) {
-		if (atomic_read(&ctx->dev->busfreq_lock_cnt) == 0) {
-			/* For fixed MFC & Bus Freq to 160 & 266 MHz for 1080p Contents */
-			if (ctx->codecid == 0)	/* H264_DEC */
-				s5pv310_busfreq_lock(DVFS_LOCK_ID_MFC, BUS_L0);
-			else
-				s5pv310_busfreq_lock(DVFS_LOCK_ID_MFC, BUS_L1);
-			mfc_dbg("[%s] Bus Freq Locked L1 !!\n", __func__);
-		}
-		atomic_inc(&ctx->dev->busfreq_lock_cnt);
-		ctx->busfreq_flag = true;
+	if ((ctx->width >= 1920 || ctx->height >= 1080) &&
+	    !pm_qos_request_active(&ctx->busfreq_req)) {
+		/* For fixed MFC & Bus Freq to 160 & 266 MHz for 1080p Contents */
+		pm_qos_add_request(&ctx->busfreq_req, PM_QOS_BUS_FREQ_MIN,
+			ctx->codecid == 0 ? BUSFREQ_400MHZ : BUSFREQ_267MHZ);
+		mfc_dbg("[%s] Bus Freq Locked L1 !!\n", __func__);
 	}
 #endif
 #endif
@@ -1733,26 +1728,20 @@ int mfc_init_decoding(struct mfc_inst_ctx *ctx, union mfc_args *args)
 #if defined(CONFIG_CPU_FREQ) && defined(CONFIG_S5PV310_BUSFREQ)
 #if defined(CONFIG_MACH_P8_REV00) || defined(CONFIG_MACH_P8_REV01) || defined(CONFIG_MACH_P8LTE_REV00) || defined(CONFIG_MACH_P4W_REV00) || defined(CONFIG_MACH_P4W_REV01)
 	/* Fix MFC & Bus Frequency for High resolution for better performance */
-	if (atomic_read(&ctx->dev->busfreq_lock_cnt) == 0) {
-		s5pv310_busfreq_lock(DVFS_LOCK_ID_MFC, BUS_L1);
+	if (!pm_qos_request_active(&ctx->busfreq_req)) {
+		pm_qos_add_request(&ctx->busfreq_req, PM_QOS_BUS_FREQ_MIN,
+				BUSFREQ_267MHZ);
 		mfc_info("[%s] Bus Freq Locked L1!!\n", __func__);
 	}
-	atomic_inc(&ctx->dev->busfreq_lock_cnt);
-	ctx->busfreq_flag = true;
 #endif
 #endif
 
 #if defined(CONFIG_CPU_FREQ) && defined(CONFIG_S5PV310_BUSFREQ)
-	if (ctx->width >= 1280 || ctx->height >= 720) {
-		if (atomic_read(&ctx->dev->cpufreq_lock_cnt) == 0) {
-			static int cpu_lv = -1;
-			if (cpu_lv == -1)
-				cpu_lv = s5pv310_cpufreq_round_idx(CPUFREQ_500MHZ);
-			s5pv310_cpufreq_lock(DVFS_LOCK_ID_MFC, cpu_lv); /* 500MHz */
-			mfc_info("[%s] CPU Freq Locked 500MHz!!\n", __func__);
-		}
-		atomic_inc(&ctx->dev->cpufreq_lock_cnt);
-		ctx->cpufreq_flag = true;
+	if ((ctx->width >= 1280 || ctx->height >= 720) &&
+	    !pm_qos_request_active(&ctx->cpufreq_req)) {
+		pm_qos_add_request(&ctx->cpufreq_req, PM_QOS_CPU_FREQ_MIN,
+				CPUFREQ_500MHZ);
+		mfc_info("[%s] CPU Freq Locked 500MHz!!\n", __func__);
 	}
 #endif
 
@@ -1906,7 +1895,7 @@ static int mfc_decoding_frame(struct mfc_inst_ctx *ctx, struct mfc_dec_exe_arg *
 	}
 
 	/* FIXME: postion */
-	mfc_set_stream_info(ctx, mfc_mem_base_ofs(exe_arg->in_strm_buf) >> 11,
+	mfc_set_stream_info(ctx, exe_arg->in_strm_buf,
 		exe_arg->in_strm_size, start_ofs);
 
 	/* lastframe: mfc_dec_cfg */
@@ -1991,6 +1980,22 @@ static int mfc_decoding_frame(struct mfc_inst_ctx *ctx, struct mfc_dec_exe_arg *
 	exe_arg->out_y_offset = mfc_mem_data_ofs(display_luma_addr << 11, 1);
 	exe_arg->out_c_offset = mfc_mem_data_ofs(display_chroma_addr << 11, 1);
 
+	mfc_buf_device_wrote(mfc_mem_addr_ofs(
+		read_reg(MFC_SI_DECODE_Y_ADR) << 11, PORT_B));
+	mfc_buf_device_wrote(mfc_mem_addr_ofs(
+		read_reg(MFC_SI_DECODE_C_ADR) << 11, PORT_A));
+
+	/*
+	 * Only the stream is maintained before decoding now, so the CPU
+	 * has to drop what it may hold of the frame it is given.
+	 */
+	if (ctx->buf_cache_type == CACHE) {
+		mfc_buf_inv(mfc_mem_addr_ofs(display_luma_addr << 11, PORT_B),
+			    dec_ctx->lumasize);
+		mfc_buf_inv(mfc_mem_addr_ofs(display_chroma_addr << 11, PORT_A),
+			    dec_ctx->chromasize);
+	}
+
 #if defined(CONFIG_VIDEO_MFC_VCM_UMP)
 	exe_arg->out_y_secure_id = 0;
 	exe_arg->out_c_secure_id = 0;
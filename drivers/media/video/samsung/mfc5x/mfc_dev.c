@@ -25,6 +25,7 @@
 #include <linux/slab.h>
 #include <linux/dma-mapping.h>
 #include <linux/delay.h>
+#include <linux/poll.h>
 
 #include <linux/sched.h>
 #include <linux/firmware.h>
@@ -48,6 +49,7 @@
 #include "mfc_enc.h"
 #include "mfc_mem.h"
 #include "mfc_cmd.h"
+#include "mfc_sched.h"
 
 #ifdef SYSMMU_MFC_ON
 #include <plat/sysmmu.h>
@@ -203,29 +205,21 @@ static int mfc_release(struct inode *inode, struct file *file)
 
 	dev = mfc_ctx->dev;
 
+	/* frames still queued for this instance are dropped */
+	mfc_sched_final_inst(mfc_ctx);
+
 	mutex_lock(&dev->lock);
 
 #if defined(CONFIG_CPU_FREQ) && defined(CONFIG_S5PV310_BUSFREQ)
-	/* Release MFC & Bus Frequency lock for High resolution */
-	if (mfc_ctx->busfreq_flag == true) {
-		atomic_dec(&dev->busfreq_lock_cnt);
-		mfc_ctx->busfreq_flag = false;
-		if (atomic_read(&dev->busfreq_lock_cnt) == 0) {
-			/* release Freq lock back to normal */
-			s5pv310_busfreq_lock_free(DVFS_LOCK_ID_MFC);
-			mfc_info("[%s] Bus Freq lock Released Normal !!\n", __func__);
-		}
+	/* Release this instance's Bus & CPU Frequency requests */
+	if (pm_qos_request_active(&mfc_ctx->busfreq_req)) {
+		pm_qos_remove_request(&mfc_ctx->busfreq_req);
+		mfc_info("[%s] Bus Freq lock Released Normal !!\n", __func__);
 	}
 
-	/* Release MFC & CPU Frequency lock for High resolution */
-	if (mfc_ctx->cpufreq_flag == true) {
-		atomic_dec(&dev->cpufreq_lock_cnt);
-		mfc_ctx->cpufreq_flag = false;
-		if (atomic_read(&dev->cpufreq_lock_cnt) == 0) {
-			/* release Freq lock back to normal */
-			s5pv310_cpufreq_lock_free(DVFS_LOCK_ID_MFC);
-			mfc_info("[%s] CPU Freq lock Released Normal !!\n", __func__);
-		}
+	if (pm_qos_request_active(&mfc_ctx->cpufreq_req)) {
+		pm_qos_remove_request(&mfc_ctx->cpufreq_req);
+		mfc_info("[%s] CPU Freq lock Released Normal !!\n", __func__);
 	}
 #endif
 
@@ -357,12 +351,25 @@ static long mfc_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 
-		mfc_clock_on();
-		in_param.ret_code = mfc_exec_decoding(mfc_ctx, &(in_param.args));
+		mutex_unlock(&dev->lock);
+
+		in_param.ret_code = mfc_sched_exec(mfc_ctx, IOCTL_MFC_DEC_EXE,
+						   &(in_param.args));
 		ret = in_param.ret_code;
-		mfc_clock_off();
+		break;
 
-		mutex_unlock(&dev->lock);
+	case IOCTL_MFC_DEC_EXE_ASYNC:
+		if (mfc_ctx->state < INST_STATE_INIT) {
+			mfc_err("IOCTL_MFC_DEC_EXE_ASYNC invalid state: 0x%08x\n",
+				mfc_ctx->state);
+			in_param.ret_code = MFC_STATE_INVALID;
+			ret = -EINVAL;
+			break;
+		}
+
+		in_param.ret_code = mfc_sched_submit(mfc_ctx, IOCTL_MFC_DEC_EXE,
+						     &(in_param.args));
+		ret = in_param.ret_code;
 		break;
 
 	case IOCTL_MFC_ENC_EXE:
@@ -378,12 +385,31 @@ static long mfc_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 
-		mfc_clock_on();
-		in_param.ret_code = mfc_exec_encoding(mfc_ctx, &(in_param.args));
+		mutex_unlock(&dev->lock);
+
+		in_param.ret_code = mfc_sched_exec(mfc_ctx, IOCTL_MFC_ENC_EXE,
+						   &(in_param.args));
 		ret = in_param.ret_code;
-		mfc_clock_off();
+		break;
 
-		mutex_unlock(&dev->lock);
+	case IOCTL_MFC_ENC_EXE_ASYNC:
+		if (mfc_ctx->state < INST_STATE_INIT) {
+			mfc_err("IOCTL_MFC_ENC_EXE_ASYNC invalid state: 0x%08x\n",
+				mfc_ctx->state);
+			in_param.ret_code = MFC_STATE_INVALID;
+			ret = -EINVAL;
+			break;
+		}
+
+		in_param.ret_code = mfc_sched_submit(mfc_ctx, IOCTL_MFC_ENC_EXE,
+						     &(in_param.args));
+		ret = in_param.ret_code;
+		break;
+
+	case IOCTL_MFC_GET_EXE_RESULT:
+		in_param.ret_code = mfc_sched_get_result(mfc_ctx,
+							 &(in_param.args));
+		ret = in_param.ret_code;
 		break;
 
 	case IOCTL_MFC_GET_IN_BUF:
@@ -487,6 +513,16 @@ static long mfc_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		}
 
 		break;
+
+	case IOCTL_MFC_IMPORT_BUF:
+		mutex_lock(&dev->lock);
+
+		in_param.ret_code = mfc_import_buf(mfc_ctx,
+						   &(in_param.args.buf_import));
+		ret = in_param.ret_code;
+
+		mutex_unlock(&dev->lock);
+		break;
 #endif
 
 	case IOCTL_MFC_SET_CONFIG:
@@ -518,6 +554,13 @@ static long mfc_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		in_param.ret_code = MFC_OK;
 		break;
 
+	case IOCTL_MFC_SET_SCHED:
+		in_param.ret_code = mfc_sched_set_param(mfc_ctx,
+					in_param.args.sched.in_priority,
+					in_param.args.sched.in_weight);
+		ret = in_param.ret_code;
+		break;
+
 	default:
 		mfc_err("failed to execute ioctl cmd: 0x%08x\n", cmd);
 
@@ -822,12 +865,27 @@ static int mfc_mmap(struct file *file, struct vm_area_struct *vma)
 	return 0;
 }
 
+/* readable when a queued frame is done, writable when another fits */
+static unsigned int mfc_poll(struct file *file, poll_table *wait)
+{
+	struct mfc_inst_ctx *mfc_ctx;
+
+	mfc_ctx = (struct mfc_inst_ctx *)file->private_data;
+	if (!mfc_ctx)
+		return POLLERR;
+
+	poll_wait(file, &mfc_ctx->sched.wait, wait);
+
+	return mfc_sched_poll(mfc_ctx);
+}
+
 static const struct file_operations mfc_fops = {
 	.owner		= THIS_MODULE,
 	.open		= mfc_open,
 	.release	= mfc_release,
 	.unlocked_ioctl	= mfc_ioctl,
 	.mmap		= mfc_mmap,
+	.poll		= mfc_poll,
 };
 
 static struct miscdevice mfc_miscdev = {
@@ -875,12 +933,14 @@ static int __devinit mfc_probe(struct platform_device *pdev)
 	init_waitqueue_head(&mfcdev->wait_codec[0]);
 	init_waitqueue_head(&mfcdev->wait_codec[1]);
 	atomic_set(&mfcdev->inst_cnt, 0);
-#ifdef CONFIG_CPU_FREQ
-	atomic_set(&mfcdev->busfreq_lock_cnt, 0);
-	atomic_set(&mfcdev->cpufreq_lock_cnt, 0);
-#endif
 	mfcdev->device = &pdev->dev;
 
+	ret = mfc_init_sched(mfcdev);
+	if (ret < 0) {
+		dev_err(&pdev->dev, "failed to create scheduler\n");
+		goto err_sched;
+	}
+
 	platform_set_drvdata(pdev, mfcdev);
 
 	/* get the memory region */
@@ -1038,6 +1098,9 @@ err_mem_map:
 err_mem_req:
 err_mem_res:
 	platform_set_drvdata(pdev, NULL);
+	mfc_final_sched(mfcdev);
+
+err_sched:
 	mutex_destroy(&mfcdev->lock);
 	kfree(mfcdev);
 
@@ -1074,6 +1137,7 @@ static int __devexit mfc_remove(struct platform_device *pdev)
 	iounmap(dev->reg.base);
 	release_mem_region(dev->reg.rsrc_start, dev->reg.rsrc_len);
 	platform_set_drvdata(pdev, NULL);
+	mfc_final_sched(dev);
 	mutex_destroy(&dev->lock);
 	kfree(dev);
 
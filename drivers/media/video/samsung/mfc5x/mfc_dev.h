@@ -18,6 +18,7 @@
 #include <linux/firmware.h>
 
 #include "mfc_inst.h"
+#include "mfc_sched.h"
 
 #define MFC_DEV_NAME	"s3c-mfc"
 #define MFC_NAME_LEN	16
@@ -98,15 +99,13 @@ struct mfc_dev {
 	wait_queue_head_t	wait_codec[2];
 	int			irq_codec[2];
 
+	struct mfc_sched	sched;
+
 	struct mfc_fw		fw;
 
 	struct s5p_vcm_mmu	*_vcm_mmu;
 
 	struct device		*device;
-#ifdef CONFIG_CPU_FREQ
-	atomic_t		busfreq_lock_cnt; /* Bus frequency Lock count */
-	atomic_t		cpufreq_lock_cnt; /* CPU frequency Lock count */
-#endif
 };
 
 #endif /* __MFC_DEV_H */
@@ -1340,14 +1340,12 @@ int mfc_init_encoding(struct mfc_inst_ctx *ctx, union mfc_args *args)
 
 #if defined(CONFIG_CPU_FREQ) && defined(CONFIG_S5PV310_BUSFREQ)
 	/* Fix MFC & Bus Frequency for High resolution for better performance */
-	if (ctx->width >= 1920 || ctx->height >= 1080) {
-		if (atomic_read(&ctx->dev->busfreq_lock_cnt) == 0) {
-			/* For fixed MFC & Bus Freq to 200 & 400 MHz for 1080p Contents */
-			s5pv310_busfreq_lock(DVFS_LOCK_ID_MFC, BUS_L0);
-			mfc_info("[%s] Bus Freq Locked L0\n", __func__);
-		}
-		atomic_inc(&ctx->dev->busfreq_lock_cnt);
-		ctx->busfreq_flag = true;
+	if ((ctx->width >= 1920 || ctx->height >= 1080) &&
+	    !pm_qos_request_active(&ctx->busfreq_req)) {
+		/* For fixed MFC & Bus Freq to 200 & 400 MHz for 1080p Contents */
+		pm_qos_add_request(&ctx->busfreq_req, PM_QOS_BUS_FREQ_MIN,
+				BUSFREQ_400MHZ);
+		mfc_info("[%s] Bus Freq Locked L0\n", __func__);
 	}
 #endif
 
@@ -1360,16 +1358,10 @@ int mfc_init_encoding(struct mfc_inst_ctx *ctx, union mfc_args *args)
 		cpu_lock = 1;
 #endif
 
-	if (cpu_lock) {
-		if (atomic_read(&ctx->dev->cpufreq_lock_cnt) == 0) {
-			static int cpu_lv = -1;
-			if (cpu_lv == -1)
-				cpu_lv = s5pv310_cpufreq_round_idx(CPUFREQ_500MHZ);
-			s5pv310_cpufreq_lock(DVFS_LOCK_ID_MFC, cpu_lv); /* 500MHz */
-			mfc_info("[%s] CPU Freq Locked 500MHz!!\n", __func__);
-		}
-		atomic_inc(&ctx->dev->cpufreq_lock_cnt);
-		ctx->cpufreq_flag = true;
+	if (cpu_lock && !pm_qos_request_active(&ctx->cpufreq_req)) {
+		pm_qos_add_request(&ctx->cpufreq_req, PM_QOS_CPU_FREQ_MIN,
+				CPUFREQ_500MHZ);
+		mfc_info("[%s] CPU Freq Locked 500MHz!!\n", __func__);
 	}
 #endif
 
@@ -1489,7 +1481,16 @@ static int mfc_encoding_frame(struct mfc_inst_ctx *ctx, struct mfc_enc_exe_arg *
 	write_reg(0x1 << 1, MFC_ENC_SF_BUF_CTRL);
 	#endif
 
-	if (ctx->buf_cache_type == CACHE) {
+	/*
+	 * Clean the frame the CPU wrote and drop what it holds of the
+	 * stream the codec is about to write; buffers outside the codec
+	 * buffers still need everything flushed.
+	 */
+	if (ctx->buf_cache_type == CACHE &&
+	    (mfc_buf_clean(exe_arg->in_Y_addr, UINT_MAX) < 0 ||
+	     mfc_buf_clean(exe_arg->in_CbCr_addr, UINT_MAX) < 0 ||
+	     mfc_buf_inv(exe_arg->in_strm_st,
+			 exe_arg->in_strm_end - exe_arg->in_strm_st) < 0)) {
 		flush_all_cpu_caches();
 		outer_flush_all();
 	}
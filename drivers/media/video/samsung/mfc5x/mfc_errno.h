@@ -64,6 +64,9 @@ enum mfc_ret_code {
 	MFC_GET_CONF_FAIL = -6007,
 	MFC_SET_CONF_FAIL = -6008,
 	MFC_INVALID_PARAM_FAIL = -6009,
+	MFC_SCHED_QUEUE_FULL = -6010,
+	MFC_SCHED_NO_RESULT = -6011,
+	MFC_MEM_BUSY_FAIL = -6012,
 	MFC_API_FAIL = -9000,
 
 	MFC_CMD_FAIL = -1003,
@@ -51,9 +51,6 @@ struct mfc_inst_ctx *mfc_create_inst(void)
 	ctx->state = INST_STATE_CREATE;
 
 	ctx->resolution_status = RES_NO_CHANGE;
-#ifdef CONFIG_CPU_FREQ
-	ctx->busfreq_flag = false;
-#endif
 
 #ifdef SYSMMU_MFC_ON
 	/*
@@ -64,6 +61,8 @@ struct mfc_inst_ctx *mfc_create_inst(void)
 
 	INIT_LIST_HEAD(&ctx->presetcfgs);
 
+	mfc_sched_init_inst(ctx);
+
 	return ctx;
 }
 
@@ -15,9 +15,11 @@
 #define __MFC_INST_H __FILE__
 
 #include <linux/list.h>
+#include <linux/pm_qos_params.h>
 
 #include "mfc.h"
 #include "mfc_interface.h"
+#include "mfc_sched.h"
 
 
 /* FIXME: instance state should be more specific */
@@ -145,12 +147,13 @@ struct mfc_inst_ctx {
 	void *c_priv;
 	struct codec_operations *c_ops;
 	struct mfc_dev *dev;
+	struct mfc_inst_sched sched;
 #ifdef SYSMMU_MFC_ON
 	unsigned long pgd;
 #endif
 #ifdef CONFIG_CPU_FREQ
-	int busfreq_flag; /* context bus frequency flag*/
-	int cpufreq_flag; /* context CPU frequency flag*/
+	struct pm_qos_request_list busfreq_req; /* bus frequency request */
+	struct pm_qos_request_list cpufreq_req; /* CPU frequency request */
 #endif
 };
 
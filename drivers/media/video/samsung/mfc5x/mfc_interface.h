@@ -31,17 +31,22 @@
 #define IOCTL_MFC_ENC_INIT			(0x00800002)
 #define IOCTL_MFC_DEC_EXE			(0x00800003)
 #define IOCTL_MFC_ENC_EXE			(0x00800004)
+#define IOCTL_MFC_DEC_EXE_ASYNC		(0x00800005)
+#define IOCTL_MFC_ENC_EXE_ASYNC		(0x00800006)
+#define IOCTL_MFC_GET_EXE_RESULT	(0x00800007)
 
 #define IOCTL_MFC_GET_IN_BUF		(0x00800010)
 #define IOCTL_MFC_FREE_BUF			(0x00800011)
 #define IOCTL_MFC_GET_REAL_ADDR		(0x00800012)
 #define IOCTL_MFC_GET_MMAP_SIZE		(0x00800014)
 #define IOCTL_MFC_SET_IN_BUF		(0x00800018)
+#define IOCTL_MFC_IMPORT_BUF		(0x00800019)
 
 #define IOCTL_MFC_SET_CONFIG		(0x00800101)
 #define IOCTL_MFC_GET_CONFIG		(0x00800102)
 
 #define IOCTL_MFC_SET_BUF_CACHE		(0x00800201)
+#define IOCTL_MFC_SET_SCHED		(0x00800202)
 
 /* MFC H/W support maximum 32 extra DPB. */
 #define MFC_MAX_EXTRA_DPB               5
@@ -334,6 +339,11 @@ struct mfc_set_config_arg {
 	int in_config_value[4];
 };
 
+struct mfc_sched_arg {
+	int in_priority;		/* [IN] 0 (default) to 2, higher first */
+	unsigned int in_weight;		/* [IN] 1 (default) to 8 frames per turn */
+};
+
 struct mfc_get_real_addr_arg {
 	unsigned int key;
 	unsigned int addr;
@@ -365,6 +375,29 @@ struct mfc_buf_free_arg {
 	unsigned int addr;
 };
 
+enum mfc_import_usage {
+	MFC_IMPORT_STRM = 0,	/* decoder input, encoder output stream */
+	MFC_IMPORT_LUMA,	/* decoder DPB, encoder input frame */
+	MFC_IMPORT_CHROMA,
+};
+
+/*
+ * Bind a UMP buffer of another device (Mali, FIMC) into the codec
+ * address space. Importing the same secure id again returns the
+ * same address; the type and usage are fixed by the first import,
+ * and a different one fails with MFC_INVALID_PARAM_FAIL. The buffer
+ * stays bound until IOCTL_MFC_FREE_BUF with the secure id as key, or
+ * until the instance is closed. A DPB the codec still uses cannot be
+ * freed until the DPBs of the instance are released: that fails with
+ * MFC_MEM_BUSY_FAIL.
+ */
+struct mfc_buf_import_arg {
+	enum inst_type type;		/* [IN] DECODER or ENCODER */
+	enum mfc_import_usage usage;	/* [IN] */
+	unsigned int secure_id;		/* [IN] */
+	unsigned int addr;		/* [OUT] codec address */
+};
+
 
 /* RMVME */
 struct mfc_mem_alloc_arg {
@@ -402,10 +435,12 @@ union mfc_args {
 
 	struct mfc_get_config_arg get_config;
 	struct mfc_set_config_arg set_config;
+	struct mfc_sched_arg sched;
 
 	struct mfc_buf_alloc_arg buf_alloc;
 	struct mfc_buf_free_arg buf_free;
 	struct mfc_get_real_addr_arg real_addr;
+	struct mfc_buf_import_arg buf_import;
 
 	/* RMVME */
 	struct mfc_mem_alloc_arg mem_alloc;
@@ -19,6 +19,7 @@
 #include <mach/media.h>
 #endif
 #include <plat/media.h>
+#include <plat/s5p-bufsync.h>
 
 #ifndef CONFIG_S5P_VMEM
 #include <linux/dma-mapping.h>
@@ -160,8 +161,7 @@ unsigned int mfc_mem_addr_ofs(unsigned int ofs, int port)
 	return mem_infos[port].base + ofs;
 }
 
-#ifdef SYSMMU_MFC_ON
-#ifdef CONFIG_S5P_VMEM
+#if defined(SYSMMU_MFC_ON) && defined(CONFIG_S5P_VMEM)
 void mfc_mem_cache_clean(const void *start_addr, unsigned long size)
 {
 	s5p_vmem_dmac_map_area(start_addr, size, DMA_TO_DEVICE);
@@ -171,155 +171,19 @@ void mfc_mem_cache_inv(const void *start_addr, unsigned long size)
 {
 	s5p_vmem_dmac_map_area(start_addr, size, DMA_FROM_DEVICE);
 }
-#else /* CONFIG_VIDEO_MFC_VCM_UMP or kernel virtual memory allocator */
-void mfc_mem_cache_clean(const void *start_addr, unsigned long size)
-{
-	unsigned long paddr;
-	void *cur_addr, *end_addr;
-
-	dmac_map_area(start_addr, size, DMA_TO_DEVICE);
-
-	cur_addr = (void *)((unsigned long)start_addr & PAGE_MASK);
-	end_addr = cur_addr + PAGE_ALIGN(size);
-
-	while (cur_addr < end_addr) {
-		paddr = page_to_pfn(vmalloc_to_page(cur_addr));
-		paddr <<= PAGE_SHIFT;
-		if (paddr)
-			outer_clean_range(paddr, paddr + PAGE_SIZE);
-		cur_addr += PAGE_SIZE;
-	}
-
-	/* FIXME: L2 operation optimization */
-	/*
-	unsigned long start, end, unitsize;
-	unsigned long cur_addr, remain;
-
-	dmac_map_area(start_addr, size, DMA_TO_DEVICE);
-
-	cur_addr = (unsigned long)start_addr;
-	remain = size;
-
-	start = page_to_pfn(vmalloc_to_page(cur_addr));
-	start <<= PAGE_SHIFT;
-	if (start & PAGE_MASK) {
-		unitsize = min((start | PAGE_MASK) - start + 1, remain);
-		end = start + unitsize;
-		outer_clean_range(start, end);
-		remain -= unitsize;
-		cur_addr += unitsize;
-	}
-
-	while (remain >= PAGE_SIZE) {
-		start = page_to_pfn(vmalloc_to_page(cur_addr));
-		start <<= PAGE_SHIFT;
-		end = start + PAGE_SIZE;
-		outer_clean_range(start, end);
-		remain -= PAGE_SIZE;
-		cur_addr += PAGE_SIZE;
-	}
-
-	if (remain) {
-		start = page_to_pfn(vmalloc_to_page(cur_addr));
-		start <<= PAGE_SHIFT;
-		end = start + remain;
-		outer_clean_range(start, end);
-	}
-	*/
-
-}
-
-void mfc_mem_cache_inv(const void *start_addr, unsigned long size)
-{
-	unsigned long paddr;
-	void *cur_addr, *end_addr;
-
-	cur_addr = (void *)((unsigned long)start_addr & PAGE_MASK);
-	end_addr = cur_addr + PAGE_ALIGN(size);
-
-	while (cur_addr < end_addr) {
-		paddr = page_to_pfn(vmalloc_to_page(cur_addr));
-		paddr <<= PAGE_SHIFT;
-		if (paddr)
-			outer_inv_range(paddr, paddr + PAGE_SIZE);
-		cur_addr += PAGE_SIZE;
-	}
-
-	dmac_unmap_area(start_addr, size, DMA_FROM_DEVICE);
-
-	/* FIXME: L2 operation optimization */
-	/*
-	unsigned long start, end, unitsize;
-	unsigned long cur_addr, remain;
-
-	cur_addr = (unsigned long)start_addr;
-	remain = size;
-
-	start = page_to_pfn(vmalloc_to_page(cur_addr));
-	start <<= PAGE_SHIFT;
-	if (start & PAGE_MASK) {
-		unitsize = min((start | PAGE_MASK) - start + 1, remain);
-		end = start + unitsize;
-		outer_inv_range(start, end);
-		remain -= unitsize;
-		cur_addr += unitsize;
-	}
-
-	while (remain >= PAGE_SIZE) {
-		start = page_to_pfn(vmalloc_to_page(cur_addr));
-		start <<= PAGE_SHIFT;
-		end = start + PAGE_SIZE;
-		outer_inv_range(start, end);
-		remain -= PAGE_SIZE;
-		cur_addr += PAGE_SIZE;
-	}
-
-	if (remain) {
-		start = page_to_pfn(vmalloc_to_page(cur_addr));
-		start <<= PAGE_SHIFT;
-		end = start + remain;
-		outer_inv_range(start, end);
-	}
-
-	dmac_unmap_area(start_addr, size, DMA_FROM_DEVICE);
-	*/
-}
-#endif	/* end of CONFIG_S5P_VMEM */
-#else	/* not SYSMMU_MFC_ON */
-	/* early allocator */
-	/* CMA or bootmem(memblock) */
+#else
+/* VCM, vmalloc, CMA or bootmem: kernel addresses the shared layer can walk */
 void mfc_mem_cache_clean(const void *start_addr, unsigned long size)
 {
-	unsigned long paddr;
-
-	dmac_map_area(start_addr, size, DMA_TO_DEVICE);
-	/*
-	 * virtual & phsical addrees mapped directly, so we can convert
-	 * the address just using offset
-	 */
-	paddr = __pa((unsigned long)start_addr);
-	outer_clean_range(paddr, paddr + size);
-
-	/* OPT#1: kernel provide below function */
-	/*
-	dma_map_single(NULL, (void *)start_addr, size, DMA_TO_DEVICE);
-	*/
+	s5p_bufsync_for_device(S5P_BUFSYNC_MFC, start_addr, size,
+			       DMA_TO_DEVICE);
 }
 
 void mfc_mem_cache_inv(const void *start_addr, unsigned long size)
 {
-	unsigned long paddr;
-
-	paddr = __pa((unsigned long)start_addr);
-	outer_inv_range(paddr, paddr + size);
-	dmac_unmap_area(start_addr, size, DMA_FROM_DEVICE);
-
-	/* OPT#1: kernel provide below function */
-	/*
-	dma_unmap_single(NULL, (void *)start_addr, size, DMA_FROM_DEVICE);
-	*/
+	s5p_bufsync_for_cpu(S5P_BUFSYNC_MFC, start_addr, size);
 }
-#endif /* end of SYSMMU_MFC_ON */
+#endif
 
 #ifdef CONFIG_VIDEO_MFC_VCM_UMP
 static void mfc_tlb_invalidate(enum vcm_dev_id id)
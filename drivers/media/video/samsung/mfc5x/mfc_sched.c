@@ -0,0 +1,326 @@
+/*
+ * linux/drivers/media/video/samsung/mfc5x/mfc_sched.c
+ *
+ * Copyright (c) 2010 Samsung Electronics Co., Ltd.
+ *		http://www.samsung.com/
+ *
+ * Instance scheduler for Samsung MFC (Multi Function Codec - FIMV) driver
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/ktime.h>
+
+#include "mfc_dev.h"
+#include "mfc_sched.h"
+#include "mfc_inst.h"
+#include "mfc_log.h"
+#include "mfc_pm.h"
+#include "mfc_dec.h"
+#include "mfc_enc.h"
+
+static inline struct mfc_inst_ctx *sched_to_ctx(struct mfc_inst_sched *s)
+{
+	return container_of(s, struct mfc_inst_ctx, sched);
+}
+
+/* Next job to run, with sched->lock held; NULL if there is none */
+static struct mfc_job *mfc_sched_pick(struct mfc_sched *sched,
+				      struct mfc_inst_sched **ps)
+{
+	struct mfc_inst_sched *s;
+	struct mfc_job *job;
+	int prio;
+
+	for (prio = MFC_SCHED_PRIO_MAX; prio >= 0; prio--) {
+		if (!list_empty(&sched->runq[prio]))
+			break;
+	}
+	if (prio < 0)
+		return NULL;
+
+	s = list_first_entry(&sched->runq[prio], struct mfc_inst_sched,
+			     run_list);
+	job = list_first_entry(&s->queued, struct mfc_job, list);
+	list_del(&job->list);
+	s->running = true;
+
+	if (list_empty(&s->queued)) {
+		list_del_init(&s->run_list);
+		s->credit = s->weight;
+	} else if (--s->credit == 0) {
+		/* turn used up, let the others in this class go first */
+		s->credit = s->weight;
+		list_move_tail(&s->run_list, &sched->runq[prio]);
+	}
+
+	*ps = s;
+
+	return job;
+}
+
+static void mfc_sched_work(struct work_struct *work)
+{
+	struct mfc_sched *sched = container_of(work, struct mfc_sched, work);
+	struct mfc_dev *dev = container_of(sched, struct mfc_dev, sched);
+	struct mfc_inst_sched *s;
+	struct mfc_inst_ctx *ctx;
+	struct mfc_job *job;
+	ktime_t start;
+
+	for (;;) {
+		spin_lock(&sched->lock);
+		job = mfc_sched_pick(sched, &s);
+		spin_unlock(&sched->lock);
+
+		if (!job)
+			break;
+
+		ctx = sched_to_ctx(s);
+		start = ktime_get();
+
+		mutex_lock(&dev->lock);
+		mfc_clock_on();
+		if (job->cmd == IOCTL_MFC_DEC_EXE)
+			job->ret_code = mfc_exec_decoding(ctx, &job->args);
+		else
+			job->ret_code = mfc_exec_encoding(ctx, &job->args);
+		mfc_clock_off();
+		mutex_unlock(&dev->lock);
+
+		/*
+		 * The wake up is done under the lock: once the lock is
+		 * dropped with running cleared, the instance may be gone.
+		 */
+		spin_lock(&sched->lock);
+		s->running = false;
+		s->nr_run++;
+		s->hw_us += ktime_us_delta(ktime_get(), start);
+		if (job->done)
+			complete(job->done);
+		else
+			list_add_tail(&job->list, &s->done);
+		wake_up(&s->wait);
+		spin_unlock(&sched->lock);
+	}
+}
+
+static int mfc_sched_queue(struct mfc_inst_ctx *ctx, struct mfc_job *job)
+{
+	struct mfc_sched *sched = &ctx->dev->sched;
+	struct mfc_inst_sched *s = &ctx->sched;
+
+	spin_lock(&sched->lock);
+	if (s->dying) {
+		spin_unlock(&sched->lock);
+		return MFC_STATE_INVALID;
+	}
+
+	if (!job->done) {
+		if (s->nr_jobs >= MFC_SCHED_QUEUE_LEN) {
+			spin_unlock(&sched->lock);
+			return MFC_SCHED_QUEUE_FULL;
+		}
+		s->nr_jobs++;
+	}
+
+	list_add_tail(&job->list, &s->queued);
+	if (list_empty(&s->run_list))
+		list_add_tail(&s->run_list, &sched->runq[s->prio]);
+	spin_unlock(&sched->lock);
+
+	queue_work(sched->wq, &sched->work);
+
+	return MFC_OK;
+}
+
+/*
+ * Queue a frame and return; the result is collected with
+ * mfc_sched_get_result() once mfc_sched_poll() reports it.
+ */
+int mfc_sched_submit(struct mfc_inst_ctx *ctx, unsigned int cmd,
+		     union mfc_args *args)
+{
+	struct mfc_job *job;
+	int ret;
+
+	job = kzalloc(sizeof(struct mfc_job), GFP_KERNEL);
+	if (unlikely(job == NULL)) {
+		mfc_err("failed to allocate job\n");
+		return MFC_MEM_ALLOC_FAIL;
+	}
+
+	job->cmd = cmd;
+	memcpy(&job->args, args, sizeof(union mfc_args));
+
+	ret = mfc_sched_queue(ctx, job);
+	if (ret != MFC_OK)
+		kfree(job);
+
+	return ret;
+}
+
+/* Queue a frame and wait for it, the *_EXE ioctls */
+int mfc_sched_exec(struct mfc_inst_ctx *ctx, unsigned int cmd,
+		   union mfc_args *args)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct mfc_job job;
+	int ret;
+
+	job.cmd = cmd;
+	job.done = &done;
+	memcpy(&job.args, args, sizeof(union mfc_args));
+
+	ret = mfc_sched_queue(ctx, &job);
+	if (ret != MFC_OK)
+		return ret;
+
+	wait_for_completion(&done);
+	memcpy(args, &job.args, sizeof(union mfc_args));
+
+	return job.ret_code;
+}
+
+/* Oldest finished frame of the instance, in submission order */
+int mfc_sched_get_result(struct mfc_inst_ctx *ctx, union mfc_args *args)
+{
+	struct mfc_sched *sched = &ctx->dev->sched;
+	struct mfc_inst_sched *s = &ctx->sched;
+	struct mfc_job *job;
+	int ret;
+
+	spin_lock(&sched->lock);
+	if (list_empty(&s->done)) {
+		spin_unlock(&sched->lock);
+		return MFC_SCHED_NO_RESULT;
+	}
+
+	job = list_first_entry(&s->done, struct mfc_job, list);
+	list_del(&job->list);
+	s->nr_jobs--;
+	spin_unlock(&sched->lock);
+
+	memcpy(args, &job->args, sizeof(union mfc_args));
+	ret = job->ret_code;
+	kfree(job);
+
+	return ret;
+}
+
+int mfc_sched_set_param(struct mfc_inst_ctx *ctx, int prio,
+			unsigned int weight)
+{
+	struct mfc_sched *sched = &ctx->dev->sched;
+	struct mfc_inst_sched *s = &ctx->sched;
+
+	if (prio < 0 || prio > MFC_SCHED_PRIO_MAX ||
+	    weight < 1 || weight > MFC_SCHED_WEIGHT_MAX)
+		return MFC_INVALID_PARAM_FAIL;
+
+	spin_lock(&sched->lock);
+	if (!list_empty(&s->run_list) && s->prio != prio)
+		list_move_tail(&s->run_list, &sched->runq[prio]);
+	s->prio = prio;
+	s->weight = weight;
+	s->credit = weight;
+	spin_unlock(&sched->lock);
+
+	return MFC_OK;
+}
+
+unsigned int mfc_sched_poll(struct mfc_inst_ctx *ctx)
+{
+	struct mfc_sched *sched = &ctx->dev->sched;
+	struct mfc_inst_sched *s = &ctx->sched;
+	unsigned int mask = 0;
+
+	spin_lock(&sched->lock);
+	if (!list_empty(&s->done))
+		mask |= POLLIN | POLLRDNORM;
+	if (s->nr_jobs < MFC_SCHED_QUEUE_LEN)
+		mask |= POLLOUT | POLLWRNORM;
+	spin_unlock(&sched->lock);
+
+	return mask;
+}
+
+void mfc_sched_init_inst(struct mfc_inst_ctx *ctx)
+{
+	struct mfc_inst_sched *s = &ctx->sched;
+
+	INIT_LIST_HEAD(&s->run_list);
+	INIT_LIST_HEAD(&s->queued);
+	INIT_LIST_HEAD(&s->done);
+	init_waitqueue_head(&s->wait);
+
+	s->weight = 1;
+	s->credit = 1;
+}
+
+/*
+ * Drop what the instance has queued and wait for its running frame.
+ * Called on release, before the instance is closed.
+ */
+void mfc_sched_final_inst(struct mfc_inst_ctx *ctx)
+{
+	struct mfc_sched *sched = &ctx->dev->sched;
+	struct mfc_inst_sched *s = &ctx->sched;
+	struct mfc_job *job, *tmp;
+	LIST_HEAD(drop);
+
+	spin_lock(&sched->lock);
+	s->dying = true;
+	list_del_init(&s->run_list);
+	list_splice_init(&s->queued, &drop);
+	list_splice_tail_init(&s->done, &drop);
+	spin_unlock(&sched->lock);
+
+	wait_event(s->wait, !s->running);
+
+	spin_lock(&sched->lock);
+	list_splice_tail_init(&s->done, &drop);
+	spin_unlock(&sched->lock);
+
+	list_for_each_entry_safe(job, tmp, &drop, list) {
+		list_del(&job->list);
+		if (job->done) {
+			job->ret_code = MFC_STATE_INVALID;
+			complete(job->done);
+		} else {
+			kfree(job);
+		}
+	}
+
+	mfc_dbg("instance [%d]: %u frames, %llu us on H/W\n", ctx->id,
+		s->nr_run, s->hw_us);
+}
+
+int mfc_init_sched(struct mfc_dev *dev)
+{
+	struct mfc_sched *sched = &dev->sched;
+	int i;
+
+	spin_lock_init(&sched->lock);
+	for (i = 0; i <= MFC_SCHED_PRIO_MAX; i++)
+		INIT_LIST_HEAD(&sched->runq[i]);
+
+	sched->wq = create_singlethread_workqueue("mfc_sched");
+	if (!sched->wq)
+		return -ENOMEM;
+
+	INIT_WORK(&sched->work, mfc_sched_work);
+
+	return 0;
+}
+
+void mfc_final_sched(struct mfc_dev *dev)
+{
+	destroy_workqueue(dev->sched.wq);
+}
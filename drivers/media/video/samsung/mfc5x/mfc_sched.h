@@ -0,0 +1,89 @@
+/*
+ * linux/drivers/media/video/samsung/mfc5x/mfc_sched.h
+ *
+ * Copyright (c) 2010 Samsung Electronics Co., Ltd.
+ *		http://www.samsung.com/
+ *
+ * Instance scheduler for Samsung MFC (Multi Function Codec - FIMV) driver
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __MFC_SCHED_H
+#define __MFC_SCHED_H __FILE__
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+
+#include "mfc_interface.h"
+
+/* jobs an instance may have queued, running or not yet collected */
+#define MFC_SCHED_QUEUE_LEN	4
+
+#define MFC_SCHED_PRIO_MAX	2
+#define MFC_SCHED_WEIGHT_MAX	8
+
+struct mfc_inst_ctx;
+struct mfc_dev;
+
+struct mfc_job {
+	struct list_head	list;
+	unsigned int		cmd;		/* IOCTL_MFC_{DEC,ENC}_EXE */
+	union mfc_args		args;
+	enum mfc_ret_code	ret_code;
+	struct completion	*done;		/* synchronous caller, or NULL */
+};
+
+/* Per instance, protected by mfc_sched.lock */
+struct mfc_inst_sched {
+	struct list_head	run_list;	/* entry in mfc_sched.runq[] */
+	struct list_head	queued;
+	struct list_head	done;
+	unsigned int		nr_jobs;	/* queued + running + done */
+	bool			running;
+	bool			dying;
+
+	int			prio;		/* higher runs first */
+	unsigned int		weight;		/* jobs per round-robin turn */
+	unsigned int		credit;
+
+	wait_queue_head_t	wait;
+
+	/* stats */
+	unsigned int		nr_run;
+	u64			hw_us;
+};
+
+/*
+ * The codec runs one frame at a time. Instances with queued jobs are
+ * kept on one round-robin list per priority; the highest non-empty
+ * list is served first, and each instance runs up to its weight of
+ * jobs before going to the back of its list.
+ */
+struct mfc_sched {
+	spinlock_t		lock;
+	struct list_head	runq[MFC_SCHED_PRIO_MAX + 1];
+	struct workqueue_struct	*wq;
+	struct work_struct	work;
+};
+
+int mfc_init_sched(struct mfc_dev *dev);
+void mfc_final_sched(struct mfc_dev *dev);
+
+void mfc_sched_init_inst(struct mfc_inst_ctx *ctx);
+void mfc_sched_final_inst(struct mfc_inst_ctx *ctx);
+
+int mfc_sched_submit(struct mfc_inst_ctx *ctx, unsigned int cmd,
+		     union mfc_args *args);
+int mfc_sched_exec(struct mfc_inst_ctx *ctx, unsigned int cmd,
+		   union mfc_args *args);
+int mfc_sched_get_result(struct mfc_inst_ctx *ctx, union mfc_args *args);
+int mfc_sched_set_param(struct mfc_inst_ctx *ctx, int prio,
+			unsigned int weight);
+unsigned int mfc_sched_poll(struct mfc_inst_ctx *ctx);
+
+#endif /* __MFC_SCHED_H */
@@ -39,6 +39,10 @@
 #include <asm/irq.h>
 #include <asm/uaccess.h>
 
+#ifdef CONFIG_MACH_C1
+#include <mach/cpuidle.h>
+#endif /* CONFIG_MACH_C1 */
+
 /*
  * This is used to lock changes in serial line configuration.
  */
@@ -47,6 +51,9 @@ static DEFINE_MUTEX(port_mutex);
 #ifdef CONFIG_MACH_C1
 volatile int gps_is_running;
 EXPORT_SYMBOL(gps_is_running);
+
+/* No LPA while the GPS is streaming on UART1 */
+static DEFINE_S5PV310_IDLE_BLOCKER(gps_idle_blocker, "gps uart");
 #endif /* CONFIG_MACH_C1 */
 
 /*
@@ -1295,6 +1302,8 @@ static void uart_close(struct tty_struct *tty, struct file *filp)
 #ifdef CONFIG_MACH_C1
 	if (uport->line == 1) {
 		pr_info("%s: UART1 GPS not running\n", __func__);
+		if (gps_is_running)
+			s5pv310_idle_unblock(&gps_idle_blocker);
 		gps_is_running = 0;
 	}
 #endif /* CONFIG_MACH_C1 */
@@ -1612,6 +1621,8 @@ static int uart_open(struct tty_struct *tty, struct file *filp)
 #ifdef CONFIG_MACH_C1
 	if (line == 1) {
 		pr_info("%s: UART1 - GPS running\n", __func__);
+		if (!gps_is_running)
+			s5pv310_idle_block(&gps_idle_blocker);
 		gps_is_running = 1;
 	}
 #endif /* CONFIG_MACH_C1 */
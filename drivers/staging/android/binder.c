@@ -20,6 +20,8 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
 #include <linux/module.h>
@@ -36,7 +38,7 @@
 
 #include "binder.h"
 
-static DEFINE_MUTEX(binder_lock);
+static DEFINE_MUTEX(binder_main_lock);
 static DEFINE_MUTEX(binder_deferred_lock);
 
 static HLIST_HEAD(binder_procs);
@@ -105,6 +107,21 @@ module_param_named(debug_mask, binder_debug_mask, uint, S_IWUSR | S_IRUGO);
 static int binder_debug_no_lock;
 module_param_named(proc_no_lock, binder_debug_no_lock, bool, S_IWUSR | S_IRUGO);
 
+/*
+ * Pages backing freed buffers stay mapped in a per-proc pool, up to
+ * page_pool_high pages, and are handed out again without going through
+ * the page allocator. page_pool_low pages are mapped ahead at mmap time.
+ * The pool is trimmed by a shrinker under memory pressure.
+ */
+static int binder_page_pool_low = 4;
+module_param_named(page_pool_low, binder_page_pool_low, int, S_IWUSR | S_IRUGO);
+
+static int binder_page_pool_high = 32;
+module_param_named(page_pool_high, binder_page_pool_high, int, S_IWUSR | S_IRUGO);
+
+static atomic_t binder_page_pool_total = ATOMIC_INIT(0);
+static unsigned long binder_page_pool_reclaimed;
+
 static DECLARE_WAIT_QUEUE_HEAD(binder_user_error_wait);
 static int binder_stop_on_user_error;
 
@@ -184,6 +201,37 @@ struct binder_transaction_log {
 static struct binder_transaction_log binder_transaction_log;
 static struct binder_transaction_log binder_transaction_log_failed;
 
+/*
+ * binder_main_lock protects nodes, refs, threads, work lists and the
+ * transaction stacks. The per-proc alloc_lock protects the buffer area
+ * of a proc and nests inside binder_main_lock. Buffer allocation and
+ * the payload copy of a transaction only take the target's alloc_lock.
+ */
+struct binder_lock_stats {
+	unsigned long acquired;
+	unsigned long contended;
+	u64 wait_ns;
+};
+static struct binder_lock_stats binder_lock_stats;
+
+static inline void binder_lock(void)
+{
+	u64 start;
+
+	if (!mutex_trylock(&binder_main_lock)) {
+		start = sched_clock();
+		mutex_lock(&binder_main_lock);
+		binder_lock_stats.contended++;
+		binder_lock_stats.wait_ns += sched_clock() - start;
+	}
+	binder_lock_stats.acquired++;
+}
+
+static inline void binder_unlock(void)
+{
+	mutex_unlock(&binder_main_lock);
+}
+
 static struct binder_transaction_log_entry *binder_transaction_log_add(
 	struct binder_transaction_log *log)
 {
@@ -273,6 +321,17 @@ struct binder_buffer {
 	uint8_t data[0];
 };
 
+/*
+ * Free extents are counted in power-of-four size classes starting at
+ * 256 bytes, the last class holds everything from 1MB up.
+ */
+#define BINDER_FREE_CLASSES 8
+
+struct binder_lru_page {
+	struct list_head lru;
+	struct page *page_ptr;
+};
+
 enum binder_deferred_state {
 	BINDER_DEFERRED_PUT_FILES    = 0x01,
 	BINDER_DEFERRED_FLUSH        = 0x02,
@@ -294,12 +353,21 @@ struct binder_proc {
 	void *buffer;
 	ptrdiff_t user_buffer_offset;
 
+	struct mutex alloc_lock;
+	unsigned long alloc_lock_contended;
 	struct list_head buffers;
 	struct rb_root free_buffers;
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
-
-	struct page **pages;
+	size_t free_space;
+	int free_extents[BINDER_FREE_CLASSES];
+	unsigned long alloc_failed;
+
+	struct binder_lru_page *pages;
+	struct list_head page_pool;
+	int page_pool_count;
+	unsigned long page_pool_hits;
+	unsigned long page_pool_misses;
 	size_t buffer_size;
 	uint32_t buffer_free;
 	struct list_head todo;
@@ -312,6 +380,8 @@ struct binder_proc {
 	int ready_threads;
 	long default_priority;
 	struct dentry *debugfs_entry;
+	int tmp_ref;
+	int dead;
 };
 
 enum {
@@ -515,6 +585,35 @@ static void binder_set_nice(long nice)
 	binder_user_error("binder: %d RLIMIT_NICE not set\n", current->pid);
 }
 
+static inline void binder_alloc_lock(struct binder_proc *proc)
+{
+	if (!mutex_trylock(&proc->alloc_lock)) {
+		mutex_lock(&proc->alloc_lock);
+		proc->alloc_lock_contended++;
+	}
+}
+
+static inline void binder_alloc_unlock(struct binder_proc *proc)
+{
+	mutex_unlock(&proc->alloc_lock);
+}
+
+/*
+ * A temporary reference keeps a proc struct around while binder_main_lock
+ * is dropped. Both are called with binder_main_lock held.
+ */
+static inline void binder_proc_inc_tmpref(struct binder_proc *proc)
+{
+	proc->tmp_ref++;
+}
+
+static void binder_proc_dec_tmpref(struct binder_proc *proc)
+{
+	proc->tmp_ref--;
+	if (proc->dead && proc->tmp_ref == 0)
+		kfree(proc);
+}
+
 static size_t binder_buffer_size(struct binder_proc *proc,
 				 struct binder_buffer *buffer)
 {
@@ -525,6 +624,22 @@ static size_t binder_buffer_size(struct binder_proc *proc,
 			struct binder_buffer, entry) - (size_t)buffer->data;
 }
 
+static int binder_free_class(size_t size)
+{
+	int class;
+
+	if (size < 256)
+		return 0;
+	class = (ilog2(size) - 8) / 2 + 1;
+	return min(class, BINDER_FREE_CLASSES - 1);
+}
+
+/*
+ * The free tree is ordered by size and then by address, so the best fit
+ * search below returns the lowest addressed of the smallest free buffers
+ * that fit. Keeping allocations packed at the start of the area leaves
+ * the largest possible extent free at the end.
+ */
 static void binder_insert_free_buffer(struct binder_proc *proc,
 				      struct binder_buffer *new_buffer)
 {
@@ -549,13 +664,39 @@ static void binder_insert_free_buffer(struct binder_proc *proc,
 
 		buffer_size = binder_buffer_size(proc, buffer);
 
-		if (new_buffer_size < buffer_size)
+		if (new_buffer_size < buffer_size ||
+		    (new_buffer_size == buffer_size && new_buffer < buffer))
 			p = &parent->rb_left;
 		else
 			p = &parent->rb_right;
 	}
 	rb_link_node(&new_buffer->rb_node, parent, p);
 	rb_insert_color(&new_buffer->rb_node, &proc->free_buffers);
+
+	proc->free_space += new_buffer_size;
+	proc->free_extents[binder_free_class(new_buffer_size)]++;
+}
+
+/* must be called before the list neighbours of buffer change */
+static void binder_erase_free_buffer(struct binder_proc *proc,
+				     struct binder_buffer *buffer)
+{
+	size_t buffer_size = binder_buffer_size(proc, buffer);
+
+	BUG_ON(!buffer->free);
+	rb_erase(&buffer->rb_node, &proc->free_buffers);
+	proc->free_space -= buffer_size;
+	proc->free_extents[binder_free_class(buffer_size)]--;
+}
+
+static size_t binder_largest_free_extent(struct binder_proc *proc)
+{
+	struct rb_node *n = rb_last(&proc->free_buffers);
+
+	if (n == NULL)
+		return 0;
+	return binder_buffer_size(proc,
+				  rb_entry(n, struct binder_buffer, rb_node));
 }
 
 static void binder_insert_allocated_buffer(struct binder_proc *proc,
@@ -607,6 +748,67 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 	return NULL;
 }
 
+static inline struct binder_lru_page *binder_lru_page(struct binder_proc *proc,
+							void *page_addr)
+{
+	return &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+}
+
+static void binder_page_pool_del(struct binder_proc *proc,
+				 struct binder_lru_page *lru_page)
+{
+	BUG_ON(list_empty(&lru_page->lru));
+	list_del_init(&lru_page->lru);
+	proc->page_pool_count--;
+	atomic_dec(&binder_page_pool_total);
+}
+
+static int binder_page_pool_put(struct binder_proc *proc,
+				struct binder_lru_page *lru_page)
+{
+	if (proc->page_pool_count >= binder_page_pool_high)
+		return 0;
+	list_add(&lru_page->lru, &proc->page_pool);
+	proc->page_pool_count++;
+	atomic_inc(&binder_page_pool_total);
+	return 1;
+}
+
+/*
+ * Take start-end from the page pool if every page in it is pooled, so
+ * the common case does not need the mm of the proc at all.
+ */
+static int binder_page_pool_get_range(struct binder_proc *proc,
+				      void *start, void *end)
+{
+	void *page_addr;
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE)
+		if (binder_lru_page(proc, page_addr)->page_ptr == NULL)
+			return 0;
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		binder_page_pool_del(proc, binder_lru_page(proc, page_addr));
+		proc->page_pool_hits++;
+	}
+	return 1;
+}
+
+static int binder_page_pool_put_range(struct binder_proc *proc,
+				      void *start, void *end)
+{
+	void *page_addr;
+
+	if (proc->page_pool_count + (end - start) / PAGE_SIZE >
+	    binder_page_pool_high)
+		return 0;
+
+	for (page_addr = end - PAGE_SIZE; page_addr >= start;
+	     page_addr -= PAGE_SIZE)
+		binder_page_pool_put(proc, binder_lru_page(proc, page_addr));
+	return 1;
+}
+
 static int binder_update_page_range(struct binder_proc *proc, int allocate,
 				    void *start, void *end,
 				    struct vm_area_struct *vma)
@@ -614,6 +816,7 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	void *page_addr;
 	unsigned long user_page_addr;
 	struct vm_struct tmp_area;
+	struct binder_lru_page *lru_page;
 	struct page **page;
 	struct mm_struct *mm;
 
@@ -624,6 +827,10 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	if (end <= start)
 		return 0;
 
+	if (allocate ? binder_page_pool_get_range(proc, start, end) :
+		       binder_page_pool_put_range(proc, start, end))
+		return 0;
+
 	if (vma)
 		mm = NULL;
 	else
@@ -646,9 +853,16 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
 		int ret;
 		struct page **page_array_ptr;
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		lru_page = binder_lru_page(proc, page_addr);
+		page = &lru_page->page_ptr;
 
-		BUG_ON(*page);
+		if (*page) {
+			/* still mapped from the page pool */
+			binder_page_pool_del(proc, lru_page);
+			proc->page_pool_hits++;
+			continue;
+		}
+		proc->page_pool_misses++;
 		*page = alloc_page(GFP_KERNEL | __GFP_ZERO);
 		if (*page == NULL) {
 			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
@@ -685,7 +899,10 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 free_range:
 	for (page_addr = end - PAGE_SIZE; page_addr >= start;
 	     page_addr -= PAGE_SIZE) {
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		lru_page = binder_lru_page(proc, page_addr);
+		page = &lru_page->page_ptr;
+		if (binder_page_pool_put(proc, lru_page))
+			continue;
 		if (vma)
 			zap_page_range(vma, (uintptr_t)page_addr +
 				proc->user_buffer_offset, PAGE_SIZE, NULL);
@@ -705,6 +922,86 @@ err_no_vma:
 	return -ENOMEM;
 }
 
+/*
+ * Release the least recently pooled pages of proc. Called from reclaim,
+ * so only trylocks are used; the lock order is the same as for
+ * binder_update_page_range.
+ */
+static int binder_page_pool_shrink_proc(struct binder_proc *proc,
+					int nr_to_scan)
+{
+	struct binder_lru_page *lru_page;
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	void *page_addr;
+	int freed = 0;
+
+	if (!mutex_trylock(&proc->alloc_lock))
+		return 0;
+	if (list_empty(&proc->page_pool))
+		goto err_pool_empty;
+	mm = get_task_mm(proc->tsk);
+	if (mm == NULL)
+		goto err_no_mm;
+	if (!down_write_trylock(&mm->mmap_sem))
+		goto err_mmap_sem_busy;
+
+	vma = proc->vma;
+	while (freed < nr_to_scan && !list_empty(&proc->page_pool)) {
+		lru_page = list_entry(proc->page_pool.prev,
+				      struct binder_lru_page, lru);
+		page_addr = proc->buffer + (lru_page - proc->pages) * PAGE_SIZE;
+		binder_page_pool_del(proc, lru_page);
+		if (vma)
+			zap_page_range(vma, (uintptr_t)page_addr +
+				proc->user_buffer_offset, PAGE_SIZE, NULL);
+		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+		__free_page(lru_page->page_ptr);
+		lru_page->page_ptr = NULL;
+		freed++;
+	}
+	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
+		     "binder: %d: shrink page pool by %d, %d left\n",
+		     proc->pid, freed, proc->page_pool_count);
+
+	up_write(&mm->mmap_sem);
+err_mmap_sem_busy:
+	mmput(mm);
+err_no_mm:
+err_pool_empty:
+	binder_alloc_unlock(proc);
+	return freed;
+}
+
+static int binder_page_pool_shrink(struct shrinker *s, int nr_to_scan,
+				   gfp_t gfp_mask)
+{
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	int freed;
+
+	if (nr_to_scan == 0)
+		return atomic_read(&binder_page_pool_total);
+
+	if (!mutex_trylock(&binder_main_lock))
+		return -1;
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		freed = binder_page_pool_shrink_proc(proc, nr_to_scan);
+		binder_page_pool_reclaimed += freed;
+		nr_to_scan -= freed;
+		if (nr_to_scan <= 0)
+			break;
+	}
+	binder_unlock();
+
+	return atomic_read(&binder_page_pool_total);
+}
+
+static struct shrinker binder_page_pool_shrinker = {
+	.shrink = binder_page_pool_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
 static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 					      size_t data_size,
 					      size_t offsets_size, int is_async)
@@ -745,25 +1042,22 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		BUG_ON(!buffer->free);
 		buffer_size = binder_buffer_size(proc, buffer);
 
-		if (size < buffer_size) {
+		if (size <= buffer_size) {
 			best_fit = n;
 			n = n->rb_left;
-		} else if (size > buffer_size)
+		} else
 			n = n->rb_right;
-		else {
-			best_fit = n;
-			break;
-		}
 	}
 	if (best_fit == NULL) {
+		proc->alloc_failed++;
 		printk(KERN_ERR "binder: %d: binder_alloc_buf size %zd failed, "
-		       "no address space\n", proc->pid, size);
+		       "no address space, %zd free, largest %zd\n", proc->pid,
+		       size, proc->free_space,
+		       binder_largest_free_extent(proc));
 		return NULL;
 	}
-	if (n == NULL) {
-		buffer = rb_entry(best_fit, struct binder_buffer, rb_node);
-		buffer_size = binder_buffer_size(proc, buffer);
-	}
+	buffer = rb_entry(best_fit, struct binder_buffer, rb_node);
+	buffer_size = binder_buffer_size(proc, buffer);
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: binder_alloc_buf size %zd got buff"
@@ -771,12 +1065,10 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 
 	has_page_addr =
 		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK);
-	if (n == NULL) {
-		if (size + sizeof(struct binder_buffer) + 4 >= buffer_size)
-			buffer_size = size; /* no room for other buffers */
-		else
-			buffer_size = size + sizeof(struct binder_buffer);
-	}
+	if (size + sizeof(struct binder_buffer) + 4 >= buffer_size)
+		buffer_size = size; /* no room for other buffers */
+	else
+		buffer_size = size + sizeof(struct binder_buffer);
 	end_page_addr =
 		(void *)PAGE_ALIGN((uintptr_t)buffer->data + buffer_size);
 	if (end_page_addr > has_page_addr)
@@ -785,7 +1077,7 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	    (void *)PAGE_ALIGN((uintptr_t)buffer->data), end_page_addr, NULL))
 		return NULL;
 
-	rb_erase(best_fit, &proc->free_buffers);
+	binder_erase_free_buffer(proc, buffer);
 	buffer->free = 0;
 	binder_insert_allocated_buffer(proc, buffer);
 	if (buffer_size != size) {
@@ -907,7 +1199,7 @@ static void binder_free_buf(struct binder_proc *proc,
 		struct binder_buffer *next = list_entry(buffer->entry.next,
 						struct binder_buffer, entry);
 		if (next->free) {
-			rb_erase(&next->rb_node, &proc->free_buffers);
+			binder_erase_free_buffer(proc, next);
 			binder_delete_free_buffer(proc, next);
 		}
 	}
@@ -915,8 +1207,8 @@ static void binder_free_buf(struct binder_proc *proc,
 		struct binder_buffer *prev = list_entry(buffer->entry.prev,
 						struct binder_buffer, entry);
 		if (prev->free) {
+			binder_erase_free_buffer(proc, prev);
 			binder_delete_free_buffer(proc, buffer);
-			rb_erase(&prev->rb_node, &proc->free_buffers);
 			buffer = prev;
 		}
 	}
@@ -1375,6 +1667,36 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 	}
 }
 
+/*
+ * Allocate the buffer for t in target_proc and copy the payload into it.
+ * Called with target_proc->alloc_lock held; t->buffer is NULL if the
+ * allocation failed.
+ */
+static int binder_transaction_copy(struct binder_proc *target_proc,
+				   struct binder_transaction *t,
+				   struct binder_transaction_data *tr,
+				   struct binder_node *target_node, int reply)
+{
+	size_t *offp;
+
+	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
+		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
+	if (t->buffer == NULL)
+		return -ENOMEM;
+	t->buffer->allow_user_free = 0;
+	t->buffer->debug_id = t->debug_id;
+	t->buffer->transaction = t;
+	t->buffer->target_node = target_node;
+
+	offp = (size_t *)(t->buffer->data + ALIGN(tr->data_size, sizeof(void *)));
+
+	if (copy_from_user(t->buffer->data, tr->data.ptr.buffer, tr->data_size))
+		return -EFAULT;
+	if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size))
+		return -EFAULT;
+	return 0;
+}
+
 static void binder_transaction(struct binder_proc *proc,
 			       struct binder_thread *thread,
 			       struct binder_transaction_data *tr, int reply)
@@ -1390,6 +1712,7 @@ static void binder_transaction(struct binder_proc *proc,
 	struct binder_transaction *in_reply_to = NULL;
 	struct binder_transaction_log_entry *e;
 	uint32_t return_error;
+	int unlocked, target_dead, ret;
 
 	e = binder_transaction_log_add(&binder_transaction_log);
 	e->call_type = reply ? 2 : !!(tr->flags & TF_ONE_WAY);
@@ -1543,30 +1866,65 @@ static void binder_transaction(struct binder_proc *proc,
 	t->code = tr->code;
 	t->flags = tr->flags;
 	t->priority = task_nice(current);
-	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
-		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
+	if (target_node)
+		binder_inc_node(target_node, 1, 0, NULL);
+
+	/*
+	 * The payload copy only touches the buffer we allocate in the
+	 * target, so run it without binder_main_lock. A target thread
+	 * picked from the transaction stack cannot be revalidated
+	 * afterwards; keep the lock in that case.
+	 */
+	unlocked = reply || target_thread == NULL;
+	if (unlocked) {
+		binder_proc_inc_tmpref(target_proc);
+		binder_unlock();
+	}
+	binder_alloc_lock(target_proc);
+	ret = binder_transaction_copy(target_proc, t, tr, target_node, reply);
+	binder_alloc_unlock(target_proc);
+	if (unlocked) {
+		binder_lock();
+		target_dead = target_proc->dead;
+		if (target_dead) {
+			return_error = BR_DEAD_REPLY;
+			/*
+			 * Release frees the buffers it finds without
+			 * releasing their objects, and zeroes the local refs
+			 * of the nodes it kills: drop what is still ours.
+			 */
+			binder_alloc_lock(target_proc);
+			if (t->buffer) {
+				offp = (size_t *)(t->buffer->data + ALIGN(tr->data_size, sizeof(void *)));
+				binder_transaction_buffer_release(target_proc, t->buffer, offp);
+				t->buffer->transaction = NULL;
+				binder_free_buf(target_proc, t->buffer);
+			} else if (target_node && target_node->proc)
+				binder_dec_node(target_node, 1, 0);
+			binder_alloc_unlock(target_proc);
+		}
+		/* may free target_proc if it died meanwhile */
+		binder_proc_dec_tmpref(target_proc);
+		if (target_dead)
+			goto err_dead_target;
+		if (reply && in_reply_to->from != target_thread) {
+			return_error = BR_DEAD_REPLY;
+			if (t->buffer == NULL)
+				goto err_binder_alloc_buf_failed;
+			offp = (size_t *)(t->buffer->data + ALIGN(tr->data_size, sizeof(void *)));
+			goto err_copy_data_failed;
+		}
+	}
 	if (t->buffer == NULL) {
 		return_error = BR_FAILED_REPLY;
 		goto err_binder_alloc_buf_failed;
 	}
-	t->buffer->allow_user_free = 0;
-	t->buffer->debug_id = t->debug_id;
-	t->buffer->transaction = t;
-	t->buffer->target_node = target_node;
-	if (target_node)
-		binder_inc_node(target_node, 1, 0, NULL);
 
 	offp = (size_t *)(t->buffer->data + ALIGN(tr->data_size, sizeof(void *)));
 
-	if (copy_from_user(t->buffer->data, tr->data.ptr.buffer, tr->data_size)) {
-		binder_user_error("binder: %d:%d got transaction with invalid "
-			"data ptr\n", proc->pid, thread->pid);
-		return_error = BR_FAILED_REPLY;
-		goto err_copy_data_failed;
-	}
-	if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size)) {
+	if (ret) {
 		binder_user_error("binder: %d:%d got transaction with invalid "
-			"offsets ptr\n", proc->pid, thread->pid);
+			"data or offsets ptr\n", proc->pid, thread->pid);
 		return_error = BR_FAILED_REPLY;
 		goto err_copy_data_failed;
 	}
@@ -1751,8 +2109,15 @@ err_bad_offset:
 err_copy_data_failed:
 	binder_transaction_buffer_release(target_proc, t->buffer, offp);
 	t->buffer->transaction = NULL;
+	binder_alloc_lock(target_proc);
 	binder_free_buf(target_proc, t->buffer);
+	binder_alloc_unlock(target_proc);
+	goto err_buffer_freed;
 err_binder_alloc_buf_failed:
+	if (target_node)
+		binder_dec_node(target_node, 1, 0);
+err_buffer_freed:
+err_dead_target:
 	kfree(tcomplete);
 	binder_stats_deleted(BINDER_STAT_TRANSACTION_COMPLETE);
 err_alloc_tcomplete_failed:
@@ -1933,7 +2298,9 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				return -EFAULT;
 			ptr += sizeof(void *);
 
+			binder_alloc_lock(proc);
 			buffer = binder_buffer_lookup(proc, data_ptr);
+			binder_alloc_unlock(proc);
 			if (buffer == NULL) {
 				binder_user_error("binder: %d:%d "
 					"BC_FREE_BUFFER u%p no match\n",
@@ -1964,7 +2331,9 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 					list_move_tail(buffer->target_node->async_todo.next, &thread->todo);
 			}
 			binder_transaction_buffer_release(proc, buffer, NULL);
+			binder_alloc_lock(proc);
 			binder_free_buf(proc, buffer);
+			binder_alloc_unlock(proc);
 			break;
 		}
 
@@ -2232,7 +2601,7 @@ retry:
 	thread->looper |= BINDER_LOOPER_STATE_WAITING;
 	if (wait_for_proc_work)
 		proc->ready_threads++;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 	if (wait_for_proc_work) {
 		if (!(thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 					BINDER_LOOPER_STATE_ENTERED))) {
@@ -2256,7 +2625,7 @@ retry:
 		} else
 			ret = wait_event_interruptible(thread->wait, binder_has_thread_work(thread));
 	}
-	mutex_lock(&binder_lock);
+	binder_lock();
 	if (wait_for_proc_work)
 		proc->ready_threads--;
 	thread->looper &= ~BINDER_LOOPER_STATE_WAITING;
@@ -2598,12 +2967,12 @@ static unsigned int binder_poll(struct file *filp,
 	struct binder_thread *thread = NULL;
 	int wait_for_proc_work;
 
-	mutex_lock(&binder_lock);
+	binder_lock();
 	thread = binder_get_thread(proc);
 
 	wait_for_proc_work = thread->transaction_stack == NULL &&
 		list_empty(&thread->todo) && thread->return_error == BR_OK;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 
 	if (wait_for_proc_work) {
 		if (binder_has_proc_work(proc, thread))
@@ -2635,7 +3004,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	if (ret)
 		return ret;
 
-	mutex_lock(&binder_lock);
+	binder_lock();
 	thread = binder_get_thread(proc);
 	if (thread == NULL) {
 		ret = -ENOMEM;
@@ -2744,7 +3113,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 err:
 	if (thread)
 		thread->looper &= ~BINDER_LOOPER_STATE_NEED_RETURN;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 	wait_event_interruptible(binder_user_error_wait, binder_stop_on_user_error < 2);
 	if (ret && ret != -ERESTARTSYS)
 		printk(KERN_INFO "binder: %d:%d ioctl %x %lx returned %d\n", proc->pid, current->pid, cmd, arg, ret);
@@ -2786,6 +3155,7 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	struct binder_proc *proc = filp->private_data;
 	const char *failure_string;
 	struct binder_buffer *buffer;
+	int i, fill;
 
 	if ((vma->vm_end - vma->vm_start) > SZ_4M)
 		vma->vm_end = vma->vm_start + SZ_4M;
@@ -2833,6 +3203,8 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 		goto err_alloc_pages_failed;
 	}
 	proc->buffer_size = vma->vm_end - vma->vm_start;
+	for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++)
+		INIT_LIST_HEAD(&proc->pages[i].lru);
 
 	vma->vm_ops = &binder_vm_ops;
 	vma->vm_private_data = proc;
@@ -2842,6 +3214,18 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 		failure_string = "alloc small buf";
 		goto err_alloc_small_buf_failed;
 	}
+	/*
+	 * Pre-populate the page pool, failure here is not fatal. The
+	 * mmap_sem held by our caller keeps the shrinker off the pool.
+	 */
+	fill = min_t(int, binder_page_pool_low, binder_page_pool_high);
+	fill = min_t(int, fill, proc->buffer_size / PAGE_SIZE - 1);
+	if (fill > 0 &&
+	    !binder_update_page_range(proc, 1, proc->buffer + PAGE_SIZE,
+				      proc->buffer + (fill + 1) * PAGE_SIZE, vma))
+		binder_update_page_range(proc, 0, proc->buffer + PAGE_SIZE,
+				proc->buffer + (fill + 1) * PAGE_SIZE, vma);
+
 	buffer = proc->buffer;
 	INIT_LIST_HEAD(&proc->buffers);
 	list_add(&buffer->entry, &proc->buffers);
@@ -2884,14 +3268,16 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	proc->tsk = current;
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
+	mutex_init(&proc->alloc_lock);
+	INIT_LIST_HEAD(&proc->page_pool);
 	proc->default_priority = task_nice(current);
-	mutex_lock(&binder_lock);
+	binder_lock();
 	binder_stats_created(BINDER_STAT_PROC);
 	hlist_add_head(&proc->proc_node, &binder_procs);
 	proc->pid = current->group_leader->pid;
 	INIT_LIST_HEAD(&proc->delivered_death);
 	filp->private_data = proc;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 
 	if (binder_debugfs_dir_entry_proc) {
 		char strbuf[11];
@@ -2950,6 +3336,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 	BUG_ON(proc->vma);
 	BUG_ON(proc->files);
 
+	proc->dead = 1;
 	hlist_del(&proc->proc_node);
 	if (binder_context_mgr_node && binder_context_mgr_node->proc == proc) {
 		binder_debug(BINDER_DEBUG_DEAD_BINDER,
@@ -3013,6 +3400,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 	binder_release_work(&proc->todo);
 	buffers = 0;
 
+	binder_alloc_lock(proc);
 	while ((n = rb_first(&proc->allocated_buffers))) {
 		struct binder_buffer *buffer = rb_entry(n, struct binder_buffer,
 							rb_node);
@@ -3031,11 +3419,14 @@ static void binder_deferred_release(struct binder_proc *proc)
 
 	binder_stats_deleted(BINDER_STAT_PROC);
 
+	atomic_sub(proc->page_pool_count, &binder_page_pool_total);
+	proc->page_pool_count = 0;
+
 	page_count = 0;
 	if (proc->pages) {
 		int i;
 		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
-			if (proc->pages[i]) {
+			if (proc->pages[i].page_ptr) {
 				void *page_addr = proc->buffer + i * PAGE_SIZE;
 				binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 					     "binder_release: %d: "
@@ -3044,13 +3435,14 @@ static void binder_deferred_release(struct binder_proc *proc)
 					     page_addr);
 				unmap_kernel_range((unsigned long)page_addr,
 					PAGE_SIZE);
-				__free_page(proc->pages[i]);
+				__free_page(proc->pages[i].page_ptr);
 				page_count++;
 			}
 		}
 		kfree(proc->pages);
 		vfree(proc->buffer);
 	}
+	binder_alloc_unlock(proc);
 
 	put_task_struct(proc->tsk);
 
@@ -3061,7 +3453,9 @@ static void binder_deferred_release(struct binder_proc *proc)
 		     proc->pid, threads, nodes, incoming_refs, outgoing_refs,
 		     active_transactions, buffers, page_count);
 
-	kfree(proc);
+	/* a transaction still copying into us frees proc when done */
+	if (proc->tmp_ref == 0)
+		kfree(proc);
 }
 
 static void binder_deferred_func(struct work_struct *work)
@@ -3071,7 +3465,7 @@ static void binder_deferred_func(struct work_struct *work)
 
 	int defer;
 	do {
-		mutex_lock(&binder_lock);
+		binder_lock();
 		mutex_lock(&binder_deferred_lock);
 		if (!hlist_empty(&binder_deferred_list)) {
 			proc = hlist_entry(binder_deferred_list.first,
@@ -3098,7 +3492,7 @@ static void binder_deferred_func(struct work_struct *work)
 		if (defer & BINDER_DEFERRED_RELEASE)
 			binder_deferred_release(proc); /* frees proc */
 
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 		if (files)
 			put_files_struct(files);
 	} while (proc);
@@ -3279,9 +3673,11 @@ static void print_binder_proc(struct seq_file *m,
 			print_binder_ref(m, rb_entry(n, struct binder_ref,
 						     rb_node_desc));
 	}
+	binder_alloc_lock(proc);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		print_binder_buffer(m, "  buffer",
 				    rb_entry(n, struct binder_buffer, rb_node));
+	binder_alloc_unlock(proc);
 	list_for_each_entry(w, &proc->todo, entry)
 		print_binder_work(m, "  ", "  pending transaction", w);
 	list_for_each_entry(w, &proc->delivered_death, entry) {
@@ -3377,6 +3773,38 @@ static void print_binder_stats(struct seq_file *m, const char *prefix,
 	}
 }
 
+static const char *binder_free_class_strings[] = {
+	"<256",
+	"<1K",
+	"<4K",
+	"<16K",
+	"<64K",
+	"<256K",
+	"<1M",
+	">=1M"
+};
+
+static void print_binder_proc_fragmentation(struct seq_file *m,
+					    struct binder_proc *proc)
+{
+	int i;
+
+	BUILD_BUG_ON(ARRAY_SIZE(binder_free_class_strings) !=
+		     BINDER_FREE_CLASSES);
+
+	seq_printf(m, "proc %d\n", proc->pid);
+	binder_alloc_lock(proc);
+	seq_printf(m, "  size %zd free %zd largest free %zd "
+		   "alloc failed %lu\n", proc->buffer_size, proc->free_space,
+		   binder_largest_free_extent(proc), proc->alloc_failed);
+	seq_puts(m, "  free extents:");
+	for (i = 0; i < BINDER_FREE_CLASSES; i++)
+		seq_printf(m, " %s %d", binder_free_class_strings[i],
+			   proc->free_extents[i]);
+	seq_puts(m, "\n");
+	binder_alloc_unlock(proc);
+}
+
 static void print_binder_proc_stats(struct seq_file *m,
 				    struct binder_proc *proc)
 {
@@ -3411,9 +3839,16 @@ static void print_binder_proc_stats(struct seq_file *m,
 	seq_printf(m, "  refs: %d s %d w %d\n", count, strong, weak);
 
 	count = 0;
+	binder_alloc_lock(proc);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
+	binder_alloc_unlock(proc);
 	seq_printf(m, "  buffers: %d\n", count);
+	seq_printf(m, "  alloc lock contended: %lu\n",
+		   proc->alloc_lock_contended);
+	seq_printf(m, "  page pool: %d hits %lu misses %lu\n",
+		   proc->page_pool_count, proc->page_pool_hits,
+		   proc->page_pool_misses);
 
 	count = 0;
 	list_for_each_entry(w, &proc->todo, entry) {
@@ -3439,7 +3874,7 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 
 	seq_puts(m, "binder state:\n");
 
@@ -3451,7 +3886,7 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 1);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3462,16 +3897,40 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 
 	seq_puts(m, "binder stats:\n");
 
+	seq_printf(m, "lock: acquired %lu contended %lu wait %llu us\n",
+		   binder_lock_stats.acquired, binder_lock_stats.contended,
+		   div_u64(binder_lock_stats.wait_ns, NSEC_PER_USEC));
+	seq_printf(m, "page pool: %d reclaimed %lu\n",
+		   atomic_read(&binder_page_pool_total),
+		   binder_page_pool_reclaimed);
+
 	print_binder_stats(m, "", &binder_stats);
 
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc_stats(m, proc);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
+	return 0;
+}
+
+static int binder_fragmentation_show(struct seq_file *m, void *unused)
+{
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	int do_lock = !binder_debug_no_lock;
+
+	if (do_lock)
+		binder_lock();
+
+	seq_puts(m, "binder fragmentation:\n");
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
+		print_binder_proc_fragmentation(m, proc);
+	if (do_lock)
+		binder_unlock();
 	return 0;
 }
 
@@ -3482,13 +3941,13 @@ static int binder_transactions_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 
 	seq_puts(m, "binder transactions:\n");
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 0);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3498,11 +3957,11 @@ static int binder_proc_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 	seq_puts(m, "binder proc state:\n");
 	print_binder_proc(m, proc, 1);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3549,6 +4008,7 @@ static struct miscdevice binder_miscdev = {
 
 BINDER_DEBUG_ENTRY(state);
 BINDER_DEBUG_ENTRY(stats);
+BINDER_DEBUG_ENTRY(fragmentation);
 BINDER_DEBUG_ENTRY(transactions);
 BINDER_DEBUG_ENTRY(transaction_log);
 
@@ -3565,6 +4025,7 @@ static int __init binder_init(void)
 		binder_debugfs_dir_entry_proc = debugfs_create_dir("proc",
 						 binder_debugfs_dir_entry_root);
 	ret = misc_register(&binder_miscdev);
+	register_shrinker(&binder_page_pool_shrinker);
 	if (binder_debugfs_dir_entry_root) {
 		debugfs_create_file("state",
 				    S_IRUGO,
@@ -3576,6 +4037,11 @@ static int __init binder_init(void)
 				    binder_debugfs_dir_entry_root,
 				    NULL,
 				    &binder_stats_fops);
+		debugfs_create_file("fragmentation",
+				    S_IRUGO,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_fragmentation_fops);
 		debugfs_create_file("transactions",
 				    S_IRUGO,
 				    binder_debugfs_dir_entry_root,
@@ -24,18 +24,39 @@
 #include <linux/uaccess.h>
 #include <linux/poll.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/time.h>
+#include <linux/log2.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
 #include <mach/sec_debug.h>
 
+#ifdef CONFIG_ANDROID_LOGGER_PERCPU
+/*
+ * struct logger_seg - one CPU's segment of a log
+ *
+ * Positions are free-running byte counts, the index into 'buffer' is the
+ * position modulo 'size'. Writers on this CPU and readers take 'lock' only
+ * for short copies between kernel buffers, never around a user copy.
+ */
+struct logger_seg {
+	spinlock_t		lock;	/* lock protecting the segment */
+	unsigned char		*buffer;/* this CPU's part of the log buffer */
+	size_t			size;	/* size of the segment */
+	size_t			w_pos;	/* next write position */
+	size_t			tail;	/* position of the oldest entry */
+	size_t			head;	/* new readers start here */
+} ____cacheline_aligned_in_smp;
+#endif
+
 /*
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
  * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * mutex 'mutex'. With CONFIG_ANDROID_LOGGER_PERCPU, writers do not take the
+ * mutex, each segment has its own lock.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
@@ -43,8 +64,13 @@ struct logger_log {
 	wait_queue_head_t	wq;	/* wait queue for readers */
 	struct list_head	readers; /* this log's readers */
 	struct mutex		mutex;	/* mutex protecting buffer */
+#ifdef CONFIG_ANDROID_LOGGER_PERCPU
+	struct logger_seg	segs[NR_CPUS]; /* per-CPU ring segments */
+	atomic_t		seq;	/* sequence of the last entry reserved */
+#else
 	size_t			w_off;	/* current write head offset */
 	size_t			head;	/* new readers start here */
+#endif
 	size_t			size;	/* size of the log */
 };
 
@@ -57,7 +83,12 @@ struct logger_log {
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
 	struct list_head	list;	/* entry in logger_log's list */
+#ifdef CONFIG_ANDROID_LOGGER_PERCPU
+	size_t			r_pos[NR_CPUS]; /* read position per segment */
+	unsigned char		*bounce; /* entry being copied to the user */
+#else
 	size_t			r_off;	/* current read head offset */
+#endif
 };
 
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
@@ -86,6 +117,409 @@ static inline struct logger_log *file_get_log(struct file *file)
 		return file->private_data;
 }
 
+#ifdef CONFIG_ANDROID_LOGGER_PERCPU
+
+/*
+ * The __pad field of an entry in a segment tells readers whether the
+ * payload is complete. It is always zero in what readers copy out.
+ */
+#define LOGGER_ENTRY_BUSY	1	/* the writer is still copying it in */
+#define LOGGER_ENTRY_SKIP	2	/* the payload copy failed */
+
+/*
+ * In a segment each entry is preceded by its sequence number, taken from
+ * the log-wide counter when the entry is reserved. Readers merge the
+ * segments in sequence order and never see it.
+ */
+#define SEG_SEQ_LEN		sizeof(u32)
+
+/* seg_offset - returns index of position 'n' into 'seg' */
+#define seg_offset(seg, n)	((n) & ((seg)->size - 1))
+
+/* seg_pos_before - is position 'a' older than position 'b'? */
+#define seg_pos_before(a, b)	((long)((a) - (b)) < 0)
+
+static void seg_read(struct logger_seg *seg, size_t pos, void *buf,
+		     size_t count)
+{
+	size_t off = seg_offset(seg, pos);
+	size_t len = min(count, seg->size - off);
+
+	memcpy(buf, seg->buffer + off, len);
+	if (count != len)
+		memcpy(buf + len, seg->buffer, count - len);
+}
+
+static void seg_write(struct logger_seg *seg, size_t pos, const void *buf,
+		      size_t count)
+{
+	size_t off = seg_offset(seg, pos);
+	size_t len = min(count, seg->size - off);
+
+	memcpy(seg->buffer + off, buf, len);
+	if (count != len)
+		memcpy(seg->buffer, buf + len, count - len);
+}
+
+/*
+ * seg_write_from_user - copies 'count' bytes from the user-space buffer
+ * 'buf' to position 'pos' of 'seg'. The range must be reserved by the
+ * caller.
+ */
+static int seg_write_from_user(struct logger_seg *seg, size_t pos,
+			       const void __user *buf, size_t count)
+{
+	size_t off = seg_offset(seg, pos);
+	size_t len = min(count, seg->size - off);
+
+	if (len && copy_from_user(seg->buffer + off, buf, len))
+		return -EFAULT;
+
+	if (count != len)
+		if (copy_from_user(seg->buffer, buf + len, count - len))
+			return -EFAULT;
+
+	return 0;
+}
+
+static void seg_set_state(struct logger_seg *seg, size_t pos, __u16 state)
+{
+	spin_lock(&seg->lock);
+	seg_write(seg, pos + offsetof(struct logger_entry, __pad), &state,
+		  sizeof(state));
+	spin_unlock(&seg->lock);
+}
+
+/*
+ * seg_reserve - reserves room for the entry 'header' in 'seg' of 'log',
+ * dropping the oldest entries as needed, and writes out the header marked
+ * busy. 'pos' is set to the position of the header. Returns -ENOSPC if it
+ * would have to drop an entry that is still being written.
+ */
+static int seg_reserve(struct logger_log *log, struct logger_seg *seg,
+		       struct logger_entry *header, size_t *pos)
+{
+	size_t len = SEG_SEQ_LEN + sizeof(struct logger_entry) + header->len;
+	struct logger_entry old;
+	struct timespec now;
+	u32 seq;
+
+	spin_lock(&seg->lock);
+
+	while (seg->w_pos + len - seg->tail > seg->size) {
+		seg_read(seg, seg->tail + SEG_SEQ_LEN, &old, sizeof(old));
+		if (old.__pad == LOGGER_ENTRY_BUSY) {
+			spin_unlock(&seg->lock);
+			return -ENOSPC;
+		}
+		seg->tail += SEG_SEQ_LEN + sizeof(struct logger_entry) + old.len;
+	}
+	if (seg_pos_before(seg->head, seg->tail))
+		seg->head = seg->tail;
+
+	/* number under the lock, so each segment is in sequence order */
+	seq = atomic_inc_return(&log->seq);
+	now = current_kernel_time();
+	header->sec = now.tv_sec;
+	header->nsec = now.tv_nsec;
+	header->__pad = LOGGER_ENTRY_BUSY;
+
+	seg_write(seg, seg->w_pos, &seq, SEG_SEQ_LEN);
+	*pos = seg->w_pos + SEG_SEQ_LEN;
+	seg->w_pos += len;
+	seg_write(seg, *pos, header, sizeof(struct logger_entry));
+
+	spin_unlock(&seg->lock);
+
+	return 0;
+}
+
+/*
+ * seg_next_entry - moves 'r_pos' to the next complete entry of 'seg' and
+ * copies out its sequence number and header. Returns -EAGAIN if there is
+ * none yet. A reader that was lapped by the writers is pulled forward to
+ * the oldest entry.
+ *
+ * Caller must hold seg->lock.
+ */
+static int seg_next_entry(struct logger_seg *seg, size_t *r_pos, u32 *seq,
+			  struct logger_entry *header)
+{
+	if (seg_pos_before(*r_pos, seg->tail))
+		*r_pos = seg->tail;
+
+	while (*r_pos != seg->w_pos) {
+		seg_read(seg, *r_pos + SEG_SEQ_LEN, header, sizeof(*header));
+		if (header->__pad == LOGGER_ENTRY_BUSY)
+			break;
+		if (header->__pad == 0) {
+			seg_read(seg, *r_pos, seq, SEG_SEQ_LEN);
+			return 0;
+		}
+		*r_pos += SEG_SEQ_LEN + sizeof(struct logger_entry) +
+			  header->len;
+	}
+
+	return -EAGAIN;
+}
+
+/*
+ * seg_readable_len - returns the bytes, entry headers included, that a
+ * reader at 'r_pos' would get from 'seg'. Sequence numbers are not read
+ * out; entries still being written or whose copy failed do not count.
+ *
+ * Caller must hold seg->lock.
+ */
+static size_t seg_readable_len(struct logger_seg *seg, size_t r_pos)
+{
+	struct logger_entry header;
+	size_t len = 0;
+
+	if (seg_pos_before(r_pos, seg->tail))
+		r_pos = seg->tail;
+
+	while (r_pos != seg->w_pos) {
+		seg_read(seg, r_pos + SEG_SEQ_LEN, &header, sizeof(header));
+		if (header.__pad == 0)
+			len += sizeof(struct logger_entry) + header.len;
+		r_pos += SEG_SEQ_LEN + sizeof(struct logger_entry) + header.len;
+	}
+
+	return len;
+}
+
+/*
+ * logger_peek - finds the oldest entry over all segments that 'reader' can
+ * read and copies out its header. Returns the CPU of its segment, or -1 if
+ * there is nothing to read.
+ *
+ * Caller must hold log->mutex.
+ */
+static int logger_peek(struct logger_log *log, struct logger_reader *reader,
+		       struct logger_entry *header)
+{
+	struct logger_entry entry;
+	u32 seq, best_seq = 0;
+	int cpu, best = -1;
+
+	for_each_possible_cpu(cpu) {
+		struct logger_seg *seg = &log->segs[cpu];
+
+		spin_lock(&seg->lock);
+		if (!seg_next_entry(seg, &reader->r_pos[cpu], &seq, &entry) &&
+		    (best < 0 || (s32)(seq - best_seq) < 0)) {
+			*header = entry;
+			best_seq = seq;
+			best = cpu;
+		}
+		spin_unlock(&seg->lock);
+	}
+
+	return best;
+}
+
+/*
+ * do_read_log_to_user - reads the oldest entry of 'log' into the user-space
+ * buffer 'buf'. Returns the length of the entry on success, or zero if there
+ * is nothing to read.
+ *
+ * Caller must hold log->mutex.
+ */
+static ssize_t do_read_log_to_user(struct logger_log *log,
+				   struct logger_reader *reader,
+				   char __user *buf,
+				   size_t count)
+{
+	struct logger_entry header;
+	struct logger_seg *seg;
+	size_t len;
+	u32 seq;
+	int cpu;
+
+	cpu = logger_peek(log, reader, &header);
+	if (cpu < 0)
+		return 0;
+	seg = &log->segs[cpu];
+
+	/* look again, a writer may have lapped us since the peek */
+	spin_lock(&seg->lock);
+	if (seg_next_entry(seg, &reader->r_pos[cpu], &seq, &header)) {
+		spin_unlock(&seg->lock);
+		return 0;
+	}
+	len = sizeof(struct logger_entry) + header.len;
+	if (count < len) {
+		spin_unlock(&seg->lock);
+		return -EINVAL;
+	}
+	seg_read(seg, reader->r_pos[cpu] + SEG_SEQ_LEN, reader->bounce, len);
+	reader->r_pos[cpu] += SEG_SEQ_LEN + len;
+	spin_unlock(&seg->lock);
+
+	if (copy_to_user(buf, reader->bounce, len))
+		return -EFAULT;
+
+	return len;
+}
+
+/*
+ * logger_read - our log's read() method
+ *
+ * Behaves like the single ring version, except that entries are returned
+ * merged from the per-CPU segments in the order they were written.
+ */
+static ssize_t logger_read(struct file *file, char __user *buf,
+			   size_t count, loff_t *pos)
+{
+	struct logger_reader *reader = file->private_data;
+	struct logger_log *log = reader->log;
+	struct logger_entry header;
+	ssize_t ret;
+	DEFINE_WAIT(wait);
+
+start:
+	while (1) {
+		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
+
+		mutex_lock(&log->mutex);
+		ret = (logger_peek(log, reader, &header) < 0);
+		mutex_unlock(&log->mutex);
+		if (!ret)
+			break;
+
+		if (file->f_flags & O_NONBLOCK) {
+			ret = -EAGAIN;
+			break;
+		}
+
+		if (signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+
+		schedule();
+	}
+
+	finish_wait(&log->wq, &wait);
+	if (ret)
+		return ret;
+
+	mutex_lock(&log->mutex);
+	ret = do_read_log_to_user(log, reader, buf, count);
+	mutex_unlock(&log->mutex);
+
+	/* is there still something to read or did we race? */
+	if (unlikely(!ret))
+		goto start;
+
+	return ret;
+}
+
+/*
+ * seg_print_marked - print as kernel log if the 'count' bytes at 'pos'
+ * start with "!@"
+ */
+static void seg_print_marked(struct logger_seg *seg, size_t pos, size_t count)
+{
+	char tmp[256];
+
+	if (count < 2)
+		return;
+
+	seg_read(seg, pos, tmp, 2);
+	if (tmp[0] != '!' || tmp[1] != '@')
+		return;
+
+	count = min(count, sizeof(tmp) - 1);
+	seg_read(seg, pos, tmp, count);
+	tmp[count] = '\0';
+	printk("%s\n", tmp);
+}
+
+/*
+ * logger_aio_write - our write method, implementing support for write(),
+ * writev(), and aio_write(). Writes are our fast path, and we try to optimize
+ * them above all else.
+ *
+ * The entry is reserved in the segment of the CPU we run on and the payload
+ * is copied in without holding any lock. Readers skip the entry until it
+ * is marked complete.
+ */
+ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
+			 unsigned long nr_segs, loff_t ppos)
+{
+	struct logger_log *log = file_get_log(iocb->ki_filp);
+	struct logger_entry header;
+	struct logger_seg *seg;
+	size_t pos, off;
+	ssize_t ret = 0;
+
+	header.pid = current->tgid;
+	header.tid = current->pid;
+	header.len = min_t(size_t, iocb->ki_left, LOGGER_ENTRY_MAX_PAYLOAD);
+
+	/* null writes succeed, return zero */
+	if (unlikely(!header.len))
+		return 0;
+
+	/* migrating after this is fine, the entry stays where it is */
+	seg = &log->segs[raw_smp_processor_id()];
+
+	/*
+	 * A writer stuck in a page fault for a whole lap of the segment
+	 * blocks reuse of its entry; drop ours, as if it was overwritten.
+	 */
+	if (unlikely(seg_reserve(log, seg, &header, &pos)))
+		return header.len;
+
+	off = pos + sizeof(struct logger_entry);
+	while (nr_segs-- > 0) {
+		size_t len;
+
+		/* figure out how much of this vector we can keep */
+		len = min_t(size_t, iov->iov_len, header.len - ret);
+
+		/* write out this segment's payload */
+		if (unlikely(seg_write_from_user(seg, off + ret,
+						 iov->iov_base, len))) {
+			seg_set_state(seg, pos, LOGGER_ENTRY_SKIP);
+			return -EFAULT;
+		}
+		seg_print_marked(seg, off + ret, len);
+
+		iov++;
+		ret += len;
+	}
+
+	seg_set_state(seg, pos, 0);
+
+	/* wake up any blocked readers */
+	wake_up_interruptible(&log->wq);
+
+	return ret;
+}
+
+/*
+ * logger_reader_start - positions a new reader at the head of each segment
+ *
+ * Caller must hold log->mutex.
+ */
+static void logger_reader_start(struct logger_log *log,
+				struct logger_reader *reader)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct logger_seg *seg = &log->segs[cpu];
+
+		spin_lock(&seg->lock);
+		reader->r_pos[cpu] = seg->head;
+		spin_unlock(&seg->lock);
+	}
+}
+
+#else
+
 /*
  * get_entry_len - Grabs the length of the payload of the next entry starting
  * from 'off'.
@@ -396,6 +830,8 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	return ret;
 }
 
+#endif /* CONFIG_ANDROID_LOGGER_PERCPU */
+
 static struct logger_log *get_log_from_minor(int);
 
 /*
@@ -426,8 +862,19 @@ static int logger_open(struct inode *inode, struct file *file)
 		reader->log = log;
 		INIT_LIST_HEAD(&reader->list);
 
+#ifdef CONFIG_ANDROID_LOGGER_PERCPU
+		reader->bounce = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+		if (!reader->bounce) {
+			kfree(reader);
+			return -ENOMEM;
+		}
+
+		mutex_lock(&log->mutex);
+		logger_reader_start(log, reader);
+#else
 		mutex_lock(&log->mutex);
 		reader->r_off = log->head;
+#endif
 		list_add_tail(&reader->list, &log->readers);
 		mutex_unlock(&log->mutex);
 
@@ -453,6 +900,9 @@ static int logger_release(struct inode *inode, struct file *file)
 		mutex_lock(&log->mutex);
 		list_del(&reader->list);
 		mutex_unlock(&log->mutex);
+#ifdef CONFIG_ANDROID_LOGGER_PERCPU
+		kfree(reader->bounce);
+#endif
 		kfree(reader);
 		pr_info("%s: took %d msec\n", __func__, jiffies_to_msecs(jiffies - start));
 	}
@@ -460,6 +910,103 @@ static int logger_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
+#ifdef CONFIG_ANDROID_LOGGER_PERCPU
+
+/*
+ * logger_poll - the log's poll file operation, for poll/select/epoll
+ *
+ * See the single ring version below for the semantics.
+ */
+static unsigned int logger_poll(struct file *file, poll_table *wait)
+{
+	struct logger_reader *reader;
+	struct logger_entry header;
+	struct logger_log *log;
+	unsigned int ret = POLLOUT | POLLWRNORM;
+
+	if (!(file->f_mode & FMODE_READ))
+		return ret;
+
+	reader = file->private_data;
+	log = reader->log;
+
+	poll_wait(file, &log->wq, wait);
+
+	mutex_lock(&log->mutex);
+	if (logger_peek(log, reader, &header) >= 0)
+		ret |= POLLIN | POLLRDNORM;
+	mutex_unlock(&log->mutex);
+
+	return ret;
+}
+
+static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct logger_log *log = file_get_log(file);
+	struct logger_reader *reader;
+	struct logger_entry header;
+	struct logger_seg *seg;
+	long ret = -ENOTTY;
+	size_t head;
+	int cpu;
+
+	mutex_lock(&log->mutex);
+
+	switch (cmd) {
+	case LOGGER_GET_LOG_BUF_SIZE:
+		/* a writer only ever has its own segment to fill */
+		ret = log->segs[0].size;
+		break;
+	case LOGGER_GET_LOG_LEN:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		ret = 0;
+		for_each_possible_cpu(cpu) {
+			seg = &log->segs[cpu];
+			spin_lock(&seg->lock);
+			ret += seg_readable_len(seg, reader->r_pos[cpu]);
+			spin_unlock(&seg->lock);
+		}
+		break;
+	case LOGGER_GET_NEXT_ENTRY_LEN:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		if (logger_peek(log, reader, &header) >= 0)
+			ret = sizeof(struct logger_entry) + header.len;
+		else
+			ret = 0;
+		break;
+	case LOGGER_FLUSH_LOG:
+		if (!(file->f_mode & FMODE_WRITE)) {
+			ret = -EBADF;
+			break;
+		}
+		for_each_possible_cpu(cpu) {
+			seg = &log->segs[cpu];
+			spin_lock(&seg->lock);
+			seg->head = seg->w_pos;
+			head = seg->head;
+			spin_unlock(&seg->lock);
+			list_for_each_entry(reader, &log->readers, list)
+				reader->r_pos[cpu] = head;
+		}
+		ret = 0;
+		break;
+	}
+
+	mutex_unlock(&log->mutex);
+
+	return ret;
+}
+
+#else
+
 /*
  * logger_poll - the log's poll file operation, for poll/select/epoll
  *
@@ -542,6 +1089,8 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	return ret;
 }
 
+#endif /* CONFIG_ANDROID_LOGGER_PERCPU */
+
 static const struct file_operations logger_fops = {
 	.owner = THIS_MODULE,
 	.read = logger_read,
@@ -571,8 +1120,6 @@ static struct logger_log VAR = { \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
 	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
-	.w_off = 0, \
-	.head = 0, \
 	.size = SIZE, \
 };
 
@@ -601,6 +1148,18 @@ static struct logger_log *get_log_from_minor(int minor)
 static int __init init_log(struct logger_log *log)
 {
 	int ret;
+#ifdef CONFIG_ANDROID_LOGGER_PERCPU
+	size_t seg_size = rounddown_pow_of_two(log->size / nr_cpu_ids);
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct logger_seg *seg = &log->segs[cpu];
+
+		spin_lock_init(&seg->lock);
+		seg->buffer = log->buffer + cpu * seg_size;
+		seg->size = seg_size;
+	}
+#endif
 
 	ret = misc_register(&log->misc);
 	if (unlikely(ret)) {
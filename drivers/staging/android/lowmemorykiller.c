@@ -16,6 +16,16 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * With /sys/module/lowmemorykiller/parameters/pressure_mode set, the level
+ * picked from minfree is moved by how well reclaim is doing. When reclaim
+ * frees less than reclaim_eff_escalate percent of the pages it scans, or
+ * there is swap (e.g. zram) and no more than swap_headroom pages of it are
+ * free, the next more aggressive level is used; this only applies once a
+ * minfree level has been hit. Otherwise, while reclaim frees at least
+ * reclaim_eff_relax percent, the next less aggressive level is used.
+ * Efficiency is sampled every pressure_interval_ms and can be read from
+ * reclaim_eff.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -35,6 +45,13 @@
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/notifier.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/swap.h>
+#include <linux/vmstat.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/lowmemorykiller.h>
 
 static uint32_t lowmem_debug_level = 2;
 static int lowmem_adj[6] = {
@@ -52,9 +69,36 @@ static size_t lowmem_minfree[6] = {
 };
 static int lowmem_minfree_size = 4;
 
+static int lowmem_pressure_mode;
+static uint32_t lowmem_pressure_interval_ms = 100;
+static uint32_t lowmem_reclaim_eff_relax = 50;
+static uint32_t lowmem_reclaim_eff_escalate = 10;
+static uint32_t lowmem_swap_headroom = 4096;	/* 16MB */
+static int lowmem_reclaim_eff = 100;
+
+static DEFINE_SPINLOCK(lowmem_pressure_lock);
+static unsigned long lowmem_pressure_stamp;
+static unsigned long lowmem_last_scanned;
+static unsigned long lowmem_last_reclaimed;
+
 static struct task_struct *lowmem_deathpending;
 static unsigned long lowmem_deathpending_timeout;
 
+/*
+ * Thread group leaders, bucketed by oom_adj, so that victim selection only
+ * looks at the highest populated buckets instead of every process. The
+ * buckets are set up on first use, as tasks are forked before our init.
+ */
+#define LOWMEM_ADJ_BUCKETS	(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+
+/*
+ * The fork, exit and exec hooks run with tasklist_lock write-held, so the
+ * lock is always taken with interrupts off: an interrupt read-locking
+ * tasklist_lock must not come in while we hold it.
+ */
+static DEFINE_SPINLOCK(lowmem_adj_lock);
+static struct list_head lowmem_adj_buckets[LOWMEM_ADJ_BUCKETS];
+
 #define lowmem_print(level, x...)			\
 	do {						\
 		if (lowmem_debug_level >= (level))	\
@@ -79,6 +123,142 @@ task_notify_func(struct notifier_block *self, unsigned long val, void *data)
 	return NOTIFY_OK;
 }
 
+static struct list_head *lowmem_adj_bucket(int oom_adj)
+{
+	struct list_head *bucket;
+
+	oom_adj = clamp(oom_adj, OOM_DISABLE, OOM_ADJUST_MAX);
+	bucket = &lowmem_adj_buckets[oom_adj - OOM_DISABLE];
+	if (unlikely(!bucket->next))
+		INIT_LIST_HEAD(bucket);
+	return bucket;
+}
+
+void lowmem_adj_index_add(struct task_struct *p)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	list_add(&p->lowmem_adj_node, lowmem_adj_bucket(p->signal->oom_adj));
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+
+void lowmem_adj_index_del(struct task_struct *p)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	list_del_init(&p->lowmem_adj_node);
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+
+void lowmem_adj_index_replace(struct task_struct *old, struct task_struct *new)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	list_replace_init(&old->lowmem_adj_node, &new->lowmem_adj_node);
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+
+void lowmem_adj_index_update(struct task_struct *p)
+{
+	struct task_struct *leader;
+	unsigned long flags;
+
+	rcu_read_lock();
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	leader = p->group_leader;
+	/* an exited leader was already taken out of the index */
+	if (!list_empty(&leader->lowmem_adj_node))
+		list_move(&leader->lowmem_adj_node,
+			  lowmem_adj_bucket(p->signal->oom_adj));
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+	rcu_read_unlock();
+}
+
+/*
+ * Sums the pages scanned and reclaimed by vmscan on all CPUs. This runs
+ * from reclaim, so it does not take the hotplug lock like all_vm_events.
+ */
+static int lowmem_reclaim_stat(unsigned long *scanned, unsigned long *reclaimed)
+{
+#ifdef CONFIG_VM_EVENT_COUNTERS
+	int cpu, i;
+
+	*scanned = 0;
+	*reclaimed = 0;
+	for_each_possible_cpu(cpu) {
+		struct vm_event_state *this = &per_cpu(vm_event_states, cpu);
+
+		for (i = PGSTEAL_MOVABLE + 1; i <= PGSCAN_DIRECT_MOVABLE; i++)
+			*scanned += this->event[i];
+		for (i = PGREFILL_MOVABLE + 1; i <= PGSTEAL_MOVABLE; i++)
+			*reclaimed += this->event[i];
+	}
+	return 0;
+#else
+	return -ENODEV;
+#endif
+}
+
+static void lowmem_sample_pressure(void)
+{
+	unsigned long scanned, reclaimed;
+	unsigned long interval;
+
+	interval = msecs_to_jiffies(lowmem_pressure_interval_ms);
+	if (time_before(jiffies, lowmem_pressure_stamp + interval))
+		return;
+	if (!spin_trylock(&lowmem_pressure_lock))
+		return;
+	if (time_before(jiffies, lowmem_pressure_stamp + interval) ||
+	    lowmem_reclaim_stat(&scanned, &reclaimed))
+		goto out;
+
+	/* too little scanning to tell, reclaim is keeping up */
+	if (scanned - lowmem_last_scanned < SWAP_CLUSTER_MAX)
+		lowmem_reclaim_eff = 100;
+	else
+		lowmem_reclaim_eff = min_t(unsigned long, 100,
+			(reclaimed - lowmem_last_reclaimed) * 100 /
+			(scanned - lowmem_last_scanned));
+
+	lowmem_print(4, "lowmem_sample_pressure scanned %lu reclaimed %lu, "
+		     "eff %d\n", scanned - lowmem_last_scanned,
+		     reclaimed - lowmem_last_reclaimed, lowmem_reclaim_eff);
+	lowmem_last_scanned = scanned;
+	lowmem_last_reclaimed = reclaimed;
+	lowmem_pressure_stamp = jiffies;
+out:
+	spin_unlock(&lowmem_pressure_lock);
+}
+
+/*
+ * lowmem_pressure_level - moves the minfree level 'i', where 'array_size'
+ * means no level was hit, by one step depending on reclaim efficiency
+ * and swap headroom. Only a level that was hit is tightened: pressure
+ * alone never starts a kill.
+ */
+static int lowmem_pressure_level(int i, int array_size)
+{
+	int swap_low;
+
+	lowmem_sample_pressure();
+
+	swap_low = total_swap_pages &&
+		   nr_swap_pages <= (long)lowmem_swap_headroom;
+
+	if (lowmem_reclaim_eff < lowmem_reclaim_eff_escalate || swap_low) {
+		if (i > 0 && i < array_size)
+			i--;
+	} else if (lowmem_reclaim_eff >= lowmem_reclaim_eff_relax) {
+		if (i < array_size)
+			i++;
+	}
+	return i;
+}
+
 static int lowmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 {
 	struct task_struct *p;
@@ -93,6 +273,10 @@ static int lowmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 	int other_free = global_page_state(NR_FREE_PAGES);
 	int other_file = global_page_state(NR_FILE_PAGES) -
 		global_page_state(NR_SHMEM);
+	int adj;
+	struct list_head *bucket;
+	unsigned long flags;
+	ktime_t start;
 
 	/*
 	 * If we already have a death outstanding, then
@@ -111,19 +295,21 @@ static int lowmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 		array_size = lowmem_minfree_size;
 	for (i = 0; i < array_size; i++) {
 		if (other_free < lowmem_minfree[i] &&
-		    other_file < lowmem_minfree[i]) {
-			min_adj = lowmem_adj[i];
+		    other_file < lowmem_minfree[i])
 			break;
-		}
 	}
+	if (lowmem_pressure_mode)
+		i = lowmem_pressure_level(i, array_size);
+	if (i < array_size)
+		min_adj = lowmem_adj[i];
 
 	if (min_adj == OOM_ADJUST_MAX + 1)
 		return 0;
 
 	if (nr_to_scan > 0)
-		lowmem_print(3, "lowmem_shrink %d, %x, ofree %d %d, ma %d\n",
-			     nr_to_scan, gfp_mask, other_free, other_file,
-			     min_adj);
+		lowmem_print(3, "lowmem_shrink %d, %x, ofree %d %d, ma %d, "
+			     "eff %d\n", nr_to_scan, gfp_mask, other_free,
+			     other_file, min_adj, lowmem_reclaim_eff);
 	rem = global_page_state(NR_ACTIVE_ANON) +
 		global_page_state(NR_ACTIVE_FILE) +
 		global_page_state(NR_INACTIVE_ANON) +
@@ -135,54 +321,68 @@ static int lowmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 	}
 	selected_oom_adj = min_adj;
 
-	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
+	/*
+	 * Walk the buckets from the highest oom_adj down and stop at the
+	 * first one that has a task with memory, picking its largest task.
+	 */
+	start = ktime_get();
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	for (adj = OOM_ADJUST_MAX; adj >= max(min_adj, OOM_DISABLE); adj--) {
+		bucket = lowmem_adj_bucket(adj);
+		list_for_each_entry(p, bucket, lowmem_adj_node) {
+			struct mm_struct *mm;
+			struct signal_struct *sig;
+			int oom_adj;
 
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
+			task_lock(p);
+			mm = p->mm;
+			sig = p->signal;
+			if (!mm || !sig) {
+				task_unlock(p);
+				continue;
+			}
+			oom_adj = sig->oom_adj;
+			/* oom_adj changed, the update is on its way */
+			if (oom_adj < min_adj) {
+				task_unlock(p);
+				continue;
+			}
+			tasksize = get_mm_rss(mm);
 			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
+			if (tasksize <= 0)
 				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
+			if (selected && tasksize <= selected_tasksize)
 				continue;
+			selected = p;
+			selected_tasksize = tasksize;
+			selected_oom_adj = oom_adj;
+			lowmem_print(2, "select %d (%s), adj %d, size %d, "
+				     "to kill\n", p->pid, p->comm, oom_adj,
+				     tasksize);
 		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
+		if (selected)
+			break;
 	}
+	if (selected)
+		get_task_struct(selected);
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+
 	if (selected) {
+		trace_lowmem_kill(selected, selected_oom_adj,
+				  selected_tasksize, min_adj,
+				  ktime_to_ns(ktime_sub(ktime_get(), start)));
 		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
 			     selected->pid, selected->comm,
 			     selected_oom_adj, selected_tasksize);
 		lowmem_deathpending = selected;
 		lowmem_deathpending_timeout = jiffies + HZ;
 		force_sig(SIGKILL, selected);
+		put_task_struct(selected);
 		rem -= selected_tasksize;
 	} else
 		rem = -1;
 	lowmem_print(4, "lowmem_shrink %d, %x, return %d\n",
 		     nr_to_scan, gfp_mask, rem);
-	read_unlock(&tasklist_lock);
 	return rem;
 }
 
@@ -210,6 +410,17 @@ module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+module_param_named(pressure_mode, lowmem_pressure_mode, bool,
+		   S_IRUGO | S_IWUSR);
+module_param_named(pressure_interval_ms, lowmem_pressure_interval_ms, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(reclaim_eff_relax, lowmem_reclaim_eff_relax, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(reclaim_eff_escalate, lowmem_reclaim_eff_escalate, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(swap_headroom, lowmem_swap_headroom, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(reclaim_eff, lowmem_reclaim_eff, int, S_IRUGO);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
@@ -28,6 +28,9 @@
 #include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/random.h>
+#include <linux/math64.h>
 
 #include "zram_drv.h"
 
@@ -56,6 +59,122 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
+/*
+ * Compressed objects are kept by either zsmalloc or xvmalloc. The
+ * helpers below hide which one; incompressible pages are always stored
+ * as whole pages in table[index].page.
+ */
+#if defined(CONFIG_ZRAM_ZSMALLOC)
+static int zram_pool_create(struct zram *zram)
+{
+	zram->mem_pool = zs_create_pool();
+	return zram->mem_pool ? 0 : -ENOMEM;
+}
+
+static void zram_pool_destroy(struct zram *zram)
+{
+	zs_destroy_pool(zram->mem_pool);
+	zram->mem_pool = NULL;
+}
+
+static u64 zram_pool_total_size(struct zram *zram)
+{
+	return zs_get_total_size_bytes(zram->mem_pool);
+}
+
+static int zram_obj_alloc(struct zram *zram, u32 index, u32 size)
+{
+	unsigned long handle;
+
+	handle = zs_malloc(zram->mem_pool, size, GFP_NOIO | __GFP_HIGHMEM);
+	if (!handle)
+		return -ENOMEM;
+
+	zram->table[index].handle = handle;
+	zram->table[index].size = size;
+	return 0;
+}
+
+static void zram_obj_free(struct zram *zram, u32 index)
+{
+	zs_free(zram->mem_pool, zram->table[index].handle);
+}
+
+static u32 zram_obj_size(struct zram *zram, u32 index)
+{
+	return zram->table[index].size;
+}
+
+static void *zram_obj_map(struct zram *zram, u32 index, int write)
+{
+	return zs_map_object(zram->mem_pool, zram->table[index].handle,
+			     write ? ZS_MM_WO : ZS_MM_RO);
+}
+
+static void zram_obj_unmap(struct zram *zram, u32 index, void *cmem)
+{
+	zs_unmap_object(zram->mem_pool, zram->table[index].handle);
+}
+#else
+static int zram_pool_create(struct zram *zram)
+{
+	zram->mem_pool = xv_create_pool();
+	return zram->mem_pool ? 0 : -ENOMEM;
+}
+
+static void zram_pool_destroy(struct zram *zram)
+{
+	xv_destroy_pool(zram->mem_pool);
+	zram->mem_pool = NULL;
+}
+
+static u64 zram_pool_total_size(struct zram *zram)
+{
+	return xv_get_total_size_bytes(zram->mem_pool);
+}
+
+static int zram_obj_alloc(struct zram *zram, u32 index, u32 size)
+{
+	u32 offset;
+
+	if (xv_malloc(zram->mem_pool, size, &zram->table[index].page,
+			&offset, GFP_NOIO | __GFP_HIGHMEM))
+		return -ENOMEM;
+
+	zram->table[index].offset = offset;
+	return 0;
+}
+
+static void zram_obj_free(struct zram *zram, u32 index)
+{
+	xv_free(zram->mem_pool, zram->table[index].page,
+		zram->table[index].offset);
+}
+
+static void *zram_obj_map(struct zram *zram, u32 index, int write)
+{
+	return kmap_atomic(zram->table[index].page, KM_USER1) +
+			zram->table[index].offset;
+}
+
+static void zram_obj_unmap(struct zram *zram, u32 index, void *cmem)
+{
+	kunmap_atomic(cmem, KM_USER1);
+}
+
+static u32 zram_obj_size(struct zram *zram, u32 index)
+{
+	u32 size;
+	void *obj;
+
+	obj = zram_obj_map(zram, index, 0);
+	size = xv_get_object_size(obj);
+	zram_obj_unmap(zram, index, obj);
+
+	return size;
+}
+#endif /* CONFIG_ZRAM_ZSMALLOC */
+
 static int page_zero_filled(void *ptr)
 {
 	unsigned int pos;
@@ -111,7 +230,7 @@ static void zram_ioctl_get_stats(struct zram *zram,
 	size_t succ_writes, mem_used;
 	unsigned int good_compress_perc = 0, no_compress_perc = 0;
 
-	mem_used = xv_get_total_size_bytes(zram->mem_pool)
+	mem_used = zram_pool_total_size(zram)
 			+ (rs->pages_expand << PAGE_SHIFT);
 	succ_writes = zram_stat64_read(zram, &rs->num_writes) -
 			zram_stat64_read(zram, &rs->failed_writes);
@@ -143,13 +262,136 @@ static void zram_ioctl_get_stats(struct zram *zram,
 #endif /* CONFIG_ZRAM_STATS */
 }
 
+static void zram_ioctl_get_stream_stats(struct zram *zram,
+			struct zram_ioctl_stream_stats *s)
+{
+	s->num_streams = min_t(u32, nr_cpu_ids, ZRAM_MAX_STREAMS);
+
+#if defined(CONFIG_ZRAM_STATS)
+	{
+	u32 i;
+
+	for (i = 0; i < s->num_streams; i++) {
+		struct zram_stream *zstrm = &zram->streams[i];
+
+		mutex_lock(&zstrm->lock);
+		s->stream[i].compressions = zstrm->compressions;
+		s->stream[i].compr_bytes = zstrm->compr_bytes;
+		s->stream[i].contended = zstrm->contended;
+		mutex_unlock(&zstrm->lock);
+	}
+	}
+#endif /* CONFIG_ZRAM_STATS */
+}
+
+/* Benchmark defaults and limits, in pages */
+#define ZRAM_BENCH_DEFAULT_PAGES	1024
+#define ZRAM_BENCH_MAX_PAGES		65536
+
+/*
+ * Fill a page so that it compresses roughly like anonymous memory does:
+ * one quarter random bytes, the rest short repeating runs.
+ */
+static void zram_bench_fill(unsigned char *buf)
+{
+	static const char pattern[] = "zram benchmark ";
+	unsigned int pos;
+	u32 rnd = 0;
+
+	for (pos = 0; pos < PAGE_SIZE; pos++) {
+		if ((pos & 63) < 16) {
+			if (!(pos & 3))
+				rnd = random32();
+			buf[pos] = rnd >> ((pos & 3) * 8);
+		} else {
+			buf[pos] = pattern[pos % (sizeof(pattern) - 1)];
+		}
+	}
+}
+
+static u32 zram_bench_mbps(u32 pages, s64 ns)
+{
+	if (ns <= 0)
+		ns = 1;
+
+	/* bytes per ns * 1000 == MB (10^6 bytes) per second */
+	return div64_u64((u64)pages * PAGE_SIZE * 1000, ns);
+}
+
+/*
+ * Run LZO on this CPU against a test page and report the throughput.
+ * This uses private buffers, so it does not stall writes to the device.
+ */
+static int zram_ioctl_benchmark(struct zram_ioctl_bench *b)
+{
+	int ret = 0;
+	u32 i;
+	size_t clen, dlen;
+	ktime_t start;
+	void *workmem;
+	unsigned char *src, *dst, *out;
+
+	if (!b->pages)
+		b->pages = ZRAM_BENCH_DEFAULT_PAGES;
+	b->pages = min_t(u32, b->pages, ZRAM_BENCH_MAX_PAGES);
+
+	workmem = kmalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+	src = (void *)__get_free_page(GFP_KERNEL);
+	out = (void *)__get_free_page(GFP_KERNEL);
+	/* worst case LZO output is larger than the input page */
+	dst = (void *)__get_free_pages(GFP_KERNEL, 1);
+	if (!workmem || !src || !out || !dst) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	zram_bench_fill(src);
+
+	start = ktime_get();
+	for (i = 0; i < b->pages; i++) {
+		ret = lzo1x_1_compress(src, PAGE_SIZE, dst, &clen, workmem);
+		if (unlikely(ret != LZO_E_OK))
+			goto fail;
+		cond_resched();
+	}
+	b->compress_mbps = zram_bench_mbps(b->pages,
+				ktime_to_ns(ktime_sub(ktime_get(), start)));
+	b->compr_size = clen;
+
+	start = ktime_get();
+	for (i = 0; i < b->pages; i++) {
+		dlen = PAGE_SIZE;
+		ret = lzo1x_decompress_safe(dst, clen, out, &dlen);
+		if (unlikely(ret != LZO_E_OK || dlen != PAGE_SIZE))
+			goto fail;
+		cond_resched();
+	}
+	b->decompress_mbps = zram_bench_mbps(b->pages,
+				ktime_to_ns(ktime_sub(ktime_get(), start)));
+
+	pr_info("Benchmark: %u pages, compress %u MB/s, "
+		"decompress %u MB/s, ratio %lu%%\n", b->pages,
+		b->compress_mbps, b->decompress_mbps,
+		clen * 100 / PAGE_SIZE);
+	ret = 0;
+	goto out;
+
+fail:
+	pr_err("Benchmark failed! err=%d\n", ret);
+	ret = -EIO;
+out:
+	free_pages((unsigned long)dst, 1);
+	free_page((unsigned long)out);
+	free_page((unsigned long)src);
+	kfree(workmem);
+	return ret;
+}
+
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	u32 clen;
-	void *obj;
 
 	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
 
 	if (unlikely(!page)) {
 		/*
@@ -158,7 +400,9 @@ static void zram_free_page(struct zram *zram, size_t index)
 		 */
 		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
 			zram_clear_flag(zram, index, ZRAM_ZERO);
+			spin_lock(&zram->stat64_lock);
 			zram_stat_dec(&zram->stats.pages_zero);
+			spin_unlock(&zram->stat64_lock);
 		}
 		return;
 	}
@@ -167,24 +411,23 @@ static void zram_free_page(struct zram *zram, size_t index)
 		clen = PAGE_SIZE;
 		__free_page(page);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
+		spin_lock(&zram->stat64_lock);
 		zram_stat_dec(&zram->stats.pages_expand);
 		goto out;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
-
-	xv_free(zram->mem_pool, page, offset);
+	clen = zram_obj_size(zram, index) - sizeof(struct zobj_header);
+	zram_obj_free(zram, index);
+	spin_lock(&zram->stat64_lock);
 	if (clen <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
 
 out:
 	zram->stats.compr_size -= clen;
 	zram_stat_dec(&zram->stats.pages_stored);
+	spin_unlock(&zram->stat64_lock);
 
 	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
 }
 
 static void handle_zero_page(struct page *page)
@@ -204,12 +447,11 @@ static void handle_uncompressed_page(struct zram *zram,
 	unsigned char *user_mem, *cmem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
+	cmem = kmap_atomic(zram->table[index].page, KM_USER1);
 
 	memcpy(user_mem, cmem, PAGE_SIZE);
-	kunmap_atomic(user_mem, KM_USER0);
 	kunmap_atomic(cmem, KM_USER1);
+	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
 }
@@ -226,6 +468,7 @@ static int zram_read(struct zram *zram, struct bio *bio)
 	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
+		u32 size;
 		size_t clen;
 		struct page *page;
 		struct zobj_header *zheader;
@@ -255,16 +498,16 @@ static int zram_read(struct zram *zram, struct bio *bio)
 		user_mem = kmap_atomic(page, KM_USER0);
 		clen = PAGE_SIZE;
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+		size = zram_obj_size(zram, index);
+		cmem = zram_obj_map(zram, index, 0);
 
 		ret = lzo1x_decompress_safe(
 			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
+			size - sizeof(*zheader),
 			user_mem, &clen);
 
+		zram_obj_unmap(zram, index, cmem);
 		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
 
 		/* Should NEVER happen. Return bio error if it does. */
 		if (unlikely(ret != LZO_E_OK)) {
@@ -287,6 +530,30 @@ out:
 	return 0;
 }
 
+/*
+ * Get the compression stream of the CPU we are running on. We may be
+ * migrated while holding it, so its mutex still serializes users.
+ */
+static struct zram_stream *zram_get_stream(struct zram *zram)
+{
+	struct zram_stream *zstrm;
+
+	zstrm = &zram->streams[raw_smp_processor_id()];
+	if (!mutex_trylock(&zstrm->lock)) {
+		mutex_lock(&zstrm->lock);
+#if defined(CONFIG_ZRAM_STATS)
+		zstrm->contended++;
+#endif
+	}
+
+	return zstrm;
+}
+
+static void zram_put_stream(struct zram_stream *zstrm)
+{
+	mutex_unlock(&zstrm->lock);
+}
+
 static int zram_write(struct zram *zram, struct bio *bio)
 {
 	int i;
@@ -299,14 +566,13 @@ static int zram_write(struct zram *zram, struct bio *bio)
 
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		u32 offset;
 		size_t clen;
 		struct zobj_header *zheader;
+		struct zram_stream *zstrm;
 		struct page *page, *page_store;
 		unsigned char *user_mem, *cmem, *src;
 
 		page = bvec->bv_page;
-		src = zram->compress_buffer;
 
 		/*
 		 * System overwrites unused sectors. Free memory associated
@@ -316,24 +582,28 @@ static int zram_write(struct zram *zram, struct bio *bio)
 				zram_test_flag(zram, index, ZRAM_ZERO))
 			zram_free_page(zram, index);
 
-		mutex_lock(&zram->lock);
-
 		user_mem = kmap_atomic(page, KM_USER0);
 		if (page_zero_filled(user_mem)) {
 			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
+			spin_lock(&zram->stat64_lock);
 			zram_stat_inc(&zram->stats.pages_zero);
+			spin_unlock(&zram->stat64_lock);
 			zram_set_flag(zram, index, ZRAM_ZERO);
 			continue;
 		}
+		kunmap_atomic(user_mem, KM_USER0);
+
+		zstrm = zram_get_stream(zram);
+		src = zstrm->buffer;
 
+		user_mem = kmap_atomic(page, KM_USER0);
 		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+					zstrm->workmem);
 
 		kunmap_atomic(user_mem, KM_USER0);
 
 		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
+			zram_put_stream(zstrm);
 			pr_err("Compression failed! err=%d\n", ret);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
@@ -348,7 +618,7 @@ static int zram_write(struct zram *zram, struct bio *bio)
 			clen = PAGE_SIZE;
 			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
 			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
+				zram_put_stream(zstrm);
 				pr_info("Error allocating memory for "
 					"incompressible page: %u\n", index);
 				zram_stat64_inc(zram,
@@ -356,18 +626,17 @@ static int zram_write(struct zram *zram, struct bio *bio)
 				goto out;
 			}
 
-			offset = 0;
 			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+			spin_lock(&zram->stat64_lock);
 			zram_stat_inc(&zram->stats.pages_expand);
+			spin_unlock(&zram->stat64_lock);
 			zram->table[index].page = page_store;
 			src = kmap_atomic(page, KM_USER0);
 			goto memstore;
 		}
 
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
+		if (zram_obj_alloc(zram, index, clen + sizeof(*zheader))) {
+			zram_put_stream(zstrm);
 			pr_info("Error allocating memory for compressed "
 				"page: %u, size=%zu\n", index, clen);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
@@ -375,10 +644,10 @@ static int zram_write(struct zram *zram, struct bio *bio)
 		}
 
 memstore:
-		zram->table[index].offset = offset;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
+			cmem = kmap_atomic(zram->table[index].page, KM_USER1);
+		else
+			cmem = zram_obj_map(zram, index, 1);
 
 #if 0
 		/* Back-reference needed for memory defragmentation */
@@ -391,17 +660,27 @@ memstore:
 
 		memcpy(cmem, src, clen);
 
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
+		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+			kunmap_atomic(cmem, KM_USER1);
 			kunmap_atomic(src, KM_USER0);
+		} else {
+			zram_obj_unmap(zram, index, cmem);
+		}
 
 		/* Update stats */
+#if defined(CONFIG_ZRAM_STATS)
+		zstrm->compressions++;
+		zstrm->compr_bytes += clen;
+#endif
+		zram_put_stream(zstrm);
+
+		spin_lock(&zram->stat64_lock);
 		zram->stats.compr_size += clen;
 		zram_stat_inc(&zram->stats.pages_stored);
 		if (clen <= PAGE_SIZE / 2)
 			zram_stat_inc(&zram->stats.good_compress);
+		spin_unlock(&zram->stat64_lock);
 
-		mutex_unlock(&zram->lock);
 		index++;
 	}
 
@@ -471,19 +750,21 @@ static void reset_device(struct zram *zram)
 	zram->init_done = 0;
 
 	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	if (zram->streams) {
+		for (index = 0; index < nr_cpu_ids; index++) {
+			kfree(zram->streams[index].workmem);
+			free_pages((unsigned long)zram->streams[index].buffer,
+				   1);
+		}
+		kfree(zram->streams);
+		zram->streams = NULL;
+	}
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
 		struct page *page;
-		u16 offset;
 
 		page = zram->table[index].page;
-		offset = zram->table[index].offset;
 
 		if (!page)
 			continue;
@@ -491,14 +772,14 @@ static void reset_device(struct zram *zram)
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
 			__free_page(page);
 		else
-			xv_free(zram->mem_pool, page, offset);
+			zram_obj_free(zram, index);
 	}
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
-	zram->mem_pool = NULL;
+	if (zram->mem_pool)
+		zram_pool_destroy(zram);
 
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
@@ -509,6 +790,7 @@ static void reset_device(struct zram *zram)
 static int zram_ioctl_init_device(struct zram *zram)
 {
 	int ret;
+	unsigned int cpu;
 	size_t num_pages;
 
 	if (zram->init_done) {
@@ -518,18 +800,31 @@ static int zram_ioctl_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
+	zram->streams = kzalloc(nr_cpu_ids * sizeof(*zram->streams),
+				GFP_KERNEL);
+	if (!zram->streams) {
+		pr_err("Error allocating compression streams!\n");
 		ret = -ENOMEM;
 		goto fail;
 	}
 
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
-		goto fail;
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		struct zram_stream *zstrm = &zram->streams[cpu];
+
+		mutex_init(&zstrm->lock);
+		zstrm->workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+		if (!zstrm->workmem) {
+			pr_err("Error allocating compressor working memory!\n");
+			ret = -ENOMEM;
+			goto fail;
+		}
+
+		zstrm->buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
+		if (!zstrm->buffer) {
+			pr_err("Error allocating compressor buffer space\n");
+			ret = -ENOMEM;
+			goto fail;
+		}
 	}
 
 	num_pages = zram->disksize >> PAGE_SHIFT;
@@ -548,8 +843,7 @@ static int zram_ioctl_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
-	if (!zram->mem_pool) {
+	if (zram_pool_create(zram)) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
 		goto fail;
@@ -619,8 +913,45 @@ static int zram_ioctl(struct block_device *bdev, fmode_t mode,
 		kfree(stats);
 		break;
 	}
+	case ZRAMIO_GET_STREAM_STATS:
+	{
+		struct zram_ioctl_stream_stats *stats;
+		if (!zram->init_done) {
+			ret = -ENOTTY;
+			goto out;
+		}
+		stats = kzalloc(sizeof(*stats), GFP_KERNEL);
+		if (!stats) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		zram_ioctl_get_stream_stats(zram, stats);
+		if (copy_to_user((void *)arg, stats, sizeof(*stats))) {
+			kfree(stats);
+			ret = -EFAULT;
+			goto out;
+		}
+		kfree(stats);
+		break;
+	}
+	case ZRAMIO_BENCHMARK:
+	{
+		struct zram_ioctl_bench bench;
+		if (copy_from_user(&bench, (void *)arg, sizeof(bench))) {
+			ret = -EFAULT;
+			goto out;
+		}
+		ret = zram_ioctl_benchmark(&bench);
+		if (ret)
+			goto out;
+		if (copy_to_user((void *)arg, &bench, sizeof(bench)))
+			ret = -EFAULT;
+		break;
+	}
 	case ZRAMIO_INIT:
+		down_write(&zram->init_lock);
 		ret = zram_ioctl_init_device(zram);
+		up_write(&zram->init_lock);
 		break;
 
 	case ZRAMIO_RESET:
@@ -634,7 +965,9 @@ static int zram_ioctl(struct block_device *bdev, fmode_t mode,
 		if (bdev)
 			fsync_bdev(bdev);
 
+		down_write(&zram->init_lock);
 		ret = zram_ioctl_reset_device(zram);
+		up_write(&zram->init_lock);
 		break;
 
 	default:
@@ -661,12 +994,67 @@ static const struct block_device_operations zram_devops = {
 	.owner = THIS_MODULE
 };
 
+#if defined(CONFIG_ZRAM_ZSMALLOC)
+static struct zram *dev_to_zram(struct device *dev)
+{
+	return dev_to_disk(dev)->private_data;
+}
+
+/*
+ * /sys/block/zram<id>/compact: writing anything migrates objects out of
+ * sparsely used zspages and releases them; reading gives the no. of
+ * pages released by compaction so far.
+ */
+static ssize_t compact_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	u64 val = 0;
+
+	down_read(&zram->init_lock);
+	if (zram->init_done)
+		val = zs_get_compacted_pages(zram->mem_pool);
+	up_read(&zram->init_lock);
+
+	return sprintf(buf, "%llu\n", val);
+}
+
+static ssize_t compact_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long freed;
+
+	down_read(&zram->init_lock);
+	if (!zram->init_done) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+	freed = zs_compact(zram->mem_pool);
+	up_read(&zram->init_lock);
+
+	pr_debug("Compaction released %lu pages\n", freed);
+	return len;
+}
+
+static DEVICE_ATTR(compact, S_IRUGO | S_IWUSR, compact_show, compact_store);
+
+static struct attribute *zram_disk_attrs[] = {
+	&dev_attr_compact.attr,
+	NULL,
+};
+
+static struct attribute_group zram_disk_attr_group = {
+	.attrs = zram_disk_attrs,
+};
+#endif /* CONFIG_ZRAM_ZSMALLOC */
+
 static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	spin_lock_init(&zram->stat64_lock);
+	init_rwsem(&zram->init_lock);
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -710,6 +1098,19 @@ static int create_device(struct zram *zram, int device_id)
 
 	add_disk(zram->disk);
 
+#if defined(CONFIG_ZRAM_ZSMALLOC)
+	ret = sysfs_create_group(&disk_to_dev(zram->disk)->kobj,
+				&zram_disk_attr_group);
+	if (ret < 0) {
+		pr_warning("Error creating sysfs group for device %d\n",
+			device_id);
+		del_gendisk(zram->disk);
+		put_disk(zram->disk);
+		blk_cleanup_queue(zram->queue);
+		goto out;
+	}
+#endif
+
 	zram->init_done = 0;
 
 out:
@@ -719,6 +1120,10 @@ out:
 static void destroy_device(struct zram *zram)
 {
 	if (zram->disk) {
+#if defined(CONFIG_ZRAM_ZSMALLOC)
+		sysfs_remove_group(&disk_to_dev(zram->disk)->kobj,
+				&zram_disk_attr_group);
+#endif
 		del_gendisk(zram->disk);
 		put_disk(zram->disk);
 	}
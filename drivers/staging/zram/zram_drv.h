@@ -17,9 +17,14 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/rwsem.h>
 
 #include "zram_ioctl.h"
+#if defined(CONFIG_ZRAM_ZSMALLOC)
+#include "zsmalloc.h"
+#else
 #include "xvmalloc.h"
+#endif
 
 /*
  * Some arbitrary value. This is just to catch
@@ -53,7 +58,8 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 /*
  * NOTE: max_zpage_size must be less than or equal to:
  *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ * (or ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE - sizeof(struct zobj_header))
+ * otherwise, xv_malloc() (zs_malloc()) would always return failure.
  */
 
 /*-- End of configurable params */
@@ -78,8 +84,15 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
+	union {
+		struct page *page;	/* xvmalloc or uncompressed page */
+		unsigned long handle;	/* zsmalloc object */
+	};
+#if defined(CONFIG_ZRAM_ZSMALLOC)
+	u16 size;	/* object size, for compressed pages */
+#else
 	u16 offset;
+#endif
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
 } __attribute__((aligned(4)));
@@ -103,16 +116,36 @@ struct zram_stats {
 #endif
 };
 
+/*
+ * Compression stream: LZO working memory and output buffer. There is one
+ * per possible CPU, so writes from different CPUs compress in parallel.
+ */
+struct zram_stream {
+	struct mutex lock;	/* protect buffers against concurrent writes
+				 * that were migrated off this CPU */
+	void *workmem;
+	void *buffer;
+#if defined(CONFIG_ZRAM_STATS)
+	u64 compressions;	/* no. of pages compressed */
+	u64 compr_bytes;	/* compressed output, in bytes */
+	u64 contended;		/* stream was busy on lock */
+#endif
+};
+
 struct zram {
+#if defined(CONFIG_ZRAM_ZSMALLOC)
+	struct zs_pool *mem_pool;
+#else
 	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+#endif
+	struct zram_stream *streams;	/* nr_cpu_ids entries */
 	struct table *table;
-	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	spinlock_t stat64_lock;	/* protect 64-bit stats and compr_size,
+				 * pages_stored, good_compress, pages_expand */
 	struct request_queue *queue;
 	struct gendisk *disk;
+	struct rw_semaphore init_lock;	/* protect init and reset against
+					 * compaction */
 	int init_done;
 	/*
 	 * This is the limit on amount of *uncompressed* worth of data
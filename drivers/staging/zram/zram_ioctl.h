@@ -33,9 +33,30 @@ struct zram_ioctl_stats {
 	u64 mem_used_total;
 } __attribute__ ((packed, aligned(4)));
 
+/* Only the first ZRAM_MAX_STREAMS compression streams are reported */
+#define ZRAM_MAX_STREAMS	8
+
+struct zram_ioctl_stream_stats {
+	u32 num_streams;	/* no. of compression streams (one per CPU) */
+	struct {
+		u64 compressions;	/* no. of pages compressed */
+		u64 compr_bytes;	/* compressed output, in bytes */
+		u64 contended;		/* no. of times the stream was busy */
+	} stream[ZRAM_MAX_STREAMS];
+} __attribute__ ((packed, aligned(4)));
+
+struct zram_ioctl_bench {
+	u32 pages;		/* in: no. of pages to run (0 = default) */
+	u32 compress_mbps;	/* out: LZO compress throughput, MB/s */
+	u32 decompress_mbps;	/* out: LZO decompress throughput, MB/s */
+	u32 compr_size;		/* out: compressed size of the test page */
+} __attribute__ ((packed, aligned(4)));
+
 #define ZRAMIO_SET_DISKSIZE_KB	_IOW('z', 0, size_t)
 #define ZRAMIO_GET_STATS	_IOR('z', 1, struct zram_ioctl_stats)
 #define ZRAMIO_INIT		_IO('z', 2)
 #define ZRAMIO_RESET		_IO('z', 3)
+#define ZRAMIO_GET_STREAM_STATS	_IOR('z', 4, struct zram_ioctl_stream_stats)
+#define ZRAMIO_BENCHMARK	_IOWR('z', 5, struct zram_ioctl_bench)
 
 #endif
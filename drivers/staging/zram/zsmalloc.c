@@ -0,0 +1,572 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+/* Handles are shared by all pools */
+static struct kmem_cache *zs_handle_cachep;
+static unsigned int zs_handle_cache_users;
+static DEFINE_MUTEX(zs_handle_cache_lock);
+
+static u32 get_size_class_index(u32 size)
+{
+	if (unlikely(size < ZS_MIN_ALLOC_SIZE))
+		size = ZS_MIN_ALLOC_SIZE;
+	return DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE, ZS_SIZE_CLASS_DELTA);
+}
+
+/*
+ * Pick the no. of pages per zspage that leaves the least unused
+ * space at the end of the zspage, for objects of the given size.
+ */
+static u32 get_pages_per_zspage(u32 size)
+{
+	u32 i, max_usedpc = 0, max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		u32 zspage_size = i * PAGE_SIZE;
+		u32 waste = zspage_size % size;
+		u32 usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	if (!zspage->inuse)
+		return ZS_EMPTY;
+	if (zspage->inuse == class->objs_per_zspage)
+		return ZS_FULL;
+	if (zspage->inuse * 4 >= class->objs_per_zspage * 3)
+		return ZS_ALMOST_FULL;
+	return ZS_ALMOST_EMPTY;
+}
+
+/*
+ * Move zspage to the fullness list matching its no. of objects in use.
+ * Caller must hold class->lock and must deal with ZS_EMPTY itself.
+ */
+static void fix_fullness_group(struct size_class *class,
+				struct zspage *zspage)
+{
+	enum fullness_group fg = get_fullness_group(class, zspage);
+
+	if (fg == zspage->fullness || fg == ZS_EMPTY)
+		return;
+
+	list_move(&zspage->list, &class->fullness_list[fg]);
+	zspage->fullness = fg;
+}
+
+/* Returns a zspage with free objects, or NULL. */
+static struct zspage *find_free_zspage(struct size_class *class)
+{
+	struct list_head *head;
+
+	head = &class->fullness_list[ZS_ALMOST_FULL];
+	if (list_empty(head))
+		head = &class->fullness_list[ZS_ALMOST_EMPTY];
+	if (list_empty(head))
+		return NULL;
+
+	return list_first_entry(head, struct zspage, list);
+}
+
+/*
+ * Copy between a linear buffer and the object bytes at offset
+ * within zspage, which may cross page boundaries.
+ */
+static void zs_copy_from(struct zspage *zspage, u32 offset,
+			void *buf, u32 len)
+{
+	while (len) {
+		struct page *page = zspage->pages[offset >> PAGE_SHIFT];
+		u32 off = offset & ~PAGE_MASK;
+		u32 n = min_t(u32, len, PAGE_SIZE - off);
+		unsigned char *base;
+
+		base = kmap_atomic(page, KM_USER1);
+		memcpy(buf, base + off, n);
+		kunmap_atomic(base, KM_USER1);
+
+		buf += n;
+		offset += n;
+		len -= n;
+	}
+}
+
+static void zs_copy_to(struct zspage *zspage, u32 offset,
+			const void *buf, u32 len)
+{
+	while (len) {
+		struct page *page = zspage->pages[offset >> PAGE_SHIFT];
+		u32 off = offset & ~PAGE_MASK;
+		u32 n = min_t(u32, len, PAGE_SIZE - off);
+		unsigned char *base;
+
+		base = kmap_atomic(page, KM_USER1);
+		memcpy(base + off, buf, n);
+		kunmap_atomic(base, KM_USER1);
+
+		buf += n;
+		offset += n;
+		len -= n;
+	}
+}
+
+/*
+ * Take a free object in zspage for handle and write the back-reference
+ * header. Caller must hold class->lock.
+ */
+static void obj_alloc(struct size_class *class, struct zspage *zspage,
+			struct zs_handle *handle)
+{
+	unsigned long h = (unsigned long)handle;
+	u32 idx;
+
+	idx = find_first_zero_bit(zspage->used_map, class->objs_per_zspage);
+	BUG_ON(idx >= class->objs_per_zspage);
+
+	__set_bit(idx, zspage->used_map);
+	zspage->inuse++;
+	class->objs_inuse++;
+
+	handle->zspage = zspage;
+	handle->obj_idx = idx;
+
+	zs_copy_to(zspage, idx * class->size, &h, ZS_HANDLE_SIZE);
+	fix_fullness_group(class, zspage);
+}
+
+/* Caller must hold class->lock. */
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			u32 idx)
+{
+	/* Catch double free bugs */
+	BUG_ON(!test_bit(idx, zspage->used_map));
+
+	__clear_bit(idx, zspage->used_map);
+	zspage->inuse--;
+	class->objs_inuse--;
+
+	fix_fullness_group(class, zspage);
+}
+
+static struct zspage *alloc_zspage(struct size_class *class, u32 class_idx,
+				gfp_t flags)
+{
+	u32 i;
+	struct zspage *zspage;
+
+	zspage = kzalloc(sizeof(*zspage) +
+			BITS_TO_LONGS(class->objs_per_zspage) * sizeof(long),
+			flags & ~__GFP_HIGHMEM);
+	if (unlikely(!zspage))
+		return NULL;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(flags);
+		if (unlikely(!zspage->pages[i]))
+			goto fail;
+	}
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class_idx = class_idx;
+	zspage->fullness = ZS_EMPTY;
+
+	return zspage;
+
+fail:
+	while (i)
+		__free_page(zspage->pages[--i]);
+	kfree(zspage);
+	return NULL;
+}
+
+static void free_zspage(struct zs_pool *pool, struct zspage *zspage)
+{
+	struct size_class *class = &pool->size_class[zspage->class_idx];
+	u32 i;
+
+	for (i = 0; i < class->pages_per_zspage; i++)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+
+	atomic_long_sub(class->pages_per_zspage, &pool->total_pages);
+}
+
+/*
+ * Create a memory pool. Allocates size classes, per-CPU mapping
+ * buffers and other per-pool metadata.
+ */
+struct zs_pool *zs_create_pool(void)
+{
+	int cpu;
+	u32 i, fg;
+	struct zs_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		spin_lock_init(&class->lock);
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage *
+						PAGE_SIZE / class->size;
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+	}
+
+	pool->map_area = alloc_percpu(struct zs_map_area);
+	if (!pool->map_area)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		struct zs_map_area *area = per_cpu_ptr(pool->map_area, cpu);
+
+		area->buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+		if (!area->buf)
+			goto fail;
+	}
+
+	mutex_lock(&zs_handle_cache_lock);
+	if (!zs_handle_cache_users) {
+		zs_handle_cachep = kmem_cache_create("zs_handle",
+					sizeof(struct zs_handle), 0, 0, NULL);
+		if (!zs_handle_cachep) {
+			mutex_unlock(&zs_handle_cache_lock);
+			goto fail;
+		}
+	}
+	zs_handle_cache_users++;
+	mutex_unlock(&zs_handle_cache_lock);
+
+	return pool;
+
+fail:
+	if (pool->map_area) {
+		for_each_possible_cpu(cpu)
+			kfree(per_cpu_ptr(pool->map_area, cpu)->buf);
+		free_percpu(pool->map_area);
+	}
+	kfree(pool);
+	return NULL;
+}
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int cpu;
+	u32 i, fg;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			struct zspage *zspage, *tmp;
+
+			list_for_each_entry_safe(zspage, tmp,
+					&class->fullness_list[fg], list) {
+				WARN_ONCE(1, "zsmalloc: freeing pool with "
+					"objects in use (size class %u)\n",
+					class->size);
+				list_del(&zspage->list);
+				free_zspage(pool, zspage);
+			}
+		}
+	}
+
+	for_each_possible_cpu(cpu)
+		kfree(per_cpu_ptr(pool->map_area, cpu)->buf);
+	free_percpu(pool->map_area);
+	kfree(pool);
+
+	mutex_lock(&zs_handle_cache_lock);
+	if (!--zs_handle_cache_users) {
+		kmem_cache_destroy(zs_handle_cachep);
+		zs_handle_cachep = NULL;
+	}
+	mutex_unlock(&zs_handle_cache_lock);
+}
+
+/**
+ * zs_malloc - Allocate object of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of object to allocate
+ * @flags: gfp flags for any new pages
+ *
+ * On success, returns a handle to be used with zs_map_object()
+ * and zs_free(). On failure, returns 0.
+ *
+ * Allocation requests with size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * will fail.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, u32 size, gfp_t flags)
+{
+	u32 class_idx;
+	struct zs_handle *handle;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	size += ZS_HANDLE_SIZE;
+	if (unlikely(size > ZS_MAX_ALLOC_SIZE))
+		return 0;
+
+	class_idx = get_size_class_index(size);
+	class = &pool->size_class[class_idx];
+
+	handle = kmem_cache_alloc(zs_handle_cachep, flags & ~__GFP_HIGHMEM);
+	if (unlikely(!handle))
+		return 0;
+	handle->class_idx = class_idx;
+
+	spin_lock(&class->lock);
+	zspage = find_free_zspage(class);
+
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		/* callers that cannot sleep only get room in existing zspages */
+		if (!(flags & __GFP_WAIT))
+			goto fail;
+		zspage = alloc_zspage(class, class_idx, flags);
+		if (unlikely(!zspage))
+			goto fail;
+		atomic_long_add(class->pages_per_zspage, &pool->total_pages);
+
+		spin_lock(&class->lock);
+		class->zspages++;
+	}
+
+	obj_alloc(class, zspage, handle);
+	spin_unlock(&class->lock);
+
+	return (unsigned long)handle;
+
+fail:
+	kmem_cache_free(zs_handle_cachep, handle);
+	return 0;
+}
+
+void zs_free(struct zs_pool *pool, unsigned long obj)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct size_class *class = &pool->size_class[handle->class_idx];
+	struct zspage *zspage;
+
+	spin_lock(&class->lock);
+	zspage = handle->zspage;
+	obj_free(class, zspage, handle->obj_idx);
+
+	/* No used objects in this zspage. Free it. */
+	if (!zspage->inuse) {
+		list_del(&zspage->list);
+		class->zspages--;
+		spin_unlock(&class->lock);
+
+		free_zspage(pool, zspage);
+	} else {
+		spin_unlock(&class->lock);
+	}
+
+	kmem_cache_free(zs_handle_cachep, handle);
+}
+
+/**
+ * zs_map_object - get a pointer to the object behind a handle
+ * @pool: pool the object was allocated from
+ * @handle: handle returned by zs_malloc()
+ * @mm: how the caller will access the object
+ *
+ * Holds the object's size class lock until zs_unmap_object(), which
+ * keeps compaction from moving the object meanwhile. Objects that span
+ * a page boundary are accessed through a per-CPU copy.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long obj,
+			enum zs_mapmode mm)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct size_class *class = &pool->size_class[handle->class_idx];
+	struct zs_map_area *area;
+	u32 offset, off;
+
+	spin_lock(&class->lock);
+
+	area = this_cpu_ptr(pool->map_area);
+	area->zspage = handle->zspage;
+	area->mm = mm;
+
+	offset = handle->obj_idx * class->size;
+	area->offset = offset;
+	off = offset & ~PAGE_MASK;
+
+	if (off + class->size <= PAGE_SIZE) {
+		/* this object is contained entirely within a page */
+		area->vaddr = kmap_atomic(area->zspage->pages[offset >>
+					PAGE_SHIFT], KM_USER1);
+		return area->vaddr + off + ZS_HANDLE_SIZE;
+	}
+
+	area->vaddr = NULL;
+	if (mm != ZS_MM_WO)
+		zs_copy_from(area->zspage, offset + ZS_HANDLE_SIZE,
+			     area->buf, class->size - ZS_HANDLE_SIZE);
+
+	return area->buf;
+}
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long obj)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct size_class *class = &pool->size_class[handle->class_idx];
+	struct zs_map_area *area;
+
+	area = this_cpu_ptr(pool->map_area);
+
+	if (area->vaddr)
+		kunmap_atomic(area->vaddr, KM_USER1);
+	else if (area->mm != ZS_MM_RO)
+		zs_copy_to(area->zspage, area->offset + ZS_HANDLE_SIZE,
+			   area->buf, class->size - ZS_HANDLE_SIZE);
+
+	spin_unlock(&class->lock);
+}
+
+/* Returns the emptiest zspage that is not full, or NULL. */
+static struct zspage *find_compact_source(struct size_class *class)
+{
+	struct zspage *zspage, *src = NULL;
+	enum fullness_group fg = ZS_ALMOST_EMPTY;
+
+	if (list_empty(&class->fullness_list[fg]))
+		fg = ZS_ALMOST_FULL;
+
+	list_for_each_entry(zspage, &class->fullness_list[fg], list)
+		if (!src || zspage->inuse < src->inuse)
+			src = zspage;
+
+	return src;
+}
+
+/*
+ * Move objects out of the emptiest zspages of class into other zspages
+ * of the class, for as long as that frees a whole zspage. Returns the
+ * no. of pages freed.
+ */
+static unsigned long zs_compact_class(struct zs_pool *pool,
+					struct size_class *class)
+{
+	unsigned long freed = 0;
+	struct zspage *src, *dst;
+	struct zs_handle *handle;
+	struct zs_map_area *area;
+	u32 idx;
+
+	spin_lock(&class->lock);
+	while (class->zspages * class->objs_per_zspage - class->objs_inuse >=
+			class->objs_per_zspage) {
+		src = find_compact_source(class);
+		if (!src)
+			break;
+
+		/* Take src off its list so that obj_alloc cannot pick it */
+		list_del_init(&src->list);
+		src->fullness = ZS_EMPTY;
+
+		area = this_cpu_ptr(pool->map_area);
+		for_each_set_bit(idx, src->used_map, class->objs_per_zspage) {
+			zs_copy_from(src, idx * class->size, area->buf,
+				     class->size);
+			handle = *(struct zs_handle **)area->buf;
+
+			/*
+			 * There are enough free objects outside src for all
+			 * of its objects, see the loop condition.
+			 */
+			dst = find_free_zspage(class);
+			BUG_ON(!dst);
+			obj_alloc(class, dst, handle);
+			zs_copy_to(dst, handle->obj_idx * class->size +
+				   ZS_HANDLE_SIZE, area->buf + ZS_HANDLE_SIZE,
+				   class->size - ZS_HANDLE_SIZE);
+
+			__clear_bit(idx, src->used_map);
+			src->inuse--;
+			class->objs_inuse--;
+		}
+
+		BUG_ON(src->inuse);
+		class->zspages--;
+		spin_unlock(&class->lock);
+
+		free_zspage(pool, src);
+		freed += class->pages_per_zspage;
+		cond_resched();
+
+		spin_lock(&class->lock);
+	}
+	spin_unlock(&class->lock);
+
+	return freed;
+}
+
+/**
+ * zs_compact - migrate objects to release pages
+ * @pool: pool to compact
+ *
+ * Returns the no. of pages released. May sleep.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	unsigned long freed = 0;
+	u32 i;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++)
+		freed += zs_compact_class(pool, &pool->size_class[i]);
+
+	atomic_long_add(freed, &pool->compacted_pages);
+
+	return freed;
+}
+
+/*
+ * Returns total memory used by allocator (userdata + metadata)
+ */
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->total_pages) << PAGE_SHIFT;
+}
+
+u64 zs_get_compacted_pages(struct zs_pool *pool)
+{
+	return atomic_long_read(&pool->compacted_pages);
+}
@@ -0,0 +1,111 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/spinlock.h>
+#include <linux/list.h>
+
+/* User configurable params */
+
+/*
+ * Each object starts with a back-reference to its handle, so that
+ * compaction can find and update the handle of an object it moves.
+ */
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
+
+/* Size classes are separated by ZS_SIZE_CLASS_DELTA bytes */
+#define ZS_SIZE_CLASS_DELTA	16
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+#define ZS_SIZE_CLASSES		((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) \
+					/ ZS_SIZE_CLASS_DELTA + 1)
+
+/*
+ * A zspage is a group of up to ZS_MAX_PAGES_PER_ZSPAGE order-0 pages
+ * that hold objects of one size class back to back, so objects may
+ * span a page boundary. Each class uses the group size that wastes
+ * the least space at the end of the zspage.
+ */
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+#define ZS_MAX_OBJS_PER_ZSPAGE	(ZS_MAX_PAGES_PER_ZSPAGE * PAGE_SIZE \
+					/ ZS_MIN_ALLOC_SIZE)
+
+/* End of user params */
+
+/*
+ * Allocation prefers almost full zspages, compaction drains the
+ * emptiest ones. Empty zspages are freed right away.
+ */
+enum fullness_group {
+	ZS_ALMOST_FULL,		/* 3/4 or more of the objects in use */
+	ZS_ALMOST_EMPTY,
+	ZS_FULL,
+	_ZS_NR_FULLNESS_GROUPS,
+
+	ZS_EMPTY,
+};
+
+struct zspage {
+	struct list_head list;		/* entry in class fullness list */
+	u16 class_idx;
+	u16 inuse;			/* no. of objects in use */
+	u8 fullness;
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+	unsigned long used_map[0];	/* bitmap of objects in use */
+};
+
+/* Handle returned to the user; points at the current object location */
+struct zs_handle {
+	struct zspage *zspage;
+	u16 obj_idx;
+	u16 class_idx;			/* never changes for an object */
+};
+
+struct size_class {
+	spinlock_t lock;
+	u32 size;			/* object size, including header */
+	u32 pages_per_zspage;
+	u32 objs_per_zspage;
+
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+
+	/* stats */
+	u32 zspages;
+	u32 objs_inuse;
+};
+
+/*
+ * Objects that span a page boundary are copied into a per-CPU buffer
+ * by zs_map_object and copied back, if needed, by zs_unmap_object.
+ */
+struct zs_map_area {
+	char *buf;			/* ZS_MAX_ALLOC_SIZE bytes */
+	void *vaddr;			/* kmap_atomic address, if mapped */
+	struct zspage *zspage;
+	u32 offset;			/* object offset within zspage */
+	enum zs_mapmode mm;
+};
+
+struct zs_pool {
+	struct size_class size_class[ZS_SIZE_CLASSES];
+	struct zs_map_area __percpu *map_area;
+
+	/* stats */
+	atomic_long_t total_pages;
+	atomic_long_t compacted_pages;
+};
+
+#endif
@@ -188,6 +188,8 @@ extern int cpufreq_driver_target(struct cpufreq_policy *policy,
 extern int __cpufreq_driver_target(struct cpufreq_policy *policy,
 				   unsigned int target_freq,
 				   unsigned int relation);
+extern int cpufreq_driver_fast_switch(struct cpufreq_policy *policy,
+				      unsigned int index);
 
 
 extern int __cpufreq_driver_getavg(struct cpufreq_policy *policy,
@@ -224,6 +226,10 @@ struct cpufreq_driver {
 	/* should be defined, if possible */
 	unsigned int	(*get)	(unsigned int cpu);
 
+	/* optional, may not sleep; see cpufreq_driver_fast_switch() */
+	int	(*fast_switch)	(struct cpufreq_policy *policy,
+				 unsigned int index);
+
 	/* optional */
 	unsigned int (*getavg)	(struct cpufreq_policy *policy,
 				 unsigned int cpu);
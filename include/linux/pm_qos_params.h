@@ -12,13 +12,24 @@
 #define PM_QOS_CPU_DMA_LATENCY 1
 #define PM_QOS_NETWORK_LATENCY 2
 #define PM_QOS_NETWORK_THROUGHPUT 3
+#define PM_QOS_CPU_FREQ_MIN 4
+#define PM_QOS_CPU_FREQ_MAX 5
+#define PM_QOS_BUS_FREQ_MIN 6
+#define PM_QOS_BUS_FREQ_MAX 7
 
-#define PM_QOS_NUM_CLASSES 4
+#define PM_QOS_NUM_CLASSES 8
 #define PM_QOS_DEFAULT_VALUE -1
 
+/* frequency classes are in kHz */
+#define PM_QOS_CPU_FREQ_MIN_DEFAULT_VALUE 0
+#define PM_QOS_CPU_FREQ_MAX_DEFAULT_VALUE INT_MAX
+#define PM_QOS_BUS_FREQ_MIN_DEFAULT_VALUE 0
+#define PM_QOS_BUS_FREQ_MAX_DEFAULT_VALUE INT_MAX
+
 struct pm_qos_request_list {
 	struct plist_node list;
 	int pm_qos_class;
+	void *owner;		/* caller of pm_qos_add_request() */
 };
 
 void pm_qos_add_request(struct pm_qos_request_list *l, int pm_qos_class, s32 value);
@@ -1215,6 +1215,9 @@ struct task_struct {
 #endif
 
 	struct list_head tasks;
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+	struct list_head lowmem_adj_node;
+#endif
 	struct plist_node pushable_tasks;
 
 	struct mm_struct *mm, *active_mm;
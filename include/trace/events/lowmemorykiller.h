@@ -0,0 +1,44 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM lowmemorykiller
+
+#if !defined(_TRACE_LOWMEMORYKILLER_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_LOWMEMORYKILLER_H
+
+#include <linux/sched.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(lowmem_kill,
+
+	TP_PROTO(struct task_struct *p, int oom_adj, int tasksize,
+		 int min_adj, s64 select_ns),
+
+	TP_ARGS(p, oom_adj, tasksize, min_adj, select_ns),
+
+	TP_STRUCT__entry(
+		__array(	char,	comm,	TASK_COMM_LEN	)
+		__field(	pid_t,	pid			)
+		__field(	int,	oom_adj			)
+		__field(	int,	tasksize		)
+		__field(	int,	min_adj			)
+		__field(	s64,	select_ns		)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->comm, p->comm, TASK_COMM_LEN);
+		__entry->pid		= p->pid;
+		__entry->oom_adj	= oom_adj;
+		__entry->tasksize	= tasksize;
+		__entry->min_adj	= min_adj;
+		__entry->select_ns	= select_ns;
+	),
+
+	TP_printk("comm=%s pid=%d oom_adj=%d tasksize=%d min_adj=%d select_ns=%lld",
+		__entry->comm, __entry->pid, __entry->oom_adj,
+		__entry->tasksize, __entry->min_adj,
+		(long long)__entry->select_ns)
+);
+
+#endif /* _TRACE_LOWMEMORYKILLER_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
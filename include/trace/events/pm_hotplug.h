@@ -0,0 +1,43 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM pm_hotplug
+
+#if !defined(_TRACE_PM_HOTPLUG_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_PM_HOTPLUG_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(pm_hotplug_decision,
+
+	TP_PROTO(unsigned int load, unsigned int nr_run, unsigned int freq,
+		 int action),
+
+	TP_ARGS(load, nr_run, freq, action),
+
+	TP_STRUCT__entry(
+		__field(	unsigned int,	load		)
+		__field(	unsigned int,	nr_run		)
+		__field(	unsigned int,	freq		)
+		__field(	int,		action		)
+	),
+
+	TP_fast_assign(
+		__entry->load	= load;
+		__entry->nr_run	= nr_run;
+		__entry->freq	= freq;
+		__entry->action	= action;
+	),
+
+	TP_printk("load=%u nr_run=%u.%02u freq=%u action=%s",
+		__entry->load, __entry->nr_run / 100, __entry->nr_run % 100,
+		__entry->freq,
+		__print_symbolic(__entry->action,
+				 { 0, "none" },
+				 { 1, "up" },
+				 { 2, "down" },
+				 { 3, "boost" }))
+);
+
+#endif /* _TRACE_PM_HOTPLUG_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
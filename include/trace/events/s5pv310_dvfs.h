@@ -0,0 +1,64 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM s5pv310_dvfs
+
+#if !defined(_TRACE_S5PV310_DVFS_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_S5PV310_DVFS_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * One frequency level change. @volt_us is the time spent in regulator
+ * calls, @lock_us the time waiting for the APLL to lock (CPU) or for
+ * the dividers to settle (bus), @total_us the whole change.
+ */
+DECLARE_EVENT_CLASS(s5pv310_dvfs_transition,
+
+	TP_PROTO(unsigned int old_level, unsigned int new_level,
+		 unsigned int volt_us, unsigned int lock_us,
+		 unsigned int total_us),
+
+	TP_ARGS(old_level, new_level, volt_us, lock_us, total_us),
+
+	TP_STRUCT__entry(
+		__field(	unsigned int,	old_level	)
+		__field(	unsigned int,	new_level	)
+		__field(	unsigned int,	volt_us		)
+		__field(	unsigned int,	lock_us		)
+		__field(	unsigned int,	total_us	)
+	),
+
+	TP_fast_assign(
+		__entry->old_level	= old_level;
+		__entry->new_level	= new_level;
+		__entry->volt_us	= volt_us;
+		__entry->lock_us	= lock_us;
+		__entry->total_us	= total_us;
+	),
+
+	TP_printk("L%u->L%u volt=%uus lock=%uus total=%uus",
+		__entry->old_level, __entry->new_level, __entry->volt_us,
+		__entry->lock_us, __entry->total_us)
+);
+
+DEFINE_EVENT(s5pv310_dvfs_transition, s5pv310_cpufreq_transition,
+
+	TP_PROTO(unsigned int old_level, unsigned int new_level,
+		 unsigned int volt_us, unsigned int lock_us,
+		 unsigned int total_us),
+
+	TP_ARGS(old_level, new_level, volt_us, lock_us, total_us)
+);
+
+DEFINE_EVENT(s5pv310_dvfs_transition, s5pv310_busfreq_transition,
+
+	TP_PROTO(unsigned int old_level, unsigned int new_level,
+		 unsigned int volt_us, unsigned int lock_us,
+		 unsigned int total_us),
+
+	TP_ARGS(old_level, new_level, volt_us, lock_us, total_us)
+);
+
+#endif /* _TRACE_S5PV310_DVFS_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
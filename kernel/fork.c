@@ -19,6 +19,7 @@
 #include <linux/completion.h>
 #include <linux/personality.h>
 #include <linux/mempolicy.h>
+#include <linux/oom.h>
 #include <linux/sem.h>
 #include <linux/file.h>
 #include <linux/fdtable.h>
@@ -1293,6 +1294,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 			attach_pid(p, PIDTYPE_SID, task_session(current));
 			list_add_tail(&p->sibling, &p->real_parent->children);
 			list_add_tail_rcu(&p->tasks, &init_task.tasks);
+			lowmem_adj_index_add(p);
 			__get_cpu_var(process_counts)++;
 		}
 		attach_pid(p, PIDTYPE_PID, pid);
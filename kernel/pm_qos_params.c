@@ -40,6 +40,8 @@
 #include <linux/string.h>
 #include <linux/platform_device.h>
 #include <linux/init.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <linux/uaccess.h>
 
@@ -94,15 +96,57 @@ static struct pm_qos_object network_throughput_pm_qos = {
 };
 
 
+static BLOCKING_NOTIFIER_HEAD(cpu_freq_min_notifier);
+static struct pm_qos_object cpu_freq_min_pm_qos = {
+	.requests = PLIST_HEAD_INIT(cpu_freq_min_pm_qos.requests, pm_qos_lock),
+	.notifiers = &cpu_freq_min_notifier,
+	.name = "cpu_freq_min",
+	.default_value = PM_QOS_CPU_FREQ_MIN_DEFAULT_VALUE,
+	.type = PM_QOS_MAX,
+};
+
+static BLOCKING_NOTIFIER_HEAD(cpu_freq_max_notifier);
+static struct pm_qos_object cpu_freq_max_pm_qos = {
+	.requests = PLIST_HEAD_INIT(cpu_freq_max_pm_qos.requests, pm_qos_lock),
+	.notifiers = &cpu_freq_max_notifier,
+	.name = "cpu_freq_max",
+	.default_value = PM_QOS_CPU_FREQ_MAX_DEFAULT_VALUE,
+	.type = PM_QOS_MIN,
+};
+
+static BLOCKING_NOTIFIER_HEAD(bus_freq_min_notifier);
+static struct pm_qos_object bus_freq_min_pm_qos = {
+	.requests = PLIST_HEAD_INIT(bus_freq_min_pm_qos.requests, pm_qos_lock),
+	.notifiers = &bus_freq_min_notifier,
+	.name = "bus_freq_min",
+	.default_value = PM_QOS_BUS_FREQ_MIN_DEFAULT_VALUE,
+	.type = PM_QOS_MAX,
+};
+
+static BLOCKING_NOTIFIER_HEAD(bus_freq_max_notifier);
+static struct pm_qos_object bus_freq_max_pm_qos = {
+	.requests = PLIST_HEAD_INIT(bus_freq_max_pm_qos.requests, pm_qos_lock),
+	.notifiers = &bus_freq_max_notifier,
+	.name = "bus_freq_max",
+	.default_value = PM_QOS_BUS_FREQ_MAX_DEFAULT_VALUE,
+	.type = PM_QOS_MIN,
+};
+
 static struct pm_qos_object *pm_qos_array[] = {
 	&null_pm_qos,
 	&cpu_dma_pm_qos,
 	&network_lat_pm_qos,
-	&network_throughput_pm_qos
+	&network_throughput_pm_qos,
+	&cpu_freq_min_pm_qos,
+	&cpu_freq_max_pm_qos,
+	&bus_freq_min_pm_qos,
+	&bus_freq_max_pm_qos,
 };
 
 static ssize_t pm_qos_power_write(struct file *filp, const char __user *buf,
 		size_t count, loff_t *f_pos);
+static void __pm_qos_add_request(struct pm_qos_request_list *dep,
+				 int pm_qos_class, s32 value, void *owner);
 static int pm_qos_power_open(struct inode *inode, struct file *filp);
 static int pm_qos_power_release(struct inode *inode, struct file *filp);
 
@@ -220,11 +264,20 @@ EXPORT_SYMBOL_GPL(pm_qos_request_active);
  * performance characteristics.  It recomputes the aggregate QoS expectations
  * for the pm_qos_class of parameters and initializes the pm_qos_request_list
  * handle.  Caller needs to save this handle for later use in updates and
- * removal.
+ * removal.  The caller is recorded as the owner of the request, as shown
+ * in debugfs.
  */
 
 void pm_qos_add_request(struct pm_qos_request_list *dep,
 			int pm_qos_class, s32 value)
+{
+	__pm_qos_add_request(dep, pm_qos_class, value,
+			     __builtin_return_address(0));
+}
+EXPORT_SYMBOL_GPL(pm_qos_add_request);
+
+static void __pm_qos_add_request(struct pm_qos_request_list *dep,
+				 int pm_qos_class, s32 value, void *owner)
 {
 	struct pm_qos_object *o =  pm_qos_array[pm_qos_class];
 	int new_value;
@@ -239,9 +292,9 @@ void pm_qos_add_request(struct pm_qos_request_list *dep,
 		new_value = value;
 	plist_node_init(&dep->list, new_value);
 	dep->pm_qos_class = pm_qos_class;
+	dep->owner = owner;
 	update_target(o, &dep->list, 0, PM_QOS_DEFAULT_VALUE);
 }
-EXPORT_SYMBOL_GPL(pm_qos_add_request);
 
 /**
  * pm_qos_update_request - modifies an existing qos request
@@ -354,7 +407,8 @@ static int pm_qos_power_open(struct inode *inode, struct file *filp)
 		if (!req)
 			return -ENOMEM;
 
-		pm_qos_add_request(req, pm_qos_class, PM_QOS_DEFAULT_VALUE);
+		__pm_qos_add_request(req, pm_qos_class, PM_QOS_DEFAULT_VALUE,
+				     pm_qos_power_open);
 		filp->private_data = req;
 
 		if (filp->private_data)
@@ -405,10 +459,51 @@ static ssize_t pm_qos_power_write(struct file *filp, const char __user *buf,
 }
 
 
+/*
+ * debugfs "pm_qos": for each class, the target value and every active
+ * request with the function that added it.
+ */
+static int pm_qos_debug_show(struct seq_file *s, void *unused)
+{
+	struct pm_qos_request_list *req;
+	struct pm_qos_object *o;
+	unsigned long flags;
+	int pm_qos_class;
+
+	for (pm_qos_class = 1;
+		pm_qos_class < PM_QOS_NUM_CLASSES; pm_qos_class++) {
+		o = pm_qos_array[pm_qos_class];
+
+		spin_lock_irqsave(&pm_qos_lock, flags);
+		seq_printf(s, "%s: %d\n", o->name, pm_qos_get_value(o));
+		plist_for_each_entry(req, &o->requests, list)
+			seq_printf(s, "  %11d  %pS\n", req->list.prio,
+				   req->owner);
+		spin_unlock_irqrestore(&pm_qos_lock, flags);
+	}
+
+	return 0;
+}
+
+static int pm_qos_debug_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pm_qos_debug_show, inode->i_private);
+}
+
+static const struct file_operations pm_qos_debug_fops = {
+	.open = pm_qos_debug_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int __init pm_qos_power_init(void)
 {
 	int ret = 0;
 
+	debugfs_create_file("pm_qos", S_IRUGO, NULL, NULL,
+			    &pm_qos_debug_fops);
+
 	ret = register_pm_qos_misc(&cpu_dma_pm_qos);
 	if (ret < 0) {
 		printk(KERN_ERR "pm_qos_param: cpu_dma_latency setup failed\n");
@@ -420,9 +515,29 @@ static int __init pm_qos_power_init(void)
 		return ret;
 	}
 	ret = register_pm_qos_misc(&network_throughput_pm_qos);
-	if (ret < 0)
+	if (ret < 0) {
 		printk(KERN_ERR
 			"pm_qos_param: network_throughput setup failed\n");
+		return ret;
+	}
+	ret = register_pm_qos_misc(&cpu_freq_min_pm_qos);
+	if (ret < 0) {
+		printk(KERN_ERR "pm_qos_param: cpu_freq_min setup failed\n");
+		return ret;
+	}
+	ret = register_pm_qos_misc(&cpu_freq_max_pm_qos);
+	if (ret < 0) {
+		printk(KERN_ERR "pm_qos_param: cpu_freq_max setup failed\n");
+		return ret;
+	}
+	ret = register_pm_qos_misc(&bus_freq_min_pm_qos);
+	if (ret < 0) {
+		printk(KERN_ERR "pm_qos_param: bus_freq_min setup failed\n");
+		return ret;
+	}
+	ret = register_pm_qos_misc(&bus_freq_max_pm_qos);
+	if (ret < 0)
+		printk(KERN_ERR "pm_qos_param: bus_freq_max setup failed\n");
 
 	return ret;
 }
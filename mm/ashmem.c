@@ -29,7 +29,10 @@
 #include <linux/mutex.h>
 #include <linux/shmem_fs.h>
 #include <linux/ashmem.h>
-#include <linux/delay.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #define ASHMEM_NAME_PREFIX "dev/ashmem/"
 #define ASHMEM_NAME_PREFIX_LEN (sizeof(ASHMEM_NAME_PREFIX) - 1)
@@ -38,12 +41,14 @@
 /*
  * ashmem_area - anonymous shared memory area
  * Lifecycle: From our parent file's open() until its release()
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its `mutex'
  * Big Note: Mappings do NOT pin this structure; it dies on close()
  */
 struct ashmem_area {
 	char name[ASHMEM_FULL_NAME_LEN];/* optional name for /proc/pid/maps */
 	struct list_head unpinned_list;	/* list of all ashmem areas */
+	struct list_head area_list;	/* entry in ashmem_area_list */
+	struct mutex mutex;		/* protects this area */
 	struct file *file;		/* the shmem-based backing file */
 	size_t size;			/* size of the mapping, in bytes */
 	unsigned long prot_mask;	/* allowed prot bits, as vm_flags */
@@ -52,7 +57,9 @@ struct ashmem_area {
 /*
  * ashmem_range - represents an interval of unpinned (evictable) pages
  * Lifecycle: From unpin to pin
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its area's `mutex'. The bounds, `lru' and
+ * `purged' are also protected by `ashmem_lru_lock', as the shrinker
+ * works on ranges without holding the area mutex.
  */
 struct ashmem_range {
 	struct list_head lru;		/* entry in LRU list */
@@ -63,18 +70,31 @@ struct ashmem_range {
 	unsigned int purged;		/* ASHMEM_NOT or ASHMEM_WAS_PURGED */
 };
 
-/* LRU list of unpinned pages, protected by ashmem_mutex */
+/* LRU list of unpinned pages, protected by ashmem_lru_lock */
 static LIST_HEAD(ashmem_lru_list);
 
-/* Count of pages on our LRU list, protected by ashmem_mutex */
+/* Count of pages on our LRU list, protected by ashmem_lru_lock */
 static unsigned long lru_count;
 
 /*
- * ashmem_mutex - protects the list of and each individual ashmem_area
+ * ashmem_lru_lock - protects the LRU list and the ranges on it
  *
- * Lock Ordering: ashmex_mutex -> i_mutex -> i_alloc_sem
+ * Lock Ordering: asma->mutex -> ashmem_lru_lock
+ *		  asma->mutex -> i_mutex -> i_alloc_sem
  */
-static DEFINE_MUTEX(ashmem_mutex);
+static DEFINE_SPINLOCK(ashmem_lru_lock);
+
+/*
+ * Ranges the shrinker took off the LRU and is still truncating. Pinning a
+ * purged range waits for these, so that the pages are gone before the
+ * user repopulates them.
+ */
+static atomic_t ashmem_purges_inflight = ATOMIC_INIT(0);
+static DECLARE_WAIT_QUEUE_HEAD(ashmem_purge_wait);
+
+/* List of all areas, for the debugfs view, protected by ashmem_area_lock */
+static LIST_HEAD(ashmem_area_list);
+static DEFINE_MUTEX(ashmem_area_lock);
 
 static struct kmem_cache *ashmem_area_cachep __read_mostly;
 static struct kmem_cache *ashmem_range_cachep __read_mostly;
@@ -103,12 +123,14 @@ static struct kmem_cache *ashmem_range_cachep __read_mostly;
 
 #define PROT_MASK		(PROT_EXEC | PROT_READ | PROT_WRITE)
 
+/* Caller must hold ashmem_lru_lock. */
 static inline void lru_add(struct ashmem_range *range)
 {
 	list_add_tail(&range->lru, &ashmem_lru_list);
 	lru_count += range_size(range);
 }
 
+/* Caller must hold ashmem_lru_lock. */
 static inline void lru_del(struct ashmem_range *range)
 {
 	list_del(&range->lru);
@@ -124,7 +146,7 @@ static inline void lru_del(struct ashmem_range *range)
  * 'start' - starting page, inclusive
  * 'end' - ending page, inclusive
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int range_alloc(struct ashmem_area *asma,
 		       struct ashmem_range *prev_range, unsigned int purged,
@@ -143,35 +165,57 @@ static int range_alloc(struct ashmem_area *asma,
 
 	list_add_tail(&range->unpinned, &prev_range->unpinned);
 
+	spin_lock(&ashmem_lru_lock);
 	if (range_on_lru(range))
 		lru_add(range);
+	spin_unlock(&ashmem_lru_lock);
 
 	return 0;
 }
 
-static void range_del(struct ashmem_range *range)
+/*
+ * range_del - deletes a range, returning whether it was purged
+ *
+ * Caller must hold asma->mutex.
+ */
+static unsigned int range_del(struct ashmem_range *range)
 {
+	unsigned int purged;
+
 	list_del(&range->unpinned);
+	spin_lock(&ashmem_lru_lock);
+	purged = range->purged;
 	if (range_on_lru(range))
 		lru_del(range);
+	spin_unlock(&ashmem_lru_lock);
 	kmem_cache_free(ashmem_range_cachep, range);
+
+	return purged;
 }
 
 /*
- * range_shrink - shrinks a range
+ * range_shrink - shrinks a range, returning whether it was purged
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
-static inline void range_shrink(struct ashmem_range *range,
-				size_t start, size_t end)
+static inline unsigned int range_shrink(struct ashmem_range *range,
+					size_t start, size_t end)
 {
-	size_t pre = range_size(range);
+	unsigned int purged;
+	size_t pre;
+
+	spin_lock(&ashmem_lru_lock);
+	pre = range_size(range);
 
 	range->pgstart = start;
 	range->pgend = end;
 
+	purged = range->purged;
 	if (range_on_lru(range))
 		lru_count -= pre - range_size(range);
+	spin_unlock(&ashmem_lru_lock);
+
+	return purged;
 }
 
 static int ashmem_open(struct inode *inode, struct file *file)
@@ -188,10 +232,15 @@ static int ashmem_open(struct inode *inode, struct file *file)
 		return -ENOMEM;
 
 	INIT_LIST_HEAD(&asma->unpinned_list);
+	mutex_init(&asma->mutex);
 	memcpy(asma->name, ASHMEM_NAME_PREFIX, ASHMEM_NAME_PREFIX_LEN);
 	asma->prot_mask = PROT_MASK;
 	file->private_data = asma;
 
+	mutex_lock(&ashmem_area_lock);
+	list_add_tail(&asma->area_list, &ashmem_area_list);
+	mutex_unlock(&ashmem_area_lock);
+
 	return 0;
 }
 
@@ -200,10 +249,14 @@ static int ashmem_release(struct inode *ignored, struct file *file)
 	struct ashmem_area *asma = file->private_data;
 	struct ashmem_range *range, *next;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&ashmem_area_lock);
+	list_del(&asma->area_list);
+	mutex_unlock(&ashmem_area_lock);
+
+	mutex_lock(&asma->mutex);
 	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned)
 		range_del(range);
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	if (asma->file)
 		fput(asma->file);
@@ -216,30 +269,36 @@ static ssize_t ashmem_read(struct file *file, char __user *buf,
 			   size_t len, loff_t *pos)
 {
 	struct ashmem_area *asma = file->private_data;
+	struct file *vmfile;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* If size is not set, or set to 0, always return EOF. */
 	if (asma->size == 0) {
-		goto out;
-        }
+		mutex_unlock(&asma->mutex);
+		return 0;
+	}
 
 	if (!asma->file) {
-		ret = -EBADF;
-		goto out;
+		mutex_unlock(&asma->mutex);
+		return -EBADF;
 	}
 
-	ret = asma->file->f_op->read(asma->file, buf, len, pos);
-	if (ret < 0) {
-		goto out;
-	}
+	/*
+	 * Do not hold the mutex over the copy to userspace, a fault there
+	 * takes mmap_sem, which ashmem_mmap holds while taking the mutex.
+	 */
+	vmfile = asma->file;
+	get_file(vmfile);
+	mutex_unlock(&asma->mutex);
 
-	/** Update backing file pos, since f_ops->read() doesn't */
-	asma->file->f_pos = *pos;
+	ret = vmfile->f_op->read(vmfile, buf, len, pos);
+	if (ret >= 0)
+		/** Update backing file pos, since f_ops->read() doesn't */
+		vmfile->f_pos = *pos;
 
-out:
-	mutex_unlock(&ashmem_mutex);
+	fput(vmfile);
 	return ret;
 }
 
@@ -248,7 +307,7 @@ static loff_t ashmem_llseek(struct file *file, loff_t offset, int origin)
 	struct ashmem_area *asma = file->private_data;
 	int ret;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	if (asma->size == 0) {
 		ret = -EINVAL;
@@ -269,7 +328,7 @@ static loff_t ashmem_llseek(struct file *file, loff_t offset, int origin)
 	file->f_pos = asma->file->f_pos;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -284,19 +343,13 @@ calc_vm_may_flags(unsigned long prot)
 static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	struct ashmem_area *asma = file->private_data;
-	int ret = 0, count = 1000;
+	int ret = 0;
 
-	while (1) {
-		if (mutex_trylock(&ashmem_mutex)) {
-			/* pr_err("%s: ashmem_mutex obtained with %d!\n", __func__, count); */
-			break;
-		}
-		if (--count == 0) {
-			WARN(1, KERN_ERR "%s: FAILED to lock ashmem_mutex\n", __func__);
-			return -EBUSY;
-		}
-		msleep(1);
-	}
+	/*
+	 * We are called with mmap_sem held. Nothing copies to or from
+	 * userspace with asma->mutex held, so this cannot deadlock.
+	 */
+	mutex_lock(&asma->mutex);
 
 	/* user needs to SET_SIZE before mapping */
 	if (unlikely(!asma->size)) {
@@ -339,7 +392,7 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	vma->vm_flags |= VM_CAN_NONLINEAR;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -355,12 +408,22 @@ out:
  * proceed without risk of deadlock (due to gfp_mask).
  *
  * We approximate LRU via least-recently-unpinned, jettisoning unpinned partial
- * chunks of ashmem regions LRU-wise one-at-a-time until we hit 'nr_to_scan'
- * pages freed.
+ * chunks of ashmem regions LRU-wise until we hit 'nr_to_scan' pages freed.
+ * Ranges are taken off the LRU in batches under ashmem_lru_lock and then
+ * truncated without any ashmem lock held, so pin and unpin callers are not
+ * blocked behind the truncation.
  */
+#define ASHMEM_PURGE_BATCH	16
+
 static int ashmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 {
+	struct {
+		struct file *file;
+		loff_t start;
+		loff_t end;
+	} batch[ASHMEM_PURGE_BATCH];
 	struct ashmem_range *range, *next;
+	int i, n;
 
 	/* We might recurse into filesystem code, so bail out if necessary */
 	if (nr_to_scan && !(gfp_mask & __GFP_FS))
@@ -368,22 +431,38 @@ static int ashmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 	if (!nr_to_scan)
 		return lru_count;
 
-	if (!mutex_trylock(&ashmem_mutex))
-		return lru_count;
-	list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
-		struct inode *inode = range->asma->file->f_dentry->d_inode;
-		loff_t start = range->pgstart * PAGE_SIZE;
-		loff_t end = (range->pgend + 1) * PAGE_SIZE - 1;
-
-		vmtruncate_range(inode, start, end);
-		range->purged = ASHMEM_WAS_PURGED;
-		lru_del(range);
+	while (nr_to_scan > 0) {
+		n = 0;
+		spin_lock(&ashmem_lru_lock);
+		list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
+			batch[n].file = range->asma->file;
+			batch[n].start = range->pgstart * PAGE_SIZE;
+			batch[n].end = (range->pgend + 1) * PAGE_SIZE - 1;
+			get_file(batch[n].file);
+			n++;
+
+			range->purged = ASHMEM_WAS_PURGED;
+			lru_del(range);
+
+			nr_to_scan -= range_size(range);
+			if (nr_to_scan <= 0 || n == ASHMEM_PURGE_BATCH)
+				break;
+		}
+		atomic_add(n, &ashmem_purges_inflight);
+		spin_unlock(&ashmem_lru_lock);
 
-		nr_to_scan -= range_size(range);
-		if (nr_to_scan <= 0)
+		if (!n)
 			break;
+
+		for (i = 0; i < n; i++) {
+			vmtruncate_range(batch[i].file->f_dentry->d_inode,
+					 batch[i].start, batch[i].end);
+			fput(batch[i].file);
+		}
+
+		if (atomic_sub_and_test(n, &ashmem_purges_inflight))
+			wake_up_all(&ashmem_purge_wait);
 	}
-	mutex_unlock(&ashmem_mutex);
 
 	return lru_count;
 }
@@ -397,7 +476,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* the user can only remove, not add, protection bits */
 	if (unlikely((asma->prot_mask & prot) != prot)) {
@@ -412,15 +491,24 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 	asma->prot_mask = prot;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
+/*
+ * The name is copied through a local buffer in set_name and get_name, so
+ * that no user copy happens under asma->mutex (see ashmem_mmap).
+ */
 static int set_name(struct ashmem_area *asma, void __user *name)
 {
+	char local_name[ASHMEM_NAME_LEN];
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	if (unlikely(copy_from_user(local_name, name, ASHMEM_NAME_LEN)))
+		return -EFAULT;
+	local_name[ASHMEM_NAME_LEN-1] = '\0';
+
+	mutex_lock(&asma->mutex);
 
 	/* cannot change an existing mapping's name */
 	if (unlikely(asma->file)) {
@@ -428,48 +516,44 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 		goto out;
 	}
 
-	if (unlikely(copy_from_user(asma->name + ASHMEM_NAME_PREFIX_LEN,
-				    name, ASHMEM_NAME_LEN)))
-		ret = -EFAULT;
-	asma->name[ASHMEM_FULL_NAME_LEN-1] = '\0';
+	strcpy(asma->name + ASHMEM_NAME_PREFIX_LEN, local_name);
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
 
 static int get_name(struct ashmem_area *asma, void __user *name)
 {
-	int ret = 0;
+	char local_name[ASHMEM_NAME_LEN];
+	size_t len;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 	if (asma->name[ASHMEM_NAME_PREFIX_LEN] != '\0') {
-		size_t len;
-
 		/*
 		 * Copying only `len', instead of ASHMEM_NAME_LEN, bytes
 		 * prevents us from revealing one user's stack to another.
 		 */
 		len = strlen(asma->name + ASHMEM_NAME_PREFIX_LEN) + 1;
-		if (unlikely(copy_to_user(name,
-				asma->name + ASHMEM_NAME_PREFIX_LEN, len)))
-			ret = -EFAULT;
+		memcpy(local_name, asma->name + ASHMEM_NAME_PREFIX_LEN, len);
 	} else {
-		if (unlikely(copy_to_user(name, ASHMEM_NAME_DEF,
-					  sizeof(ASHMEM_NAME_DEF))))
-			ret = -EFAULT;
+		len = sizeof(ASHMEM_NAME_DEF);
+		memcpy(local_name, ASHMEM_NAME_DEF, len);
 	}
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
-	return ret;
+	if (unlikely(copy_to_user(name, local_name, len)))
+		return -EFAULT;
+
+	return 0;
 }
 
 /*
  * ashmem_pin - pin the given ashmem region, returning whether it was
  * previously purged (ASHMEM_WAS_PURGED) or not (ASHMEM_NOT_PURGED).
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
@@ -496,46 +580,60 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 		 *    so we have to update one side of the range and then
 		 *    create a new range for the other side.
 		 */
+		/*
+		 * The purged state is sampled under ashmem_lru_lock as the
+		 * range is taken off the LRU, so the shrinker cannot purge
+		 * what we pin after we reported it as not purged.
+		 */
 		if (page_range_in_range(range, pgstart, pgend)) {
-			ret |= range->purged;
+			size_t end = range->pgend;
+			unsigned int purged;
 
 			/* Case #1: Easy. Just nuke the whole thing. */
 			if (page_range_subsumes_range(range, pgstart, pgend)) {
-				range_del(range);
+				ret |= range_del(range);
 				continue;
 			}
 
 			/* Case #2: We overlap from the start, so adjust it */
 			if (range->pgstart >= pgstart) {
-				range_shrink(range, pgend + 1, range->pgend);
+				ret |= range_shrink(range, pgend + 1, end);
 				continue;
 			}
 
 			/* Case #3: We overlap from the rear, so adjust it */
 			if (range->pgend <= pgend) {
-				range_shrink(range, range->pgstart, pgstart-1);
+				ret |= range_shrink(range, range->pgstart,
+						    pgstart - 1);
 				continue;
 			}
 
 			/*
 			 * Case #4: We eat a chunk out of the middle. A bit
-			 * more complicated, we allocate a new range for the
-			 * second half and adjust the first chunk's endpoint.
+			 * more complicated, we adjust the first chunk's
+			 * endpoint and allocate a new range for the second
+			 * half.
 			 */
-			range_alloc(asma, range, range->purged,
-				    pgend + 1, range->pgend);
-			range_shrink(range, range->pgstart, pgstart - 1);
+			purged = range_shrink(range, range->pgstart,
+					      pgstart - 1);
+			ret |= purged;
+			range_alloc(asma, range, purged, pgend + 1, end);
 			break;
 		}
 	}
 
+	/* let the shrinker finish punching out what we reported purged */
+	if (ret == ASHMEM_WAS_PURGED)
+		wait_event(ashmem_purge_wait,
+			   !atomic_read(&ashmem_purges_inflight));
+
 	return ret;
 }
 
 /*
  * ashmem_unpin - unpin the given range of pages. Returns zero on success.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_unpin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
@@ -557,8 +655,7 @@ restart:
 		if (page_range_in_range(range, pgstart, pgend)) {
 			pgstart = min_t(size_t, range->pgstart, pgstart),
 			pgend = max_t(size_t, range->pgend, pgend);
-			purged |= range->purged;
-			range_del(range);
+			purged |= range_del(range);
 			goto restart;
 		}
 	}
@@ -570,7 +667,7 @@ restart:
  * ashmem_get_pin_status - Returns ASHMEM_IS_UNPINNED if _any_ pages in the
  * given interval are unpinned and ASHMEM_IS_PINNED otherwise.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_get_pin_status(struct ashmem_area *asma, size_t pgstart,
 				 size_t pgend)
@@ -619,7 +716,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 	pgstart = pin.offset / PAGE_SIZE;
 	pgend = pgstart + (pin.len / PAGE_SIZE) - 1;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	switch (cmd) {
 	case ASHMEM_PIN:
@@ -633,7 +730,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 		break;
 	}
 
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -700,6 +797,64 @@ static struct miscdevice ashmem_misc = {
 	.fops = &ashmem_fops,
 };
 
+/*
+ * ashmem_areas_show - one line per area with its name and how many of its
+ * bytes are pinned, unpinned and already purged.
+ */
+static int ashmem_areas_show(struct seq_file *m, void *unused)
+{
+	struct ashmem_area *asma;
+	struct ashmem_range *range;
+	size_t unpinned, purged;
+
+	seq_printf(m, "%-32s %10s %10s %10s %10s\n",
+		   "name", "size", "pinned", "unpinned", "purged");
+
+	mutex_lock(&ashmem_area_lock);
+	list_for_each_entry(asma, &ashmem_area_list, area_list) {
+		unpinned = 0;
+		purged = 0;
+
+		mutex_lock(&asma->mutex);
+		spin_lock(&ashmem_lru_lock);
+		list_for_each_entry(range, &asma->unpinned_list, unpinned) {
+			unpinned += range_size(range) * PAGE_SIZE;
+			if (range->purged == ASHMEM_WAS_PURGED)
+				purged += range_size(range) * PAGE_SIZE;
+		}
+		spin_unlock(&ashmem_lru_lock);
+
+		/* unpinned ranges may extend past the end of the area */
+		unpinned = min(unpinned, asma->size);
+		purged = min(purged, asma->size);
+		seq_printf(m, "%-32s %10zu %10zu %10zu %10zu\n",
+			   asma->name + ASHMEM_NAME_PREFIX_LEN,
+			   asma->size, asma->size - unpinned,
+			   unpinned, purged);
+		mutex_unlock(&asma->mutex);
+	}
+	mutex_unlock(&ashmem_area_lock);
+
+	seq_printf(m, "lru: %lu pages\n", lru_count);
+
+	return 0;
+}
+
+static int ashmem_areas_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ashmem_areas_show, inode->i_private);
+}
+
+static const struct file_operations ashmem_areas_fops = {
+	.owner = THIS_MODULE,
+	.open = ashmem_areas_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static struct dentry *ashmem_debugfs_areas;
+
 static int __init ashmem_init(void)
 {
 	int ret;
@@ -728,6 +883,9 @@ static int __init ashmem_init(void)
 
 	register_shrinker(&ashmem_shrinker);
 
+	ashmem_debugfs_areas = debugfs_create_file("ashmem", S_IRUGO, NULL,
+						   NULL, &ashmem_areas_fops);
+
 	printk(KERN_INFO "ashmem: initialized\n");
 
 	return 0;
@@ -737,6 +895,7 @@ static void __exit ashmem_exit(void)
 {
 	int ret;
 
+	debugfs_remove(ashmem_debugfs_areas);
 	unregister_shrinker(&ashmem_shrinker);
 
 	ret = misc_deregister(&ashmem_misc);